@@ -0,0 +1,116 @@
+#include "benchmark/benchmark.h"
+
+#include "../crypto/crypto.hpp"
+#include "../crypto/ntrupp.hpp"
+
+using namespace antinet_crypto;
+
+namespace {
+
+/// keypair of one crypto system (the argument is t_crypto_system_type)
+void BM_crypto_keygen(benchmark::State & state) {
+	const auto crypto_system = static_cast<t_crypto_system_type>( state.range(0) );
+	state.SetLabel( t_crypto_system_type_to_name(crypto_system) );
+	for (auto _ : state) {
+		c_multikeys_PAIR keypair;
+		keypair.generate(crypto_system, 1);
+		benchmark::DoNotOptimize(keypair);
+	}
+}
+BENCHMARK(BM_crypto_keygen)->Unit(benchmark::kMicrosecond)
+	->Arg(e_crypto_system_type_X25519)
+	->Arg(e_crypto_system_type_Ed25519)
+	->Arg(e_crypto_system_type_NTRU_EES439EP1)
+	->Arg(e_crypto_system_type_NTRU_sign)
+	->Arg(e_crypto_system_type_SIDH);
+
+/// setup of the SIDH curve, that SIDH keygen and agreement did in each call before (now it is made once, sidhpp::get_curve)
+void BM_crypto_sidh_curve_setup(benchmark::State & state) {
+	PCurveIsogenyStaticData curve_data = &CurveIsogeny_SIDHp751;
+	auto random_bytes = [](unsigned int nbytes, unsigned char * random_array) -> CRYPTO_STATUS {
+		randombytes_buf(random_array, nbytes);
+		return CRYPTO_SUCCESS;
+	};
+	for (auto _ : state) {
+		PCurveIsogenyStruct curve = SIDH_curve_allocate(curve_data);
+		if (SIDH_curve_initialize(curve, random_bytes, curve_data) != CRYPTO_SUCCESS) state.SkipWithError("SIDH_curve_initialize");
+		SIDH_curve_free(curve);
+	}
+}
+BENCHMARK(BM_crypto_sidh_curve_setup)->Unit(benchmark::kMicrosecond);
+
+/// NTRU encrypt (as of kexasym password in KCT), with the long-lived DRBG of this thread
+void BM_crypto_ntru_encrypt(benchmark::State & state) {
+	const auto keypair = ntrupp::generate_encrypt_keypair();
+	const std::string password(32, 'p');
+	for (auto _ : state) benchmark::DoNotOptimize( ntrupp::encrypt(password, keypair.second) );
+}
+BENCHMARK(BM_crypto_ntru_encrypt)->Unit(benchmark::kMicrosecond);
+
+/// creating a new DRBG - what each encrypt would cost more, without the long-lived DRBG of thread (ntrupp::get_DRBG)
+void BM_crypto_ntru_drbg_instantiate(benchmark::State & state) {
+	for (auto _ : state) {
+		DRBG_HANDLE drbg;
+		if (ntru_crypto_drbg_instantiate(128, nullptr, 0, ntrupp::get_entropy, &drbg) != DRBG_OK) state.SkipWithError("instantiate");
+		ntru_crypto_drbg_uninstantiate(drbg);
+	}
+}
+BENCHMARK(BM_crypto_ntru_drbg_instantiate)->Unit(benchmark::kMicrosecond);
+
+/// IDC keys as in multi_key_sign_generation (2x Ed25519, 1x NTRU sign)
+c_multikeys_PAIR make_IDC() {
+	c_multikeys_PAIR keypair;
+	keypair.generate(e_crypto_system_type_Ed25519, 2);
+	keypair.generate(e_crypto_system_type_NTRU_sign, 1);
+	return keypair;
+}
+
+/// full KCT agreement: Alice sends packetstart, Bob replies, both have the final CT
+void BM_crypto_tunnel_agreement(benchmark::State & state) {
+	const c_multikeys_PAIR keypairA = make_IDC(), keypairB = make_IDC();
+	for (auto _ : state) {
+		c_crypto_tunnel AliceCT(keypairA, keypairB.m_pub, "Alice");
+		AliceCT.create_IDe();
+		const string packetstart_1 = AliceCT.get_packetstart_ab(); // A--->>>
+		c_crypto_tunnel BobCT(keypairB, keypairA.m_pub, packetstart_1, "Bobby");
+		const string packetstart_2 = BobCT.get_packetstart_final(); // B--->>>
+		AliceCT.create_CTf(packetstart_2); // A<<<---
+	}
+}
+BENCHMARK(BM_crypto_tunnel_agreement)->Unit(benchmark::kMillisecond);
+
+/// as BM_crypto_tunnel_agreement, but with kexasym: IDC has X25519 and NTRU encrypt keys (it uses DRBG for each password)
+void BM_crypto_tunnel_agreement_kexasym(benchmark::State & state) {
+	c_multikeys_PAIR keypairA, keypairB;
+	for (auto * keypair : { &keypairA , &keypairB }) {
+		keypair->generate(e_crypto_system_type_X25519, 1);
+		keypair->generate(e_crypto_system_type_NTRU_EES439EP1, 1);
+	}
+	for (auto _ : state) {
+		c_crypto_tunnel AliceCT(keypairA, keypairB.m_pub, "Alice");
+		AliceCT.create_IDe();
+		c_crypto_tunnel BobCT(keypairB, keypairA.m_pub, AliceCT.get_packetstart_ab(), "Bobby");
+		AliceCT.create_CTf( BobCT.get_packetstart_final() );
+	}
+}
+BENCHMARK(BM_crypto_tunnel_agreement_kexasym)->Unit(benchmark::kMillisecond);
+
+/// box and unbox in the final CT, the argument is size of message
+void BM_crypto_tunnel_box_unbox(benchmark::State & state) {
+	const c_multikeys_PAIR keypairA = make_IDC(), keypairB = make_IDC();
+	c_crypto_tunnel AliceCT(keypairA, keypairB.m_pub, "Alice");
+	AliceCT.create_IDe();
+	c_crypto_tunnel BobCT(keypairB, keypairA.m_pub, AliceCT.get_packetstart_ab(), "Bobby");
+	AliceCT.create_CTf( BobCT.get_packetstart_final() );
+
+	const std::string msg(state.range(0), 'm');
+	for (auto _ : state) {
+		t_crypto_nonce nonce_used;
+		const auto boxed = AliceCT.box(msg, nonce_used);
+		benchmark::DoNotOptimize( BobCT.unbox(boxed, nonce_used) );
+	}
+	state.SetBytesProcessed( static_cast<int64_t>(state.iterations()) * msg.size() );
+}
+BENCHMARK(BM_crypto_tunnel_box_unbox)->RangeMultiplier(4)->Range(64, 64*1024);
+
+} // namespace
@@ -0,0 +1,64 @@
+#include "benchmark/benchmark.h"
+
+#include "../rpc/c_lockfree_queue.hpp"
+#include "../rpc/c_locked_queue.hpp"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const size_t per_producer = 100000;
+
+/// 1, 2, 4... producers, up to the number of cores of this machine (the consumer is one more thread)
+void producer_counts(benchmark::internal::Benchmark * bench) {
+	const int cores = std::max( 1u , std::thread::hardware_concurrency() ); // (0 if it is not known)
+	bench->RangeMultiplier(2)->Range(1, cores);
+}
+
+/// producers (the argument) push all their messages, while one consumer pops them; as the asio threads and receive()
+template <typename TPush, typename TPop>
+void run_contention(benchmark::State & state, TPush push, TPop pop) {
+	const size_t producers = state.range(0);
+	for (auto _ : state) {
+		std::vector<std::thread> threads;
+		for (size_t p=0; p<producers; ++p) {
+			threads.emplace_back([&push]() {
+				for (size_t i=0; i<per_producer; ++i) {
+					while (!push(i)) std::this_thread::yield();
+				}
+			});
+		}
+		for (size_t received=0; received < producers * per_producer; ) {
+			size_t value;
+			if (pop(value)) ++received;
+		}
+		for (auto & thread : threads) thread.join();
+	}
+	state.SetItemsProcessed( static_cast<int64_t>(state.iterations() * producers * per_producer) );
+}
+
+void BM_mpsc_ring_contention(benchmark::State & state) {
+	c_mpsc_ring<size_t> ring(4096);
+	run_contention(state,
+		[&ring](size_t value) { return ring.try_push(value); },
+		[&ring](size_t & value) { return ring.wait_pop(value, std::chrono::milliseconds(10)); });
+}
+BENCHMARK(BM_mpsc_ring_contention)->Apply(producer_counts)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+/// the locked queue that c_tcp_asio_node used before c_mpsc_ring
+void BM_locked_queue_contention(benchmark::State & state) {
+	c_locked_queue<size_t> locked;
+	run_contention(state,
+		[&locked](size_t value) { locked.push(std::move(value)); return true; },
+		[&locked](size_t & value) {
+			std::lock_guard<std::recursive_mutex> lg(locked.get_mutex());
+			if (locked.empty()) return false;
+			value = locked.pop();
+			return true;
+		});
+}
+BENCHMARK(BM_locked_queue_contention)->Apply(producer_counts)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+} // namespace
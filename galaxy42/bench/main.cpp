@@ -0,0 +1,12 @@
+#include "benchmark/benchmark.h"
+
+#include "../libs1.hpp"
+
+/// bench.elf --benchmark_out=bench.json --benchmark_out_format=json --benchmark_repetitions=5 to compare releases
+int main(int argc, char **argv) {
+	g_dbg_level_set(200, "Benchmarks, debug would be the bottleneck");
+	::benchmark::Initialize(&argc, argv);
+	if (::benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+	::benchmark::RunSpecifiedBenchmarks();
+	return 0;
+}
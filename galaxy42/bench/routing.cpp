@@ -0,0 +1,166 @@
+#include "benchmark/benchmark.h"
+
+#include "../haship.hpp"
+#include "../c_dht.hpp"
+#include "../c_route_dv.hpp"
+#include "../c_routing_manager.hpp"
+#include "../c_tunserver.hpp"
+
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+/// random hash-ips (always the same ones)
+std::vector<c_haship_addr> make_addrs(size_t count) {
+	std::mt19937 gen(42);
+	std::vector<c_haship_addr> ret(count);
+	for (auto & addr : ret) {
+		for (auto & byte : addr) byte = static_cast<unsigned char>( gen() );
+		addr.at(0) = 0xFD;  addr.at(1) = 0x42;
+	}
+	return ret;
+}
+
+/// full form (no ::), as c_haship_addr can parse
+std::string hexdot(const c_haship_addr & hip) {
+	std::ostringstream oss;
+	for (size_t i=0; i<hip.size(); i+=2) {
+		if (i) oss << ':';
+		oss << std::hex << std::setfill('0') << std::setw(2) << int(hip[i]) << std::setw(2) << int(hip[i+1]);
+	}
+	return oss.str();
+}
+
+/// c_tunserver with these peers (on addresses 10.x.y.z:9042, in order of hips)
+std::vector<c_ip46_addr> add_peers(c_tunserver & server, const std::vector<c_haship_addr> & hips) {
+	std::vector<c_ip46_addr> ret;
+	for (size_t i=0; i<hips.size(); ++i) {
+		ret.push_back( c_ip46_addr::create_ipv4( "10." + std::to_string(i / 65536) + "." + std::to_string(i / 256 % 256)
+			+ "." + std::to_string(i % 256) , 9042 ) );
+		server.add_peer( t_peering_reference( ret.back() , hexdot( hips.at(i) ) ) );
+	}
+	return ret;
+}
+
+/// c_tunserver::get_peer_with_hip - its peer by hash-ip, as for each routed packet (the argument is number of peers)
+void BM_peer_lookup(benchmark::State & state) {
+	const auto addrs = make_addrs( state.range(0) );
+	c_tunserver server;
+	add_peers( server , addrs );
+	size_t i = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize( & server.get_peer_with_hip( addrs[i] , false ) );
+		if (++i == addrs.size()) i = 0;
+	}
+}
+BENCHMARK(BM_peer_lookup)->Arg(16)->Arg(256)->Arg(4096);
+
+/// c_tunserver::find_peer_by_sender_peering_addr - the peer that sent us an UDP datagram, as for each one that we receive
+void BM_peer_lookup_by_ip(benchmark::State & state) {
+	const auto addrs = make_addrs( state.range(0) );
+	c_tunserver server;
+	const auto ips = add_peers( server , addrs );
+	size_t i = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize( & server.find_peer_by_sender_peering_addr( ips[i] ) );
+		if (++i == ips.size()) i = 0;
+	}
+}
+BENCHMARK(BM_peer_lookup_by_ip)->Arg(16)->Arg(256)->Arg(4096);
+
+/// nodes nearest to a key in DHT k-buckets (one step of a lookup); the argument is number of known nodes
+void BM_dht_nearest(benchmark::State & state) {
+	const auto addrs = make_addrs( state.range(0) + 1 );
+	dht::c_routing_table<c_haship_addr, std::string> table( addrs.at(0) );
+	for (size_t i=1; i<addrs.size(); ++i) table.seen( dht::t_contact<c_haship_addr, std::string>{ addrs.at(i) , "locator" } );
+	size_t i = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize( table.nearest( addrs[i] , dht::k_bucket_size ) );
+		if (++i == addrs.size()) i = 0;
+	}
+}
+BENCHMARK(BM_dht_nearest)->Arg(16)->Arg(256)->Arg(4096);
+
+/// c_routing_manager: route to a destination that is not our peer, as for each packet that we send or forward
+/// (the argument is number of routes, via 8 peers of c_tunserver - first it checks if the destination is a peer)
+void BM_route_lookup(benchmark::State & state) {
+	const auto addrs = make_addrs( state.range(0) + 8 );
+	const std::vector<c_haship_addr> peers( addrs.begin() , addrs.begin() + 8 );
+	c_tunserver server;
+	add_peers( server , peers );
+	c_routing_manager routing;
+	for (size_t i=8; i<addrs.size(); ++i) {
+		routing.add_route_info_and_return( addrs.at(i) , c_routing_manager::c_route_info( peers.at(i % 8) , 10 , 20 , c_haship_pubkey() ) );
+	}
+	const c_routing_manager::c_route_reason reason( c_haship_addr() , c_routing_manager::e_search_mode_route_own_packet );
+	size_t i = 8;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize( & routing.get_route_or_maybe_search( server , addrs[i] , reason , true , 0 ) );
+		if (++i == addrs.size()) i = 8;
+	}
+}
+BENCHMARK(BM_route_lookup)->Arg(16)->Arg(256)->Arg(4096);
+
+/// c_routing_manager::pick_nexthop - next hop for a flow, from 2 routes to each destination (the argument is number of them)
+void BM_route_pick_nexthop(benchmark::State & state) {
+	const auto addrs = make_addrs( state.range(0) + 8 );
+	c_routing_manager routing;
+	for (size_t i=8; i<addrs.size(); ++i) {
+		routing.add_route_info_and_return( addrs.at(i) , c_routing_manager::c_route_info( addrs.at(i % 8) , 10 , 20 , c_haship_pubkey() ) );
+		routing.add_route_info_and_return( addrs.at(i) , c_routing_manager::c_route_info( addrs.at((i+1) % 8) , 10 , 25 , c_haship_pubkey() ) );
+	}
+	const auto weight = [](const c_haship_addr &) { return 1.0; };
+	size_t i = 8;
+	uint64_t flow_hash = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize( routing.pick_nexthop( addrs[i] , ++flow_hash , weight ) );
+		if (++i == addrs.size()) i = 8;
+	}
+}
+BENCHMARK(BM_route_pick_nexthop)->Arg(16)->Arg(256)->Arg(4096);
+
+/// next hop to a destination in the distance-vector table (the argument is number of routes, via 8 peers)
+void BM_route_dv_lookup(benchmark::State & state) {
+	typedef route_dv::c_dv_table<c_haship_addr> t_table;
+	const auto addrs = make_addrs( state.range(0) + 1 + 8 );
+	const auto now = t_table::t_clock::now();
+	t_table table( addrs.at(0) );
+	for (size_t p=1; p<=8; ++p) table.set_link( addrs.at(p) , 1 , now );
+	for (size_t i=9; i<addrs.size(); ++i) table.got_adv( addrs.at(1 + i % 8) , route_dv::t_adv<c_haship_addr>{ addrs.at(i) , 2 , 2 } , now );
+	size_t i = 9;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize( table.get_nexthop( addrs[i] ) );
+		if (++i == addrs.size()) i = 9;
+	}
+}
+BENCHMARK(BM_route_dv_lookup)->Arg(16)->Arg(256)->Arg(4096);
+
+/// distance-vector routing in a simulated random mesh (the argument is number of nodes, average of 4 links each): until
+/// it converges, then again after a link failed. Counters: rounds (of triggered_update_interval), routes advertised, and
+/// bad routes (of 1000 random pairs, following next hops does not get to the destination)
+void BM_route_dv_converge(benchmark::State & state) {
+	const size_t nodes_count = state.range(0);
+	size_t rounds = 0, rounds_fail = 0, bad = 0;
+	uint64_t adverts = 0, adverts_fail = 0;
+	for (auto _ : state) {
+		route_dv::c_simulation sim( nodes_count , nodes_count , 42 );
+		rounds = sim.run_until_converged(1000);
+		adverts = sim.get_adverts();
+		sim.fail_link(0, 1);
+		rounds_fail = sim.run_until_converged(1000);
+		adverts_fail = sim.get_adverts() - adverts;
+		state.PauseTiming();
+		std::mt19937 gen(1);
+		bad = sim.count_bad_routes(1000, gen);
+		state.ResumeTiming();
+	}
+	state.counters["rounds"] = rounds;
+	state.counters["adverts"] = adverts;
+	state.counters["rounds_after_fail"] = rounds_fail;
+	state.counters["adverts_after_fail"] = adverts_fail;
+	state.counters["bad_routes"] = bad;
+}
+BENCHMARK(BM_route_dv_converge)->Arg(500)->Arg(1000)->Unit(benchmark::kMillisecond);
+
+} // namespace
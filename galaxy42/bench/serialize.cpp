@@ -0,0 +1,49 @@
+#include "benchmark/benchmark.h"
+
+#include "../trivialserialize.hpp"
+#include "../haship.hpp"
+
+namespace {
+
+/// fields as in our packet headers: command byte, uvarint, fixed integers, fixed-size bytes, and a payload with its size
+std::string encode(const std::string & payload) {
+	trivialserialize::generator gen(payload.size() + 64);
+	gen.push_byte_u(13);
+	gen.push_integer_uvarint(123456);
+	gen.push_integer_u<4>(0xCAFE0042u);
+	gen.push_integer_u<8>(uint64_t(1) << 40);
+	gen.push_bytes_n(16, std::string(16, 'h'));
+	gen.push_varstring(payload);
+	return gen.str_move();
+}
+
+void BM_trivialserialize_encode(benchmark::State & state) {
+	const std::string payload(state.range(0), 'p');
+	for (auto _ : state) benchmark::DoNotOptimize( encode(payload) );
+	state.SetBytesProcessed( static_cast<int64_t>(state.iterations()) * payload.size() );
+}
+BENCHMARK(BM_trivialserialize_encode)->Arg(64)->Arg(1280)->Arg(64*1024);
+
+void BM_trivialserialize_decode(benchmark::State & state) {
+	const std::string data = encode( std::string(state.range(0), 'p') );
+	for (auto _ : state) {
+		trivialserialize::parser parser( trivialserialize::parser::tag_caller_must_keep_this_string_valid() , data );
+		benchmark::DoNotOptimize( parser.pop_byte_u() );
+		benchmark::DoNotOptimize( parser.pop_integer_uvarint() );
+		benchmark::DoNotOptimize( parser.pop_integer_u<4, uint32_t>() );
+		benchmark::DoNotOptimize( parser.pop_integer_u<8, uint64_t>() );
+		benchmark::DoNotOptimize( parser.pop_bytes_n(16) );
+		benchmark::DoNotOptimize( parser.pop_varstring() );
+	}
+	state.SetBytesProcessed( static_cast<int64_t>(state.iterations()) * state.range(0) );
+}
+BENCHMARK(BM_trivialserialize_decode)->Arg(64)->Arg(1280)->Arg(64*1024);
+
+/// the hash-ip as in config and in peer references
+void BM_haship_addr_parse(benchmark::State & state) {
+	const t_ipv6dot dot = "fd42:0123:4567:89ab:cdef:0000:ffff:0042";
+	for (auto _ : state) benchmark::DoNotOptimize( c_haship_addr( c_haship_addr::tag_constr_by_addr_dot() , dot ) );
+}
+BENCHMARK(BM_haship_addr_parse);
+
+} // namespace
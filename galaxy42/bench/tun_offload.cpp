@@ -0,0 +1,72 @@
+#include "benchmark/benchmark.h"
+
+#include "../c_tun_offload.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+
+using namespace tun_offload;
+
+namespace {
+
+const size_t ipv6_header_size = 40, tcp_header_size = 20;
+const size_t mss = 1440, segments = 44; // like TCP on 1500 MTU
+
+/// TCP over ipv6 with this payload (just the headers that segment() needs), at ip_at in data
+void make_tcp_packet(std::string & data, size_t ip_at, size_t payload_size) {
+	data.assign( ip_at + ipv6_header_size + tcp_header_size + payload_size , char(0x42) );
+	unsigned char * ip = reinterpret_cast<unsigned char*>( &data[ip_at] );
+	std::memset(ip, 0, ipv6_header_size + tcp_header_size);
+	const size_t ip_payload = tcp_header_size + payload_size;
+	ip[0] = 0x60;  ip[4] = ip_payload >> 8;  ip[5] = ip_payload & 0xFF;  ip[6] = 6; /* TCP */  ip[7] = 64;
+	ip[ipv6_header_size + 12] = 5 << 4;  ip[ipv6_header_size + 13] = 0x18; // ACK PSH
+}
+
+/// read from TUN without offloads (one read per packet; argument 0) and with offloads (one read per super-packet, split
+/// by segment(); argument 1). A socketpair is used in place of the TUN device, so both pay for the real read()/write() calls
+void BM_tun_read(benchmark::State & state) {
+	const bool offload = state.range(0);
+	state.SetLabel( offload ? "with offloads (GSO super-packets)" : "without offloads" );
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) != 0) { state.SkipWithError("Can not create socketpair"); return; }
+	const int sndbuf = 4*1024*1024;
+	setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+	std::string packet, super;
+	make_tcp_packet(packet, pi_size, mss); // normal packet, as from TUN without offloads
+	make_tcp_packet(super, header_position_of_ipv6, mss * segments); // as with offloads
+	t_vnet_hdr hdr;
+	std::memset(&hdr, 0, sizeof(hdr));
+	hdr.gso_type = vnet_gso_tcpv6;  hdr.gso_size = mss;
+	std::memcpy(&super[pi_size], &hdr, sizeof(hdr));
+
+	std::string buf(max_read_size, 0), scratch;
+	size_t bytes = 0;
+	auto consume = [&bytes](const char *, size_t size) { bytes += size; };
+	for (auto _ : state) { // one batch of segments
+		if (offload) {
+			if (write(fds[0], super.data(), super.size()) < 0) { state.SkipWithError("write failed"); break; }
+			const auto size_read = read(fds[1], &buf[0], buf.size());
+			if (size_read < 0) { state.SkipWithError("read failed"); break; }
+			segment(buf.data(), size_read, consume, scratch);
+		} else {
+			for (size_t i=0; i<segments; ++i) {
+				if (write(fds[0], packet.data(), packet.size()) < 0) { state.SkipWithError("write failed"); break; }
+			}
+			for (size_t i=0; i<segments; ++i) {
+				const auto size_read = read(fds[1], &buf[0], buf.size());
+				if (size_read < 0) { state.SkipWithError("read failed"); break; }
+				consume(buf.data(), size_read);
+			}
+		}
+	}
+	benchmark::DoNotOptimize(bytes);
+	close(fds[0]);  close(fds[1]);
+	state.SetItemsProcessed( static_cast<int64_t>(state.iterations() * segments) ); // packets
+	state.SetBytesProcessed( static_cast<int64_t>(state.iterations() * segments * mss) ); // of payload
+}
+BENCHMARK(BM_tun_read)->Arg(0)->Arg(1);
+
+} // namespace
@@ -0,0 +1,77 @@
+#include "benchmark/benchmark.h"
+
+#include "../c_udp_gso.hpp"
+
+#include <arpa/inet.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+using namespace udp_gso;
+
+namespace {
+
+/// UDP socket bound to a free port on loopback (its address is saved to addr)
+int make_socket(sockaddr_in & addr) {
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock < 0) throw std::runtime_error("Can not create UDP socket for benchmark");
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);  addr.sin_port = 0;
+	socklen_t len = sizeof(addr);
+	if ((bind(sock, reinterpret_cast<sockaddr*>(&addr), len) != 0)
+		|| (getsockname(sock, reinterpret_cast<sockaddr*>(&addr), &len) != 0)) throw std::runtime_error("Can not bind UDP socket");
+	const int bufsize = 8*1024*1024;
+	setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+	setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+	timeval timeout{ 0, 200*1000 };
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	return sock;
+}
+
+/// send batches of datagrams over loopback, without (argument 0) and with UDP_SEGMENT/UDP_GRO (argument 1), as to peers;
+/// counters: syscalls per batch, and how many of the sent datagrams the receiver (other thread) got
+void BM_udp_send(benchmark::State & state) {
+	const bool gso = state.range(0);
+	const size_t datagram_size = 1400, batch = 44;
+	const std::string datagram(datagram_size, 'x');
+	sockaddr_in addr_send, addr_recv;
+	const int sock_send = make_socket(addr_send), sock_recv = make_socket(addr_recv);
+	c_batch_sender sender(sock_send);
+	sender.set_gso_enabled(gso);
+	c_gro_receiver receiver(sock_recv, gso);
+	state.SetLabel( gso ? (sender.is_gso_enabled() ? "with GSO/GRO" : "with GSO/GRO (not supported here - fell back)") : "without GSO/GRO" );
+
+	std::atomic<bool> stop(false);
+	std::atomic<uint64_t> received(0);
+	std::thread thread_recv([&]() {
+		std::string buf(65535, 0);
+		while (!stop) {
+			sockaddr_storage from;  socklen_t from_len = sizeof(from);
+			if (receiver.receive(&buf[0], buf.size(), reinterpret_cast<sockaddr*>(&from), &from_len) > 0) ++received;
+		}
+	});
+	for (auto _ : state) {
+		for (size_t i=0; i<batch; ++i) {
+			sender.add(reinterpret_cast<sockaddr*>(&addr_recv), sizeof(addr_recv), datagram.data(), datagram.size());
+		}
+		sender.flush();
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(100)); // let receiver get the rest
+	stop = true;
+	thread_recv.join();
+	close(sock_send);  close(sock_recv);
+
+	state.SetItemsProcessed( static_cast<int64_t>(sender.get_count_datagrams()) );
+	state.SetBytesProcessed( static_cast<int64_t>(sender.get_count_datagrams() * datagram_size) );
+	state.counters["syscalls_per_batch"] = static_cast<double>(sender.get_count_syscalls()) / std::max<size_t>(state.iterations(), 1);
+	state.counters["received"] = static_cast<double>(received) / std::max<uint64_t>(sender.get_count_datagrams(), 1);
+}
+BENCHMARK(BM_udp_send)->Arg(0)->Arg(1)->UseRealTime();
+
+} // namespace
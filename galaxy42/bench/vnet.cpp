@@ -0,0 +1,151 @@
+#include "benchmark/benchmark.h"
+
+#include "../c_virtual_net_harness.hpp"
+#include "../c_conn_ids.hpp"
+#include "../trivialserialize.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+
+namespace {
+
+typedef std::chrono::steady_clock t_clock;
+
+enum class e_topology { chain, star, mesh };
+
+/// throughput and forwarding latency of tunserver nodes (c_tunserver, each in its thread) in virtual network: chain (first to
+/// last), star (leaf to leaf, all via center), mesh (ring with random links, flows between random nodes).
+/// Arguments: topology, nodes, link latency in us, link loss in 1/1000. Warm up (HI, routes, pubkeys from DHT) is not timed;
+/// then each iteration sends a packet of each flow that has room in its window. Counters: latency p50/p99 (us), part of sent
+/// packets that was delivered, warm up (ms)
+void BM_vnet(benchmark::State & state) {
+	const auto topology = static_cast<e_topology>( state.range(0) );
+	const size_t nodes_count = state.range(1);
+	const virtual_net::t_link_params link{ std::chrono::microseconds( state.range(2) ) , state.range(3) / 1000.0 };
+	const size_t packet_size = 1280;
+	constexpr size_t window = 64; // packets of one flow on the way
+	const size_t ipv6_header_size = 40, payload_header_size = 4 + 8 + 8; // flow number, seq, time when sent
+
+	std::vector<std::pair<size_t, size_t>> flows; // src, dst
+	std::vector<std::pair<size_t, size_t>> links;
+	std::mt19937 gen(1);
+	if (topology == e_topology::chain) {
+		state.SetLabel("chain");
+		for (size_t i=0; i+1<nodes_count; ++i) links.emplace_back(i, i+1);
+		flows.emplace_back(0, nodes_count-1);
+	} else if (topology == e_topology::star) {
+		state.SetLabel("star");
+		for (size_t i=1; i<nodes_count; ++i) links.emplace_back(0, i);
+		for (size_t i=1; i<nodes_count; ++i) flows.emplace_back(i, (i % (nodes_count-1)) + 1);
+	} else {
+		state.SetLabel("mesh");
+		for (size_t i=0; i<nodes_count; ++i) links.emplace_back(i, (i+1) % nodes_count);
+		std::uniform_int_distribution<size_t> any(0, nodes_count-1);
+		for (size_t i=0; i<nodes_count/2; ++i) {
+			const size_t a = any(gen), b = any(gen);
+			if ((a != b) && (a+1 != b) && (b+1 != a)) links.emplace_back(a, b);
+		}
+		for (size_t i=0; i<nodes_count/2; ++i) {
+			const size_t a = any(gen), b = any(gen);
+			if (a != b) flows.emplace_back(a, b);
+		}
+	}
+	if (flows.empty()) { state.SkipWithError("No flows in this topology (too few nodes?)"); return; }
+
+	std::mutex mutex; // guards all below
+	std::vector<size_t> outstanding(flows.size(), 0);
+	std::vector<t_clock::time_point> last_received(flows.size());
+	std::vector<double> latencies_us;
+	uint64_t received = 0;
+	bool measuring = false;
+
+	auto receive = [&](size_t node, const char * packet, size_t size) {
+		const size_t pos = g_tuntap::TUN_with_PI::header_position_of_ipv6 + ipv6_header_size;
+		if (size < pos + payload_header_size) return;
+		trivialserialize::parser parser( trivialserialize::parser::tag_caller_must_keep_this_buffer_valid() , packet + pos , size - pos );
+		const size_t flow = conn_ids::bin_to_u32( parser.pop_bytes_n(4).data() );
+		parser.skip_bytes_n(8); // seq
+		const uint64_t sent_ns = parser.pop_integer_u<8, uint64_t>();
+		const auto now = t_clock::now();
+		std::lock_guard<std::mutex> lock(mutex);
+		if ((flow >= flows.size()) || (flows.at(flow).second != node)) return;
+		if (outstanding.at(flow) > 0) --outstanding.at(flow);
+		last_received.at(flow) = now;
+		if (! measuring) return;
+		++received;
+		const uint64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>( now.time_since_epoch() ).count();
+		latencies_us.push_back( (now_ns - sent_ns) / 1000.0 );
+	};
+
+	developer_tests::c_virtual_net_harness harness(nodes_count, link, receive);
+	for (const auto & l : links) harness.add_link(l.first, l.second);
+	harness.start();
+
+	uint64_t seq = 0;
+	auto send = [&](size_t flow) {
+		trivialserialize::generator gen_payload(packet_size);
+		gen_payload.push_bytes_n( 4 , conn_ids::u32_to_bin( static_cast<uint32_t>(flow) ) );
+		gen_payload.push_integer_u<8>( ++seq );
+		gen_payload.push_integer_u<8>( static_cast<uint64_t>( std::chrono::duration_cast<std::chrono::nanoseconds>(
+			t_clock::now().time_since_epoch() ).count() ) );
+		std::string payload = gen_payload.str_move();
+		payload.resize( packet_size - ipv6_header_size , 'x' );
+		return harness.send( flows.at(flow).first , flows.at(flow).second , payload );
+	};
+
+	// warm up: until each flow got its first packet
+	const auto warmup_start = t_clock::now();
+	for (bool all = false; ! all; ) {
+		if (t_clock::now() - warmup_start > std::chrono::seconds(60)) { state.SkipWithError("Flows did not start in 60 seconds"); return; }
+		for (size_t f=0; f<flows.size(); ++f) send(f);
+		std::this_thread::sleep_for( std::chrono::milliseconds(200) );
+		std::lock_guard<std::mutex> lock(mutex);
+		all = std::none_of( last_received.begin() , last_received.end() , [](t_clock::time_point t) { return t == t_clock::time_point(); } );
+	}
+	const auto warmup_ms = std::chrono::duration_cast<std::chrono::milliseconds>( t_clock::now() - warmup_start ).count();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::fill( outstanding.begin() , outstanding.end() , 0 );
+		measuring = true;
+	}
+
+	const auto stall = std::chrono::milliseconds(200) + 4 * link.m_latency; // no reply for that long: rest of window is lost
+	uint64_t sent = 0;
+	for (auto _ : state) {
+		bool any_sent = false;
+		for (size_t f=0; f<flows.size(); ++f) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (t_clock::now() - last_received.at(f) > stall) { outstanding.at(f) = 0;  last_received.at(f) = t_clock::now(); }
+				if (outstanding.at(f) >= window) continue;
+				++outstanding.at(f);
+			}
+			if (send(f)) { ++sent;  any_sent = true; }
+			else { std::lock_guard<std::mutex> lock(mutex);  --outstanding.at(f); } // TUN queue is full
+		}
+		if (! any_sent) std::this_thread::sleep_for( std::chrono::microseconds(50) );
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	measuring = false;
+	std::sort( latencies_us.begin() , latencies_us.end() );
+	auto percentile = [&latencies_us](double p) {
+		return latencies_us.empty() ? 0 : latencies_us.at( std::min( latencies_us.size()-1 , static_cast<size_t>(p * latencies_us.size()) ) ); };
+	state.SetItemsProcessed( static_cast<int64_t>(received) ); // packets delivered
+	state.SetBytesProcessed( static_cast<int64_t>(received * packet_size) );
+	state.counters["latency_p50_us"] = percentile(0.50);
+	state.counters["latency_p99_us"] = percentile(0.99);
+	state.counters["delivered"] = static_cast<double>(received) / std::max<uint64_t>(sent, 1);
+	state.counters["warmup_ms"] = warmup_ms;
+}
+BENCHMARK(BM_vnet)
+	->Args({ static_cast<int>(e_topology::chain) , 4 , 0 , 0 })
+	->Args({ static_cast<int>(e_topology::star) , 6 , 0 , 0 })
+	->Args({ static_cast<int>(e_topology::mesh) , 10 , 0 , 0 })
+	->Args({ static_cast<int>(e_topology::chain) , 4 , 5000 , 10 })
+	->Iterations(100000)->UseRealTime()->Unit(benchmark::kMicrosecond); // one run: each run warms up its network
+
+} // namespace
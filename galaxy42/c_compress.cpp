@@ -0,0 +1,192 @@
+#include "c_compress.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace tunnel_compress {
+
+namespace {
+
+constexpr size_t min_match = 4;
+constexpr size_t last_literals = 5; ///< LZ4 block ends with at least that many literals
+constexpr size_t match_limit = 12; ///< no match can start in the last bytes
+constexpr int hash_bits = 12;
+constexpr size_t max_offset = 65535;
+constexpr size_t size_field = 3; ///< size of decompressed data, after flags
+
+uint32_t read32(const unsigned char * p) { uint32_t v;  std::memcpy(&v, p, sizeof(v));  return v; }
+uint32_t hash32(uint32_t v) { return (v * 2654435761u) >> (32 - hash_bits); }
+
+void push_length(std::string & out, size_t len) { ///< the rest of length >= 15, as in LZ4
+	while (len >= 255) { out += static_cast<char>(255);  len -= 255; }
+	out += static_cast<char>(len);
+}
+
+size_t pop_length(const unsigned char * data, size_t size, size_t & pos) {
+	size_t len = 0;
+	unsigned char c = 255;
+	while (c == 255) {
+		if (pos >= size) throw std::invalid_argument("LZ4: length is outside of data");
+		c = data[pos++];
+		len += c;
+	}
+	return len;
+}
+
+} // namespace
+
+std::string lz4_compress(const char * data, size_t size) {
+	const unsigned char * src = reinterpret_cast<const unsigned char*>(data);
+	std::string out;
+	out.reserve(size + size/255 + 16);
+	size_t anchor = 0; // start of literals not written yet
+
+	if (size > match_limit) {
+		std::vector<uint32_t> table(1 << hash_bits, 0); // position+1 of last seen 4 bytes with this hash (0 = none)
+		size_t pos = 0;
+		while (pos + match_limit < size) {
+			const uint32_t seq = read32(src + pos);
+			uint32_t & slot = table[ hash32(seq) ];
+			const size_t ref = slot;  // +1
+			slot = pos + 1;
+			if ((ref == 0) || (pos + 1 - ref > max_offset) || (read32(src + ref - 1) != seq)) {
+				pos += 1 + ((pos - anchor) >> 6); // skip faster over data that does not compress
+				continue;
+			}
+			const size_t match_pos = ref - 1;
+			size_t len = min_match;
+			while ((pos + len + last_literals < size) && (src[match_pos + len] == src[pos + len])) ++len;
+
+			const size_t lit_len = pos - anchor;
+			out += static_cast<char>( (std::min<size_t>(lit_len, 15) << 4) | std::min<size_t>(len - min_match, 15) );
+			if (lit_len >= 15) push_length(out, lit_len - 15);
+			out.append(data + anchor, lit_len);
+			const size_t offset = pos - match_pos;
+			out += static_cast<char>(offset & 0xFF);  out += static_cast<char>(offset >> 8); // little-endian
+			if (len - min_match >= 15) push_length(out, len - min_match - 15);
+			pos += len;
+			anchor = pos;
+		}
+	}
+
+	const size_t lit_len = size - anchor; // the last sequence: only literals
+	out += static_cast<char>( std::min<size_t>(lit_len, 15) << 4 );
+	if (lit_len >= 15) push_length(out, lit_len - 15);
+	out.append(data + anchor, lit_len);
+	return out;
+}
+
+std::string lz4_decompress(const char * data, size_t size, size_t max_out) {
+	const unsigned char * src = reinterpret_cast<const unsigned char*>(data);
+	std::string out;
+	size_t pos = 0;
+	while (true) {
+		if (pos >= size) throw std::invalid_argument("LZ4: missing token");
+		const unsigned char token = src[pos++];
+		size_t lit_len = token >> 4;
+		if (lit_len == 15) lit_len += pop_length(src, size, pos);
+		if ((lit_len > size - pos) || (lit_len > max_out - out.size())) throw std::invalid_argument("LZ4: literals are too long");
+		out.append(data + pos, lit_len);
+		pos += lit_len;
+		if (pos == size) break; // the last sequence has no match
+
+		if (size - pos < 2) throw std::invalid_argument("LZ4: missing offset");
+		const size_t offset = src[pos] | (size_t(src[pos+1]) << 8);
+		pos += 2;
+		if ((offset == 0) || (offset > out.size())) throw std::invalid_argument("LZ4: offset is outside of data");
+		size_t len = (token & 0x0F) + min_match;
+		if ((token & 0x0F) == 15) len += pop_length(src, size, pos);
+		if (len > max_out - out.size()) throw std::invalid_argument("LZ4: data is too big");
+		const size_t from = out.size() - offset;
+		for (size_t i=0; i<len; ++i) out += out[from + i]; // can overlap (repeated pattern)
+	}
+	return out;
+}
+
+double entropy_estimate(const char * data, size_t size) {
+	const size_t sample = std::min<size_t>(size, 512);
+	if (sample == 0) return 0;
+	size_t count[256] = { 0 };
+	for (size_t i=0; i<sample; ++i) ++count[ static_cast<unsigned char>(data[i]) ];
+	double entropy = 0;
+	size_t symbols = 0;
+	for (size_t c : count) {
+		if (c == 0) continue;
+		++symbols;
+		const double p = static_cast<double>(c) / sample;
+		entropy -= p * std::log2(p);
+	}
+	entropy += (symbols - 1) / (2.0 * sample * std::log(2.0)); // Miller-Madow: small sample looks less random then it is
+	return std::min(entropy, 8.0);
+}
+
+// ------------------------------------------------------------------
+
+c_compressor::c_compressor() : m_enabled(false), m_peer_accepting(false) { }
+
+void c_compressor::set_enabled(bool enabled) { m_enabled = enabled; }
+bool c_compressor::is_enabled() const { return m_enabled; }
+bool c_compressor::is_peer_accepting() const { return m_peer_accepting; }
+
+std::string c_compressor::encode(const char * packet, size_t size) {
+	if (size == 0) throw std::invalid_argument("Can not encode empty packet");
+	std::string ret;
+	if (m_enabled && m_peer_accepting && (size >= min_size) && (size <= max_size)) {
+		const auto start = std::chrono::steady_clock::now();
+		if (entropy_estimate(packet + 1, size - 1) > max_entropy) ++m_stats.m_bypass_entropy;
+		else {
+			std::string compressed = lz4_compress(packet + 1, size - 1);
+			if (1 + size_field + compressed.size() < size) {
+				ret.reserve(1 + size_field + compressed.size());
+				ret += static_cast<char>(flag_accepts | flag_compressed);
+				ret += static_cast<char>((size - 1) >> 16);  ret += static_cast<char>(((size - 1) >> 8) & 0xFF);
+				ret += static_cast<char>((size - 1) & 0xFF);
+				ret += compressed;
+				++m_stats.m_compressed;
+			}
+			else ++m_stats.m_bypass_no_gain;
+		}
+		m_stats.m_bytes_in += size;
+		m_stats.m_bytes_out += ret.empty() ? size : ret.size();
+		m_stats.m_time_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		if (! ret.empty()) return ret;
+	}
+	ret.assign(packet, size);
+	ret[0] = static_cast<char>( m_enabled ? flag_accepts : 0 ); // PI flags from our TUN are 0 anyway
+	return ret;
+}
+
+std::string c_compressor::decode(const std::string & data) {
+	if (data.empty()) throw std::invalid_argument("Can not decode empty packet");
+	const unsigned char flags = static_cast<unsigned char>(data[0]);
+	m_peer_accepting = (flags & flag_accepts);
+	if (! (flags & flag_compressed)) {
+		std::string ret(data);
+		ret[0] = 0;
+		return ret;
+	}
+	if (! m_enabled) throw std::invalid_argument("Got compressed packet, but compression is disabled");
+	if (data.size() < 1 + size_field) throw std::invalid_argument("Compressed packet is too short");
+	const size_t size = (size_t(static_cast<unsigned char>(data[1])) << 16) | (size_t(static_cast<unsigned char>(data[2])) << 8)
+		| static_cast<unsigned char>(data[3]);
+	if (size + 1 > max_size) throw std::invalid_argument("Compressed packet is too big");
+	std::string rest = lz4_decompress(data.data() + 1 + size_field, data.size() - 1 - size_field, size);
+	if (rest.size() != size) throw std::invalid_argument("Compressed packet has wrong size");
+	return std::string(1, 0) + rest;
+}
+
+const t_compress_stats & c_compressor::get_stats() const { return m_stats; }
+
+void c_compressor::print(std::ostream & ostr) const {
+	ostr << "compression " << (m_enabled ? "on" : "off") << ", peer " << (m_peer_accepting ? "accepts" : "does not accept");
+	if (m_stats.m_bytes_in > 0) {
+		ostr << ": compressed=" << m_stats.m_compressed << " bypass(entropy)=" << m_stats.m_bypass_entropy
+			<< " bypass(no gain)=" << m_stats.m_bypass_no_gain
+			<< " ratio=" << static_cast<double>(m_stats.m_bytes_out) / m_stats.m_bytes_in
+			<< " cpu=" << m_stats.m_time_ns / (m_stats.m_compressed + m_stats.m_bypass_entropy + m_stats.m_bypass_no_gain) << "ns/packet";
+	}
+}
+
+} // namespace tunnel_compress
@@ -0,0 +1,65 @@
+#pragma once
+#ifndef include_c_compress_hpp
+#define include_c_compress_hpp
+
+#include "libs1.hpp"
+
+/**
+ * @brief Optional compression of the tunneled packets, done before they are encrypted in the end2end tunnel.
+ * Off by default: length of encrypted data tells something about its content (see CRIME/BREACH attacks).
+ *
+ * The cleartext in tunnel is the TUN packet (PI + ipv6). Its first byte (PI flags, always 0 from our TUN)
+ * carries our flags: "I accept compressed data" and "this packet is compressed". So it is negotiated per tunnel:
+ * we compress only after the other side said (in his packets) that he accepts it, and he does the same;
+ * and old nodes, that never set these flags, never get compressed data.
+ * Packets that look random (encrypted, already compressed - e.g. TLS) skip the compressor, by entropy estimate.
+ */
+namespace tunnel_compress {
+
+constexpr unsigned char flag_accepts = 0x80; ///< sender of this packet accepts compressed packets
+constexpr unsigned char flag_compressed = 0x40; ///< then: size of rest of packet (3 bytes), and LZ4 block of it
+constexpr size_t min_size = 128; ///< do not try to compress smaller packets
+constexpr size_t max_size = 65535 + 64; ///< biggest packet after decompression (ipv6 packet + PI)
+constexpr double max_entropy = 7.2; ///< bits per byte: more then that is probably encrypted or compressed
+
+/// LZ4 block format (no frame); fast, and not compressing well-compressible data as well as zlib, that is fine here
+std::string lz4_compress(const char * data, size_t size);
+/// throws std::invalid_argument if data is not correct LZ4 block, or it would be bigger then max_out
+std::string lz4_decompress(const char * data, size_t size, size_t max_out);
+
+/// estimate of entropy in bits per byte (0..8), from a sample at the start of data
+double entropy_estimate(const char * data, size_t size);
+
+struct t_compress_stats {
+	uint64_t m_compressed = 0; ///< packets sent compressed
+	uint64_t m_bypass_entropy = 0; ///< not compressed because they look random
+	uint64_t m_bypass_no_gain = 0; ///< compressed, but it was not smaller
+	uint64_t m_bytes_in = 0; ///< size of packets that we tried to compress
+	uint64_t m_bytes_out = 0; ///< the size that we sent for them
+	uint64_t m_time_ns = 0; ///< spent in compressing (and entropy estimate)
+};
+
+/// Compression of one end2end tunnel: both directions
+class c_compressor final {
+	public:
+		c_compressor();
+
+		void set_enabled(bool enabled); ///< do we want to compress (and accept compressed data)
+		bool is_enabled() const;
+		bool is_peer_accepting() const; ///< did the other side say that he accepts compressed packets
+
+		std::string encode(const char * packet, size_t size); ///< TUN packet -> the cleartext to encrypt
+		std::string decode(const std::string & data); ///< decrypted cleartext -> TUN packet; throws std::invalid_argument
+
+		const t_compress_stats & get_stats() const;
+		void print(std::ostream & ostr) const;
+
+	private:
+		bool m_enabled;
+		bool m_peer_accepting;
+		t_compress_stats m_stats;
+};
+
+} // namespace tunnel_compress
+
+#endif
@@ -0,0 +1,45 @@
+#include "c_conn_ids.hpp"
+
+namespace conn_ids {
+
+std::string nonce_prefix(const std::string & nonce) {
+	if (nonce.size() != nonce_size) throw std::invalid_argument("Invalid size of nonce");
+	return nonce.substr(0, nonce_prefix_size);
+}
+
+uint64_t nonce_sequence(const std::string & nonce) {
+	if (nonce.size() != nonce_size) throw std::invalid_argument("Invalid size of nonce");
+	uint64_t ret = 0;
+	for (size_t i = nonce_prefix_size; i < nonce_size; ++i) ret = (ret << 8) | static_cast<unsigned char>(nonce[i]);
+	return ret;
+}
+
+std::string make_nonce(const std::string & prefix, uint64_t seq) {
+	if (prefix.size() != nonce_prefix_size) throw std::invalid_argument("Invalid size of nonce prefix");
+	std::string ret(prefix);
+	for (int i = sizeof(uint64_t) - 1; i >= 0; --i) ret += static_cast<char>( (seq >> (8*i)) & 0xFF );
+	return ret;
+}
+
+std::string u32_to_bin(uint32_t value) {
+	std::string ret(4, 0);
+	for (int i=0; i<4; ++i) ret[i] = static_cast<char>( (value >> (8*(3-i))) & 0xFF );
+	return ret;
+}
+
+uint32_t bin_to_u32(const char * bin) {
+	uint32_t ret = 0;
+	for (int i=0; i<4; ++i) ret = (ret << 8) | static_cast<unsigned char>(bin[i]);
+	return ret;
+}
+
+uint64_t expand_sequence(uint64_t largest, uint32_t truncated) {
+	const uint64_t win = uint64_t(1) << 32, half_win = win / 2;
+	const uint64_t expected = largest + 1;
+	const uint64_t candidate = (expected & ~(win - 1)) | truncated;
+	if ((candidate + half_win <= expected) && (candidate <= std::numeric_limits<uint64_t>::max() - win)) return candidate + win;
+	if ((candidate > expected + half_win) && (candidate >= win)) return candidate - win;
+	return candidate;
+}
+
+} // namespace conn_ids
@@ -0,0 +1,137 @@
+#pragma once
+#ifndef include_c_conn_ids_hpp
+#define include_c_conn_ids_hpp
+
+#include "libs1.hpp"
+
+#include <chrono>
+
+/**
+ * @brief Connection IDs for the compact format of tunneled data (e_proto_cmd_tunneled_data_compact).
+ * The full format has in each frame the src and dst HIP and whole 24-byte nonce.
+ * Instead, the receiving peer (on each hop) gives to the sender a short ID for the pair (src HIP, dst HIP),
+ * together with the constant part of nonce of that stream (e_proto_cmd_conn_id_offer).
+ * Then the sender puts just this ID and the lowest 4 bytes of the nonce counter in frames, and the receiver
+ * reconstructs the full nonce from the biggest counter that it saw on this connection.
+ * While sender has no ID (or the nonce prefix changed, e.g. after re-keying) it uses the full format.
+ */
+namespace conn_ids {
+
+constexpr size_t seq_truncated_size = 4; ///< the lowest bytes of nonce counter that are sent
+constexpr size_t nonce_size = 24; ///< crypto_box_NONCEBYTES (nonce64: constant prefix and 8 bytes counter)
+constexpr size_t nonce_prefix_size = nonce_size - sizeof(uint64_t);
+
+std::string nonce_prefix(const std::string & nonce); ///< the constant part of nonce (in binary)
+uint64_t nonce_sequence(const std::string & nonce); ///< the counter of nonce (its last 8 bytes, big-endian)
+std::string make_nonce(const std::string & prefix, uint64_t seq); ///< nonce (binary) from prefix and counter
+
+std::string u32_to_bin(uint32_t value); ///< 4 bytes, big-endian, as the conn ID and counter are on wire
+uint32_t bin_to_u32(const char * bin); ///< reads 4 bytes written by u32_to_bin
+
+/// the full counter, nearest to the biggest one seen on connection, that has these lowest 32 bits (like QUIC packet numbers)
+uint64_t expand_sequence(uint64_t largest, uint32_t truncated);
+
+/**
+ * IDs with one peer: the ones that we gave him (for data that he sends to us), and the ones that he gave us.
+ * ID 0 is never used (it means "none").
+ */
+template <typename TAddr>
+class c_conn_ids {
+	public:
+		typedef std::chrono::steady_clock t_clock;
+
+		static constexpr size_t max_conns = 4096; ///< of each kind, per peer
+		static constexpr std::chrono::seconds offer_interval{ 1 }; ///< offer again if he still uses full format after that
+
+		c_conn_ids();
+
+		/// he sent us full frame. @return the ID that we should offer him now, or 0 if there is no need to offer now
+		uint32_t seen_full(const TAddr & src, const TAddr & dst, const std::string & nonce, t_clock::time_point now);
+		/// he sent us compact frame: get its src, dst and full nonce. @return false if this ID is not known
+		bool seen_compact(uint32_t id, uint32_t seq_truncated, TAddr & src, TAddr & dst, std::string & nonce);
+
+		/// he offered us this ID, for frames with this nonce prefix
+		void set_remote(const TAddr & src, const TAddr & dst, const std::string & prefix, uint32_t id);
+		/// the ID to use in frame to him, or 0 if full format must be used
+		uint32_t get_remote(const TAddr & src, const TAddr & dst, const std::string & nonce) const;
+
+	private:
+		struct t_conn_local {
+			TAddr m_src, m_dst;
+			std::string m_prefix;
+			uint64_t m_largest_seq;
+			t_clock::time_point m_offered;
+		};
+		struct t_conn_remote {
+			std::string m_prefix;
+			uint32_t m_id;
+		};
+		typedef std::pair<TAddr, TAddr> t_addr_pair;
+
+		std::map<uint32_t, t_conn_local> m_local; ///< IDs that we gave
+		std::map<t_addr_pair, uint32_t> m_local_by_addr;
+		std::map<t_addr_pair, t_conn_remote> m_remote; ///< IDs that he gave us
+		uint32_t m_next_id;
+};
+
+// ------------------------------------------------------------------
+
+template <typename TAddr> constexpr size_t c_conn_ids<TAddr>::max_conns;
+template <typename TAddr> constexpr std::chrono::seconds c_conn_ids<TAddr>::offer_interval;
+
+template <typename TAddr>
+c_conn_ids<TAddr>::c_conn_ids() : m_next_id(1) { }
+
+template <typename TAddr>
+uint32_t c_conn_ids<TAddr>::seen_full(const TAddr & src, const TAddr & dst, const std::string & nonce, t_clock::time_point now) {
+	const std::string prefix = nonce_prefix(nonce);
+	const uint64_t seq = nonce_sequence(nonce);
+	auto found = m_local_by_addr.find( t_addr_pair(src, dst) );
+	if (found == m_local_by_addr.end()) {
+		if (m_local.size() >= max_conns) return 0; // he will just use full format
+		while ((m_next_id == 0) || (m_local.count(m_next_id))) ++m_next_id;
+		const uint32_t id = m_next_id++;
+		m_local.emplace(id, t_conn_local{ src, dst, prefix, seq, now });
+		m_local_by_addr.emplace( t_addr_pair(src, dst) , id );
+		return id;
+	}
+	auto & conn = m_local.at(found->second);
+	if (conn.m_prefix != prefix) { conn.m_prefix = prefix;  conn.m_largest_seq = seq;  conn.m_offered = t_clock::time_point(); }
+	else conn.m_largest_seq = std::max(conn.m_largest_seq, seq);
+	if (now - conn.m_offered < offer_interval) return 0; // offer is probably on its way
+	conn.m_offered = now;
+	return found->second;
+}
+
+template <typename TAddr>
+bool c_conn_ids<TAddr>::seen_compact(uint32_t id, uint32_t seq_truncated, TAddr & src, TAddr & dst, std::string & nonce) {
+	auto found = m_local.find(id);
+	if (found == m_local.end()) return false;
+	auto & conn = found->second;
+	const uint64_t seq = expand_sequence(conn.m_largest_seq, seq_truncated);
+	conn.m_largest_seq = std::max(conn.m_largest_seq, seq); // frame is authenticated by CT-P2P MAC, before this is called
+	src = conn.m_src;  dst = conn.m_dst;
+	nonce = make_nonce(conn.m_prefix, seq);
+	return true;
+}
+
+template <typename TAddr>
+void c_conn_ids<TAddr>::set_remote(const TAddr & src, const TAddr & dst, const std::string & prefix, uint32_t id) {
+	if ((id == 0) || (prefix.size() != nonce_prefix_size)) throw std::invalid_argument("Invalid connection ID offer");
+	auto found = m_remote.find( t_addr_pair(src, dst) );
+	if (found != m_remote.end()) { found->second = t_conn_remote{ prefix, id };  return; }
+	if (m_remote.size() >= max_conns) return;
+	m_remote.emplace( t_addr_pair(src, dst) , t_conn_remote{ prefix, id } );
+}
+
+template <typename TAddr>
+uint32_t c_conn_ids<TAddr>::get_remote(const TAddr & src, const TAddr & dst, const std::string & nonce) const {
+	auto found = m_remote.find( t_addr_pair(src, dst) );
+	if (found == m_remote.end()) return 0;
+	if (found->second.m_prefix.compare(0, nonce_prefix_size, nonce, 0, nonce_prefix_size) != 0) return 0; // other stream now
+	return found->second.m_id;
+}
+
+} // namespace conn_ids
+
+#endif
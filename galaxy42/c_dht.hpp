@@ -0,0 +1,575 @@
+#pragma once
+#ifndef include_c_dht_hpp
+#define include_c_dht_hpp
+
+#include "libs1.hpp"
+#include "trivialserialize.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <random>
+#include <vector>
+
+/**
+ * @brief Kademlia DHT: a directory of records (e.g. pubkey of given HIP), spread over all nodes by XOR distance of IDs.
+ * A lookup asks the nodes nearest to the key that it knows (alpha of them at once), they answer with nodes even nearer,
+ * until the k nearest nodes answered (or one had the value) - so it takes O(log N) messages, and is not limited by TTL.
+ * Records are kept on the k nodes nearest to the key (and cached on the way), for record_ttl, so owners publish them again.
+ * Messages are sent and received by the user of c_dht (e.g. over UDP), so it works also in simulation.
+ * Replies (nodes, records) are much bigger then requests, and a request can come from a faked address; so a node can require
+ * return routability: a request without the cookie that we gave to its address gets only the cookie, in a reply not bigger
+ * then the request (like DNS cookies, RFC 7873). Then the asking node sends the request again, with the cookie.
+ * TAddr is the ID (array of bytes, like c_haship_addr), TLocator is where to send to a node (e.g. c_ip46_addr).
+ */
+namespace dht {
+
+constexpr size_t k_bucket_size = 20; ///< k: nodes in one k-bucket, and nodes that keep each record
+constexpr size_t alpha = 3; ///< queries sent at once in one lookup
+constexpr size_t max_value_size = 16*1024;
+constexpr uint32_t max_txid = 0xFFFFFFFE; ///< txid is 4 octets on wire, and 0xFFFFFFFF does not fit in trivialserialize
+constexpr uint32_t max_cookie = max_txid; ///< the same on wire
+
+enum class e_msg : unsigned char {
+	find_node = 0, ///< request: nodes nearest to m_key
+	find_value = 1, ///< request: value of m_key, or nodes nearest to it
+	store = 2, ///< request (not answered): keep m_value for m_key
+	nodes = 3, ///< reply: m_contacts
+	value = 4, ///< reply: m_value
+	cookie = 5, ///< reply to request without the correct m_cookie: use this m_cookie in requests to this node
+};
+
+template <typename TAddr, typename TLocator>
+struct t_contact {
+	TAddr m_id;
+	TLocator m_locator;
+};
+
+template <typename TAddr, typename TLocator>
+struct t_message {
+	e_msg m_type;
+	uint32_t m_txid; ///< reply has the txid of its request
+	TAddr m_sender; ///< ID of the node that sends it
+	TAddr m_key;
+	std::string m_value;
+	std::vector<t_contact<TAddr, TLocator>> m_contacts;
+	uint32_t m_cookie; ///< in find_node, find_value: given to us by that node (0 if none yet); in cookie reply: the one to use
+};
+
+/// message as bytes (TLocator needs trivialserialize::obj_serialize). Decoding throws std::exception if data is not valid
+template <typename TAddr, typename TLocator> std::string message_to_bin(const t_message<TAddr, TLocator> & msg);
+template <typename TAddr, typename TLocator> t_message<TAddr, TLocator> message_from_bin(const std::string & data);
+
+template <typename TAddr> bool is_closer(const TAddr & a, const TAddr & b, const TAddr & target); ///< XOR distance a-target < b-target
+template <typename TAddr> int common_prefix_bits(const TAddr & a, const TAddr & b); ///< the index of k-bucket
+
+/// k-buckets: nodes that we know, more of them near to us; the ones that talked to us recently are kept
+template <typename TAddr, typename TLocator>
+class c_routing_table {
+	public:
+		typedef t_contact<TAddr, TLocator> t_contact_type;
+
+		explicit c_routing_table(const TAddr & self);
+
+		void seen(const t_contact_type & contact); ///< he talked to us. When his bucket is full, he waits in replacement cache
+		void failed(const TAddr & id); ///< did not reply: removed, the newest from replacement cache takes his place
+		std::vector<t_contact_type> nearest(const TAddr & target, size_t count) const;
+		size_t size() const;
+
+	private:
+		const TAddr m_self;
+		std::vector<std::deque<t_contact_type>> m_buckets; ///< by common_prefix_bits with m_self; the least recently seen first
+		std::vector<std::deque<t_contact_type>> m_replacements;
+};
+
+template <typename TAddr, typename TLocator>
+class c_dht {
+	public:
+		typedef std::chrono::steady_clock t_clock;
+		typedef t_contact<TAddr, TLocator> t_contact_type;
+		typedef t_message<TAddr, TLocator> t_message_type;
+
+		static constexpr std::chrono::milliseconds query_timeout{ 1000 };
+		static constexpr std::chrono::seconds record_ttl{ 3600 }; ///< records not stored again for that long are dropped
+		static constexpr std::chrono::seconds republish_interval{ 1800 }; ///< our own records
+		static constexpr size_t max_records = 10000;
+		static constexpr size_t max_lookups = 100; ///< running at once; find_value for a new key fails when there are that many
+		static constexpr size_t max_found_per_lookup = 16; ///< callbacks waiting for one lookup
+		static constexpr size_t max_cookies = 10000; ///< cookies that other nodes gave us, the oldest ones are forgotten
+
+		typedef std::function<void(const TLocator & to, const t_message_type & msg)> t_send_func;
+		typedef std::function<bool(const TAddr & key, const std::string & value)> t_check_func; ///< is it a valid record for the key
+		/// our cookie for requests from this address: secret (e.g. keyed hash of it), 1..max_cookie
+		typedef std::function<uint32_t(const TLocator & from)> t_cookie_func;
+		/// lookup is done: the value (empty if not found), and nodes nearest to key that answered (the key itself, if it is a node)
+		typedef std::function<void(const TAddr & key, const std::string & value, const std::vector<t_contact_type> & nearest)>
+			t_found_func;
+
+		/// without cookie function, all requests get full replies (e.g. in simulation)
+		c_dht(const TAddr & self, t_send_func send, t_check_func check, t_cookie_func cookie = nullptr);
+
+		void add_contact(const t_contact_type & contact); ///< a node to start with (e.g. our peer)
+		void bootstrap(t_clock::time_point now); ///< lookup of our own ID: we learn nodes near us, and they learn us
+		void receive(const TLocator & from, const t_message_type & msg, t_clock::time_point now);
+		/// found is called when done (maybe at once); false if there are too many lookups (then found is never called)
+		bool find_value(const TAddr & key, t_found_func found, t_clock::time_point now);
+		void publish(const TAddr & key, const std::string & value, t_clock::time_point now); ///< stored on k nearest nodes, again and again
+		void tick(t_clock::time_point now); ///< timeouts, dropping old records, publishing again
+		/// when tick() will have work (a query times out, a record may be dropped, our records are published again): call it
+		/// then, not more often. Can be in the past (due now). Changes after the calls above (e.g. new queries were sent)
+		t_clock::time_point next_tick_time() const;
+
+		const std::string & get_local(const TAddr & key) const; ///< record kept here; throws expected_not_found
+		const c_routing_table<TAddr, TLocator> & get_routing_table() const;
+		uint64_t get_count_sent() const; ///< messages sent
+
+	private:
+		enum class e_state { fresh, asked, replied, failed };
+		struct t_candidate {
+			t_contact_type m_contact;
+			e_state m_state;
+		};
+		struct t_lookup {
+			TAddr m_target;
+			bool m_find_value;
+			std::vector<t_candidate> m_shortlist; ///< nearest to target first
+			size_t m_in_flight;
+			std::vector<t_found_func> m_found;
+			std::string m_publish; ///< value to store on the nodes that we find (if not empty)
+		};
+		struct t_query {
+			uint32_t m_lookup;
+			t_contact_type m_contact;
+			t_clock::time_point m_sent;
+			bool m_with_new_cookie; ///< sent again with cookie from his cookie reply (he gets no other chance)
+		};
+		struct t_record {
+			std::string m_value;
+			t_clock::time_point m_stored;
+		};
+
+		void start_lookup(const TAddr & target, bool find_value, t_found_func found, const std::string & publish,
+			t_clock::time_point now);
+		void step(uint32_t lookup_id, t_clock::time_point now); ///< send queries, or finish
+		void finish(uint32_t lookup_id, const std::string & value);
+		void got_reply(const TLocator & from, const t_message_type & msg, t_clock::time_point now);
+		void send(const TLocator & to, const t_message_type & msg);
+		void send_query(const t_query & query, uint32_t txid); ///< find_node or find_value of its lookup, with his cookie
+		uint32_t new_txid();
+		void store_record(const TAddr & key, const std::string & value, t_clock::time_point now);
+
+		const TAddr m_self;
+		t_send_func m_send;
+		t_check_func m_check;
+		t_cookie_func m_cookie;
+		c_routing_table<TAddr, TLocator> m_routing;
+		std::map<uint32_t, t_lookup> m_lookups;
+		std::map<uint32_t, t_query> m_queries; ///< by txid
+		std::map<TAddr, t_record> m_records;
+		std::map<TAddr, std::string> m_published; ///< our own records
+		std::map<TLocator, uint32_t> m_cookies; ///< that other nodes gave us, by their address
+		t_clock::time_point m_last_publish;
+		t_clock::time_point m_next_record_drop; ///< no record is too old before that (can be early: set again in tick())
+		uint32_t m_next_txid; ///< starts random, so it is hard to fake replies
+		uint32_t m_next_lookup;
+		uint64_t m_count_sent;
+};
+
+// ------------------------------------------------------------------
+
+template <typename TAddr, typename TLocator>
+std::string message_to_bin(const t_message<TAddr, TLocator> & msg) {
+	trivialserialize::generator gen(100 + msg.m_value.size() + msg.m_contacts.size() * 40);
+	gen.push_byte_u( static_cast<unsigned char>(msg.m_type) );
+	gen.push_integer_u<4>( msg.m_txid );
+	gen.push_bytes_n( msg.m_sender.size() , std::string( msg.m_sender.begin() , msg.m_sender.end() ) );
+	gen.push_bytes_n( msg.m_key.size() , std::string( msg.m_key.begin() , msg.m_key.end() ) );
+	if ((msg.m_type == e_msg::store) || (msg.m_type == e_msg::value)) gen.push_varstring( msg.m_value );
+	if ((msg.m_type == e_msg::find_node) || (msg.m_type == e_msg::find_value) || (msg.m_type == e_msg::cookie)) {
+		gen.push_integer_u<4>( msg.m_cookie );
+	}
+	if (msg.m_type == e_msg::nodes) {
+		if (msg.m_contacts.size() > k_bucket_size) throw std::invalid_argument("DHT: too many contacts in message");
+		gen.push_byte_u( static_cast<unsigned char>( msg.m_contacts.size() ) );
+		for (const auto & contact : msg.m_contacts) {
+			gen.push_bytes_n( contact.m_id.size() , std::string( contact.m_id.begin() , contact.m_id.end() ) );
+			gen.push_object( contact.m_locator );
+		}
+	}
+	return gen.str_move();
+}
+
+template <typename TAddr, typename TLocator>
+t_message<TAddr, TLocator> message_from_bin(const std::string & data) {
+	trivialserialize::parser parser( trivialserialize::parser::tag_caller_must_keep_this_buffer_valid() , data.data() , data.size() );
+	auto pop_addr = [&parser]() { TAddr addr;  const std::string bin = parser.pop_bytes_n( addr.size() );
+		std::copy( bin.begin() , bin.end() , addr.begin() );  return addr; };
+	t_message<TAddr, TLocator> msg;
+	msg.m_cookie = 0;
+	const unsigned char type = parser.pop_byte_u();
+	if (type > static_cast<unsigned char>(e_msg::cookie)) throw std::invalid_argument("DHT: unknown message type");
+	msg.m_type = static_cast<e_msg>(type);
+	msg.m_txid = parser.pop_integer_u<4, uint32_t>();
+	if (msg.m_txid > max_txid) throw std::invalid_argument("DHT: bad txid");
+	msg.m_sender = pop_addr();
+	msg.m_key = pop_addr();
+	if ((msg.m_type == e_msg::store) || (msg.m_type == e_msg::value)) {
+		msg.m_value = parser.pop_varstring();
+		if (msg.m_value.size() > max_value_size) throw std::invalid_argument("DHT: value is too big");
+	}
+	if ((msg.m_type == e_msg::find_node) || (msg.m_type == e_msg::find_value) || (msg.m_type == e_msg::cookie)) {
+		msg.m_cookie = parser.pop_integer_u<4, uint32_t>();
+		if (msg.m_cookie > max_cookie) throw std::invalid_argument("DHT: bad cookie");
+	}
+	if (msg.m_type == e_msg::nodes) {
+		const size_t count = parser.pop_byte_u();
+		if (count > k_bucket_size) throw std::invalid_argument("DHT: too many contacts in message");
+		for (size_t i=0; i<count; ++i) {
+			const TAddr id = pop_addr();
+			msg.m_contacts.push_back( t_contact<TAddr, TLocator>{ id , parser.pop_object<TLocator>() } );
+		}
+	}
+	if (! parser.is_end()) throw std::invalid_argument("DHT: garbage after message");
+	return msg;
+}
+
+template <typename TAddr>
+bool is_closer(const TAddr & a, const TAddr & b, const TAddr & target) {
+	for (size_t i=0; i<target.size(); ++i) {
+		const unsigned char da = a[i] ^ target[i], db = b[i] ^ target[i];
+		if (da != db) return da < db;
+	}
+	return false;
+}
+
+template <typename TAddr>
+int common_prefix_bits(const TAddr & a, const TAddr & b) {
+	for (size_t i=0; i<a.size(); ++i) {
+		unsigned char x = a[i] ^ b[i];
+		if (x == 0) continue;
+		int bits = static_cast<int>(i) * 8;
+		while (! (x & 0x80)) { ++bits;  x <<= 1; }
+		return bits;
+	}
+	return static_cast<int>(a.size()) * 8; // the same
+}
+
+// ------------------------------------------------------------------
+
+template <typename TAddr, typename TLocator>
+c_routing_table<TAddr, TLocator>::c_routing_table(const TAddr & self)
+	: m_self(self), m_buckets(self.size() * 8), m_replacements(self.size() * 8)
+{ }
+
+template <typename TAddr, typename TLocator>
+void c_routing_table<TAddr, TLocator>::seen(const t_contact_type & contact) {
+	const int index = common_prefix_bits(m_self, contact.m_id);
+	if (index >= static_cast<int>(m_buckets.size())) return; // this is us
+	auto same = [&contact](const t_contact_type & c) { return c.m_id == contact.m_id; };
+	auto & bucket = m_buckets.at(index);
+	auto found = std::find_if(bucket.begin(), bucket.end(), same);
+	if (found != bucket.end()) bucket.erase(found); // will be the most recent
+	else if (bucket.size() >= k_bucket_size) { // old nodes that still reply are more reliable (Kademlia), so he waits
+		auto & replacements = m_replacements.at(index);
+		replacements.erase( std::remove_if(replacements.begin(), replacements.end(), same) , replacements.end() );
+		replacements.push_back(contact);
+		if (replacements.size() > k_bucket_size) replacements.pop_front();
+		return;
+	}
+	bucket.push_back(contact);
+}
+
+template <typename TAddr, typename TLocator>
+void c_routing_table<TAddr, TLocator>::failed(const TAddr & id) {
+	const int index = common_prefix_bits(m_self, id);
+	if (index >= static_cast<int>(m_buckets.size())) return;
+	auto & bucket = m_buckets.at(index);
+	auto found = std::find_if(bucket.begin(), bucket.end(), [&id](const t_contact_type & c) { return c.m_id == id; });
+	if (found == bucket.end()) return;
+	bucket.erase(found);
+	auto & replacements = m_replacements.at(index);
+	if (! replacements.empty()) { bucket.push_back( replacements.back() );  replacements.pop_back(); }
+}
+
+template <typename TAddr, typename TLocator>
+std::vector<t_contact<TAddr, TLocator>> c_routing_table<TAddr, TLocator>::nearest(const TAddr & target, size_t count) const {
+	std::vector<t_contact_type> ret;
+	for (const auto & bucket : m_buckets) ret.insert(ret.end(), bucket.begin(), bucket.end());
+	count = std::min(count, ret.size());
+	std::partial_sort(ret.begin(), ret.begin() + count, ret.end(),
+		[&target](const t_contact_type & a, const t_contact_type & b) { return is_closer(a.m_id, b.m_id, target); } );
+	ret.resize(count);
+	return ret;
+}
+
+template <typename TAddr, typename TLocator>
+size_t c_routing_table<TAddr, TLocator>::size() const {
+	size_t ret = 0;
+	for (const auto & bucket : m_buckets) ret += bucket.size();
+	return ret;
+}
+
+// ------------------------------------------------------------------
+
+template <typename TAddr, typename TLocator> constexpr std::chrono::milliseconds c_dht<TAddr, TLocator>::query_timeout;
+template <typename TAddr, typename TLocator> constexpr std::chrono::seconds c_dht<TAddr, TLocator>::record_ttl;
+template <typename TAddr, typename TLocator> constexpr std::chrono::seconds c_dht<TAddr, TLocator>::republish_interval;
+template <typename TAddr, typename TLocator> constexpr size_t c_dht<TAddr, TLocator>::max_records;
+template <typename TAddr, typename TLocator> constexpr size_t c_dht<TAddr, TLocator>::max_lookups;
+template <typename TAddr, typename TLocator> constexpr size_t c_dht<TAddr, TLocator>::max_found_per_lookup;
+template <typename TAddr, typename TLocator> constexpr size_t c_dht<TAddr, TLocator>::max_cookies;
+
+template <typename TAddr, typename TLocator>
+c_dht<TAddr, TLocator>::c_dht(const TAddr & self, t_send_func send, t_check_func check, t_cookie_func cookie)
+	: m_self(self), m_send(send), m_check(check), m_cookie(cookie), m_routing(self), m_last_publish(),
+	m_next_record_drop( t_clock::time_point::max() ),
+	m_next_txid( std::random_device()() ), m_next_lookup(0), m_count_sent(0)
+{ }
+
+template <typename TAddr, typename TLocator>
+void c_dht<TAddr, TLocator>::add_contact(const t_contact_type & contact) { m_routing.seen(contact); }
+
+template <typename TAddr, typename TLocator>
+void c_dht<TAddr, TLocator>::bootstrap(t_clock::time_point now) { start_lookup(m_self, false, nullptr, "", now); }
+
+template <typename TAddr, typename TLocator>
+void c_dht<TAddr, TLocator>::send(const TLocator & to, const t_message_type & msg) {
+	++m_count_sent;
+	m_send(to, msg);
+}
+
+template <typename TAddr, typename TLocator>
+void c_dht<TAddr, TLocator>::send_query(const t_query & query, uint32_t txid) {
+	const auto & lookup = m_lookups.at(query.m_lookup);
+	const auto cookie = m_cookies.find(query.m_contact.m_locator);
+	send( query.m_contact.m_locator , t_message_type{ lookup.m_find_value ? e_msg::find_value : e_msg::find_node ,
+		txid , m_self , lookup.m_target , "" , { } , (cookie == m_cookies.end()) ? 0 : cookie->second } );
+}
+
+template <typename TAddr, typename TLocator>
+uint32_t c_dht<TAddr, TLocator>::new_txid() {
+	if (m_next_txid > max_txid) m_next_txid = 0;
+	return m_next_txid++;
+}
+
+template <typename TAddr, typename TLocator>
+void c_dht<TAddr, TLocator>::store_record(const TAddr & key, const std::string & value, t_clock::time_point now) {
+	if ((value.size() > max_value_size) || (! m_check(key, value))) return;
+	if ((m_records.size() >= max_records) && (m_records.count(key) == 0)) return; // full
+	m_records[key] = t_record{ value , now };
+	m_next_record_drop = std::min( m_next_record_drop , now + record_ttl );
+}
+
+template <typename TAddr, typename TLocator>
+void c_dht<TAddr, TLocator>::receive(const TLocator & from, const t_message_type & msg, t_clock::time_point now) {
+	if (msg.m_sender == m_self) return;
+	if ((msg.m_type == e_msg::nodes) || (msg.m_type == e_msg::value) || (msg.m_type == e_msg::cookie)) {
+		got_reply(from, msg, now);
+		return;
+	}
+	if (msg.m_type == e_msg::store) { // not answered, so nothing to amplify; the record is checked
+		if (! m_cookie) m_routing.seen( t_contact_type{ msg.m_sender , from } );
+		store_record(msg.m_key, msg.m_value, now);
+		return;
+	}
+
+	if (m_cookie) {
+		const uint32_t cookie = m_cookie(from);
+		if (msg.m_cookie != cookie) { // maybe "from" is faked: the reply is of the same size as the request
+			send(from, t_message_type{ e_msg::cookie , msg.m_txid , m_self , msg.m_key , "" , { } , cookie });
+			return;
+		}
+	}
+	m_routing.seen( t_contact_type{ msg.m_sender , from } ); // he gets data at this address
+
+	t_message_type reply{ e_msg::nodes , msg.m_txid , m_self , msg.m_key , "" , { } , 0 };
+	auto found = m_records.find(msg.m_key);
+	if ((msg.m_type == e_msg::find_value) && (found != m_records.end())) {
+		reply.m_type = e_msg::value;
+		reply.m_value = found->second.m_value;
+	} else {
+		for (const auto & contact : m_routing.nearest(msg.m_key, k_bucket_size + 1)) {
+			if ((contact.m_id != msg.m_sender) && (reply.m_contacts.size() < k_bucket_size)) reply.m_contacts.push_back(contact);
+		}
+	}
+	send(from, reply);
+}
+
+template <typename TAddr, typename TLocator>
+void c_dht<TAddr, TLocator>::got_reply(const TLocator & from, const t_message_type & msg, t_clock::time_point now) {
+	auto query_it = m_queries.find(msg.m_txid);
+	if (query_it == m_queries.end()) return; // not asked, or too late
+	const t_query query = query_it->second;
+	if ((! (query.m_contact.m_locator == from)) || (query.m_contact.m_id != msg.m_sender)) return; // not from him
+	if (msg.m_type == e_msg::cookie) { // ask him again, with his cookie (the txid is the same, so the query waits as before)
+		if (query.m_with_new_cookie || (msg.m_cookie == 0) || (m_lookups.count(query.m_lookup) == 0)) return; // times out
+		if ((m_cookies.size() >= max_cookies) && (m_cookies.count(from) == 0)) m_cookies.erase(m_cookies.begin());
+		m_cookies[from] = msg.m_cookie;
+		query_it->second.m_with_new_cookie = true;
+		query_it->second.m_sent = now;
+		send_query(query_it->second, msg.m_txid);
+		return;
+	}
+	m_queries.erase(query_it);
+	m_routing.seen( query.m_contact );
+
+	auto lookup_it = m_lookups.find(query.m_lookup);
+	if (lookup_it == m_lookups.end()) return; // done already
+	auto & lookup = lookup_it->second;
+	--lookup.m_in_flight;
+	for (auto & candidate : lookup.m_shortlist) {
+		if (candidate.m_contact.m_id == msg.m_sender) candidate.m_state = e_state::replied;
+	}
+
+	if (msg.m_type == e_msg::value) {
+		if (lookup.m_find_value && m_check(lookup.m_target, msg.m_value)) {
+			for (const auto & candidate : lookup.m_shortlist) { // cache it on the nearest node that did not have it
+				if ((candidate.m_state != e_state::replied) || (candidate.m_contact.m_id == msg.m_sender)) continue;
+				send( candidate.m_contact.m_locator , t_message_type{ e_msg::store , new_txid() , m_self , lookup.m_target , msg.m_value , { } , 0 } );
+				break;
+			}
+			finish(query.m_lookup, msg.m_value);
+			return;
+		}
+	} else {
+		const auto closer = [&lookup](const t_candidate & a, const t_candidate & b) {
+			return is_closer(a.m_contact.m_id, b.m_contact.m_id, lookup.m_target); };
+		for (const auto & contact : msg.m_contacts) {
+			if (contact.m_id == m_self) continue;
+			const bool known = std::any_of(lookup.m_shortlist.begin(), lookup.m_shortlist.end(),
+				[&contact](const t_candidate & c) { return c.m_contact.m_id == contact.m_id; });
+			if (known) continue;
+			const t_candidate candidate{ contact , e_state::fresh };
+			lookup.m_shortlist.insert( std::upper_bound( lookup.m_shortlist.begin() , lookup.m_shortlist.end() , candidate , closer ) ,
+				candidate );
+		}
+		if (lookup.m_shortlist.size() > 3 * k_bucket_size) lookup.m_shortlist.resize(3 * k_bucket_size);
+	}
+	step(query.m_lookup, now);
+}
+
+template <typename TAddr, typename TLocator>
+void c_dht<TAddr, TLocator>::start_lookup(const TAddr & target, bool find_value, t_found_func found,
+	const std::string & publish, t_clock::time_point now)
+{
+	const uint32_t lookup_id = m_next_lookup++;
+	t_lookup lookup{ target , find_value , { } , 0 , { } , publish };
+	if (found) lookup.m_found.push_back(found);
+	for (const auto & contact : m_routing.nearest(target, k_bucket_size)) lookup.m_shortlist.push_back( t_candidate{ contact , e_state::fresh } );
+	m_lookups.emplace(lookup_id, std::move(lookup));
+	step(lookup_id, now);
+}
+
+template <typename TAddr, typename TLocator>
+void c_dht<TAddr, TLocator>::step(uint32_t lookup_id, t_clock::time_point now) {
+	auto & lookup = m_lookups.at(lookup_id);
+	size_t considered = 0; // the k nearest that did not fail must all reply
+	for (auto & candidate : lookup.m_shortlist) {
+		if (candidate.m_state == e_state::failed) continue;
+		if (considered++ >= k_bucket_size) break;
+		if (candidate.m_state != e_state::fresh) continue;
+		if (lookup.m_in_flight >= alpha) break;
+		const uint32_t txid = new_txid();
+		const auto query = m_queries.emplace( txid , t_query{ lookup_id , candidate.m_contact , now , false } ).first;
+		candidate.m_state = e_state::asked;
+		++lookup.m_in_flight;
+		send_query( query->second , txid );
+	}
+	if (lookup.m_in_flight == 0) finish(lookup_id, "");
+}
+
+template <typename TAddr, typename TLocator>
+void c_dht<TAddr, TLocator>::finish(uint32_t lookup_id, const std::string & value) {
+	t_lookup lookup = std::move( m_lookups.at(lookup_id) );
+	m_lookups.erase(lookup_id); // before callbacks, they can start new lookups
+	std::vector<t_contact_type> nearest;
+	for (const auto & candidate : lookup.m_shortlist) {
+		if (candidate.m_state == e_state::replied) nearest.push_back(candidate.m_contact);
+		if (nearest.size() >= k_bucket_size) break;
+	}
+	if (! lookup.m_publish.empty()) {
+		for (const auto & contact : nearest) {
+			send( contact.m_locator , t_message_type{ e_msg::store , new_txid() , m_self , lookup.m_target , lookup.m_publish , { } , 0 } );
+		}
+	}
+	for (const auto & found : lookup.m_found) found(lookup.m_target, value, nearest);
+}
+
+template <typename TAddr, typename TLocator>
+bool c_dht<TAddr, TLocator>::find_value(const TAddr & key, t_found_func found, t_clock::time_point now) {
+	auto record = m_records.find(key);
+	if (record != m_records.end()) { found(key, record->second.m_value, { });  return true; }
+	for (auto & lookup : m_lookups) {
+		if (lookup.second.m_find_value && (lookup.second.m_target == key)) { // already looking
+			if (lookup.second.m_found.size() >= max_found_per_lookup) return false;
+			lookup.second.m_found.push_back(found);
+			return true;
+		}
+	}
+	if (m_lookups.size() >= max_lookups) return false;
+	start_lookup(key, true, found, "", now);
+	return true;
+}
+
+template <typename TAddr, typename TLocator>
+void c_dht<TAddr, TLocator>::publish(const TAddr & key, const std::string & value, t_clock::time_point now) {
+	m_published[key] = value;
+	store_record(key, value, now);
+	start_lookup(key, false, nullptr, value, now);
+}
+
+template <typename TAddr, typename TLocator>
+void c_dht<TAddr, TLocator>::tick(t_clock::time_point now) {
+	for (auto it = m_queries.begin(); it != m_queries.end(); ) {
+		if (now - it->second.m_sent < query_timeout) { ++it;  continue; }
+		const t_query query = it->second;
+		it = m_queries.erase(it);
+		m_routing.failed(query.m_contact.m_id);
+		auto lookup_it = m_lookups.find(query.m_lookup);
+		if (lookup_it == m_lookups.end()) continue;
+		--lookup_it->second.m_in_flight;
+		for (auto & candidate : lookup_it->second.m_shortlist) {
+			if (candidate.m_contact.m_id == query.m_contact.m_id) candidate.m_state = e_state::failed;
+		}
+		step(query.m_lookup, now);
+	}
+
+	m_next_record_drop = t_clock::time_point::max();
+	for (auto it = m_records.begin(); it != m_records.end(); ) {
+		if (now - it->second.m_stored > record_ttl) { it = m_records.erase(it);  continue; }
+		m_next_record_drop = std::min( m_next_record_drop , it->second.m_stored + record_ttl );
+		++it;
+	}
+
+	if ((m_last_publish == t_clock::time_point()) || (now - m_last_publish >= republish_interval)) {
+		m_last_publish = now;
+		for (const auto & record : m_published) publish(record.first, record.second, now);
+	}
+}
+
+template <typename TAddr, typename TLocator>
+typename c_dht<TAddr, TLocator>::t_clock::time_point c_dht<TAddr, TLocator>::next_tick_time() const {
+	if (m_last_publish == t_clock::time_point()) return m_last_publish; // the first publish is due now
+	auto next = std::min( m_last_publish + republish_interval , m_next_record_drop );
+	for (const auto & query : m_queries) next = std::min( next , query.second.m_sent + query_timeout );
+	return next;
+}
+
+template <typename TAddr, typename TLocator>
+const std::string & c_dht<TAddr, TLocator>::get_local(const TAddr & key) const {
+	auto found = m_records.find(key);
+	if (found == m_records.end()) throw expected_not_found();
+	return found->second.m_value;
+}
+
+template <typename TAddr, typename TLocator>
+const c_routing_table<TAddr, TLocator> & c_dht<TAddr, TLocator>::get_routing_table() const { return m_routing; }
+
+template <typename TAddr, typename TLocator>
+uint64_t c_dht<TAddr, TLocator>::get_count_sent() const { return m_count_sent; }
+
+} // namespace dht
+
+#endif
@@ -0,0 +1,57 @@
+#include "c_hi_session.hpp"
+
+#include <random>
+
+namespace hi_session {
+
+constexpr std::chrono::seconds c_hi_session::established_timeout;
+
+t_session_id generate_session_id() {
+	std::random_device random;
+	t_session_id id = 0;
+	while (id == 0) id = (static_cast<t_session_id>( random() ) << 32) | random();
+	return id;
+}
+
+c_hi_session::c_hi_session()
+	: m_has_his_session(false), m_his_session(0), m_his_counter(0), m_confirmed(), m_my_counter(0), m_count_full_hi(0),
+	m_restarted(false)
+{ }
+
+bool c_hi_session::need_full_hi(t_clock::time_point now) const {
+	if (m_confirmed == t_clock::time_point()) return true;
+	return now - m_confirmed > established_timeout;
+}
+
+uint64_t c_hi_session::next_keepalive_counter() { return ++m_my_counter; }
+
+bool c_hi_session::hi_received(t_session_id his_session) {
+	if (m_has_his_session && (his_session == m_his_session)) return false; // e.g. our keepalive was lost, he sends HI again
+	_info("New HI session of peer: " << his_session << (m_has_his_session ? " (he restarted)" : ""));
+	m_restarted = m_has_his_session;
+	m_has_his_session = true;
+	m_his_session = his_session;
+	m_his_counter = 0;
+	m_confirmed = t_clock::time_point(); // he has not seen our HI in this session of his
+	return true;
+}
+
+bool c_hi_session::keepalive_received(t_session_id his_session, uint64_t counter, t_clock::time_point now) {
+	if ((! m_has_his_session) || (his_session != m_his_session) || (his_session == 0)) return false;
+	if (counter <= m_his_counter) return false; // replayed (or reordered, that is ok to lose for keepalive)
+	m_his_counter = counter;
+	m_confirmed = now;
+	return true;
+}
+
+bool c_hi_session::pop_restart_confirmed() {
+	if ((! m_restarted) || (m_confirmed == t_clock::time_point())) return false;
+	m_restarted = false;
+	return true;
+}
+
+uint64_t c_hi_session::get_count_full_hi() const { return m_count_full_hi; }
+void c_hi_session::full_hi_sent() { ++m_count_full_hi; }
+
+} // namespace hi_session
+
@@ -0,0 +1,59 @@
+#pragma once
+#ifndef include_c_hi_session_hpp
+#define include_c_hi_session_hpp
+
+#include "libs1.hpp"
+
+#include <chrono>
+
+/**
+ * @brief HI with one peer as a session: the full HI (IDC, IDI and the multisign - kilobytes, expensive to verify)
+ * is sent only until the peer proves that he got it, then only small keepalives, authenticated with CT-P2P MAC.
+ * A valid MAC proves that he knows our IDC (the CT-P2P key is agreed from IDC of both), so he has our HI.
+ * Each node has a random session ID (new after each restart), sent in its HI and in each keepalive: when it changes,
+ * the peer restarted and lost our HI, so we send it again at once. Keepalives have a counter (replay protection).
+ * Peers that do not send keepalives (older version) just get the full HI each time, as before.
+ */
+namespace hi_session {
+
+typedef std::chrono::steady_clock t_clock;
+typedef uint64_t t_session_id;
+
+t_session_id generate_session_id(); ///< random, not 0
+
+class c_hi_session final {
+	public:
+		/// if no valid keepalive comes from him for that long, we send the full HI again (he may have lost it)
+		static constexpr std::chrono::seconds established_timeout{ 30 };
+
+		c_hi_session();
+
+		/// should we send him the full HI now (he did not confirm that he has it)
+		bool need_full_hi(t_clock::time_point now) const;
+		uint64_t next_keepalive_counter(); ///< for our next keepalive to him (from 1, grows)
+
+		/// we verified his full HI with this session ID (0 if he sends none); true if it is a new session (send him our HI now)
+		bool hi_received(t_session_id his_session);
+		/// keepalive from him, with correct MAC; false (drop it) if it is from other session, or replayed
+		bool keepalive_received(t_session_id his_session, uint64_t counter, t_clock::time_point now);
+		/// true once, at his first valid keepalive after he restarted (new session): now his data nonces start again.
+		/// The session ID in HI is not authenticated (anyone can resend HI with other ID), the keepalive MAC is
+		bool pop_restart_confirmed();
+
+		uint64_t get_count_full_hi() const; ///< full HI that we sent him (see full_hi_sent)
+		void full_hi_sent();
+
+	private:
+		bool m_has_his_session; ///< did we get his HI
+		t_session_id m_his_session;
+		uint64_t m_his_counter; ///< highest counter of his keepalive in this session
+		t_clock::time_point m_confirmed; ///< when we got his last valid keepalive (or never)
+		uint64_t m_my_counter;
+		uint64_t m_count_full_hi;
+		bool m_restarted; ///< his session changed, and no valid keepalive of the new one yet
+};
+
+} // namespace hi_session
+
+#endif
+
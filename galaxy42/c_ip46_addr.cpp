@@ -2,6 +2,7 @@
 
 #include "cpputils.hpp"
 #include <netdb.h>
+#include <cstring>
 
 c_ip46_addr::c_ip46_addr() : m_tag(tag_none) { }
 
@@ -43,6 +44,37 @@ sockaddr_in6 c_ip46_addr::get_ip6() const {
 	_assert(ret.sin6_family == AF_INET6);
 	return ret;
 }
+socklen_t c_ip46_addr::get_sockaddr(sockaddr_storage & out) const {
+	static_assert( sizeof(sockaddr_storage) >= sizeof(sockaddr_in6) , "Invalid size of sockaddr_storage" );
+	if (m_tag == tag_ipv4) {
+		std::memcpy(&out, &m_ip_data.in4, sizeof(sockaddr_in));
+		return sizeof(sockaddr_in);
+	}
+	if (m_tag == tag_ipv6) {
+		std::memcpy(&out, &m_ip_data.in6, sizeof(sockaddr_in6));
+		return sizeof(sockaddr_in6);
+	}
+	throw std::invalid_argument("c_ip46_addr has no address (tag_none)");
+}
+
+void c_ip46_addr::set_sockaddr(const sockaddr * addr, socklen_t addr_len) {
+	if ((addr->sa_family == AF_INET) && (addr_len >= sizeof(sockaddr_in))) {
+		set_ip4( * reinterpret_cast<const sockaddr_in*>(addr) );
+	}
+	else if ((addr->sa_family == AF_INET6) && (addr_len >= sizeof(sockaddr_in6))) {
+		const sockaddr_in6 & in6 = * reinterpret_cast<const sockaddr_in6*>(addr);
+		if (IN6_IS_ADDR_V4MAPPED(&in6.sin6_addr)) { // ::ffff:a.b.c.d - it is in fact ipv4 peer
+			as_zerofill< sockaddr_in > in4;
+			in4.sin_family = AF_INET;
+			in4.sin_port = in6.sin6_port;
+			std::memcpy(&in4.sin_addr, &in6.sin6_addr.s6_addr[12], sizeof(in4.sin_addr));
+			set_ip4(in4);
+		}
+		else set_ip6(in6);
+	}
+	else throw std::invalid_argument("Unknown socket address family " + std::to_string(addr->sa_family));
+}
+
 ///< return my address, any IP (e.g. for listening), on given port
 c_ip46_addr c_ip46_addr::any_on_port(int port) {
 	as_zerofill< sockaddr_in > addr_in;
@@ -157,3 +189,40 @@ bool c_ip46_addr::operator< (const c_ip46_addr &rhs) const {
 	if (ret < 0) return true;
 	else return false;
 }
+
+template <> void trivialserialize::obj_serialize<c_ip46_addr>(const c_ip46_addr & data, trivialserialize::generator & gen) {
+	const auto type = data.get_ip_type();
+	if (type == c_ip46_addr::tag_ipv4) {
+		const auto in4 = data.get_ip4();
+		gen.push_byte_u(4);
+		gen.push_bytes_n( sizeof(in4.sin_addr) , std::string( reinterpret_cast<const char*>( & in4.sin_addr ) , sizeof(in4.sin_addr) ) );
+	} else if (type == c_ip46_addr::tag_ipv6) {
+		const auto in6 = data.get_ip6();
+		gen.push_byte_u(6);
+		gen.push_bytes_n( sizeof(in6.sin6_addr) , std::string( reinterpret_cast<const char*>( & in6.sin6_addr ) , sizeof(in6.sin6_addr) ) );
+	} else throw std::invalid_argument("Can not serialize address of type tag_none");
+	const int port = data.get_assign_port(); // not push_integer_u<2>, it can not write 65535
+	gen.push_byte_u( static_cast<unsigned char>( port >> 8 ) );
+	gen.push_byte_u( static_cast<unsigned char>( port & 0xFF ) );
+}
+
+template <> c_ip46_addr trivialserialize::obj_deserialize<c_ip46_addr>(trivialserialize::parser & parser) {
+	c_ip46_addr ret;
+	const unsigned char type = parser.pop_byte_u();
+	if (type == 4) {
+		sockaddr_in in4;
+		memset(&in4, 0, sizeof(in4));
+		in4.sin_family = AF_INET;
+		parser.pop_bytes_n_into_buff( sizeof(in4.sin_addr) , reinterpret_cast<char*>( & in4.sin_addr ) );
+		in4.sin_port = htons( parser.pop_integer_u<2, uint16_t>() ); // reads 65535 fine
+		ret.set_ip4(in4);
+	} else if (type == 6) {
+		sockaddr_in6 in6;
+		memset(&in6, 0, sizeof(in6));
+		in6.sin6_family = AF_INET6;
+		parser.pop_bytes_n_into_buff( sizeof(in6.sin6_addr) , reinterpret_cast<char*>( & in6.sin6_addr ) );
+		in6.sin6_port = htons( parser.pop_integer_u<2, uint16_t>() );
+		ret.set_ip6(in6);
+	} else throw std::invalid_argument("Unknown type of serialized address");
+	return ret;
+}
@@ -2,6 +2,7 @@
 #define C_IP46_ADDR_H
 
 #include "libs1.hpp"
+#include "trivialserialize.hpp"
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <ostream>
@@ -31,6 +32,12 @@ class c_ip46_addr { ///< any address ipv6 or ipv4, in lowest level - system sock
 		sockaddr_in  get_ip4() const;
 		sockaddr_in6 get_ip6() const;
 
+		/// fill ready to use system address (sockaddr_in or sockaddr_in6, e.g. for sendto). @return its size
+		socklen_t get_sockaddr(sockaddr_storage & out) const;
+		/// set from system address (e.g. from recvfrom). Ipv4 mapped to ipv6 (::ffff:a.b.c.d, as from dual-stack socket)
+		/// becomes ipv4 address, so it is equal to the same peer given as ipv4. Throws std::invalid_argument for other families
+		void set_sockaddr(const sockaddr * addr, socklen_t addr_len);
+
 		t_tag get_ip_type() const;
 		int get_assign_port() const {
 			if(m_tag == tag_ipv4) {
@@ -85,4 +92,12 @@ class c_ip46_addr { ///< any address ipv6 or ipv4, in lowest level - system sock
 		t_tag m_tag; ///< current type of address
 };
 
+namespace trivialserialize {
+
+/// [protocol] type (1 octet: 4 or 6), the address (4 or 16 octets), port (2 octets). Throws for tag_none, or on bad data
+template <> void obj_serialize<c_ip46_addr>(const c_ip46_addr & data, generator & gen);
+template <> c_ip46_addr obj_deserialize<c_ip46_addr>(parser & parser);
+
+} // namespace trivialserialize
+
 #endif // C_IP46_ADDR_H
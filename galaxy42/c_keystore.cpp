@@ -0,0 +1,405 @@
+#include "c_keystore.hpp"
+#include "c_multipath.hpp"
+
+#include <boost/crc.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+namespace keystore {
+
+namespace {
+
+const char data_magic[8] = { 'G','4','2','K','S','D','0','1' }; ///< at start of data file
+const char index_magic[8] = { 'G','4','2','K','S','I','0','1' }; ///< at start of index file
+
+// [format] integers are big-endian
+void put_u32(char * p, uint32_t value) { for (int i=3; i>=0; --i) { p[i] = static_cast<char>(value & 0xFF);  value >>= 8; } }
+void put_u64(char * p, uint64_t value) { for (int i=7; i>=0; --i) { p[i] = static_cast<char>(value & 0xFF);  value >>= 8; } }
+uint32_t get_u32(const char * p) { uint32_t ret=0;  for (int i=0; i<4; ++i) ret = (ret << 8) | static_cast<unsigned char>(p[i]);  return ret; }
+uint64_t get_u64(const char * p) { uint64_t ret=0;  for (int i=0; i<8; ++i) ret = (ret << 8) | static_cast<unsigned char>(p[i]);  return ret; }
+
+/// of the record header (without the crc itself) and data
+uint32_t record_crc(const char * header, const char * data, size_t size) {
+	boost::crc_32_type crc;
+	crc.process_bytes(header, c_keystore::record_header_size - 4);
+	crc.process_bytes(data, size);
+	return crc.checksum();
+}
+
+void throw_errno(const std::string & what) { throw std::runtime_error(what + ": " + std::strerror(errno)); }
+
+} // namespace
+
+constexpr size_t c_keystore::record_header_size;
+constexpr size_t c_keystore::index_header_size;
+constexpr size_t c_keystore::slot_size;
+constexpr size_t c_keystore::min_slots;
+constexpr uint64_t c_keystore::compact_min_size;
+
+c_keystore::c_keystore(const fs::path & path, e_sync sync_mode)
+	: m_path(path), m_index_path(path.native() + ".idx"), m_sync_mode(sync_mode), m_unsynced(false), m_max_keys(0), m_live_size(0),
+	m_data_fd(-1), m_index_fd(-1),
+	m_data_map(nullptr), m_data_map_size(0), m_data_size(0), m_index_map(nullptr), m_index_map_size(0),
+	m_slot_count(0), m_used(0), m_seed(0)
+{
+	try {
+		if (m_path.has_parent_path()) fs::create_directories(m_path.parent_path());
+		open_data();
+		open_index();
+	} catch(...) {
+		close_all();
+		throw;
+	}
+	_info("Keystore " << m_path << " has " << m_used << " keys");
+}
+
+c_keystore::~c_keystore() {
+	try { sync(); }
+	catch(const std::exception &e) { _warn(e.what()); }
+	close_all();
+}
+
+void c_keystore::open_data() {
+	m_data_fd = open(m_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600); // also secret keys can be here
+	if (m_data_fd < 0) throw_errno("Can not open keystore " + m_path.native());
+	struct stat st;
+	if (fstat(m_data_fd, &st) != 0) throw_errno("Can not stat keystore " + m_path.native());
+	m_data_size = st.st_size;
+	if (m_data_size == 0) { // new one
+		if (pwrite(m_data_fd, data_magic, sizeof(data_magic), 0) != sizeof(data_magic)) throw_errno("Can not write keystore " + m_path.native());
+		m_data_size = sizeof(data_magic);
+	}
+	else {
+		char magic[sizeof(data_magic)];
+		if ((m_data_size < sizeof(data_magic)) || (pread(m_data_fd, magic, sizeof(magic), 0) != sizeof(magic))
+			|| (std::memcmp(magic, data_magic, sizeof(magic)) != 0)) throw std::runtime_error("Not a keystore file: " + m_path.native());
+	}
+	map_data();
+}
+
+void c_keystore::close_all() {
+	if (m_data_map != nullptr) munmap(m_data_map, m_data_map_size);
+	if (m_index_map != nullptr) munmap(m_index_map, m_index_map_size);
+	if (m_data_fd >= 0) close(m_data_fd);
+	if (m_index_fd >= 0) close(m_index_fd);
+	m_data_map = nullptr;  m_index_map = nullptr;
+	m_data_fd = -1;  m_index_fd = -1;
+}
+
+fs::path c_keystore::default_path() {
+	fs::path path = filestorage::get_parent_path(e_filestore_galaxy_pub, "");
+	path += "keystore";
+	return path;
+}
+
+void c_keystore::put(t_filestore type, const t_hip & hip, const std::string & data) { append(type, hip, data.data(), data.size()); }
+
+void c_keystore::put_mlocked(t_filestore type, const t_hip & hip, const sodiumpp::locked_string & data) {
+	append(type, hip, data.c_str(), data.size()); // written from the locked buffer, no copies
+}
+
+void c_keystore::sync() {
+	if (! m_unsynced) return;
+	if (fdatasync(m_data_fd) != 0) throw_errno("Can not sync keystore " + m_path.native());
+	m_unsynced = false;
+}
+
+void c_keystore::set_max_keys(size_t max_keys) {
+	m_max_keys = max_keys;
+	compact_if_needed();
+}
+
+bool c_keystore::has(t_filestore type, const t_hip & hip) const { return slot_ptr( find_slot(type, hip) )[17] != 0; }
+
+boost::string_ref c_keystore::get(t_filestore type, const t_hip & hip) const {
+	const char * slot = slot_ptr( find_slot(type, hip) );
+	if (! slot[17]) throw expected_not_found();
+	const uint64_t offset = get_u64(slot + 24);
+	const auto data = record_data(offset);
+	const char * header = m_data_map + offset;
+	if ((std::memcmp(header, hip.data(), hip.size()) != 0) || (header[16] != static_cast<char>(type))) {
+		throw std::runtime_error("Keystore index does not match data, in " + m_index_path.native());
+	}
+	return data;
+}
+
+sodiumpp::locked_string c_keystore::get_mlocked(t_filestore type, const t_hip & hip) const {
+	const auto data = get(type, hip);
+	sodiumpp::locked_string ret( data.size() );
+	std::memcpy(ret.buffer_writable(), data.data(), data.size());
+	return ret;
+}
+
+size_t c_keystore::size() const { return m_used; }
+
+uint64_t c_keystore::get_data_size() const { return m_data_size; }
+
+const fs::path & c_keystore::get_path() const { return m_path; }
+
+void c_keystore::append(t_filestore type, const t_hip & hip, const char * data, size_t size) {
+	if (size > std::numeric_limits<uint32_t>::max()) throw std::invalid_argument("Too big data for keystore");
+	// [format] record: HIP(16) type(1) reserved(3) size(4) crc32(4) data(size)
+	char header[record_header_size] = { };
+	std::memcpy(header, hip.data(), hip.size());
+	header[16] = static_cast<char>(type);
+	put_u32(header + 20, size);
+	put_u32(header + 24, record_crc(header, data, size));
+	iovec iov[2] = { { header , record_header_size } , { const_cast<char*>(data) , size } };
+	if (pwritev(m_data_fd, iov, 2, m_data_size) != static_cast<ssize_t>(record_header_size + size)) { // a part is cut off on open
+		throw_errno("Can not write to keystore " + m_path.native());
+	}
+	if (m_sync_mode == e_sync::each_put) {
+		if (fdatasync(m_data_fd) != 0) throw_errno("Can not sync keystore " + m_path.native());
+	} else m_unsynced = true;
+	const uint64_t offset = m_data_size;
+	m_data_size += record_header_size + size;
+	map_data();
+	insert(type, hip, offset);
+	set_indexed_size(m_data_size);
+	_dbg2("Keystore: saved " << size << " bytes of type " << static_cast<int>(type) << " at " << offset);
+	compact_if_needed();
+}
+
+void c_keystore::insert(t_filestore type, const t_hip & hip, uint64_t offset) {
+	size_t slot = find_slot(type, hip);
+	if (slot_ptr(slot)[17] == 0) {
+		if ((m_used + 1) * 2 > m_slot_count) { // at most half used: lookups stay short, and there is always an empty slot
+			grow_index();
+			slot = find_slot(type, hip);
+		}
+		++m_used;
+	}
+	else m_live_size -= record_size( get_u64(slot_ptr(slot) + 24) ); // that record is old now
+	set_slot(slot, type, hip, offset);
+	m_live_size += record_size(offset);
+}
+
+uint64_t c_keystore::record_size(uint64_t offset) const {
+	if ((offset > m_data_size) || (m_data_size - offset < record_header_size)) return 0; // damaged index, it is found in get()
+	return record_header_size + get_u32(m_data_map + offset + 20);
+}
+
+void c_keystore::compact_if_needed() {
+	const bool mostly_old = (m_data_size >= compact_min_size) && (m_live_size * 2 < m_data_size);
+	const bool too_many = (m_max_keys != 0) && (m_used > m_max_keys + m_max_keys / 8); // a bit more: not compacted at each put
+	if (mostly_old || too_many) compact();
+}
+
+void c_keystore::compact() {
+	std::vector<uint64_t> offsets; // of the newest record of each key
+	offsets.reserve(m_used);
+	for (size_t slot=0; slot<m_slot_count; ++slot) {
+		const char * ptr = slot_ptr(slot);
+		if (ptr[17] != 0) offsets.push_back( get_u64(ptr + 24) );
+	}
+	std::sort(offsets.begin(), offsets.end()); // order of put()
+	size_t first = 0;
+	if ((m_max_keys != 0) && (offsets.size() > m_max_keys)) first = offsets.size() - m_max_keys; // the oldest ones are dropped
+
+	const fs::path new_path( m_path.native() + ".new" );
+	const int fd = open(new_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0) throw_errno("Can not create keystore " + new_path.native());
+	uint64_t new_size = 0;
+	auto write_all = [fd, &new_size](const char * data, size_t size) {
+		const bool ok = (pwrite(fd, data, size, new_size) == static_cast<ssize_t>(size));
+		new_size += size;
+		return ok;
+	};
+	bool ok = write_all(data_magic, sizeof(data_magic));
+	for (size_t i=first; ok && (i<offsets.size()); ++i) {
+		try { record_data(offsets.at(i)); }
+		catch(const std::runtime_error &) { continue; } // damaged, it is not copied
+		ok = write_all(m_data_map + offsets.at(i), record_size(offsets.at(i)));
+	}
+	ok = ok && (fdatasync(fd) == 0);
+	const int write_errno = errno;
+	close(fd);
+	if (! ok) {
+		fs::remove(new_path);
+		errno = write_errno;
+		throw_errno("Can not write keystore " + new_path.native());
+	}
+
+	// the index is emptied first: if we crash after that, it is rebuilt from the data file that is there then
+	size_t slot_count = min_slots;
+	while ((offsets.size() - first + 1) * 2 > slot_count) slot_count *= 2;
+	create_index(slot_count, m_seed);
+	const bool renamed = (std::rename(new_path.c_str(), m_path.c_str()) == 0);
+	const int rename_errno = errno;
+	if (renamed) {
+		if (m_data_map != nullptr) munmap(m_data_map, m_data_map_size);
+		m_data_map = nullptr;
+		close(m_data_fd);
+		m_data_fd = -1;
+		open_data();
+		m_unsynced = false;
+	}
+	index_records( sizeof(data_magic) );
+	if (! renamed) {
+		errno = rename_errno;
+		throw_errno("Can not replace keystore " + m_path.native());
+	}
+	_info("Keystore " << m_path << " compacted: " << m_used << " keys, " << m_data_size << " bytes");
+}
+
+size_t c_keystore::find_slot(t_filestore type, const t_hip & hip) const {
+	char key[17];
+	std::memcpy(key, hip.data(), hip.size());
+	key[16] = static_cast<char>(type);
+	size_t slot = multipath::hash_bytes(key, sizeof(key), m_seed) & (m_slot_count - 1);
+	for (;;) { // linear probing
+		const char * ptr = slot_ptr(slot);
+		if (ptr[17] == 0) return slot;
+		if ((ptr[16] == key[16]) && (std::memcmp(ptr, key, hip.size()) == 0)) return slot;
+		slot = (slot + 1) & (m_slot_count - 1);
+	}
+}
+
+const char * c_keystore::slot_ptr(size_t slot) const { return m_index_map + index_header_size + slot * slot_size; }
+
+void c_keystore::set_slot(size_t slot, t_filestore type, const t_hip & hip, uint64_t offset) {
+	// [format] slot: HIP(16) type(1) used(1) reserved(6) offset(8)
+	char * ptr = m_index_map + index_header_size + slot * slot_size;
+	std::memcpy(ptr, hip.data(), hip.size());
+	ptr[16] = static_cast<char>(type);
+	ptr[17] = 1;
+	put_u64(ptr + 24, offset);
+}
+
+boost::string_ref c_keystore::record_data(uint64_t offset) const {
+	if ((offset > m_data_size) || (m_data_size - offset < record_header_size)) {
+		throw std::runtime_error("Keystore index points outside of data, in " + m_index_path.native());
+	}
+	const char * header = m_data_map + offset;
+	const uint32_t size = get_u32(header + 20);
+	if (m_data_size - offset - record_header_size < size) throw std::runtime_error("Damaged record in keystore " + m_path.native());
+	const char * data = header + record_header_size;
+	if (get_u32(header + 24) != record_crc(header, data, size)) throw std::runtime_error("Damaged record in keystore " + m_path.native());
+	return boost::string_ref(data, size);
+}
+
+void c_keystore::open_index() {
+	m_index_fd = open(m_index_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (m_index_fd < 0) throw_errno("Can not open keystore index " + m_index_path.native());
+	struct stat st;
+	if (fstat(m_index_fd, &st) != 0) throw_errno("Can not stat keystore index " + m_index_path.native());
+	if (static_cast<size_t>(st.st_size) >= index_header_size) {
+		m_index_map_size = st.st_size;
+		map_index();
+		// [format] index header: magic(8) seed(8) slots(8) indexed_size(8) used(8), then zeros up to index_header_size
+		const uint64_t slot_count = get_u64(m_index_map + 16);
+		const uint64_t indexed_size = get_u64(m_index_map + 24);
+		const bool ok = (std::memcmp(m_index_map, index_magic, sizeof(index_magic)) == 0)
+			&& (slot_count >= min_slots) && ((slot_count & (slot_count - 1)) == 0)
+			&& (index_header_size + slot_count * slot_size == m_index_map_size)
+			&& (indexed_size >= sizeof(data_magic)) && (indexed_size <= m_data_size);
+		if (ok) {
+			m_seed = get_u64(m_index_map + 8);
+			m_slot_count = slot_count;
+			m_used = get_u64(m_index_map + 32);
+			m_live_size = 0;
+			for (size_t slot=0; slot<m_slot_count; ++slot) {
+				if (slot_ptr(slot)[17] != 0) m_live_size += record_size( get_u64(slot_ptr(slot) + 24) );
+			}
+			index_records(indexed_size); // appended after the index was saved, if any
+			return;
+		}
+		_warn("Keystore index " << m_index_path << " does not match the data, rebuilding it");
+	}
+	std::random_device rd;
+	create_index( min_slots , (uint64_t(rd()) << 32) | rd() );
+	index_records( sizeof(data_magic) );
+}
+
+void c_keystore::create_index(size_t slot_count, uint64_t seed) {
+	if (m_index_map != nullptr) munmap(m_index_map, m_index_map_size);
+	m_index_map = nullptr;
+	m_index_map_size = index_header_size + slot_count * slot_size;
+	if ((ftruncate(m_index_fd, 0) != 0) || (ftruncate(m_index_fd, m_index_map_size) != 0)) { // all zeros: empty slots
+		throw_errno("Can not resize keystore index " + m_index_path.native());
+	}
+	map_index();
+	std::memcpy(m_index_map, index_magic, sizeof(index_magic));
+	put_u64(m_index_map + 8, seed);
+	put_u64(m_index_map + 16, slot_count);
+	m_seed = seed;
+	m_slot_count = slot_count;
+	m_used = 0;
+	m_live_size = 0;
+	set_indexed_size( sizeof(data_magic) ); // nothing yet; if we crash while building it, it will be built again
+}
+
+void c_keystore::index_records(uint64_t from) {
+	uint64_t pos = from;
+	while (pos < m_data_size) {
+		const char * header = m_data_map + pos;
+		try { record_data(pos); }
+		catch(const std::runtime_error &) { break; } // not fully written
+		t_hip hip;
+		std::memcpy(hip.data(), header, hip.size());
+		insert( static_cast<t_filestore>(header[16]) , hip , pos );
+		pos += record_header_size + get_u32(header + 20);
+	}
+	if (pos < m_data_size) {
+		_warn("Keystore " << m_path << " has damaged data at end (" << (m_data_size - pos) << " bytes), cutting it off");
+		if (ftruncate(m_data_fd, pos) != 0) throw_errno("Can not truncate keystore " + m_path.native());
+		m_data_size = pos;
+		map_data();
+	}
+	set_indexed_size(pos);
+}
+
+void c_keystore::grow_index() {
+	struct t_entry { t_hip m_hip; t_filestore m_type; uint64_t m_offset; };
+	std::vector<t_entry> entries;
+	entries.reserve(m_used);
+	for (size_t slot=0; slot<m_slot_count; ++slot) {
+		const char * ptr = slot_ptr(slot);
+		if (ptr[17] == 0) continue;
+		t_entry entry;
+		std::memcpy(entry.m_hip.data(), ptr, entry.m_hip.size());
+		entry.m_type = static_cast<t_filestore>(ptr[16]);
+		entry.m_offset = get_u64(ptr + 24);
+		entries.push_back(entry);
+	}
+	const uint64_t indexed_size = get_u64(m_index_map + 24);
+	const uint64_t live_size = m_live_size;
+	create_index( m_slot_count * 2 , m_seed );
+	for (const auto & entry : entries) set_slot( find_slot(entry.m_type, entry.m_hip) , entry.m_type , entry.m_hip , entry.m_offset );
+	m_used = entries.size();
+	m_live_size = live_size;
+	set_indexed_size(indexed_size);
+	_dbg1("Keystore index grown to " << m_slot_count << " slots");
+}
+
+void c_keystore::map_data() {
+	if (m_data_map != nullptr) munmap(m_data_map, m_data_map_size);
+	m_data_map = nullptr;
+	void * map = mmap(nullptr, m_data_size, PROT_READ, MAP_SHARED, m_data_fd, 0);
+	if (map == MAP_FAILED) throw_errno("Can not mmap keystore " + m_path.native());
+	m_data_map = static_cast<char*>(map);
+	m_data_map_size = m_data_size;
+}
+
+void c_keystore::map_index() {
+	void * map = mmap(nullptr, m_index_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_index_fd, 0);
+	if (map == MAP_FAILED) throw_errno("Can not mmap keystore index " + m_index_path.native());
+	m_index_map = static_cast<char*>(map);
+}
+
+void c_keystore::set_indexed_size(uint64_t size) {
+	put_u64(m_index_map + 24, size);
+	put_u64(m_index_map + 32, m_used);
+}
+
+} // namespace keystore
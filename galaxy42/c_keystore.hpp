@@ -0,0 +1,105 @@
+#pragma once
+#ifndef include_c_keystore_hpp
+#define include_c_keystore_hpp
+
+#include "libs1.hpp"
+#include "filestorage.hpp"
+
+#include <boost/utility/string_ref.hpp>
+
+#include <array>
+
+/**
+ * @brief Keys of many nodes in one file, by HIP: e.g. thousands of pubkeys of nodes that we know.
+ * Each put() appends a record to the data file (a newer one for the same HIP and type wins). When most of the file is
+ * old records, or there are more keys than the limit (set_max_keys), the live ones are copied into a new file (compaction).
+ * Next to it is the index file: a hash table (open addressing) of HIP and type -> offset of the record,
+ * so a lookup is O(1), and opening needs no directory scans. Both files are mmap'ed: public data is read
+ * without copying, secret data is copied only into mlocked memory.
+ * The index can always be rebuilt from the data file: it is, when it is missing or does not match,
+ * and records appended after it was last updated (e.g. crash) are indexed when the keystore is opened.
+ * A record that was not fully written (crash) is cut off.
+ */
+namespace keystore {
+
+typedef std::array<unsigned char, 16> t_hip; ///< e.g. c_haship_addr (that is derived from it)
+
+class c_keystore final {
+	public:
+		static constexpr size_t record_header_size = 28; ///< HIP(16) type(1) reserved(3) size(4) crc32(4)
+		static constexpr size_t index_header_size = 64;
+		static constexpr size_t slot_size = 32; ///< HIP(16) type(1) used(1) reserved(6) offset(8)
+		static constexpr size_t min_slots = 1024;
+		static constexpr uint64_t compact_min_size = 1024*1024; ///< smaller data file is not compacted (old records in it are cheap)
+
+		enum class e_sync {
+			each_put, ///< put() returns when the record is on disk (fdatasync)
+			by_caller, ///< put() only writes to the file (page cache); sync() when a batch of them is done
+		};
+
+		///! opens or creates it (index is path + ".idx"); throws on errors
+		explicit c_keystore(const fs::path & path, e_sync sync_mode = e_sync::each_put);
+		~c_keystore();
+		c_keystore(const c_keystore &) = delete;
+		c_keystore & operator=(const c_keystore &) = delete;
+
+		static fs::path default_path(); ///< in our dir of public files, in $HOME
+
+		void put(t_filestore type, const t_hip & hip, const std::string & data); ///< appends it (and syncs to disk, see e_sync)
+		void put_mlocked(t_filestore type, const t_hip & hip, const sodiumpp::locked_string & data);
+		void sync(); ///< records from put() are on disk when this returns (with e_sync::by_caller; also done in destructor)
+
+		///! at most that many keys (0 - no limit): above it, on compaction the oldest ones are dropped. Use it only when the
+		///! keystore is a cache (e.g. pubkeys of other nodes, that can be found again), not for own keys
+		void set_max_keys(size_t max_keys);
+		void compact(); ///< copy only the newest record of each key (and at most max keys) into a new data file
+
+		bool has(t_filestore type, const t_hip & hip) const;
+		/// the data in mmap'ed file (no copy), valid until next put(). Throws expected_not_found, or runtime_error if it is damaged
+		boost::string_ref get(t_filestore type, const t_hip & hip) const;
+		sodiumpp::locked_string get_mlocked(t_filestore type, const t_hip & hip) const; ///< e.g. secret key
+
+		size_t size() const; ///< count of keys (the newest record of each HIP and type)
+		uint64_t get_data_size() const; ///< of the data file, with old records
+		const fs::path & get_path() const;
+
+	private:
+		void append(t_filestore type, const t_hip & hip, const char * data, size_t size);
+		void insert(t_filestore type, const t_hip & hip, uint64_t offset); ///< into index (grows it if needed)
+		void compact_if_needed(); ///< after append
+		uint64_t record_size(uint64_t offset) const; ///< with header
+		size_t find_slot(t_filestore type, const t_hip & hip) const; ///< with this key, or the empty one where it would be
+		const char * slot_ptr(size_t slot) const;
+		void set_slot(size_t slot, t_filestore type, const t_hip & hip, uint64_t offset);
+		boost::string_ref record_data(uint64_t offset) const; ///< checks the record (throws if damaged)
+
+		void open_data(); ///< opens (or creates) m_path and maps it
+		void open_index(); ///< opens, or rebuilds if it is missing or does not match data
+		void create_index(size_t slot_count, uint64_t seed); ///< empty index, in place of the old one
+		void index_records(uint64_t from); ///< records from this offset up to end of data (cuts off a damaged end)
+		void grow_index(); ///< twice more slots, with all keys
+
+		void map_data(); ///< (re)maps the data file, after it grew
+		void map_index();
+		void set_indexed_size(uint64_t size);
+		void close_all();
+
+		const fs::path m_path, m_index_path;
+		const e_sync m_sync_mode;
+		bool m_unsynced; ///< some put() was not synced yet
+		size_t m_max_keys; ///< 0 - no limit
+		uint64_t m_live_size; ///< of records that are in the index (the rest of data file is old records)
+		int m_data_fd, m_index_fd;
+		char * m_data_map; ///< whole data file (read only)
+		size_t m_data_map_size;
+		uint64_t m_data_size;
+		char * m_index_map; ///< whole index file (read and write)
+		size_t m_index_map_size;
+		size_t m_slot_count; ///< power of 2
+		size_t m_used; ///< slots used
+		uint64_t m_seed; ///< of the hash (random, for each index)
+};
+
+} // namespace keystore
+
+#endif
@@ -0,0 +1,148 @@
+#include "c_latency.hpp"
+
+#include <iomanip>
+
+namespace latency {
+
+// ------------------------------------------------------------------
+
+constexpr int c_histogram::sub_bucket_bits;
+constexpr size_t c_histogram::sub_bucket_count;
+constexpr size_t c_histogram::bucket_count;
+
+c_histogram::c_histogram() { reset(); }
+
+void c_histogram::record(uint64_t value) {
+	const auto relaxed = std::memory_order_relaxed;
+	m_counts[ index_of(value) ].fetch_add(1, relaxed);
+	m_count.fetch_add(1, relaxed);
+	m_sum.fetch_add(value, relaxed);
+	if (value > m_max.load(relaxed)) m_max.store(value, relaxed); // one writer
+}
+
+void c_histogram::reset() {
+	for (auto & count : m_counts) count.store(0, std::memory_order_relaxed);
+	m_count.store(0, std::memory_order_relaxed);
+	m_sum.store(0, std::memory_order_relaxed);
+	m_max.store(0, std::memory_order_relaxed);
+}
+
+uint64_t c_histogram::get_count() const { return m_count.load(std::memory_order_relaxed); }
+
+uint64_t c_histogram::get_max() const { return m_max.load(std::memory_order_relaxed); }
+
+double c_histogram::get_mean() const {
+	const uint64_t count = get_count();
+	if (count == 0) return 0;
+	return static_cast<double>( m_sum.load(std::memory_order_relaxed) ) / count;
+}
+
+uint64_t c_histogram::get_percentile(double percentile) const {
+	uint64_t total = 0; // not get_count(): buckets can be a bit ahead of it (or behind) while recording
+	for (const auto & count : m_counts) total += count.load(std::memory_order_relaxed);
+	if (total == 0) return 0;
+	const uint64_t wanted = std::max<uint64_t>( 1 , static_cast<uint64_t>( percentile / 100 * total + 0.5 ) );
+	uint64_t seen = 0;
+	for (size_t i=0; i<bucket_count; ++i) {
+		seen += m_counts[i].load(std::memory_order_relaxed);
+		if (seen >= wanted) return std::min( highest_of(i) , get_max() );
+	}
+	return get_max();
+}
+
+size_t c_histogram::index_of(uint64_t value) {
+	if (value < sub_bucket_count) return value;
+	int msb = 63;
+	while (! (value >> msb)) --msb;
+	const int shift = msb - sub_bucket_bits; // value >> shift is sub_bucket_count .. 2*sub_bucket_count-1
+	return (shift + 1) * sub_bucket_count + ((value >> shift) - sub_bucket_count);
+}
+
+uint64_t c_histogram::highest_of(size_t index) {
+	if (index < sub_bucket_count) return index;
+	const int shift = index / sub_bucket_count - 1;
+	const uint64_t lowest = uint64_t( index % sub_bucket_count + sub_bucket_count ) << shift;
+	return lowest + ((uint64_t(1) << shift) - 1);
+}
+
+// ------------------------------------------------------------------
+
+const char * stage_name(e_stage stage) {
+	switch (stage) {
+		case e_stage::wakeup: return "wakeup";
+		case e_stage::tun_read: return "tun_read";
+		case e_stage::tun_box: return "tun_box";
+		case e_stage::udp_receive: return "udp_receive";
+		case e_stage::udp_auth: return "udp_auth";
+		case e_stage::udp_parse: return "udp_parse";
+		case e_stage::udp_unbox: return "udp_unbox";
+		case e_stage::tun_write: return "tun_write";
+		case e_stage::route: return "route";
+		case e_stage::serialize: return "serialize";
+		case e_stage::enqueue: return "enqueue";
+		case e_stage::udp_send: return "udp_send";
+		case e_stage::END: break;
+	}
+	return "?";
+}
+
+// ------------------------------------------------------------------
+
+c_stages::c_stages(unsigned int sample_every) : m_sample_every(sample_every), m_sample_counter(0) { }
+
+void c_stages::set_sample_every(unsigned int sample_every) { m_sample_every = sample_every;  m_sample_counter = 0; }
+
+bool c_stages::sample() {
+	if (m_sample_every == 0) return false;
+	if (++m_sample_counter < m_sample_every) return false;
+	m_sample_counter = 0;
+	return true;
+}
+
+void c_stages::record(e_stage stage, t_clock::duration duration) {
+	const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+	m_hist.at( static_cast<size_t>(stage) ).record( ns > 0 ? ns : 0 );
+}
+
+void c_stages::reset() { for (auto & hist : m_hist) hist.reset(); }
+
+void c_stages::print(std::ostream & ostr) const {
+	ostr << "Latency of stages [us], every " << m_sample_every << ". event is measured:" << std::endl;
+	ostr << std::setw(12) << "stage" << std::setw(10) << "count" << std::setw(10) << "mean" << std::setw(10) << "p50"
+		<< std::setw(10) << "p90" << std::setw(10) << "p99" << std::setw(10) << "p99.9" << std::setw(10) << "max" << std::endl;
+	ostr << std::fixed << std::setprecision(1);
+	for (size_t i=0; i<m_hist.size(); ++i) {
+		const auto & hist = m_hist.at(i);
+		ostr << std::setw(12) << stage_name( static_cast<e_stage>(i) ) << std::setw(10) << hist.get_count()
+			<< std::setw(10) << hist.get_mean() / 1000;
+		for (double percentile : { 50.0 , 90.0 , 99.0 , 99.9 }) ostr << std::setw(10) << hist.get_percentile(percentile) / 1000.;
+		ostr << std::setw(10) << hist.get_max() / 1000. << std::endl;
+	}
+	ostr << std::defaultfloat;
+}
+
+const c_histogram & c_stages::get(e_stage stage) const { return m_hist.at( static_cast<size_t>(stage) ); }
+
+// ------------------------------------------------------------------
+
+c_trace::c_trace(c_stages & stages) : m_stages(stages), m_on(false) { }
+
+void c_trace::start(c_stages::t_clock::time_point since) {
+	m_on = m_stages.sample();
+	m_last = since;
+}
+
+void c_trace::mark(e_stage stage) {
+	if (! m_on) return;
+	const auto now = c_stages::t_clock::now();
+	m_stages.record(stage, now - m_last);
+	m_last = now;
+}
+
+void c_trace::mark_idle() {
+	if (m_on) m_last = c_stages::t_clock::now();
+}
+
+void c_trace::stop() { m_on = false; }
+
+} // namespace latency
@@ -0,0 +1,100 @@
+#pragma once
+#ifndef include_c_latency_hpp
+#define include_c_latency_hpp
+
+#include "libs1.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+
+/**
+ * @brief Latency of each stage on the packet path (TUN->UDP and UDP->TUN), in log-linear histograms (as HdrHistogram).
+ * Only every Nth packet is measured (sampled), so it is cheap enough to be always on. The event loop thread records
+ * into histograms with relaxed atomics (no locks), and any other thread (RPC, or the loop on SIGUSR1) can print them.
+ */
+namespace latency {
+
+/// log-linear: values below sub_bucket_count are exact, then each power of two is split into sub_bucket_count buckets
+class c_histogram final {
+	public:
+		static constexpr int sub_bucket_bits = 4; ///< 16 buckets per power of two: value is known with error below 1/16
+		static constexpr size_t sub_bucket_count = size_t(1) << sub_bucket_bits;
+		static constexpr size_t bucket_count = (64 - sub_bucket_bits + 1) * sub_bucket_count; ///< for any uint64_t
+
+		c_histogram();
+
+		void record(uint64_t value); ///< from one thread (but can be read by others at the same time)
+		void reset();
+
+		uint64_t get_count() const;
+		uint64_t get_max() const;
+		double get_mean() const;
+		uint64_t get_percentile(double percentile) const; ///< 0..100; the highest value of bucket where it is (0 if empty)
+
+		static size_t index_of(uint64_t value);
+		static uint64_t highest_of(size_t index); ///< the highest value that goes to this bucket
+
+	private:
+		std::array<std::atomic<uint64_t>, bucket_count> m_counts;
+		std::atomic<uint64_t> m_count, m_sum, m_max;
+};
+
+enum class e_stage : unsigned char {
+	wakeup, ///< the loop before select() (timers, pings, debug output) - not the waiting in select()
+	tun_read, ///< read() from TUN
+	tun_box, ///< our packet: tunnel lookup, compression, box_ab (end2end encryption)
+	udp_receive, ///< receive from UDP socket
+	udp_auth, ///< MAC of CT-P2P (the hop)
+	udp_parse, ///< the rest of tunneled data header
+	udp_unbox, ///< data for us: unbox_ab (end2end), decompression
+	tun_write, ///< write to TUN
+	route, ///< next hop: peer, proactive route, or route search
+	serialize, ///< frame for the next hop (header, MAC)
+	enqueue, ///< into send queue of the flow (traffic shaping)
+	udp_send, ///< sending queued frames to UDP socket (measured on its own, not as part of packet path)
+	END
+};
+
+const char * stage_name(e_stage stage);
+
+/// histograms of all stages (in nanoseconds), and what is sampled
+class c_stages final {
+	public:
+		typedef std::chrono::steady_clock t_clock;
+
+		explicit c_stages(unsigned int sample_every); ///< 0 - nothing is measured
+
+		void set_sample_every(unsigned int sample_every); ///< from the thread that records
+		bool sample(); ///< should the next event be measured (every Nth is)
+		void record(e_stage stage, t_clock::duration duration);
+		void reset(); ///< from any thread, also while recording (some samples may be lost then)
+
+		void print(std::ostream & ostr) const; ///< table: count, mean, p50, p90, p99, p99.9, max for each stage [us]
+		const c_histogram & get(e_stage stage) const;
+
+	private:
+		std::array<c_histogram, static_cast<size_t>(e_stage::END)> m_hist;
+		std::atomic<unsigned int> m_sample_every; ///< read also by print(), from other thread
+		unsigned int m_sample_counter;
+};
+
+/// one event (e.g. packet) on its path: each mark() records the time since the previous mark (or start)
+class c_trace final {
+	public:
+		explicit c_trace(c_stages & stages);
+
+		void start(c_stages::t_clock::time_point since); ///< if sampled; e.g. since the previous event was done
+		void mark(e_stage stage); ///< the stage is done now (nothing if not sampled)
+		void mark_idle(); ///< time since the previous mark is not counted (e.g. we waited for events in select)
+		void stop();
+
+	private:
+		c_stages & m_stages;
+		bool m_on;
+		c_stages::t_clock::time_point m_last;
+};
+
+} // namespace latency
+
+#endif
@@ -0,0 +1,109 @@
+#include "c_link_quality.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace link_quality {
+
+constexpr std::chrono::milliseconds c_link_quality::ping_interval;
+constexpr std::chrono::milliseconds c_link_quality::ping_timeout;
+constexpr std::chrono::milliseconds c_link_quality::rtt_reference;
+constexpr size_t c_link_quality::max_outstanding;
+constexpr int c_link_quality::hop_cost;
+constexpr int c_link_quality::max_cost;
+constexpr double c_link_quality::dead_loss;
+constexpr int c_link_quality::dead_lost_in_row;
+
+namespace {
+
+constexpr double rtt_alpha = 1.0 / 8; // as in RFC 6298
+constexpr double jitter_beta = 1.0 / 4;
+constexpr double loss_alpha = 1.0 / 16; // loss is sampled once per ping, so it needs a longer memory
+
+double to_us(std::chrono::microseconds t) { return static_cast<double>(t.count()); }
+
+} // namespace
+
+c_link_quality::c_link_quality()
+	: m_next_seq( std::random_device()() ), m_last_ping(), m_measured(false),
+	m_rtt_us( to_us(rtt_reference) ), m_jitter_us(0), m_loss(0),
+	m_lost_in_row(0)
+{ }
+
+uint32_t c_link_quality::ping_to_send(t_clock::time_point now) {
+	for (auto it = m_outstanding.begin(); it != m_outstanding.end(); ) {
+		if (now - it->second >= ping_timeout) { add_loss_sample(1);  it = m_outstanding.erase(it); }
+		else ++it;
+	}
+	if ((m_last_ping != t_clock::time_point()) && (now - m_last_ping < ping_interval)) return 0;
+
+	if (m_outstanding.size() >= max_outstanding) { // time is going backwards? or too many pings; forget the oldest one
+		auto oldest = std::min_element( m_outstanding.begin() , m_outstanding.end() ,
+			[](const auto & a, const auto & b) { return a.second < b.second; } );
+		m_outstanding.erase(oldest);
+		add_loss_sample(1);
+	}
+	if (m_next_seq == 0) ++m_next_seq; // 0 means "nothing to send"
+	const uint32_t seq = m_next_seq++;
+	m_outstanding[seq] = now;
+	m_last_ping = now;
+	return seq;
+}
+
+bool c_link_quality::pong_received(uint32_t seq, t_clock::time_point now) {
+	auto found = m_outstanding.find(seq);
+	if (found == m_outstanding.end()) return false;
+	const double rtt_us = std::max(0.0, to_us( std::chrono::duration_cast<std::chrono::microseconds>(now - found->second) ));
+	m_outstanding.erase(found);
+
+	if (! m_measured) { // first measurement
+		m_rtt_us = rtt_us;
+		m_jitter_us = rtt_us / 2;
+		m_measured = true;
+	} else {
+		m_jitter_us = (1 - jitter_beta) * m_jitter_us + jitter_beta * std::abs(m_rtt_us - rtt_us);
+		m_rtt_us = (1 - rtt_alpha) * m_rtt_us + rtt_alpha * rtt_us;
+	}
+	add_loss_sample(0);
+	return true;
+}
+
+void c_link_quality::add_loss_sample(double lost) {
+	m_loss += loss_alpha * (lost - m_loss);
+	m_lost_in_row = (lost > 0) ? (m_lost_in_row + 1) : 0;
+}
+
+bool c_link_quality::is_measured() const { return m_measured; }
+
+std::chrono::microseconds c_link_quality::get_rtt() const { return std::chrono::microseconds( std::llround(m_rtt_us) ); }
+
+std::chrono::microseconds c_link_quality::get_jitter() const { return std::chrono::microseconds( std::llround(m_jitter_us) ); }
+
+double c_link_quality::get_loss() const { return m_loss; }
+
+int c_link_quality::get_cost() const {
+	const double delay = (m_rtt_us + 4 * m_jitter_us) / to_us(rtt_reference); // in units of rtt_reference
+	const double cost = hop_cost * (1 + delay) + m_loss * max_cost; // 50 ms is like one more hop, 10% lost is like one more hop
+	return static_cast<int>( std::min<double>( std::lround(cost) , max_cost ) );
+}
+
+bool c_link_quality::is_dead() const { return (m_loss >= dead_loss) || (m_lost_in_row >= dead_lost_in_row); }
+
+double c_link_quality::get_weight() const {
+	const double reference = to_us(rtt_reference);
+	return (1 - m_loss) * reference / (reference + m_rtt_us + 4 * m_jitter_us);
+}
+
+void c_link_quality::print(std::ostream & ostr) const {
+	ostr << "link{";
+	if (m_measured) {
+		ostr << "rtt=" << m_rtt_us / 1000 << "ms jitter=" << m_jitter_us / 1000 << "ms loss=" << m_loss * 100 << "%";
+	}
+	else ostr << "not measured";
+	ostr << " cost=" << get_cost() << (is_dead() ? " DEAD" : "") << "}";
+}
+
+std::ostream & operator<<(std::ostream & ostr, const c_link_quality & obj) { obj.print(ostr); return ostr; }
+
+} // namespace link_quality
@@ -0,0 +1,67 @@
+#pragma once
+#ifndef include_c_link_quality_hpp
+#define include_c_link_quality_hpp
+
+#include "libs1.hpp"
+
+#include <chrono>
+#include <map>
+
+/**
+ * @brief Quality of the link to a direct peer: RTT, jitter and loss, measured with our pings (public ping request/reply).
+ * RTT and its variation (jitter) are smoothed as TCP does (RFC 6298), loss is the moving average of lost pings.
+ * From them come the cost of this hop for routing (a route cost is the sum over hops), and the weight of this peer
+ * as next hop for multipath - so a slow, jittery or lossy peer gets less traffic, and none at all when it is dead.
+ */
+namespace link_quality {
+
+class c_link_quality final {
+	public:
+		typedef std::chrono::steady_clock t_clock;
+
+		static constexpr std::chrono::milliseconds ping_interval{ 1000 };
+		static constexpr std::chrono::milliseconds ping_timeout{ 3000 }; ///< no reply after that = the ping is lost
+		static constexpr std::chrono::milliseconds rtt_reference{ 50 }; ///< assumed RTT before we measure, and the scale of cost
+		static constexpr size_t max_outstanding = 8; ///< pings that we wait for; the older ones are counted as lost
+
+		static constexpr int hop_cost = 10; ///< cost of one hop, when its RTT is 0 and nothing is lost
+		static constexpr int max_cost = 100; ///< cost of the worst link (the cost is sent in one byte, and summed over hops)
+		static constexpr double dead_loss = 0.9; ///< so much lost = the link is dead (not just bad), see is_dead()
+		static constexpr int dead_lost_in_row = 5; ///< so many pings lost one after another (e.g. never answered) = dead too
+
+		c_link_quality();
+
+		/// sequence number of ping that should be sent now (it is then treated as sent), or 0 if nothing is to be sent now
+		uint32_t ping_to_send(t_clock::time_point now);
+		bool pong_received(uint32_t seq, t_clock::time_point now); ///< reply to our ping; false if it is not ours (or late, or again)
+
+		bool is_measured() const; ///< did we get any reply yet
+		std::chrono::microseconds get_rtt() const; ///< smoothed RTT (or rtt_reference if not measured)
+		std::chrono::microseconds get_jitter() const; ///< smoothed variation of RTT
+		double get_loss() const; ///< part of pings lost recently, 0..1
+
+		int get_cost() const; ///< hop_cost .. max_cost, grows with RTT, jitter and loss
+		/// routes must not go via this link (get_cost() is capped, so it is never unreachable by itself)
+		bool is_dead() const;
+		double get_weight() const; ///< for multipath, 0..1: 0 if all is lost
+
+		void print(std::ostream & ostr) const;
+
+	private:
+		void add_loss_sample(double lost); ///< 1 if ping was lost, 0 if it was answered
+
+		uint32_t m_next_seq; ///< starts random, so it is hard to fake replies to our pings (they are not authenticated)
+		std::map<uint32_t, t_clock::time_point> m_outstanding; ///< pings that we wait for: when they were sent
+		t_clock::time_point m_last_ping;
+		bool m_measured;
+		double m_rtt_us; ///< SRTT
+		double m_jitter_us; ///< RTTVAR
+		double m_loss;
+		int m_lost_in_row; ///< pings lost since the last reply
+};
+
+std::ostream & operator<<(std::ostream & ostr, const c_link_quality & obj);
+
+} // namespace link_quality
+
+#endif
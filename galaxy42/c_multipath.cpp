@@ -0,0 +1,44 @@
+#include "c_multipath.hpp"
+
+#include <cstring>
+
+namespace multipath {
+
+namespace {
+
+uint64_t mix64(uint64_t x) { ///< splitmix64 finalizer
+	x ^= x >> 30;  x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;  x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+} // namespace
+
+uint64_t hash_bytes(const void * data, size_t size, uint64_t seed) {
+	const unsigned char * p = reinterpret_cast<const unsigned char*>(data);
+	uint64_t h = 0xcbf29ce484222325ULL ^ mix64(seed); // FNV-1a
+	for (size_t i=0; i<size; ++i) { h ^= p[i];  h *= 0x100000001b3ULL; }
+	return mix64(h);
+}
+
+uint64_t flow_hash(const char * packet, size_t size, uint64_t seed) {
+	const unsigned char * ip = reinterpret_cast<const unsigned char*>(packet);
+	const size_t ipv6_header_size = 40;
+	if ((size < ipv6_header_size) || ((ip[0] >> 4) != 6)) throw std::invalid_argument("Flow hash: this is not an ipv6 packet");
+	unsigned char tuple[16 + 16 + 1 + 4] = { 0 };
+	std::memcpy(tuple, ip + 8, 32); // src, dst
+	const unsigned char next_header = ip[6];
+	tuple[32] = next_header;
+	const unsigned char ipproto_tcp = 6, ipproto_udp = 17;
+	if (((next_header == ipproto_tcp) || (next_header == ipproto_udp)) && (size >= ipv6_header_size + 4)) {
+		std::memcpy(tuple + 33, ip + ipv6_header_size, 4); // src port, dst port
+	}
+	return hash_bytes(tuple, sizeof(tuple), seed);
+}
+
+double unit_interval(uint64_t hash) {
+	return (static_cast<double>(hash >> 11) + 0.5) / static_cast<double>(uint64_t(1) << 53); // never 0 or 1
+}
+
+} // namespace multipath
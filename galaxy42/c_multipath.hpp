@@ -0,0 +1,56 @@
+#pragma once
+#ifndef include_c_multipath_hpp
+#define include_c_multipath_hpp
+
+#include "libs1.hpp"
+
+#include <cmath>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Spreading traffic to one destination over several next hops (like ECMP).
+ * Each flow (the inner 5-tuple) is hashed, and the next hop is picked by weighted rendezvous hashing:
+ * one flow always takes the same path (so its packets are not reordered), flows are spread by the weights,
+ * and when a path appears or is gone, only the flows of that path move.
+ */
+namespace multipath {
+
+uint64_t hash_bytes(const void * data, size_t size, uint64_t seed); ///< not cryptographic, but well mixed
+
+/**
+ * Hash of the flow of this ipv6 packet: src, dst, next header, and ports for TCP/UDP (if right after ipv6 header).
+ * Seed should be random for each node, so that all nodes do not split flows in the same way.
+ * Throws std::invalid_argument if this is not an ipv6 packet.
+ */
+uint64_t flow_hash(const char * packet, size_t size, uint64_t seed);
+
+/**
+ * The path (e.g. next hop address) for given flow, from paths with their weights (> 0; 0 is never picked).
+ * TAddr must have data() and size() of bytes, e.g. std::array or std::string.
+ * Throws std::invalid_argument if there is no path with weight > 0.
+ */
+template <typename TAddr>
+const TAddr & pick_path(uint64_t flow, const std::vector<std::pair<TAddr, double>> & paths);
+
+// ------------------------------------------------------------------
+
+double unit_interval(uint64_t hash); ///< hash as number in (0,1)
+
+template <typename TAddr>
+const TAddr & pick_path(uint64_t flow, const std::vector<std::pair<TAddr, double>> & paths) {
+	const TAddr * best = nullptr;
+	double best_score = 0;
+	for (const auto & path : paths) {
+		if (! (path.second > 0)) continue;
+		const double u = unit_interval( hash_bytes(path.first.data(), path.first.size() * sizeof(*path.first.data()), flow) );
+		const double score = - path.second / std::log(u); // weighted rendezvous: P(win) is proportional to weight
+		if ((best == nullptr) || (score > best_score)) { best = & path.first;  best_score = score; }
+	}
+	if (best == nullptr) throw std::invalid_argument("No usable path (with weight > 0)");
+	return *best;
+}
+
+} // namespace multipath
+
+#endif
@@ -0,0 +1,50 @@
+#include "c_netio.hpp"
+
+#include "cjdns-code/NetPlatform.h" // from cjdns
+
+#include <unistd.h>
+
+namespace netio {
+
+// ------------------------------------------------------------------
+
+c_tun_device::c_tun_device(int fd, const std::string & name) : m_fd(fd), m_name(name) { }
+
+int c_tun_device::get_fd() const { return m_fd; }
+
+ssize_t c_tun_device::read(char * buf, size_t buf_size) { return ::read(m_fd, buf, buf_size); }
+
+ssize_t c_tun_device::writev(const iovec * iov, int iov_count) { return ::writev(m_fd, iov, iov_count); }
+
+void c_tun_device::set_mtu(size_t mtu) { NetPlatform_setMTU(m_name.c_str(), mtu); }
+
+// ------------------------------------------------------------------
+
+c_udp_socket::c_udp_socket(int sock, bool gso) : m_sock(sock), m_sender(sock), m_receiver(sock, gso) {
+	m_sender.set_gso_enabled(gso);
+}
+
+int c_udp_socket::get_fd() const { return m_sock; }
+
+bool c_udp_socket::has_pending() const { return m_receiver.has_pending(); }
+
+ssize_t c_udp_socket::receive(char * buf, size_t buf_size, sockaddr * from, socklen_t * from_len) {
+	return m_receiver.receive(buf, buf_size, from, from_len);
+}
+
+void c_udp_socket::send(const sockaddr * to, socklen_t to_len, const char * data, size_t size) {
+	// sockaddr_in is accepted also by dual-stack ipv6 socket
+	sendto(m_sock, data, size, 0, to, to_len);
+}
+
+void c_udp_socket::send_batched(const sockaddr * to, socklen_t to_len, const char * data, size_t size) {
+	m_sender.add(to, to_len, data, size);
+}
+
+void c_udp_socket::flush() { m_sender.flush(); }
+
+bool c_udp_socket::is_gso_enabled() const { return m_sender.is_gso_enabled(); }
+
+bool c_udp_socket::is_gro_enabled() const { return m_receiver.is_gro_enabled(); }
+
+} // namespace netio
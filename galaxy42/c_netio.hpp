@@ -0,0 +1,82 @@
+#pragma once
+#ifndef include_c_netio_hpp
+#define include_c_netio_hpp
+
+#include "libs1.hpp"
+#include "c_udp_gso.hpp"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/**
+ * @brief Where tunserver gets and puts its data: the TUN (packets of our programs) and the UDP (peers).
+ * Normally the TUN device and the UDP socket, but it can be any other endpoint (e.g. virtual_net, many nodes in one process).
+ * Each endpoint gives an fd for select() in the event loop; it is readable when read/receive will not block.
+ */
+namespace netio {
+
+/// our side of the TUN: packets with PI header (and vnet header if the device was opened with offloads)
+class c_tun_endpoint {
+	public:
+		virtual ~c_tun_endpoint() = default;
+
+		virtual int get_fd() const = 0; ///< for select()
+		virtual ssize_t read(char * buf, size_t buf_size) = 0; ///< one packet (or super-packet). @return its size, or -1 with errno
+		virtual ssize_t writev(const iovec * iov, int iov_count) = 0; ///< one packet, from parts. @return size, or -1 with errno
+		virtual void set_mtu(size_t mtu) = 0; ///< biggest ipv6 packet that programs can send to us
+};
+
+/// the peering UDP socket: datagrams to/from peers (and any other nodes)
+class c_udp_endpoint {
+	public:
+		virtual ~c_udp_endpoint() = default;
+
+		virtual int get_fd() const = 0; ///< for select()
+		virtual bool has_pending() const = 0; ///< receive() will not block, even if the fd is not readable now
+		/// like recvfrom(): copies one datagram into buf. @return its size, or -1 with errno on error
+		virtual ssize_t receive(char * buf, size_t buf_size, sockaddr * from, socklen_t * from_len) = 0;
+		virtual void send(const sockaddr * to, socklen_t to_len, const char * data, size_t size) = 0; ///< at once
+		virtual void send_batched(const sockaddr * to, socklen_t to_len, const char * data, size_t size) = 0; ///< now or in flush()
+		virtual void flush() = 0; ///< send all from send_batched()
+};
+
+/// the TUN device (fd opened and configured by caller, not owned)
+class c_tun_device final : public c_tun_endpoint {
+	public:
+		c_tun_device(int fd, const std::string & name);
+
+		int get_fd() const override;
+		ssize_t read(char * buf, size_t buf_size) override;
+		ssize_t writev(const iovec * iov, int iov_count) override;
+		void set_mtu(size_t mtu) override; ///< of the interface, in the system
+
+	private:
+		const int m_fd;
+		const std::string m_name; ///< e.g. galaxy0
+};
+
+/// UDP socket (not owned), with UDP_SEGMENT/UDP_GRO where kernel supports it (see udp_gso)
+class c_udp_socket final : public c_udp_endpoint {
+	public:
+		c_udp_socket(int sock, bool gso);
+
+		int get_fd() const override;
+		bool has_pending() const override;
+		ssize_t receive(char * buf, size_t buf_size, sockaddr * from, socklen_t * from_len) override;
+		void send(const sockaddr * to, socklen_t to_len, const char * data, size_t size) override;
+		void send_batched(const sockaddr * to, socklen_t to_len, const char * data, size_t size) override;
+		void flush() override;
+
+		bool is_gso_enabled() const;
+		bool is_gro_enabled() const;
+
+	private:
+		const int m_sock;
+		udp_gso::c_batch_sender m_sender;
+		udp_gso::c_gro_receiver m_receiver;
+};
+
+} // namespace netio
+
+#endif
@@ -6,6 +6,10 @@
 
 #include "trivialserialize.hpp"
 
+static_assert( c_protocol::p2p_mac_size == antinet_crypto::c_crypto_p2p::mac_size , "CT-P2P MAC size must match the protocol");
+static_assert( c_protocol::tunneled_data_header_size == 2 + 2*g_ipv6_rfc::length_of_addr + 1 + crypto_box_NONCEBYTES ,
+	"size of tunneled data header must match the protocol");
+
 // ------------------------------------------------------------------
 
 t_peering_reference::t_peering_reference(const t_ipv46dot & peering_addr, int port, const t_ipv6dot & peering_hip)
@@ -28,7 +32,7 @@ c_peering::c_peering(const t_peering_reference & ref)
 	m_peering_addr(ref.peering_addr)
 	,m_haship_addr(ref.haship_addr)
 	,m_pubkey(nullptr) // unknown untill we e.g. download it; was: make_unique<c_haship_pubkey>(ref.pubkey))
-	,m_limit_points(100)
+	,m_crypto_p2p(nullptr) // created when we get his HI
 { }
 
 void c_peering::print(ostream & ostr) const {
@@ -36,6 +40,9 @@ void c_peering::print(ostream & ostr) const {
 	ostr << " peering-addr=" << m_peering_addr;
 	ostr << " hip=" << m_haship_addr;
 	ostr << " pub=" << to_debug(m_pubkey);
+	if (m_crypto_p2p) ostr << " p2p-auth{ok=" << m_crypto_p2p->get_count_ok() << " bad=" << m_crypto_p2p->get_count_bad() << "}";
+	else ostr << " p2p-auth{none}";
+	ostr << " " << m_link_quality;
 	ostr << "}";
 }
 
@@ -56,22 +63,23 @@ void c_peering::set_pubkey( std::unique_ptr<c_haship_pubkey> && pubkey ) {
 
 bool c_peering::is_pubkey() const { return m_pubkey != nullptr; }
 
-void c_peering::add_limit_points(long points) {
-	m_limit_points += points;
+void c_peering::set_crypto_p2p( unique_ptr<antinet_crypto::c_crypto_p2p> && crypto_p2p ) {
+	m_crypto_p2p = std::move(crypto_p2p);
 }
 
-void c_peering::decrement_limit_points() {
-	m_limit_points--;
-}
+antinet_crypto::c_crypto_p2p * c_peering::get_crypto_p2p() const { return m_crypto_p2p.get(); }
 
-long c_peering::get_limit_points() {
-	return m_limit_points;
-}
+link_quality::c_link_quality & c_peering::get_link_quality() { return m_link_quality; }
+const link_quality::c_link_quality & c_peering::get_link_quality() const { return m_link_quality; }
+
+hi_session::c_hi_session & c_peering::get_hi_session() { return m_hi_session; }
 
 // ------------------------------------------------------------------
 
 c_peering_udp::c_peering_udp(const t_peering_reference & ref)
-	: c_peering(ref)
+	: c_peering(ref), m_peering_sockaddr(), m_peering_sockaddr_len( m_peering_addr.get_sockaddr(m_peering_sockaddr) ),
+	m_path_mtu( pmtu::base_payload ,
+		pmtu::payload_for_link_mtu( pmtu::ethernet_mtu , m_peering_addr.get_ip_type() == c_ip46_addr::tag_ipv6 ) )
 { }
 
 
@@ -83,87 +91,164 @@ void c_peering_udp::send_data(const char * data, size_t data_size) {
 
 // TODO unify array types! string_as_bin , unique_ptr to new c-array, raw c-array in libproto etc
 
-void c_peering_udp::send_data_udp(const char * data, size_t data_size, int udp_socket,
+void c_peering_udp::send_data_udp(const char * data, size_t data_size, netio::c_udp_endpoint & udp,
 	c_haship_addr src_hip, c_haship_addr dst_hip, int ttl, antinet_crypto::t_crypto_nonce nonce_used) {
-	_info("Send to peer (tunneled data) data: " << string_as_dbg(data,data_size).get() ); // TODO .get
+	string protomsg = prepare_data_udp(data, data_size, src_hip, dst_hip, ttl, nonce_used);
+	if (protomsg.empty()) return;
+	this->send_data_RAW_udp(protomsg.c_str(), protomsg.size(), udp);
+}
 
-	trivialserialize::generator gen(data_size + 50);
-	gen.push_byte_u( c_protocol::current_version );
-	gen.push_byte_u( c_protocol::e_proto_cmd_tunneled_data );
-	gen.push_bytes_n( g_ipv6_rfc::length_of_addr , to_binary_string(src_hip) );
-	gen.push_bytes_n( g_ipv6_rfc::length_of_addr , to_binary_string(dst_hip) );
-	gen.push_byte_u( ttl );
-	gen.push_bytes_n( crypto_box_NONCEBYTES , nonce_used.get().to_binary() ); // TODO avoid conversion/copy
-	gen.push_varstring( std::string(data, data+data_size)  ); // TODO view_string
+std::string c_peering_udp::prepare_data_udp(const char * data, size_t data_size,
+	c_haship_addr src_hip, c_haship_addr dst_hip, int ttl, antinet_crypto::t_crypto_nonce nonce_used) {
+	_info("Send to peer (tunneled data) data: " << string_as_dbg(data,data_size).get() ); // TODO .get
+	if (! m_crypto_p2p) { // peer would drop it anyway
+		_info("No CT-P2P with this peer yet (no HI from him?) - can not send tunneled data now");
+		return "";
+	}
 
-/*
-	// TODONOW turn off this crypto (unless leave here for peer-to-peer auth only)
-	static unsigned char generated_shared_key[crypto_generichash_BYTES] = {43, 124, 179, 100, 186, 41, 101, 94, 81, 131, 17,
-					198, 11, 53, 71, 210, 232, 187, 135, 116, 6, 195, 175,
-					233, 194, 218, 13, 180, 63, 64, 3, 11};
+	const std::string nonce_bin = nonce_used.get().to_binary(); // TODO avoid conversion/copy
+	const uint32_t conn_id = m_conn_ids.get_remote(src_hip, dst_hip, nonce_bin); // did he give us ID for this
+	const bool compact = (conn_id != 0);
 
-	static unsigned char nonce[crypto_aead_chacha20poly1305_NPUBBYTES] = {148, 231, 240, 47, 172, 96, 246, 79};
-	static unsigned char additional_data[] = {1, 2, 3};
-	static unsigned long long additional_data_len = 3; // TODO
+	trivialserialize::generator gen(data_size + 50 + c_protocol::p2p_mac_size);
+	gen.push_byte_u( c_protocol::current_version );
+	if (compact) { // [protocol] ID instead of src,dst; the lowest bytes of nonce counter, he knows the rest
+		gen.push_byte_u( c_protocol::e_proto_cmd_tunneled_data_compact );
+		gen.push_bytes_n( c_protocol::conn_id_size , conn_ids::u32_to_bin(conn_id) );
+		gen.push_byte_u( ttl );
+		gen.push_bytes_n( conn_ids::seq_truncated_size ,
+			conn_ids::u32_to_bin( static_cast<uint32_t>( conn_ids::nonce_sequence(nonce_bin) & 0xFFFFFFFF ) ) );
+		assert( gen.get_buffer().size() == c_protocol::tunneled_data_compact_header_size );
+	} else {
+		gen.push_byte_u( c_protocol::e_proto_cmd_tunneled_data );
+		gen.push_bytes_n( g_ipv6_rfc::length_of_addr , to_binary_string(src_hip) );
+		gen.push_bytes_n( g_ipv6_rfc::length_of_addr , to_binary_string(dst_hip) );
+		gen.push_byte_u( ttl );
+		gen.push_bytes_n( crypto_box_NONCEBYTES , nonce_bin );
+		assert( gen.get_buffer().size() == c_protocol::tunneled_data_header_size );
+	}
+	if (compact) gen.push_bytes_n( data_size , std::string(data, data+data_size) ); // [protocol] the rest of datagram (till MAC)
+	else gen.push_varstring( std::string(data, data+data_size)  ); // TODO view_string
+	{ // [protocol] CT-P2P MAC of the whole frame, so next hop can drop forged frames before routing them
+		char mac[c_protocol::p2p_mac_size];
+		m_crypto_p2p->write_mac( gen.get_buffer().data() , gen.get_buffer().size() , mac );
+		gen.push_bytes_n( c_protocol::p2p_mac_size , std::string(mac, c_protocol::p2p_mac_size) );
+	}
 
-	// TODO randomize this data XXX use real crypto data
+	return gen.str_move();
+}
 
-	const int header_size = c_protocol::version_size + c_protocol::cmd_size + c_protocol::ttl_size ; //  [protocol] TODO pack this into protocol class --r
+void c_peering_udp::send_frame_udp(const std::string & frame, netio::c_udp_endpoint & udp) {
+	udp.send_batched( reinterpret_cast<const sockaddr*>( & m_peering_sockaddr ) , m_peering_sockaddr_len , frame.c_str(), frame.size() );
+}
 
-	// TODO allocate buffer outside
-	std::unique_ptr<unsigned char[]> protomsg(new unsigned char[data_size + crypto_aead_chacha20poly1305_ABYTES + header_size ]); // plus the headers
-	// long long? or u64? --r assert size  sizeof(long long  .... == ...
+void c_peering_udp::send_data_udp_cmd(c_protocol::t_proto_cmd cmd, const string_as_bin & bin, netio::c_udp_endpoint & udp) {
+	_info("Send to peer (COMMAND): command="<<static_cast<int>(cmd)<<" data: " << string_as_dbg(bin).get() ); // TODO .get
+	string_as_bin raw;
+    raw.bytes += c_protocol::current_version;
+    raw.bytes += cmd;
+	raw.bytes += bin.bytes;
+	this->send_data_RAW_udp(raw.bytes.c_str(), raw.bytes.size(), udp);
+}
 
-	// why? --r:
-	assert(crypto_aead_chacha20poly1305_KEYBYTES <= crypto_generichash_BYTES);
+void c_peering_udp::send_pmtu_probe(size_t probe_size, uint32_t nonce, netio::c_udp_endpoint & udp) {
+	if ((probe_size < c_protocol::pmtu_ack_size) || (probe_size > 0xFFFF)) throw std::invalid_argument("Invalid size of PMTU probe");
+	// [protocol] e_proto_cmd_pmtu_probe: 2 bytes size of whole datagram, 4 bytes nonce, then padding
+	string_as_bin bin;
+	bin.bytes += static_cast<char>( probe_size >> 8 );
+	bin.bytes += static_cast<char>( probe_size & 0xFF );
+	bin.bytes += conn_ids::u32_to_bin( nonce );
+	bin.bytes.resize( probe_size - c_protocol::version_size - c_protocol::cmd_size , 0 );
+	this->send_data_udp_cmd(c_protocol::e_proto_cmd_pmtu_probe, bin, udp);
+}
 
-	// write headers:
-	protomsg.get()[0] = c_protocol::current_version;
-	protomsg.get()[1] = c_protocol::e_proto_cmd_tunneled_data; // this are tunneled data
-	assert( (ttl >= 0) && (ttl <= c_protocol::ttl_max_value_ever) );
-	protomsg.get()[2] = ttl; // ...this is their route ttl
+void c_peering_udp::send_pmtu_ack(size_t probe_size, uint32_t nonce, netio::c_udp_endpoint & udp) {
+	if (! m_crypto_p2p) return; // he could not check it
+	// [protocol] e_proto_cmd_pmtu_ack: size of the probe that we got (2), its nonce (4); then CT-P2P MAC of all before
+	trivialserialize::generator gen(c_protocol::pmtu_ack_size + c_protocol::p2p_mac_size);
+	gen.push_byte_u( c_protocol::current_version );
+	gen.push_byte_u( c_protocol::e_proto_cmd_pmtu_ack );
+	gen.push_integer_u<2>( probe_size );
+	gen.push_bytes_n( 4 , conn_ids::u32_to_bin( nonce ) );
+	assert( gen.get_buffer().size() == c_protocol::pmtu_ack_size );
+	char mac[c_protocol::p2p_mac_size];
+	m_crypto_p2p->write_mac( gen.get_buffer().data() , gen.get_buffer().size() , mac );
+	gen.push_bytes_n( c_protocol::p2p_mac_size , std::string(mac, c_protocol::p2p_mac_size) );
+	const std::string frame = gen.str_move();
+	this->send_data_RAW_udp(frame.c_str(), frame.size(), udp);
+}
 
-	unsigned char * ciphertext_buf = protomsg.get() + header_size; // just-pointer to part of protomsg where to write the message!
-	unsigned long long ciphertext_buf_len = 0; // encryption will write here the resulting size
-    crypto_aead_chacha20poly1305_encrypt(ciphertext_buf, &ciphertext_buf_len, reinterpret_cast<const unsigned char *>(data), data_size, additional_data,
-                                         additional_data_len, NULL, nonce, generated_shared_key);
-	unsigned long long protomsg_len = ciphertext_buf_len + header_size; // the output of crypto, plus the header in front
+void c_peering_udp::send_ping(uint32_t seq, netio::c_udp_endpoint & udp) {
+	// [protocol] e_proto_cmd_public_ping_request: 4 bytes seq; the reply echoes it (we keep the time when it was sent)
+	this->send_data_udp_cmd(c_protocol::e_proto_cmd_public_ping_request, string_as_bin( conn_ids::u32_to_bin(seq) ), udp);
+}
 
-	// TODO asserts!!!
-*/
+void c_peering_udp::send_keepalive(hi_session::t_session_id my_session, netio::c_udp_endpoint & udp) {
+	if (! m_crypto_p2p) return; // he could not check it (and we do not have his HI yet)
+	// [protocol] e_proto_cmd_keepalive: our session ID (8), counter (8); then CT-P2P MAC of all before
+	trivialserialize::generator gen(c_protocol::keepalive_size + c_protocol::p2p_mac_size);
+	gen.push_byte_u( c_protocol::current_version );
+	gen.push_byte_u( c_protocol::e_proto_cmd_keepalive );
+	gen.push_integer_u<8>( my_session );
+	gen.push_integer_u<8>( m_hi_session.next_keepalive_counter() );
+	assert( gen.get_buffer().size() == c_protocol::keepalive_size );
+	char mac[c_protocol::p2p_mac_size];
+	m_crypto_p2p->write_mac( gen.get_buffer().data() , gen.get_buffer().size() , mac );
+	gen.push_bytes_n( c_protocol::p2p_mac_size , std::string(mac, c_protocol::p2p_mac_size) );
+	const std::string frame = gen.str_move();
+	this->send_data_RAW_udp(frame.c_str(), frame.size(), udp);
+}
 
-	string protomsg = gen.str(); // TODO view_string
-	this->send_data_RAW_udp(protomsg.c_str(), protomsg.size(), udp_socket);
+void c_peering_udp::send_route_adv(const std::vector<route_dv::t_adv<c_haship_addr>> & adv, netio::c_udp_endpoint & udp) {
+	if (! m_crypto_p2p) return; // he could not check it
+	for (size_t pos = 0; pos < adv.size(); pos += c_protocol::route_adv_max_entries) {
+		// [protocol] e_proto_cmd_route_adv: entries of dst, cost, seqno; then CT-P2P MAC of all before
+		const size_t count = std::min<size_t>( adv.size() - pos , c_protocol::route_adv_max_entries );
+		trivialserialize::generator gen(2 + count * c_protocol::route_adv_entry_size + c_protocol::p2p_mac_size);
+		gen.push_byte_u( c_protocol::current_version );
+		gen.push_byte_u( c_protocol::e_proto_cmd_route_adv );
+		for (size_t i = pos; i < pos + count; ++i) {
+			gen.push_bytes_n( g_ipv6_rfc::length_of_addr , to_binary_string(adv[i].m_dst) );
+			gen.push_byte_u( static_cast<unsigned char>( std::min(adv[i].m_cost , route_dv::cost_infinity) ) );
+			gen.push_bytes_n( 4 , conn_ids::u32_to_bin( adv[i].m_seqno ) );
+		}
+		char mac[c_protocol::p2p_mac_size];
+		m_crypto_p2p->write_mac( gen.get_buffer().data() , gen.get_buffer().size() , mac );
+		gen.push_bytes_n( c_protocol::p2p_mac_size , std::string(mac, c_protocol::p2p_mac_size) );
+		const std::string frame = gen.str_move();
+		this->send_data_RAW_udp(frame.c_str(), frame.size(), udp);
+	}
 }
 
-void c_peering_udp::send_data_udp_cmd(c_protocol::t_proto_cmd cmd, const string_as_bin & bin, int udp_socket) {
-	_info("Send to peer (COMMAND): command="<<static_cast<int>(cmd)<<" data: " << string_as_dbg(bin).get() ); // TODO .get
-	string_as_bin raw;
-    raw.bytes += c_protocol::current_version;
-    raw.bytes += cmd;
-	raw.bytes += bin.bytes;
-	this->send_data_RAW_udp(raw.bytes.c_str(), raw.bytes.size(), udp_socket);
+void c_peering_udp::send_conn_id_offer(c_haship_addr src_hip, c_haship_addr dst_hip, const std::string & nonce_prefix, uint32_t id,
+	netio::c_udp_endpoint & udp)
+{
+	if (! m_crypto_p2p) return; // he could not check it
+	// [protocol] e_proto_cmd_conn_id_offer: src, dst, ID, nonce prefix; then CT-P2P MAC of all before
+	trivialserialize::generator gen(c_protocol::conn_id_offer_size + c_protocol::p2p_mac_size);
+	gen.push_byte_u( c_protocol::current_version );
+	gen.push_byte_u( c_protocol::e_proto_cmd_conn_id_offer );
+	gen.push_bytes_n( g_ipv6_rfc::length_of_addr , to_binary_string(src_hip) );
+	gen.push_bytes_n( g_ipv6_rfc::length_of_addr , to_binary_string(dst_hip) );
+	gen.push_bytes_n( c_protocol::conn_id_size , conn_ids::u32_to_bin(id) );
+	gen.push_bytes_n( conn_ids::nonce_prefix_size , nonce_prefix );
+	assert( gen.get_buffer().size() == c_protocol::conn_id_offer_size );
+	char mac[c_protocol::p2p_mac_size];
+	m_crypto_p2p->write_mac( gen.get_buffer().data() , gen.get_buffer().size() , mac );
+	gen.push_bytes_n( c_protocol::p2p_mac_size , std::string(mac, c_protocol::p2p_mac_size) );
+	const std::string frame = gen.str_move();
+	this->send_data_RAW_udp(frame.c_str(), frame.size(), udp);
 }
 
-void c_peering_udp::send_data_RAW_udp(const char * data, size_t data_size, int udp_socket) {
+pmtu::c_path_mtu & c_peering_udp::get_path_mtu() { return m_path_mtu; }
+
+conn_ids::c_conn_ids<c_haship_addr> & c_peering_udp::get_conn_ids() { return m_conn_ids; }
+
+void c_peering_udp::send_data_RAW_udp(const char * data, size_t data_size, netio::c_udp_endpoint & udp) {
 	_info("UDP send to peer RAW. To IP: " << m_peering_addr <<
 		", RAW-DATA: " << to_debug_b(std::string(data,data_size)) );
 
-	switch (m_peering_addr.get_ip_type()) {
-		case c_ip46_addr::t_tag::tag_ipv4 : {
-			auto ip_x = m_peering_addr.get_ip4(); // ip of proper type, as local variable
-			sendto(udp_socket, data, data_size, 0, reinterpret_cast<sockaddr*>( & ip_x ) , sizeof(sockaddr_in) );
-		}
-		break;
-		case c_ip46_addr::t_tag::tag_ipv6 : {
-			auto ip_x = m_peering_addr.get_ip6(); // ip of proper type, as local variable
-			sendto(udp_socket, data, data_size, 0, reinterpret_cast<sockaddr*>( & ip_x ) , sizeof(sockaddr_in6) );
-		}
-		break;
-		default: {
-			std::ostringstream oss; oss << m_peering_addr; // TODO
-			throw std::runtime_error(string("Invalid IP type (when trying to send RAW udp): ") + oss.str());
-		}
-	}
+	// reinterpret allowed by Linux specs
+	udp.send( reinterpret_cast<const sockaddr*>( & m_peering_sockaddr ) , m_peering_sockaddr_len , data, data_size );
 }
 
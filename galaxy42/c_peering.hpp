@@ -7,8 +7,15 @@
 #include "c_ip46_addr.hpp"
 #include "haship.hpp"
 #include "protocol.hpp"
+#include "c_netio.hpp"
+#include "c_pmtu.hpp"
+#include "c_conn_ids.hpp"
+#include "c_link_quality.hpp"
+#include "c_route_dv.hpp"
+#include "c_hi_session.hpp"
 
 #include "crypto/crypto_basic.hpp"
+#include "crypto/crypto_p2p.hpp"
 
 // TODO (later) make normal virtual functions (move UDP properties into class etc) once tests are done.
 
@@ -38,9 +45,13 @@ class c_peering { ///< An (mostly established) connection to peer
 
 		virtual void set_pubkey( std::unique_ptr<c_haship_pubkey> && pubkey ); ///< consume this pubkey and set as mine
 		bool is_pubkey() const; ///< do we have a valid pubkey set
-		void add_limit_points(long int points);
-		void decrement_limit_points();
-		long int get_limit_points();
+
+		void set_crypto_p2p( unique_ptr<antinet_crypto::c_crypto_p2p> && crypto_p2p ); ///< consume and use this CT-P2P from now
+		antinet_crypto::c_crypto_p2p * get_crypto_p2p() const; ///< our CT-P2P with him, or nullptr if not yet agreed (no HI)
+
+		link_quality::c_link_quality & get_link_quality(); ///< RTT, jitter and loss of the link to him (from our pings)
+		const link_quality::c_link_quality & get_link_quality() const;
+		hi_session::c_hi_session & get_hi_session(); ///< do we send him full HI, or only keepalives
 
 		friend class c_tunserver;
 
@@ -48,7 +59,9 @@ class c_peering { ///< An (mostly established) connection to peer
 		c_ip46_addr	m_peering_addr; ///< peer physical address in socket format
 		c_haship_addr m_haship_addr; ///< peer haship address
 		unique_ptr<c_haship_pubkey> m_pubkey; ///< his pubkey (when we know it)
-		std::atomic<long int> m_limit_points; // decrement when send packet to this peer
+		unique_ptr<antinet_crypto::c_crypto_p2p> m_crypto_p2p; ///< CT-P2P authenticating frames on this hop (when known)
+		link_quality::c_link_quality m_link_quality;
+		hi_session::c_hi_session m_hi_session;
 };
 
 ostream & operator<<(ostream & ostr, const c_peering & obj);
@@ -58,12 +71,36 @@ class c_peering_udp : public c_peering { ///< An established connection to UDP p
 		c_peering_udp(const t_peering_reference & ref);
 
 		virtual void send_data(const char * data, size_t data_size) override;
-		virtual void send_data_udp(const char * data, size_t data_size, int udp_socket,
+		virtual void send_data_udp(const char * data, size_t data_size, netio::c_udp_endpoint & udp,
+			c_haship_addr src_hip, c_haship_addr dst_hip, int ttl, antinet_crypto::t_crypto_nonce nonce_used);
+		///! build the frame of tunneled data (as send_data_udp does), to send it later with send_frame_udp. Empty if can not send now
+		virtual std::string prepare_data_udp(const char * data, size_t data_size,
 			c_haship_addr src_hip, c_haship_addr dst_hip, int ttl, antinet_crypto::t_crypto_nonce nonce_used);
-		virtual void send_data_udp_cmd(c_protocol::t_proto_cmd cmd, const string_as_bin & bin, int udp_socket);
+		virtual void send_frame_udp(const std::string & frame, netio::c_udp_endpoint & udp); ///< send frame from prepare_data_udp, batched (GSO)
+		virtual void send_data_udp_cmd(c_protocol::t_proto_cmd cmd, const string_as_bin & bin, netio::c_udp_endpoint & udp);
+		/// e_proto_cmd_pmtu_probe, the whole datagram has probe_size
+		void send_pmtu_probe(size_t probe_size, uint32_t nonce, netio::c_udp_endpoint & udp);
+		///! e_proto_cmd_pmtu_ack: we got his probe; only if we have CT-P2P with him (he accepts only authenticated acks)
+		void send_pmtu_ack(size_t probe_size, uint32_t nonce, netio::c_udp_endpoint & udp);
+		void send_ping(uint32_t seq, netio::c_udp_endpoint & udp); ///< e_proto_cmd_public_ping_request, he replies with the same seq
+		///! e_proto_cmd_keepalive with our session ID (as in our HI) and next counter; only if we have CT-P2P with him
+		void send_keepalive(hi_session::t_session_id my_session, netio::c_udp_endpoint & udp);
+		///! e_proto_cmd_route_adv (in as many datagrams as needed)
+		void send_route_adv(const std::vector<route_dv::t_adv<c_haship_addr>> & adv, netio::c_udp_endpoint & udp);
+
+		///! e_proto_cmd_conn_id_offer: he should send tunneled data (src,dst) to us in compact format with this ID
+		void send_conn_id_offer(c_haship_addr src_hip, c_haship_addr dst_hip, const std::string & nonce_prefix, uint32_t id,
+			netio::c_udp_endpoint & udp);
+
+		pmtu::c_path_mtu & get_path_mtu(); ///< path MTU to this peer (as UDP payload size)
+		conn_ids::c_conn_ids<c_haship_addr> & get_conn_ids(); ///< connection IDs for compact tunneled data, in both directions
 	private:
+		sockaddr_storage m_peering_sockaddr; ///< m_peering_addr ready for sendto (works also with dual-stack ipv6 socket)
+		socklen_t m_peering_sockaddr_len;
+		pmtu::c_path_mtu m_path_mtu;
+		conn_ids::c_conn_ids<c_haship_addr> m_conn_ids;
 
-		virtual void send_data_RAW_udp(const char * data, size_t data_size, int udp_socket); ///< direct write
+		virtual void send_data_RAW_udp(const char * data, size_t data_size, netio::c_udp_endpoint & udp); ///< direct write
 };
 
 #endif // C_PEERING_H
@@ -0,0 +1,116 @@
+#include "c_pmtu.hpp"
+#include "c_tun_offload.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace pmtu {
+
+constexpr size_t c_path_mtu::search_granularity;
+constexpr int c_path_mtu::max_probes;
+constexpr std::chrono::milliseconds c_path_mtu::probe_timeout;
+constexpr std::chrono::seconds c_path_mtu::raise_interval;
+
+size_t tun_mtu_for_payload(size_t payload, size_t overhead) {
+	if (payload < overhead + ipv6_min_mtu) return ipv6_min_mtu; // can not go lower, such path will drop our biggest packets
+	return payload - overhead;
+}
+
+// ------------------------------------------------------------------
+
+c_path_mtu::c_path_mtu(size_t base, size_t max)
+	: m_base(base), m_max(std::max(base, max)), m_mtu(base), m_high(m_max + 1), m_probe_size(0), m_probe_nonce(0),
+	m_probe_count(0), m_probe_time(), m_search_done(), m_random( std::random_device()() )
+{ }
+
+size_t c_path_mtu::get_mtu() const { return m_mtu; }
+
+bool c_path_mtu::is_searching() const { return m_high > m_mtu + search_granularity; }
+
+size_t c_path_mtu::probe_to_send(t_clock::time_point now) {
+	if (m_probe_size != 0) { // waiting for ack
+		if (now - m_probe_time < probe_timeout) return 0;
+		if (m_probe_count < max_probes) { // lost? try again
+			++m_probe_count;
+			m_probe_time = now;
+			return m_probe_size;
+		}
+		m_high = std::min(m_high, m_probe_size); // black hole for this size
+		m_probe_size = 0;
+	}
+
+	if (! is_searching()) {
+		if (m_search_done == t_clock::time_point()) m_search_done = now;
+		if (now - m_search_done < raise_interval) return 0;
+		m_high = m_max + 1; // maybe path is bigger now
+		m_search_done = t_clock::time_point();
+		if (! is_searching()) return 0; // already at max
+	}
+
+	m_probe_size = m_mtu + (m_high - m_mtu) / 2;
+	m_probe_nonce = static_cast<uint32_t>( m_random() ); // retries of this size keep it, ack of any of them is good
+	m_probe_count = 1;
+	m_probe_time = now;
+	return m_probe_size;
+}
+
+c_path_mtu::t_clock::time_point c_path_mtu::next_probe_time(t_clock::time_point now) const {
+	if (m_probe_size != 0) return m_probe_time + probe_timeout; // retry, or it is lost for good and the search goes on
+	if (is_searching()) return now;
+	if (m_search_done == t_clock::time_point()) return now; // probe_to_send() notes when the search ended
+	return m_search_done + raise_interval;
+}
+
+uint32_t c_path_mtu::get_probe_nonce() const { return m_probe_nonce; }
+
+bool c_path_mtu::probe_acked(size_t size, uint32_t nonce) {
+	if ((m_probe_size == 0) || (size != m_probe_size) || (nonce != m_probe_nonce)) return false; // not the probe that we wait for
+	m_mtu = size;
+	if (m_high <= m_mtu) m_high = m_mtu + 1;
+	m_probe_size = 0;
+	return true;
+}
+
+void c_path_mtu::packet_too_big(size_t size) {
+	size = std::max(size, m_base); // base is the floor, as in RFC 8899
+	if (size >= m_mtu) return;
+	m_mtu = size;
+	m_high = size + 1; // search is done, try bigger again after raise_interval
+	m_probe_size = 0;
+	m_search_done = t_clock::time_point();
+}
+
+// ------------------------------------------------------------------
+
+std::string make_packet_too_big(const char * packet, size_t size, uint32_t mtu) {
+	const unsigned char * ip = reinterpret_cast<const unsigned char*>(packet);
+	if ((size < ipv6_header_size) || ((ip[0] >> 4) != 6)) throw std::invalid_argument("Packet Too Big: this is not an ipv6 packet");
+
+	const unsigned char ipproto_icmpv6 = 58;
+	if ((ip[6] == ipproto_icmpv6) && (size > ipv6_header_size) && (ip[ipv6_header_size] < 128)) return ""; // an error
+	const unsigned char * src = ip + 8, * dst = ip + 24;
+	if (dst[0] == 0xFF) return ""; // multicast
+	if ((src[0] == 0xFF) || std::all_of(src, src + 16, [](unsigned char c) { return c == 0; })) return ""; // not unicast
+
+	const size_t icmp_header_size = 8;
+	const size_t quote_size = std::min(size, ipv6_min_mtu - ipv6_header_size - icmp_header_size); // as much as fits
+	const size_t icmp_size = icmp_header_size + quote_size;
+
+	std::string ret(ipv6_header_size + icmp_size, 0);
+	unsigned char * out = reinterpret_cast<unsigned char*>(&ret[0]);
+	out[0] = 0x60; // version 6, no traffic class, no flow label
+	out[4] = icmp_size >> 8;  out[5] = icmp_size & 0xFF;
+	out[6] = ipproto_icmpv6;
+	out[7] = 64; // hop limit
+	std::memcpy(out + 8, dst, 16); // from the destination...
+	std::memcpy(out + 24, src, 16); // ...back to sender
+	unsigned char * icmp = out + ipv6_header_size;
+	icmp[0] = icmpv6_type_packet_too_big;  icmp[1] = 0; // code
+	icmp[4] = mtu >> 24;  icmp[5] = (mtu >> 16) & 0xFF;  icmp[6] = (mtu >> 8) & 0xFF;  icmp[7] = mtu & 0xFF;
+	std::memcpy(icmp + icmp_header_size, packet, quote_size);
+	const uint16_t checksum = tun_offload::l4_checksum_ipv6(out, icmp_size, ipproto_icmpv6);
+	icmp[2] = checksum >> 8;  icmp[3] = checksum & 0xFF;
+	return ret;
+}
+
+} // namespace pmtu
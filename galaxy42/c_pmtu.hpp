@@ -0,0 +1,86 @@
+#pragma once
+#ifndef include_c_pmtu_hpp
+#define include_c_pmtu_hpp
+
+#include "libs1.hpp"
+
+#include <chrono>
+#include <random>
+
+/**
+ * @brief Path MTU of the peering (UDP) links, and keeping tunneled packets small enough for it.
+ * Each peer is probed with padded datagrams sent with DF bit (IP_MTU_DISCOVER), a binary search between the base size
+ * (that we assume always works) and the biggest size that the link could carry; the peer acks the probes that he got.
+ * This does not need ICMP from routers, so it works also where ICMP is filtered (like DPLPMTUD, RFC 8899).
+ * Sizes here are sizes of UDP payload (our whole datagram), unless said otherwise.
+ */
+namespace pmtu {
+
+constexpr size_t ipv6_min_mtu = 1280; ///< ipv6 needs links (also our TUN) with at least this MTU
+constexpr size_t ipv4_header_size = 20;
+constexpr size_t ipv6_header_size = 40;
+constexpr size_t udp_header_size = 8;
+constexpr size_t ethernet_mtu = 1500; ///< the usual biggest MTU of underlay links
+constexpr size_t base_payload = 1200; ///< BASE_PLPMTU of RFC 8899: we assume each path can carry this
+
+constexpr size_t icmpv6_type_packet_too_big = 2;
+
+/// the biggest UDP payload that fits in link with this MTU
+constexpr size_t payload_for_link_mtu(size_t link_mtu, bool ipv6) {
+	return link_mtu - (ipv6 ? ipv6_header_size : ipv4_header_size) - udp_header_size;
+}
+
+/// MTU for our TUN, when the path can carry UDP payload of this size and each tunneled packet gets overhead bytes
+size_t tun_mtu_for_payload(size_t payload, size_t overhead);
+
+/// Path MTU of one peer: the binary search with probes (and later probing again, in case the path changed)
+class c_path_mtu final {
+	public:
+		typedef std::chrono::steady_clock t_clock;
+
+		static constexpr size_t search_granularity = 8; ///< stop searching when we are this close to the max
+		static constexpr int max_probes = 3; ///< so many probes of one size lost = path does not carry this size
+		static constexpr std::chrono::milliseconds probe_timeout{ 1000 };
+		static constexpr std::chrono::seconds raise_interval{ 600 }; ///< PMTU_RAISE_TIMER: search again after that
+
+		c_path_mtu(size_t base=base_payload, size_t max=payload_for_link_mtu(ethernet_mtu, true));
+
+		size_t get_mtu() const; ///< the biggest size that is confirmed to work
+		bool is_searching() const;
+
+		/// size of probe that should be sent now (it is then treated as sent), or 0 if nothing is to be sent now
+		size_t probe_to_send(t_clock::time_point now);
+		/// when probe_to_send() can have a probe (or the lost one again): call it then, not more often. Changes after any
+		/// call that changes the search (e.g. probe_acked: the next size is due at once)
+		t_clock::time_point next_probe_time(t_clock::time_point now) const;
+		uint32_t get_probe_nonce() const; ///< random, of the probe that we wait for: send it in the probe, the ack echoes it
+		/// peer got our probe of this size, with this nonce. Only the probe that we wait for is accepted (else false):
+		/// a size that we did not probe could set MTU that the path does not carry
+		bool probe_acked(size_t size, uint32_t nonce);
+		void packet_too_big(size_t size); ///< we learned (not from probes) that the path is smaller, size is what fits
+
+	private:
+		const size_t m_base;
+		const size_t m_max;
+		size_t m_mtu; ///< confirmed
+		size_t m_high; ///< smallest size that failed (+1), or m_max+1: the search is in (m_mtu, m_high)
+		size_t m_probe_size; ///< probe that we wait for (0 if none)
+		uint32_t m_probe_nonce; ///< of that probe
+		int m_probe_count; ///< how many times it was sent
+		t_clock::time_point m_probe_time; ///< when it was sent last time
+		t_clock::time_point m_search_done; ///< when search ended (epoch while searching)
+		std::mt19937 m_random; ///< for nonces
+};
+
+/**
+ * ICMPv6 Packet Too Big for this ipv6 packet (that we will not send), as it would come from a router.
+ * Source is the destination of that packet, so that its sender sees it as coming from the path.
+ * @return the ipv6 packet, or empty string if no error may be sent for this packet (RFC 4443 2.4: it is an ICMPv6 error,
+ * or it has no unicast source; also for multicast destination, we have no address to send it from).
+ * Throws std::invalid_argument if this is not an ipv6 packet.
+ */
+std::string make_packet_too_big(const char * packet, size_t size, uint32_t mtu);
+
+} // namespace pmtu
+
+#endif
@@ -0,0 +1,77 @@
+#include "c_route_dv.hpp"
+
+namespace route_dv {
+
+c_simulation::c_simulation(size_t nodes_count, size_t extra_links, unsigned int seed)
+	: m_neighbors(nodes_count), m_now( t_sim_table::t_clock::time_point() + std::chrono::hours(1) ), m_links_count(0), m_adverts(0)
+{
+	m_tables.reserve(nodes_count);
+	for (size_t i=0; i<nodes_count; ++i) m_tables.emplace_back( static_cast<t_sim_addr>(i) );
+	std::mt19937 gen(seed);
+	std::uniform_int_distribution<int> link_cost(10, 30); // like from link_quality: 10 is one hop with no delay
+	auto add_link = [&](t_sim_addr a, t_sim_addr b) {
+		if ((a == b) || m_neighbors[a].count(b)) return;
+		const int cost = link_cost(gen);
+		m_neighbors[a][b] = cost;  m_neighbors[b][a] = cost;
+		m_tables[a].set_link(b, cost, m_now);  m_tables[b].set_link(a, cost, m_now);
+		++m_links_count;
+	};
+	for (size_t i=0; i<nodes_count; ++i) add_link(i, (i+1) % nodes_count);
+	std::uniform_int_distribution<t_sim_addr> any_node(0, nodes_count-1);
+	for (size_t i=0; i<extra_links; ++i) add_link(any_node(gen), any_node(gen));
+}
+
+bool c_simulation::run_round() {
+	m_now += t_sim_table::triggered_update_interval;
+	struct t_message { t_sim_addr m_from, m_to; std::vector<t_adv<t_sim_addr>> m_adv; };
+	std::vector<t_message> messages;
+	for (size_t i=0; i<m_tables.size(); ++i) {
+		auto & table = m_tables[i];
+		const auto kind = table.start_update(m_now);
+		if (kind == t_sim_table::e_update::none) continue;
+		for (const auto & neighbor : m_neighbors[i]) {
+			auto adv = table.make_adv(neighbor.first, kind == t_sim_table::e_update::changed);
+			if (adv.empty()) continue;
+			m_adverts += adv.size();
+			messages.push_back( t_message{ static_cast<t_sim_addr>(i), neighbor.first, std::move(adv) } );
+		}
+		table.update_sent();
+	}
+	bool changed = false;
+	for (const auto & message : messages) {
+		for (const auto & adv : message.m_adv) changed |= m_tables[message.m_to].got_adv(message.m_from, adv, m_now);
+	}
+	return changed;
+}
+
+size_t c_simulation::run_until_converged(size_t max_rounds) {
+	size_t quiet = 0; // rounds without change; a full update must pass too (routes broken on the way wait for a newer seqno)
+	const size_t quiet_needed = t_sim_table::full_update_interval / t_sim_table::triggered_update_interval + 1;
+	for (size_t round = 1; round <= max_rounds; ++round) {
+		if (run_round()) quiet = 0; else ++quiet;
+		if (quiet == quiet_needed) return round - quiet_needed;
+	}
+	return max_rounds;
+}
+
+void c_simulation::fail_link(t_sim_addr a, t_sim_addr b) {
+	m_neighbors[a].erase(b);  m_neighbors[b].erase(a);
+	m_tables[a].link_down(b, m_now);  m_tables[b].link_down(a, m_now);
+	--m_links_count;
+}
+
+size_t c_simulation::count_bad_routes(size_t pairs, std::mt19937 & gen) const {
+	std::uniform_int_distribution<t_sim_addr> any_node(0, m_tables.size()-1);
+	size_t bad = 0;
+	for (size_t i=0; i<pairs; ++i) {
+		const t_sim_addr src = any_node(gen), dst = any_node(gen);
+		t_sim_addr at = src;
+		try {
+			for (size_t hops = 0; (at != dst) && (hops <= m_tables.size()); ++hops) at = m_tables[at].get_nexthop(dst);
+		} catch(const expected_not_found &) { }
+		if (at != dst) ++bad; // no route, or a loop
+	}
+	return bad;
+}
+
+} // namespace route_dv
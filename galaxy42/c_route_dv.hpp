@@ -0,0 +1,280 @@
+#pragma once
+#ifndef include_c_route_dv_hpp
+#define include_c_route_dv_hpp
+
+#include "libs1.hpp"
+
+#include <chrono>
+#include <map>
+#include <random>
+#include <vector>
+
+/**
+ * @brief Proactive routing: distance-vector with sequence numbers (like DSDV), as alternative to searching routes (findhip).
+ * Each node advertises to its direct peers the routes that it has: (destination, cost, seqno). Full table is sent
+ * periodically, and the changed routes soon after they change (triggered updates). The table is then ready when data
+ * comes, so forwarding never waits for a search.
+ * Seqno is given by the destination itself (even numbers, growing with each full update); a route that is broken on the way
+ * gets the next odd seqno, so old adverts (that could make a loop) do not bring it back - only a newer one from the destination.
+ * Split horizon: we do not advertise a route to the peer that is its next hop (in triggered updates we poison it instead).
+ */
+namespace route_dv {
+
+constexpr int cost_infinity = 255; ///< unreachable (cost is sent in one byte)
+
+template <typename TAddr>
+struct t_adv { ///< one route in advertisement
+	TAddr m_dst;
+	int m_cost; ///< cost from the node that advertises it; cost_infinity if the route is gone
+	uint32_t m_seqno;
+};
+
+template <typename TAddr>
+class c_dv_table {
+	public:
+		typedef std::chrono::steady_clock t_clock;
+
+		static constexpr std::chrono::seconds full_update_interval{ 10 };
+		static constexpr std::chrono::milliseconds triggered_update_interval{ 1000 }; ///< changes are sent not more often
+		static constexpr std::chrono::seconds route_timeout{ 35 }; ///< route not refreshed by its next hop for that long is gone
+		static constexpr std::chrono::seconds gc_timeout{ 60 }; ///< gone route is advertised (as unreachable) that long, then forgotten
+
+		enum class e_update { none, changed, full };
+
+		struct t_route {
+			TAddr m_nexthop;
+			int m_cost; ///< from us: m_adv_cost and the cost of link to next hop
+			int m_adv_cost; ///< as the next hop advertised it
+			uint32_t m_seqno;
+			t_clock::time_point m_time; ///< when the next hop refreshed it (or when it was gone)
+			bool m_changed; ///< send it in the next triggered update
+		};
+
+		explicit c_dv_table(const TAddr & self);
+		/// our first seqno: from the wall clock (seconds, so it is even), so after a restart it is newer then all that we sent before
+		/// (it grows by 2 each full_update_interval, the clock by 2 each second); else our adverts would be ignored as old
+		static uint32_t initial_seqno();
+
+		void set_link(const TAddr & neighbor, int cost, t_clock::time_point now); ///< link to direct peer is up, with this cost
+		void link_down(const TAddr & neighbor, t_clock::time_point now); ///< routes via him are gone
+		bool got_adv(const TAddr & neighbor, const t_adv<TAddr> & adv, t_clock::time_point now); ///< @return did next hop or cost change
+
+		/// what should be advertised now (routes that timed out are gone first). Then make_adv for each neighbor, then update_sent()
+		e_update start_update(t_clock::time_point now);
+		std::vector<t_adv<TAddr>> make_adv(const TAddr & neighbor, bool only_changed) const;
+		void update_sent();
+		/// when start_update() will have something to send (full update, triggered one, or a route that times out and is
+		/// retracted) - call it then, not more often. Can be in the past (due now). Changes after any of the calls above
+		t_clock::time_point next_update_time() const;
+
+		TAddr get_nexthop(const TAddr & dst) const; ///< throws expected_not_found if there is no route (or it is gone)
+		const t_route & get_route(const TAddr & dst) const; ///< also a gone one; throws expected_not_found if not known at all
+		size_t size() const;
+
+	private:
+		void retract(t_route & route, t_clock::time_point now); ///< the route is gone
+		void set_changed(t_route & route);
+
+		const TAddr m_self;
+		uint32_t m_seqno; ///< our own (even)
+		std::map<TAddr, t_route> m_routes; ///< by destination
+		std::map<TAddr, int> m_links; ///< cost of link to each direct peer that is up
+		t_clock::time_point m_last_full;
+		t_clock::time_point m_last_update;
+		bool m_any_changed;
+};
+
+typedef uint32_t t_sim_addr; ///< node in simulation is just its number
+typedef c_dv_table<t_sim_addr> t_sim_table;
+
+/// simulated network (e.g. thousands of nodes, see bench/routing.cpp): nodes on a ring (so the network stays connected
+/// after one link fails), and random links between any nodes
+class c_simulation {
+	public:
+		c_simulation(size_t nodes_count, size_t extra_links, unsigned int seed);
+
+		/// one round is one triggered_update_interval: each node sends what it should, then all adverts arrive
+		bool run_round(); ///< @return did any route change
+		size_t run_until_converged(size_t max_rounds); ///< @return rounds that it took
+		void fail_link(t_sim_addr a, t_sim_addr b);
+		size_t count_bad_routes(size_t pairs, std::mt19937 & gen) const; ///< following next hops from src does not get to dst
+
+		size_t get_links_count() const { return m_links_count; }
+		uint64_t get_adverts() const { return m_adverts; }
+
+	private:
+		std::vector<t_sim_table> m_tables;
+		std::vector<std::map<t_sim_addr, int>> m_neighbors; ///< cost of links of each node
+		t_sim_table::t_clock::time_point m_now;
+		size_t m_links_count;
+		uint64_t m_adverts; ///< routes sent in all adverts
+};
+
+// ------------------------------------------------------------------
+
+template <typename TAddr> constexpr std::chrono::seconds c_dv_table<TAddr>::full_update_interval;
+template <typename TAddr> constexpr std::chrono::milliseconds c_dv_table<TAddr>::triggered_update_interval;
+template <typename TAddr> constexpr std::chrono::seconds c_dv_table<TAddr>::route_timeout;
+template <typename TAddr> constexpr std::chrono::seconds c_dv_table<TAddr>::gc_timeout;
+
+template <typename TAddr>
+c_dv_table<TAddr>::c_dv_table(const TAddr & self)
+	: m_self(self), m_seqno(initial_seqno()), m_last_full(), m_last_update(), m_any_changed(false)
+{ }
+
+template <typename TAddr>
+uint32_t c_dv_table<TAddr>::initial_seqno() {
+	const auto seconds = std::chrono::duration_cast<std::chrono::seconds>( std::chrono::system_clock::now().time_since_epoch() );
+	return static_cast<uint32_t>( seconds.count() ) << 1; // wraps around, as seqno are compared (see got_adv)
+}
+
+template <typename TAddr>
+void c_dv_table<TAddr>::set_changed(t_route & route) { route.m_changed = true;  m_any_changed = true; }
+
+template <typename TAddr>
+void c_dv_table<TAddr>::retract(t_route & route, t_clock::time_point now) {
+	route.m_cost = cost_infinity;
+	if (route.m_seqno % 2 == 0) ++route.m_seqno; // odd: broken on the way, only destination can give a newer one
+	route.m_time = now;
+	set_changed(route);
+}
+
+template <typename TAddr>
+void c_dv_table<TAddr>::set_link(const TAddr & neighbor, int cost, t_clock::time_point now) {
+	cost = std::max(1, std::min(cost, cost_infinity));
+	if (cost == cost_infinity) { link_down(neighbor, now); return; }
+	auto found = m_links.find(neighbor);
+	if ((found != m_links.end()) && (found->second == cost)) return;
+	m_links[neighbor] = cost;
+	for (auto & item : m_routes) {
+		auto & route = item.second;
+		if ((route.m_nexthop != neighbor) || (route.m_cost >= cost_infinity)) continue;
+		const int new_cost = std::min(route.m_adv_cost + cost, cost_infinity);
+		if (new_cost == route.m_cost) continue;
+		if (new_cost >= cost_infinity) { retract(route, now); continue; }
+		route.m_cost = new_cost;
+		set_changed(route);
+	}
+}
+
+template <typename TAddr>
+void c_dv_table<TAddr>::link_down(const TAddr & neighbor, t_clock::time_point now) {
+	if (m_links.erase(neighbor) == 0) return;
+	for (auto & item : m_routes) {
+		if ((item.second.m_nexthop == neighbor) && (item.second.m_cost < cost_infinity)) retract(item.second, now);
+	}
+}
+
+template <typename TAddr>
+bool c_dv_table<TAddr>::got_adv(const TAddr & neighbor, const t_adv<TAddr> & adv, t_clock::time_point now) {
+	if (adv.m_dst == m_self) return false;
+	auto link = m_links.find(neighbor);
+	if (link == m_links.end()) return false; // not our peer (yet)
+	const int adv_cost = std::max(0, std::min(adv.m_cost, cost_infinity));
+	const int cost = std::min(adv_cost + link->second, cost_infinity);
+
+	auto found = m_routes.find(adv.m_dst);
+	if (found == m_routes.end()) {
+		if (cost >= cost_infinity) return false;
+		auto & route = m_routes.emplace( adv.m_dst , t_route{ neighbor, cost, adv_cost, adv.m_seqno, now, false } ).first->second;
+		set_changed(route);
+		return true;
+	}
+
+	auto & route = found->second;
+	const bool from_nexthop = (route.m_nexthop == neighbor);
+	const int32_t age = static_cast<int32_t>(adv.m_seqno - route.m_seqno); // > 0 if adv is newer (wraps around)
+	if ((cost >= cost_infinity) && (! from_nexthop)) return false; // he lost it, but our route does not go via him
+	// newer seqno wins, but we do not move to a worse path just because its advert came first (that would flap after each full update)
+	const bool accept = from_nexthop ? (age >= 0) : ( ((age > 0) && (cost <= route.m_cost)) || ((age == 0) && (cost < route.m_cost)) );
+	if (! accept) return false;
+
+	const bool changed = (! from_nexthop) || (cost != route.m_cost);
+	route.m_nexthop = neighbor;
+	route.m_adv_cost = adv_cost;
+	route.m_seqno = adv.m_seqno;
+	if ((cost >= cost_infinity) && (route.m_cost < cost_infinity)) { retract(route, now);  return true; }
+	route.m_cost = cost;
+	if (cost < cost_infinity) route.m_time = now; // refreshed (a gone route keeps time when it was gone)
+	if (changed || (age > 0)) set_changed(route); // newer seqno is passed on at once too: routes broken on the way wait for it
+	return changed;
+}
+
+template <typename TAddr>
+typename c_dv_table<TAddr>::e_update c_dv_table<TAddr>::start_update(t_clock::time_point now) {
+	for (auto it = m_routes.begin(); it != m_routes.end(); ) {
+		auto & route = it->second;
+		if (route.m_cost < cost_infinity) {
+			if (now - route.m_time > route_timeout) retract(route, now);
+		}
+		else if (now - route.m_time > gc_timeout) { it = m_routes.erase(it);  continue; }
+		++it;
+	}
+
+	if ((m_last_full == t_clock::time_point()) || (now - m_last_full >= full_update_interval)) {
+		m_seqno += 2; // our own route is fresh again
+		m_last_full = now;
+		m_last_update = now;
+		return e_update::full;
+	}
+	if (m_any_changed && (now - m_last_update >= triggered_update_interval)) {
+		m_last_update = now;
+		return e_update::changed;
+	}
+	return e_update::none;
+}
+
+template <typename TAddr>
+std::vector<t_adv<TAddr>> c_dv_table<TAddr>::make_adv(const TAddr & neighbor, bool only_changed) const {
+	std::vector<t_adv<TAddr>> ret;
+	if (! only_changed) ret.push_back( t_adv<TAddr>{ m_self, 0, m_seqno } );
+	for (const auto & item : m_routes) {
+		const auto & route = item.second;
+		if (only_changed && (! route.m_changed)) continue;
+		if (item.first == neighbor) continue; // he knows the way to himself
+		if (route.m_nexthop == neighbor) { // split horizon
+			if (only_changed) ret.push_back( t_adv<TAddr>{ item.first, cost_infinity, route.m_seqno } ); // poisoned: he must not use us
+			continue;
+		}
+		ret.push_back( t_adv<TAddr>{ item.first, route.m_cost, route.m_seqno } );
+	}
+	return ret;
+}
+
+template <typename TAddr>
+void c_dv_table<TAddr>::update_sent() {
+	for (auto & item : m_routes) item.second.m_changed = false;
+	m_any_changed = false;
+}
+
+template <typename TAddr>
+typename c_dv_table<TAddr>::t_clock::time_point c_dv_table<TAddr>::next_update_time() const {
+	if (m_last_full == t_clock::time_point()) return m_last_full; // the first one is due now
+	auto next = m_last_full + full_update_interval;
+	if (m_any_changed) next = std::min( next , m_last_update + triggered_update_interval );
+	for (const auto & item : m_routes) { // gone routes are forgotten in a full update, they need no triggered one
+		if (item.second.m_cost < cost_infinity) next = std::min( next , item.second.m_time + route_timeout );
+	}
+	return next;
+}
+
+template <typename TAddr>
+TAddr c_dv_table<TAddr>::get_nexthop(const TAddr & dst) const {
+	const auto & route = get_route(dst);
+	if (route.m_cost >= cost_infinity) throw expected_not_found();
+	return route.m_nexthop;
+}
+
+template <typename TAddr>
+const typename c_dv_table<TAddr>::t_route & c_dv_table<TAddr>::get_route(const TAddr & dst) const {
+	auto found = m_routes.find(dst);
+	if (found == m_routes.end()) throw expected_not_found();
+	return found->second;
+}
+
+template <typename TAddr>
+size_t c_dv_table<TAddr>::size() const { return m_routes.size(); }
+
+} // namespace route_dv
+
+#endif
@@ -0,0 +1,274 @@
+#include "c_routing_manager.hpp"
+
+#include "c_multipath.hpp"
+
+using namespace std;
+
+const char* expected_not_found_missing_pubkey::what() const noexcept {
+		return "expected_not_found_missing_pubkey";
+}
+
+constexpr int c_routing_manager::search_retries;
+
+std::ostream & operator<<(std::ostream & ostr, std::chrono::steady_clock::time_point tp) {
+	using namespace std::chrono;
+	steady_clock::duration dtn = tp.time_since_epoch();
+	return ostr << duration_cast<seconds>(dtn).count();
+}
+
+std::ostream & operator<<(std::ostream & ostr, const c_routing_manager::t_search_mode & obj) {
+	switch (obj) {
+		case c_routing_manager::e_search_mode_route_own_packet: return ostr<<"route_OWN";
+		case c_routing_manager::e_search_mode_route_other_packet: return ostr<<"route_OTHER";
+		case c_routing_manager::e_search_mode_help_find: return ostr<<"help_FIND";
+	}
+	_warn("Unknown reason"); return ostr<<"???";
+}
+
+std::ostream & operator<<(std::ostream & ostr, const c_routing_manager::c_route_info & obj) {
+	return ostr << "{ROUTE: next_hop=" << obj.m_nexthop
+		<< " cost=" << obj.m_cost << " time=" << obj.m_time << "}";
+}
+
+std::ostream & operator<<(std::ostream & ostr, const c_routing_manager::c_route_reason & obj) {
+	return ostr << "{Reason: asked from " << obj.m_his_addr << " as " << obj.m_search_mode << "}";
+}
+std::ostream & operator<<(std::ostream & ostr, const c_routing_manager::c_route_reason_detail & obj) {
+	return ostr << "{Reason...: at " << obj.m_when << " with TTL=" << obj.m_ttl << "}";
+}
+
+std::ostream & operator<<(std::ostream & ostr, const c_routing_manager::c_route_search & obj) {
+	ostr << "{SEARCH for route to DST="<<obj.m_addr<<", was yet run=" << (obj.m_ever?"YES":"never")
+		<< " ask: time="<<obj.m_ask_time<<" ttl should="<<obj.m_ttl_should_use << ", ttl used=" << obj.m_ttl_used;
+	if (obj.m_request.size()) {
+		ostr << "with " << obj.m_request.size() << " REQUESTS:" << endl;
+		for(auto const & r : obj.m_request) ostr << " REQ: " << r.first << " => " << r.second << endl;
+		ostr << endl;
+	} else ostr << " (no requesters here)";
+	ostr << "}";
+	return ostr;
+}
+
+
+c_routing_manager::c_route_info::c_route_info(c_haship_addr nexthop, int link_cost, int cost_after_nexthop,
+	const c_haship_pubkey & pubkey)
+	: m_state(e_route_state_found), m_nexthop(nexthop)
+	, m_pubkey(pubkey)
+	, m_cost(0), m_link_cost(0), m_cost_after_nexthop(cost_after_nexthop), m_time(  std::chrono::steady_clock::now() )
+{
+	set_link_cost(link_cost);
+}
+
+int c_routing_manager::c_route_info::get_cost() const { return m_cost; }
+
+void c_routing_manager::c_route_info::set_link_cost(int link_cost) {
+	m_link_cost = link_cost;
+	m_cost = std::min<int>( m_link_cost + m_cost_after_nexthop , c_protocol::route_cost_max ); // it is sent in one byte
+}
+
+c_routing_manager::c_route_reason_detail::c_route_reason_detail( t_route_time when , int ttl )
+	: m_when(when) , m_ttl ( ttl )
+{ }
+
+void c_routing_manager::c_route_search::add_request(c_routing_manager::c_route_reason reason , int ttl) {
+	auto found = m_request.find( reason );
+	if (found == m_request.end()) { // new reason for search
+		c_route_reason_detail reason_detail( std::chrono::steady_clock::now() , ttl );
+		_info("Adding new reason for search: " << reason << " details: " << reason_detail);
+		m_request.emplace(reason, reason_detail);
+	}
+	else {
+		auto & detail = found->second;
+		_info("Updating reason of search: " << reason << " old detail: " << detail );
+		detail.m_when = std::chrono::steady_clock::now();
+		detail.m_ttl = std::max( detail.m_ttl , ttl ); // use the bigger TTL [confroute]
+		_info("Updating reason of search: " << reason << " new detail: " << detail );
+	}
+
+	// update this search'es goal TTL
+	// TODO(r)-refact: this could be factored into some generic: set_highest() , with optional debug too
+	auto ttl_old = this->m_ttl_should_use;
+	this->m_ttl_should_use = std::max( this->m_ttl_should_use , ttl);
+	if (ttl_old != this->m_ttl_should_use) _info("Updated this search TTL to " << this->m_ttl_should_use << " from " << ttl_old);
+}
+
+c_routing_manager::c_route_reason::c_route_reason(c_haship_addr his_addr, t_search_mode mode)
+	: m_his_addr(his_addr), m_search_mode(mode)
+{
+	_info("NEW reason: "<< (*this));
+}
+
+bool c_routing_manager::c_route_reason::operator<(const c_route_reason &other) const {
+	if (this->m_his_addr < other.m_his_addr) return 1;
+	if (this->m_search_mode < other.m_search_mode) return 1;
+	return 0;
+}
+
+bool c_routing_manager::c_route_reason::operator==(const c_route_reason &other) const {
+	return (this->m_his_addr == other.m_his_addr) && (this->m_search_mode == other.m_search_mode);
+}
+
+c_routing_manager::c_route_search::c_route_search(c_haship_addr addr, int basic_ttl)
+	: m_addr(addr), m_ever(false), m_ask_time(), m_ttl_used(0), m_ttl_should_use(5), m_retries(0)
+{
+	UNUSED(basic_ttl); // TODO or use it as m_ttl_should_use?
+	_info("NEW router SEARCH: " << (*this));
+}
+
+const c_routing_manager::c_route_info & c_routing_manager::add_route_info_and_return(c_haship_addr target, c_route_info route_info) {
+	// TODO(r): refactor out the create-or-update idiom
+	auto it = m_route_nexthop.find( target );
+	if (it == m_route_nexthop.end()) { // new one
+		_info("This is NEW route information." << route_info);
+		auto new_obj = make_unique<c_route_info>( route_info ); // TODO(rob): std::move it here - optimization?
+		m_route_multipath[ target ].emplace( route_info.m_nexthop , route_info );
+		auto emplace = m_route_nexthop.emplace( std::move(target) , std::move(new_obj) );
+		assert(emplace.second == true); // inserted new
+		return * emplace.first->second; // reference to object stored in member we own
+	} else {
+		_info("This is UPDATED route information." << route_info);
+		auto & paths = m_route_multipath[ target ];
+		paths.erase( route_info.m_nexthop ); // replace route via this next hop
+		paths.emplace( route_info.m_nexthop , route_info );
+		const bool checked = (it->second->m_state == e_route_state_provisional) && (route_info.m_state != e_route_state_provisional);
+		if (checked || (route_info.m_cost < it->second->m_cost)) * it->second = route_info; // the better one is the main route
+		return * it->second;
+	}
+}
+
+void c_routing_manager::set_link_cost(c_haship_addr nexthop, int link_cost) {
+	auto & known = m_link_cost[ nexthop ];
+	if (known == link_cost) return;
+	known = link_cost;
+	for (auto & dst : m_route_multipath) {
+		auto path = dst.second.find( nexthop );
+		if (path == dst.second.end()) continue;
+		path->second.set_link_cost( link_cost );
+		auto main = m_route_nexthop.find( dst.first );
+		if (main == m_route_nexthop.end()) continue;
+		auto & route = * main->second;
+		if (route.m_nexthop == nexthop) route.set_link_cost( link_cost );
+		for (const auto & other : dst.second) { // the better one is the main route, as in add_route_info_and_return
+			const bool checked = (route.m_state == e_route_state_provisional) && (other.second.m_state != e_route_state_provisional);
+			if (checked || (other.second.m_cost < route.m_cost)) route = other.second;
+		}
+	}
+}
+
+c_haship_addr c_routing_manager::pick_nexthop(c_haship_addr dst, uint64_t flow_hash, const t_nexthop_weight_func & nexthop_weight) const {
+	auto found = m_route_multipath.find( dst );
+	if (found == m_route_multipath.end()) throw expected_not_found();
+	int best_cost = std::numeric_limits<int>::max();
+	for (const auto & path : found->second) best_cost = std::min( best_cost , path.second.get_cost() );
+
+	std::vector< std::pair< c_haship_addr , double > > paths;
+	for (const auto & path : found->second) {
+		const int cost = path.second.get_cost();
+		if (cost * 2 > best_cost * 3) continue; // not near-equal (more then 50% worse)
+		paths.emplace_back( path.first , nexthop_weight(path.first) / std::max(cost, 1) );
+	}
+	if (paths.size() == 1) {
+		if (! (paths.at(0).second > 0)) throw expected_not_found();
+		return paths.at(0).first;
+	}
+	try { return multipath::pick_path( flow_hash , paths ); }
+	catch(const std::invalid_argument &) { throw expected_not_found(); } // no next hop is usable now
+}
+
+const c_routing_manager::c_route_info & c_routing_manager::get_route_or_maybe_search(c_galaxy_node & galaxy_node, c_haship_addr dst, c_routing_manager::c_route_reason reason, bool start_search , int search_ttl) {
+	_info("ROUTING-MANAGER: find: " << dst << ", for reason: " << reason );
+
+	try {
+		const auto & peer = galaxy_node.get_peer_with_hip(dst,false); // no need for PK now, caller will do this on his own usually
+		_info("We have that peer directly: " << peer );
+		const int cost = peer.get_link_quality().get_cost(); // direct peer: cost of this link (from RTT, jitter, loss)
+		c_route_info route_info( peer.get_hip() , cost , 0 , * peer.get_pub() );
+		_info("Direct route: " << route_info);
+		const auto & route_info_ref_we_own = this -> add_route_info_and_return( dst , route_info ); // store it, so that we own this object
+		return route_info_ref_we_own; // <--- return direct
+	}
+	catch(expected_not_found_missing_pubkey) { _dbg1("We LACK PUBLIC KEY for peer dst="<<dst<<" (but we have him besides that)"); } 
+	catch(expected_not_found) { _dbg1("We do not have that dst="<<dst<<" in peers at all"); } // not found in direct peers
+
+	auto found = m_route_nexthop.find( dst ); // <--- search what we know
+	if (found != m_route_nexthop.end()) { // found
+		const auto & route = found->second;
+		_info("ROUTING-MANAGER: found route: " << (*route));
+		if (start_search && (route->m_state == e_route_state_provisional) && (m_search.count(dst) == 0)) {
+			_info("Route is from state snapshot, searching again to check it");
+			start_route_search( galaxy_node , dst , reason , search_ttl );
+		}
+		return *route; // <--- warning: refrerence to this-owned object that is easily invalidatd
+	}
+	else { // don't have a planned route to him
+		if (!start_search) {
+			_info("No route, but we also so not want to search for it.");
+			throw std::runtime_error("no route known (and we do NOT WANT TO search) to dst=" + STR(dst));
+		}
+		else {
+			_info("Route not found, we will be searching");
+			start_route_search( galaxy_node , dst , reason , search_ttl );
+		}
+	}
+	_note("NO ROUTE");
+	throw std::runtime_error("NO ROUTE known (at current time) to dst=" + STR(dst));
+}
+
+void c_routing_manager::start_route_search(c_galaxy_node & galaxy_node, c_haship_addr dst, c_route_reason reason, int search_ttl) {
+	bool created_now=false;
+	auto search_iter = m_search.find(dst);
+	if (search_iter == m_search.end()) {
+		created_now=true;
+		_info("STARTED SEARCH (created brand new search record) for route to dst="<<dst);
+		auto new_search = make_unique<c_route_search>(dst, search_ttl); // start a new search, at this TTL
+		new_search->add_request( reason , search_ttl ); // add a first reason (it also sets TTL)
+		auto search_emplace = m_search.emplace( std::move(dst) , std::move(new_search) );
+
+		assert(search_emplace.second == true); // the insertion took place
+		search_iter = search_emplace.first; // save here the result
+	}
+	else {
+		_info("STARTED SEARCH (updated an existing search) for this to dst="<<dst);
+		search_iter->second->add_request( reason , search_ttl ); // add reason (can increase TTL)
+	}
+	auto & search_obj = search_iter->second; // search exists now (new or updated)
+	if (created_now) {
+		search_obj->execute( galaxy_node ); // ***
+		galaxy_node.route_search_started( search_iter->first );
+	}
+}
+
+bool c_routing_manager::retry_route_search(c_galaxy_node & galaxy_node, c_haship_addr dst) {
+	auto search_iter = m_search.find(dst);
+	if (search_iter == m_search.end()) return false;
+	auto route = m_route_nexthop.find(dst);
+	const bool found = (route != m_route_nexthop.end()) && (route->second->m_state == e_route_state_found);
+	auto & search_obj = search_iter->second;
+	if (found || (search_obj->m_retries >= search_retries)) {
+		_info("Search for route to dst=" << dst << (found ? " is done" : " found nothing, dropping it"));
+		m_search.erase(search_iter);
+		return false;
+	}
+	++search_obj->m_retries;
+	_info("Search for route to dst=" << dst << " again (retry " << search_obj->m_retries << ")");
+	search_obj->execute( galaxy_node );
+	return true;
+}
+
+void  c_routing_manager::c_route_search::execute( c_galaxy_node & galaxy_node ) {
+	_info("Sending QUERY for HIP, with m_ttl_should_use=" << m_ttl_should_use);
+	string_as_bin data; // [protocol] for search query - format is: HIP_BINARY;TTL_BINARY;
+
+	data += string_as_bin(m_addr);
+	data += string(";");
+
+	unsigned char byte_highest_ttl = m_ttl_should_use;  assert( m_ttl_should_use == byte_highest_ttl ); // TODO(r) asserted narrowing
+	data += string(1, static_cast<char>(byte_highest_ttl) );
+	data += string(";");
+
+	galaxy_node.nodep2p_foreach_cmd( c_protocol::e_proto_cmd_findhip_query , data );
+
+	m_ttl_used = byte_highest_ttl;
+	m_ask_time = std::chrono::steady_clock::now();
+}
+
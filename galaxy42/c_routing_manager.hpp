@@ -0,0 +1,167 @@
+#pragma once
+#ifndef include_c_routing_manager_hpp
+#define include_c_routing_manager_hpp
+
+#include "libs1.hpp"
+
+#include <chrono>
+#include <functional>
+#include <map>
+
+#include "haship.hpp"
+#include "protocol.hpp"
+#include "c_peering.hpp"
+
+/***
+  @brief interface for object that can act as p2p node
+*/
+class c_galaxy_node {
+	public:
+		c_galaxy_node()=default;
+		virtual ~c_galaxy_node()=default;
+
+		virtual void nodep2p_foreach_cmd( c_protocol::t_proto_cmd cmd, string_as_bin data )=0; ///< send given command/data to each peer
+
+		///! return peering reference of a peer by given HIP. Will throw expected_not_found (read more)
+		///! if require_pubkey, then will throw expected_not_found_missing_pubkey if peer is here but missing his pubkey
+		virtual const c_peering & get_peer_with_hip( c_haship_addr addr , bool require_pubkey )=0;
+
+		///! a new search for route to dst was sent; it should be retried later (see c_routing_manager::retry_route_search)
+		virtual void route_search_started( c_haship_addr dst )=0;
+};
+
+// ------------------------------------------------------------------
+
+
+// when we can not find e.g.a peer because we are missing his pubkey and it is required
+class expected_not_found_missing_pubkey : public stdplus::expected_exception {
+	public:
+		const char* what() const noexcept override;
+};
+
+
+
+/***
+@brief Use this to get information about route. It resp.: returns, stores and searches the information.
+- m_search - pathes we now look for
+- m_route_nexthop - known pathes
+*/
+class c_routing_manager { ///< holds knowledge about routes, and searches for new ones
+	public: // TODO(r) make it private, when possible - e.g. when all operator<< are changed to public: print(ostream&) const;
+		enum t_route_state { e_route_state_found, e_route_state_dead,
+			e_route_state_provisional }; // from state snapshot: used, but searched again to check it
+
+		enum t_search_mode {  // why we look for a route
+			e_search_mode_route_own_packet, // we want ourselves to send there
+			e_search_mode_route_other_packet,  // we want to route packet of someone else
+			e_search_mode_help_find }; // some else is asking us about the route
+
+		typedef	std::chrono::steady_clock::time_point t_route_time; ///< type for representing times using in routing search etc
+
+		class c_route_info {
+			public:
+				t_route_state m_state; ///< e.g. e_route_state_found is route is ready to be used
+				c_haship_addr m_nexthop; ///< hash-ip of next hop in this route
+				c_haship_pubkey m_pubkey;
+
+				int m_cost; ///< sum of link costs (see c_link_quality::get_cost) on the route: m_link_cost + m_cost_after_nexthop
+				int m_link_cost; ///< of our link to the next hop (it changes, see set_link_cost)
+				int m_cost_after_nexthop; ///< from the next hop to the destination (0 for a direct peer)
+				t_route_time m_time; ///< age of this route
+				// int m_ttl; ///< at which TTL we got this reply
+
+				c_route_info(c_haship_addr nexthop, int link_cost, int cost_after_nexthop, const c_haship_pubkey & pubkey);
+
+				int get_cost() const;
+				void set_link_cost(int link_cost); ///< our link to the next hop changed, m_cost too
+		};
+
+		class c_route_reason {
+			public:
+				c_haship_addr m_his_addr; ///< his address to which we should tell him the path
+				t_search_mode m_search_mode; ///< do we search it for him because we need to route for him, or because he asked, etc
+				// c_haship_addr m_his_question; ///< the address about which we aksed
+
+				c_route_reason(c_haship_addr his_addr, t_search_mode mode);
+
+				bool operator<(const c_route_reason &other) const;
+				bool operator==(const c_route_reason &other) const;
+		};
+
+		class c_route_reason_detail {
+			public:
+				t_route_time m_when; ///< when we hasked about this address last time
+				int m_ttl; ///< with what TTL we are doing the search
+				c_route_reason_detail( t_route_time when , int ttl );
+		};
+
+		class c_route_search {
+			public:
+				c_haship_addr m_addr; ///< goal of search: dst address
+				bool m_ever; ///< was this ever actually searched yet
+				t_route_time m_ask_time; ///< at which time we last time tried asking
+
+				int m_ttl_used; ///< at which TTL we actually last time tried asking
+				int m_ttl_should_use; ///< at which TTL we want to search, looking at our requests (this is optimization - it's same as highest value in m_requests[])
+				int m_retries; ///< how many times it was sent again, because no reply came (see retry_route_search)
+				// TODO(r)
+				// guy ttl=4 --> ttl3 --> ttl2 --> ttl1 *MYSELF*, highest_ttl=1, when we execute then: send ttl=0, set ask_ttl=0
+				// ... meanwhile ...
+				//                    guy ttl4 --> ttl3 *MYSELF*, highest_ttl=3(!!!), when we execute then: send ttl=2 (when timeout!) then ask_ttl=2
+
+				map< c_route_reason , c_route_reason_detail > m_request; ///< information about all other people who are asking about this address
+
+				c_route_search(c_haship_addr addr, int basic_ttl);
+
+				void add_request(c_routing_manager::c_route_reason reason, int ttl); ///< add info that this guy also wants to be informed about the path
+				void execute( c_galaxy_node & galaxy_node );
+		};
+
+
+
+		// searches:
+		typedef std::map< c_haship_addr, unique_ptr<c_route_search> > t_route_search_by_dst; ///< running searches, by the hash-ip of finall destination
+		t_route_search_by_dst m_search; ///< running searches
+
+		// known routes:
+		typedef std::map< c_haship_addr, unique_ptr<c_route_info> > t_route_nexthop_by_dst; ///< routes to destinations: the hash-ip of next hop, by hash-ip of finall destination
+		t_route_nexthop_by_dst m_route_nexthop; ///< known routes: the hash-ip of next hop, indexed by hash-ip of finall destination
+
+		// all known routes, for multipath:
+		typedef std::map< c_haship_addr, c_route_info > t_route_by_nexthop; ///< routes to one destination, by hash-ip of next hop
+		std::map< c_haship_addr, t_route_by_nexthop > m_route_multipath; ///< all known routes, by hash-ip of finall destination
+
+		const c_route_info & add_route_info_and_return(c_haship_addr target, c_route_info route_info); ///< learn a route to this target. If it exists, then merge it correctly (e.g. pick better one)
+
+		/// our link to this next hop has now this cost: so have routes through it (and maybe other route is now the main one)
+		void set_link_cost(c_haship_addr nexthop, int link_cost);
+
+	private:
+		std::map< c_haship_addr, int > m_link_cost; ///< last cost given to set_link_cost, to skip it when nothing changed
+
+		void start_route_search(c_galaxy_node & galaxy_node, c_haship_addr dst, c_route_reason reason, int search_ttl); ///< or add reason to running one
+
+	public:
+		static constexpr int search_retries = 3; ///< search that found nothing is sent again that many times, then it is dropped
+
+		typedef std::function< double(const c_haship_addr &) > t_nexthop_weight_func; ///< how good is this next hop (0 - do not use it)
+
+		const c_route_info & get_route_or_maybe_search(c_galaxy_node & galaxy_node , c_haship_addr dst, c_routing_manager::c_route_reason reason, bool start_search, int search_ttl);
+
+		/// next hop for this flow to dst, from the known routes of (near) best cost, by weight of next hops. Throws if no route is known
+		c_haship_addr pick_nexthop(c_haship_addr dst, uint64_t flow_hash, const t_nexthop_weight_func & nexthop_weight) const;
+
+		///! send the search for dst again, if it found no route yet. @return should it be retried later (else the search is dropped
+		///! - when found, or after search_retries; the next packet to dst can start a new one)
+		bool retry_route_search(c_galaxy_node & galaxy_node, c_haship_addr dst);
+};
+
+std::ostream & operator<<(std::ostream & ostr, std::chrono::steady_clock::time_point tp);
+std::ostream & operator<<(std::ostream & ostr, const c_routing_manager::t_search_mode & obj);
+std::ostream & operator<<(std::ostream & ostr, const c_routing_manager::c_route_info & obj);
+std::ostream & operator<<(std::ostream & ostr, const c_routing_manager::c_route_reason & obj);
+std::ostream & operator<<(std::ostream & ostr, const c_routing_manager::c_route_reason_detail & obj);
+std::ostream & operator<<(std::ostream & ostr, const c_routing_manager::c_route_search & obj);
+
+#endif
+
@@ -0,0 +1,162 @@
+#include "c_state_snapshot.hpp"
+#include "trivialserialize.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace state_snapshot {
+
+namespace {
+
+const std::string magic = "G42STATE"; ///< at start of the file
+
+enum e_section : unsigned char { e_section_pubkeys = 1, e_section_peers = 2, e_section_routes = 3, e_section_tunnels = 4 };
+
+void push_hip(trivialserialize::generator & gen, const t_hip & hip) {
+	gen.push_bytes_n( hip.size() , std::string( hip.begin() , hip.end() ) );
+}
+
+t_hip pop_hip(trivialserialize::parser & parser) {
+	t_hip hip;
+	parser.pop_bytes_n_into_buff( hip.size() , reinterpret_cast<char*>( hip.data() ) );
+	return hip;
+}
+
+void push_age(trivialserialize::generator & gen, t_age age) {
+	gen.push_integer_u<4>( static_cast<uint32_t>( std::min<t_age::rep>( std::max<t_age::rep>( age.count() , 0 ) , 0xFFFFFFFE ) ) );
+}
+
+void throw_errno(const std::string & what) { throw std::runtime_error(what + ": " + std::strerror(errno)); }
+
+} // namespace
+
+constexpr unsigned char c_snapshot::version;
+constexpr t_age c_snapshot::max_age;
+constexpr t_age c_snapshot::max_route_age;
+
+std::string c_snapshot::serialize(std::chrono::system_clock::time_point now) const {
+	// [format] magic(8) version(1) written(8, unix time in seconds) sections_count(uvarint) { id(1) body(varstring) }...
+	// a newer program can add sections (an older one skips sections that it does not know), other changes need new version
+	trivialserialize::generator gen(1000);
+	gen.push_bytes_n( magic.size() , magic );
+	gen.push_byte_u( version );
+	gen.push_integer_u<8>( static_cast<uint64_t>( std::chrono::duration_cast<std::chrono::seconds>( now.time_since_epoch() ).count() ) );
+	gen.push_integer_uvarint(4);
+
+	{ // [format] pubkeys: count(uvarint) { hip(16) pubkey(varstring) }...
+		trivialserialize::generator body(1000);
+		body.push_integer_uvarint( m_pubkeys.size() );
+		for (const auto & pubkey : m_pubkeys) { push_hip(body, pubkey.first);  body.push_varstring(pubkey.second); }
+		gen.push_byte_u( e_section_pubkeys );
+		gen.push_varstring( body.get_buffer() );
+	}
+	{ // [format] peers: count(uvarint) { hip(16) pip(c_ip46_addr) age(4) }...
+		trivialserialize::generator body(100);
+		body.push_integer_uvarint( m_peers.size() );
+		for (const auto & peer : m_peers) { push_hip(body, peer.m_hip);  body.push_object(peer.m_pip);  push_age(body, peer.m_age); }
+		gen.push_byte_u( e_section_peers );
+		gen.push_varstring( body.get_buffer() );
+	}
+	{ // [format] routes: count(uvarint) { dst(16) nexthop(16) cost(2) age(4) }...
+		trivialserialize::generator body(100);
+		body.push_integer_uvarint( m_routes.size() );
+		for (const auto & route : m_routes) {
+			push_hip(body, route.m_dst);  push_hip(body, route.m_nexthop);
+			body.push_integer_u<2>( static_cast<uint16_t>( std::min( std::max( route.m_cost , 0 ) , 0xFFFE ) ) );
+			push_age(body, route.m_age);
+		}
+		gen.push_byte_u( e_section_routes );
+		gen.push_varstring( body.get_buffer() );
+	}
+	{ // [format] tunnels: count(uvarint) { hip(16) }...
+		trivialserialize::generator body(100);
+		body.push_integer_uvarint( m_tunnels.size() );
+		for (const auto & hip : m_tunnels) push_hip(body, hip);
+		gen.push_byte_u( e_section_tunnels );
+		gen.push_varstring( body.get_buffer() );
+	}
+	return gen.get_buffer();
+}
+
+c_snapshot c_snapshot::deserialize(const std::string & data, std::chrono::system_clock::time_point now) {
+	trivialserialize::parser parser( trivialserialize::parser::tag_caller_must_keep_this_string_valid() , data );
+	if (parser.pop_bytes_n( magic.size() ) != magic) throw trivialserialize::format_error_read_badformat();
+	if (parser.pop_byte_u() != version) throw trivialserialize::format_error_read_invalid_version();
+	const auto written = std::chrono::system_clock::time_point( std::chrono::seconds( parser.pop_integer_u<8, uint64_t>() ) );
+	const t_age elapsed = std::max( std::chrono::duration_cast<t_age>( now - written ) , t_age(0) ); // clock could go back
+
+	c_snapshot ret;
+	const uint64_t sections = parser.pop_integer_uvarint();
+	for (uint64_t i=0; i<sections; ++i) {
+		const unsigned char section = parser.pop_byte_u();
+		const std::string body_data = parser.pop_varstring();
+		trivialserialize::parser body( trivialserialize::parser::tag_caller_must_keep_this_string_valid() , body_data );
+		if (section == e_section_pubkeys) {
+			const uint64_t count = body.pop_integer_uvarint();
+			for (uint64_t j=0; j<count; ++j) {
+				const t_hip hip = pop_hip(body);
+				ret.m_pubkeys[hip] = body.pop_varstring();
+			}
+		}
+		else if (section == e_section_peers) {
+			const uint64_t count = body.pop_integer_uvarint();
+			for (uint64_t j=0; j<count; ++j) {
+				t_peer peer;
+				peer.m_hip = pop_hip(body);
+				peer.m_pip = body.pop_object<c_ip46_addr>();
+				peer.m_age = t_age( body.pop_integer_u<4, uint32_t>() ) + elapsed;
+				if (peer.m_age <= max_age) ret.m_peers.push_back(peer);
+			}
+		}
+		else if (section == e_section_routes) {
+			const uint64_t count = body.pop_integer_uvarint();
+			for (uint64_t j=0; j<count; ++j) {
+				t_route route;
+				route.m_dst = pop_hip(body);
+				route.m_nexthop = pop_hip(body);
+				route.m_cost = body.pop_integer_u<2, uint16_t>();
+				route.m_age = t_age( body.pop_integer_u<4, uint32_t>() ) + elapsed;
+				if (route.m_age <= max_route_age) ret.m_routes.push_back(route);
+			}
+		}
+		else if (section == e_section_tunnels) {
+			const uint64_t count = body.pop_integer_uvarint();
+			for (uint64_t j=0; j<count; ++j) ret.m_tunnels.push_back( pop_hip(body) );
+		}
+		else _info("Skipping unknown section " << static_cast<int>(section) << " of state snapshot (from newer program?)");
+	}
+	return ret;
+}
+
+void c_snapshot::save(const fs::path & path) const {
+	const std::string data = serialize( std::chrono::system_clock::now() );
+	if (path.has_parent_path()) fs::create_directories(path.parent_path());
+	const std::string tmp_path = path.native() + ".tmp";
+	const int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0) throw_errno("Can not create " + tmp_path);
+	const bool written = (write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size())) && (fsync(fd) == 0);
+	const int saved_errno = errno;
+	close(fd);
+	errno = saved_errno;
+	if (! written) throw_errno("Can not write " + tmp_path);
+	if (rename(tmp_path.c_str(), path.c_str()) != 0) throw_errno("Can not replace " + path.native());
+}
+
+c_snapshot c_snapshot::load(const fs::path & path) {
+	if (! fs::exists(path)) throw expected_not_found();
+	fs::ifstream file(path, std::ios::binary);
+	if (! file) throw std::runtime_error("Can not open " + path.native());
+	const std::string data( (std::istreambuf_iterator<char>(file)) , std::istreambuf_iterator<char>() );
+	return deserialize( data , std::chrono::system_clock::now() );
+}
+
+fs::path c_snapshot::default_path() {
+	fs::path path = filestorage::get_parent_path(e_filestore_galaxy_pub, "");
+	path += "state";
+	return path;
+}
+
+} // namespace state_snapshot
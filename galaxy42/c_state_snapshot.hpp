@@ -0,0 +1,60 @@
+#pragma once
+#ifndef include_c_state_snapshot_hpp
+#define include_c_state_snapshot_hpp
+
+#include "libs1.hpp"
+#include "c_ip46_addr.hpp"
+#include "filestorage.hpp"
+
+#include <array>
+#include <chrono>
+#include <map>
+
+/**
+ * @brief What a node learned about the network (pubkeys, peers, routes with their age), saved so that after a restart
+ * it is at full speed at once - without sending HI and findhip queries to learn it all again.
+ * Written in a versioned trivialserialize format (from time to time, and when the node exits), loaded at start.
+ * Loaded entries are only provisional: the node uses them, but checks them again (peers must answer our pings,
+ * routes are searched again) and forgets them when they get too old.
+ */
+namespace state_snapshot {
+
+typedef std::array<unsigned char, 16> t_hip; ///< e.g. c_haship_addr
+typedef std::chrono::seconds t_age; ///< how long ago was this known to be true
+
+struct t_peer {
+	t_hip m_hip;
+	c_ip46_addr m_pip; ///< his peering address
+	t_age m_age; ///< since he answered us last time
+};
+
+struct t_route {
+	t_hip m_dst;
+	t_hip m_nexthop;
+	int m_cost;
+	t_age m_age; ///< since we learned it
+};
+
+class c_snapshot final {
+	public:
+		static constexpr unsigned char version = 1; ///< of the format; older (or newer) versions are not loaded at all
+		static constexpr t_age max_age{ 24*60*60 }; ///< older peers are forgotten
+		static constexpr t_age max_route_age{ 30*60 }; ///< older routes are forgotten
+
+		std::map<t_hip, std::string> m_pubkeys; ///< pubkeys (serialize_bin) of nodes that are below, by their HIP
+		std::vector<t_peer> m_peers;
+		std::vector<t_route> m_routes; ///< also many to one destination (multipath)
+		std::vector<t_hip> m_tunnels; ///< nodes that we had end2end tunnels with
+
+		std::string serialize(std::chrono::system_clock::time_point now) const; ///< [format] see serialize()
+		/// ages grow by the time since it was written (at now), too old entries are dropped. Throws trivialserialize::format_error
+		static c_snapshot deserialize(const std::string & data, std::chrono::system_clock::time_point now);
+
+		void save(const fs::path & path) const; ///< in a new file, that then replaces the old one (so it is never half written)
+		static c_snapshot load(const fs::path & path); ///< throws expected_not_found if there is no such file, or other exceptions
+		static fs::path default_path(); ///< in our dir of public files, in $HOME
+};
+
+} // namespace state_snapshot
+
+#endif
@@ -0,0 +1,213 @@
+#pragma once
+#ifndef include_c_timer_wheel_hpp
+#define include_c_timer_wheel_hpp
+
+#include "libs1.hpp"
+
+#include <array>
+#include <chrono>
+#include <map>
+#include <random>
+#include <vector>
+
+/**
+ * @brief Hierarchical timing wheel (as in Varghese & Lauck; like timers in Linux): many timers (e.g. a few for each peer),
+ * and the work is for the timers that expire - not a scan of all peers on each loop.
+ * Time is in ticks; level 0 has a slot for each of next slot_count ticks, level 1 for each of next slot_count ranges of
+ * slot_count ticks, and so on. When the lower level wraps, the next slot of the level above is moved (cascaded) down.
+ * Each key has at most one timer: schedule() again moves it. Old places in slots are not searched for (that would be
+ * O(slot)), they are just skipped when reached (their generation is old).
+ * Timers never fire early, and at most one tick late (plus how late expire() is called).
+ */
+namespace timer_wheel {
+
+template <typename TKey>
+class c_timer_wheel final {
+	public:
+		typedef std::chrono::steady_clock t_clock;
+
+		static constexpr std::chrono::milliseconds tick{ 10 };
+		static constexpr unsigned int slot_bits = 6;
+		static constexpr size_t slot_count = size_t(1) << slot_bits; ///< in each level
+		static constexpr unsigned int level_count = 4; ///< 64^4 ticks (about 2 days); later timers wait in the last level
+
+		explicit c_timer_wheel(t_clock::time_point now);
+
+		/// timer for this key fires at when (not before); if the key had a timer, it is moved
+		void schedule(const TKey & key, t_clock::time_point when);
+		/// at when plus random part of jitter, so timers that are scheduled together (e.g. all peers at start) do not fire together
+		void schedule(const TKey & key, t_clock::time_point when, t_clock::duration jitter);
+		bool cancel(const TKey & key); ///< @return was it scheduled
+		bool is_scheduled(const TKey & key) const;
+		size_t size() const; ///< scheduled timers
+
+		/// keys of timers that expired till now (they are no longer scheduled, schedule them again if needed)
+		std::vector<TKey> expire(t_clock::time_point now);
+		/// for how long nothing will expire (e.g. timeout of select), but not more than max_wait. Can be too short, never too long
+		t_clock::duration time_to_next(t_clock::time_point now, t_clock::duration max_wait) const;
+
+	private:
+		typedef uint64_t t_tick;
+
+		struct t_slot_entry {
+			TKey m_key;
+			uint64_t m_generation; ///< is the entry current, see is_current()
+		};
+		struct t_timer {
+			uint64_t m_generation;
+			t_tick m_deadline;
+		};
+		typedef std::vector<t_slot_entry> t_slot;
+
+		t_tick to_tick_ceil(t_clock::time_point when) const;
+		t_tick to_tick_floor(t_clock::time_point when) const;
+		static size_t slot_index(t_tick ticks, unsigned int level);
+		void insert(const TKey & key, uint64_t generation, t_tick deadline); ///< into slot for its deadline
+		bool is_current(const t_slot_entry & entry) const; ///< not cancelled nor moved since it was put in slot
+		void advance(std::vector<TKey> & expired); ///< by one tick
+
+		const t_clock::time_point m_start; ///< tick 0
+		t_tick m_now; ///< ticks till this one are done
+		std::array<std::array<t_slot, slot_count>, level_count> m_slots;
+		std::map<TKey, t_timer> m_timers; ///< all scheduled
+		uint64_t m_generation;
+		std::minstd_rand m_random; ///< for jitter
+};
+
+template <typename TKey> constexpr std::chrono::milliseconds c_timer_wheel<TKey>::tick;
+template <typename TKey> constexpr unsigned int c_timer_wheel<TKey>::slot_bits;
+template <typename TKey> constexpr size_t c_timer_wheel<TKey>::slot_count;
+template <typename TKey> constexpr unsigned int c_timer_wheel<TKey>::level_count;
+
+template <typename TKey>
+c_timer_wheel<TKey>::c_timer_wheel(t_clock::time_point now)
+	: m_start(now), m_now(0), m_generation(0), m_random( std::random_device()() )
+{ }
+
+template <typename TKey>
+typename c_timer_wheel<TKey>::t_tick c_timer_wheel<TKey>::to_tick_ceil(t_clock::time_point when) const {
+	if (when <= m_start) return 0;
+	const auto elapsed = when - m_start;
+	const t_tick ticks = static_cast<t_tick>( elapsed / tick );
+	return (elapsed % tick == t_clock::duration::zero()) ? ticks : ticks+1;
+}
+
+template <typename TKey>
+typename c_timer_wheel<TKey>::t_tick c_timer_wheel<TKey>::to_tick_floor(t_clock::time_point when) const {
+	if (when <= m_start) return 0;
+	return static_cast<t_tick>( (when - m_start) / tick );
+}
+
+template <typename TKey>
+size_t c_timer_wheel<TKey>::slot_index(t_tick ticks, unsigned int level) {
+	return static_cast<size_t>( (ticks >> (slot_bits*level)) & (slot_count-1) );
+}
+
+template <typename TKey>
+void c_timer_wheel<TKey>::schedule(const TKey & key, t_clock::time_point when) {
+	t_timer & timer = m_timers[key];
+	timer.m_generation = ++m_generation; // place of the old one (if any) is now skipped
+	timer.m_deadline = std::max( to_tick_ceil(when) , m_now+1 ); // tick m_now is done already
+	insert(key, timer.m_generation, timer.m_deadline);
+}
+
+template <typename TKey>
+void c_timer_wheel<TKey>::schedule(const TKey & key, t_clock::time_point when, t_clock::duration jitter) {
+	if (jitter <= t_clock::duration::zero()) { schedule(key, when); return; }
+	std::uniform_int_distribution<t_clock::rep> distribution(0, jitter.count());
+	schedule(key, when + t_clock::duration( distribution(m_random) ));
+}
+
+template <typename TKey>
+bool c_timer_wheel<TKey>::cancel(const TKey & key) {
+	return m_timers.erase(key) > 0; // its entry in slot is skipped
+}
+
+template <typename TKey>
+bool c_timer_wheel<TKey>::is_scheduled(const TKey & key) const {
+	return m_timers.count(key) > 0;
+}
+
+template <typename TKey>
+size_t c_timer_wheel<TKey>::size() const { return m_timers.size(); }
+
+template <typename TKey>
+void c_timer_wheel<TKey>::insert(const TKey & key, uint64_t generation, t_tick deadline) {
+	// the lowest level where deadline is in the current range of the level above (then its slot is after the current one)
+	for (unsigned int level=0; level<level_count; ++level) {
+		const unsigned int shift = slot_bits*(level+1);
+		if ((deadline >> shift) == (m_now >> shift)) {
+			m_slots.at(level).at( slot_index(deadline, level) ).push_back( t_slot_entry{ key , generation } );
+			return;
+		}
+	}
+	// too far: into slot of the next wrap of the last level (not after the deadline), then it is inserted again from there
+	m_slots.at(level_count-1).at(0).push_back( t_slot_entry{ key , generation } );
+}
+
+template <typename TKey>
+bool c_timer_wheel<TKey>::is_current(const t_slot_entry & entry) const {
+	const auto found = m_timers.find(entry.m_key);
+	return (found != m_timers.end()) && (found->second.m_generation == entry.m_generation);
+}
+
+template <typename TKey>
+void c_timer_wheel<TKey>::advance(std::vector<TKey> & expired) {
+	++m_now;
+	for (unsigned int level=level_count-1; level>=1; --level) { // cascade, from the top, each level where lower ones wrapped
+		if ((m_now & ((t_tick(1) << (slot_bits*level)) - 1)) != 0) continue;
+		t_slot slot;
+		slot.swap( m_slots.at(level).at( slot_index(m_now, level) ) ); // entries can be inserted to this same slot again
+		for (const auto & entry : slot) {
+			if (is_current(entry)) insert(entry.m_key, entry.m_generation, m_timers.at(entry.m_key).m_deadline);
+		}
+	}
+	t_slot slot;
+	slot.swap( m_slots.at(0).at( slot_index(m_now, 0) ) );
+	for (const auto & entry : slot) {
+		if (! is_current(entry)) continue;
+		m_timers.erase(entry.m_key);
+		expired.push_back(entry.m_key);
+	}
+}
+
+template <typename TKey>
+std::vector<TKey> c_timer_wheel<TKey>::expire(t_clock::time_point now) {
+	std::vector<TKey> expired;
+	const t_tick target = to_tick_floor(now);
+	while (m_now < target) {
+		if (m_timers.empty()) { // nothing to fire, just jump (slots have only old entries)
+			for (auto & level : m_slots) for (auto & slot : level) slot.clear();
+			m_now = target;
+			break;
+		}
+		advance(expired);
+	}
+	return expired;
+}
+
+template <typename TKey>
+typename c_timer_wheel<TKey>::t_clock::duration c_timer_wheel<TKey>::time_to_next(t_clock::time_point now,
+	t_clock::duration max_wait) const
+{
+	if (m_timers.empty()) return max_wait;
+	// first tick with work: a non-empty slot of level 0, else a cascade of non-empty slot of level above, and so on
+	t_tick ticks = m_now+1;
+	bool found = false;
+	for (unsigned int level=0; (level<level_count) && (! found); ++level) {
+		// here ticks is aligned to level; current entries of this level are before the next wrap of it
+		while (true) {
+			found = ! m_slots.at(level).at( slot_index(ticks, level) ).empty();
+			if (found || (slot_index(ticks, level) == 0)) break; // at wrap the level above is cascaded, look there
+			ticks += t_tick(1) << (slot_bits*level);
+		}
+	}
+	if (! found) return max_wait;
+	const auto wait = std::chrono::duration_cast<t_clock::duration>( (m_start + ticks * tick) - now );
+	return std::max( std::min( wait , max_wait ) , t_clock::duration::zero() );
+}
+
+} // namespace timer_wheel
+
+#endif
+
@@ -0,0 +1,57 @@
+
+#include "c_traffic_shaper.hpp"
+
+c_token_bucket::c_token_bucket(double rate, double burst)
+	: m_rate(0), m_burst(0), m_tokens(0), m_last() // m_last is set on first use
+{
+	set_limits(rate, burst);
+}
+
+void c_token_bucket::set_limits(double rate, double burst) {
+	if ((rate < 0) || (burst < 0)) throw std::invalid_argument("token bucket rate and burst can not be negative");
+	m_rate = rate;
+	m_burst = (burst > 0) ? burst : rate; // no burst given - allow about 1 second of traffic
+	m_tokens = m_burst; // start full
+}
+
+bool c_token_bucket::is_unlimited() const { return m_rate == 0; }
+
+void c_token_bucket::refill(t_clock::time_point now) {
+	if (m_last == t_clock::time_point()) { m_last = now; return; } // first use, we start full anyway
+	if (now <= m_last) return;
+	std::chrono::duration<double> elapsed = now - m_last;
+	m_last = now;
+	m_tokens = std::min( m_burst , m_tokens + elapsed.count() * m_rate );
+}
+
+bool c_token_bucket::can_consume(size_t bytes, t_clock::time_point now) {
+	if (is_unlimited()) return true;
+	refill(now);
+	return m_tokens >= std::min( static_cast<double>(bytes) , m_burst ); // bigger then burst: wait for full bucket
+}
+
+void c_token_bucket::consume(size_t bytes) {
+	if (is_unlimited()) return;
+	m_tokens -= bytes; // can go below 0 for frames bigger then burst
+}
+
+bool c_token_bucket::try_consume(size_t bytes, t_clock::time_point now) {
+	if (! can_consume(bytes, now)) return false;
+	consume(bytes);
+	return true;
+}
+
+c_token_bucket::t_clock::duration c_token_bucket::time_until(size_t bytes, t_clock::time_point now) {
+	if (can_consume(bytes, now)) return t_clock::duration::zero();
+	const double missing = std::min( static_cast<double>(bytes) , m_burst ) - m_tokens;
+	return std::chrono::duration_cast<t_clock::duration>( std::chrono::duration<double>( missing / m_rate ) )
+		+ std::chrono::microseconds(1); // round up, so after this time it is really allowed
+}
+
+std::ostream & operator<<(std::ostream & ostr, const t_shaper_stats & obj) {
+	ostr << "{sent=" << obj.m_sent_frames << " (" << obj.m_sent_bytes << " B) dropped=" << obj.m_dropped_frames;
+	if (obj.m_delay_count) {
+		ostr << " delay avg=" << (obj.m_delay_sum_us / obj.m_delay_count) << "us max=" << obj.m_delay_max_us << "us";
+	}
+	return ostr << "}";
+}
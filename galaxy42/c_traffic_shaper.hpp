@@ -0,0 +1,236 @@
+#pragma once
+#ifndef include_c_traffic_shaper_hpp
+#define include_c_traffic_shaper_hpp
+
+#include "libs1.hpp"
+
+#include <chrono>
+#include <deque>
+#include <functional>
+
+/**
+ * @brief Token bucket: allows m_rate bytes per second on average, with bursts up to m_burst bytes.
+ * rate==0 means unlimited. A frame bigger then the burst is allowed when the bucket is full (tokens go below 0 then),
+ * so it is delayed but never blocked forever.
+ */
+class c_token_bucket {
+	public:
+		typedef std::chrono::steady_clock t_clock;
+
+		c_token_bucket(double rate=0, double burst=0); ///< rate in bytes/second, burst in bytes
+		void set_limits(double rate, double burst);
+
+		bool is_unlimited() const;
+		bool can_consume(size_t bytes, t_clock::time_point now); ///< refills; is it allowed to send now
+		void consume(size_t bytes); ///< call after can_consume() returned true
+		bool try_consume(size_t bytes, t_clock::time_point now); ///< can_consume() + consume()
+		t_clock::duration time_until(size_t bytes, t_clock::time_point now); ///< when will can_consume() be true
+
+	private:
+		void refill(t_clock::time_point now);
+
+		double m_rate; ///< bytes per second, 0 is unlimited
+		double m_burst; ///< max tokens (bytes)
+		double m_tokens; ///< current tokens (bytes)
+		t_clock::time_point m_last; ///< time of last refill (or epoch if not used yet)
+};
+
+/// Statistics of one flow in c_drr_scheduler
+struct t_shaper_stats {
+	uint64_t m_sent_frames = 0;
+	uint64_t m_sent_bytes = 0;
+	uint64_t m_dropped_frames = 0; ///< dropped because queue of this flow was full
+	uint64_t m_delay_count = 0; ///< how many frames were measured for queueing delay
+	uint64_t m_delay_sum_us = 0; ///< sum of queueing delay, to calculate average
+	uint64_t m_delay_max_us = 0; ///< biggest queueing delay seen
+};
+std::ostream & operator<<(std::ostream & ostr, const t_shaper_stats & obj);
+
+/**
+ * @brief Deficit-round-robin of outgoing frames between flows (e.g. between peers whose traffic we send).
+ * Each flow has own queue (with limit of bytes, then new frames are dropped), own token bucket,
+ * and all flows share the uplink token bucket given to run().
+ * So one heavy flow is shaped to its rate, and can not take more then its fair share of the uplink from others.
+ *
+ * Frames are queued with their destination (TDst) and run() calls the send function for each one that is allowed now.
+ * Not thread safe - use from the event loop.
+ */
+template <typename TKey, typename TDst>
+class c_drr_scheduler {
+	public:
+		typedef c_token_bucket::t_clock t_clock;
+		typedef std::function<void(const TDst &, const std::string &)> t_send_func;
+
+		c_drr_scheduler(size_t quantum=1500, size_t max_queue_bytes=512*1024);
+
+		void set_default_flow_limits(double rate, double burst); ///< for flows that will be created later (and existing ones)
+		void set_flow_limits(const TKey & key, double rate, double burst); ///< e.g. to not limit our own traffic
+
+		/// queue frame of flow key, to be sent to dst. @return false if it was dropped (queue of this flow is full)
+		bool enqueue(const TKey & key, const TDst & dst, std::string && frame, t_clock::time_point now);
+
+		/// send all frames that token buckets allow now, in DRR order. @return number of frames sent
+		size_t run(t_clock::time_point now, c_token_bucket & uplink, const t_send_func & send);
+
+		bool empty() const; ///< no frames queued
+		t_clock::duration next_wakeup(t_clock::time_point now, c_token_bucket & uplink); ///< when can run() send something; max() if empty
+
+		const t_shaper_stats & get_stats(const TKey & key) const; ///< throws expected_not_found
+		void print(std::ostream & ostr) const;
+
+	private:
+		struct t_frame {
+			TDst m_dst;
+			std::string m_data;
+			t_clock::time_point m_when; ///< when it was queued
+		};
+
+		struct t_flow {
+			std::deque<t_frame> m_queue;
+			size_t m_queue_bytes = 0;
+			size_t m_deficit = 0;
+			bool m_active = false; ///< is in m_active list
+			bool m_custom_limits = false; ///< limits were set by set_flow_limits, do not overwrite with default
+			c_token_bucket m_bucket;
+			t_shaper_stats m_stats;
+		};
+
+		t_flow & get_flow(const TKey & key);
+
+		const size_t m_quantum; ///< bytes given to a flow in each DRR round
+		const size_t m_max_queue_bytes; ///< per flow
+		double m_default_rate, m_default_burst;
+
+		std::map<TKey, t_flow> m_flows;
+		std::deque<TKey> m_active; ///< flows with frames, in round-robin order
+};
+
+// ------------------------------------------------------------------
+
+template <typename TKey, typename TDst>
+c_drr_scheduler<TKey,TDst>::c_drr_scheduler(size_t quantum, size_t max_queue_bytes)
+	: m_quantum(quantum), m_max_queue_bytes(max_queue_bytes), m_default_rate(0), m_default_burst(0)
+{ }
+
+template <typename TKey, typename TDst>
+void c_drr_scheduler<TKey,TDst>::set_default_flow_limits(double rate, double burst) {
+	m_default_rate = rate;  m_default_burst = burst;
+	for (auto & flow : m_flows) if (! flow.second.m_custom_limits) flow.second.m_bucket.set_limits(rate, burst);
+}
+
+template <typename TKey, typename TDst>
+void c_drr_scheduler<TKey,TDst>::set_flow_limits(const TKey & key, double rate, double burst) {
+	auto & flow = get_flow(key);
+	flow.m_custom_limits = true;
+	flow.m_bucket.set_limits(rate, burst);
+}
+
+template <typename TKey, typename TDst>
+typename c_drr_scheduler<TKey,TDst>::t_flow & c_drr_scheduler<TKey,TDst>::get_flow(const TKey & key) {
+	auto found = m_flows.find(key);
+	if (found != m_flows.end()) return found->second;
+	auto & flow = m_flows[key];
+	flow.m_bucket.set_limits(m_default_rate, m_default_burst);
+	return flow;
+}
+
+template <typename TKey, typename TDst>
+bool c_drr_scheduler<TKey,TDst>::enqueue(const TKey & key, const TDst & dst, std::string && frame, t_clock::time_point now) {
+	auto & flow = get_flow(key);
+	if ((flow.m_queue_bytes > 0) && (flow.m_queue_bytes + frame.size() > m_max_queue_bytes)) {
+		++flow.m_stats.m_dropped_frames;
+		return false;
+	}
+	flow.m_queue_bytes += frame.size();
+	flow.m_queue.push_back( t_frame{ dst, std::move(frame), now } );
+	if (! flow.m_active) { flow.m_active = true; flow.m_deficit = 0; m_active.push_back(key); }
+	return true;
+}
+
+template <typename TKey, typename TDst>
+size_t c_drr_scheduler<TKey,TDst>::run(t_clock::time_point now, c_token_bucket & uplink, const t_send_func & send) {
+	size_t sent = 0;
+	size_t visits_without_progress = 0; // when all active flows are blocked by their own bucket, stop
+	while (! m_active.empty() && visits_without_progress < m_active.size()) {
+		const TKey key = m_active.front();
+		m_active.pop_front();
+		auto & flow = m_flows.at(key);
+		assert(! flow.m_queue.empty());
+
+		bool progress = false;
+		const size_t head_size = flow.m_queue.front().m_data.size();
+		if (flow.m_bucket.can_consume( head_size , now )) {
+			// the flow gets its quantum only when it can actually use it; as many quanta as the head frame needs (e.g. TUN
+			// super-packet is much bigger then quantum), else it would wait for many calls of run() while next_wakeup() is 0
+			size_t quanta = 1;
+			if (head_size > flow.m_deficit + m_quantum) quanta = (head_size - flow.m_deficit + m_quantum - 1) / m_quantum;
+			flow.m_deficit += quanta * m_quantum;
+			while (! flow.m_queue.empty()) {
+				auto & frame = flow.m_queue.front();
+				const size_t size = frame.m_data.size();
+				if (size > flow.m_deficit) break; // wait for next round
+				if (! flow.m_bucket.can_consume(size, now)) break; // this flow is over its rate
+				if (! uplink.can_consume(size, now)) { // shared uplink is full - nobody can send now
+					if (! progress) flow.m_deficit -= quanta * m_quantum; // did not use the quanta in this visit
+					m_active.push_front(key); // keep its turn
+					return sent;
+				}
+				flow.m_bucket.consume(size);
+				uplink.consume(size);
+				send(frame.m_dst, frame.m_data);
+
+				auto delay_us = std::chrono::duration_cast<std::chrono::microseconds>(now - frame.m_when).count();
+				if (delay_us < 0) delay_us = 0;
+				auto & stats = flow.m_stats;
+				++stats.m_sent_frames;  stats.m_sent_bytes += size;
+				++stats.m_delay_count;  stats.m_delay_sum_us += delay_us;
+				stats.m_delay_max_us = std::max<uint64_t>(stats.m_delay_max_us, delay_us);
+
+				flow.m_deficit -= size;
+				flow.m_queue_bytes -= size;
+				flow.m_queue.pop_front();
+				++sent;
+				progress = true;
+			}
+		}
+
+		if (flow.m_queue.empty()) { flow.m_active = false; flow.m_deficit = 0; } // idle flow does not keep credit
+		else m_active.push_back(key);
+
+		if (progress) visits_without_progress = 0; else ++visits_without_progress;
+	}
+	return sent;
+}
+
+template <typename TKey, typename TDst>
+bool c_drr_scheduler<TKey,TDst>::empty() const { return m_active.empty(); }
+
+template <typename TKey, typename TDst>
+typename c_drr_scheduler<TKey,TDst>::t_clock::duration c_drr_scheduler<TKey,TDst>::next_wakeup(
+	t_clock::time_point now, c_token_bucket & uplink)
+{
+	auto ret = t_clock::duration::max();
+	for (const auto & key : m_active) {
+		auto & flow = m_flows.at(key);
+		const size_t size = flow.m_queue.front().m_data.size();
+		ret = std::min(ret, std::max( flow.m_bucket.time_until(size, now) , uplink.time_until(size, now) ));
+	}
+	return ret;
+}
+
+template <typename TKey, typename TDst>
+const t_shaper_stats & c_drr_scheduler<TKey,TDst>::get_stats(const TKey & key) const {
+	auto found = m_flows.find(key);
+	if (found == m_flows.end()) throw expected_not_found();
+	return found->second.m_stats;
+}
+
+template <typename TKey, typename TDst>
+void c_drr_scheduler<TKey,TDst>::print(std::ostream & ostr) const {
+	for (const auto & flow : m_flows) {
+		ostr << "  flow " << flow.first << ": queued=" << flow.second.m_queue.size()
+			<< " (" << flow.second.m_queue_bytes << " B) " << flow.second.m_stats << '\n';
+	}
+}
+
+#endif
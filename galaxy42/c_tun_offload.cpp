@@ -0,0 +1,114 @@
+
+#include "c_tun_offload.hpp"
+
+#include <cstring>
+
+namespace tun_offload {
+
+namespace {
+
+constexpr size_t ipv6_header_size = 40;
+constexpr unsigned char ipproto_tcp = 6, ipproto_udp = 17;
+
+uint32_t sum16(const unsigned char * data, size_t size, uint32_t sum) { ///< internet checksum, not folded yet
+	size_t i=0;
+	for (; i+1<size; i+=2) sum += (uint32_t(data[i]) << 8) | data[i+1];
+	if (i<size) sum += uint32_t(data[i]) << 8; // odd byte is padded with 0
+	return sum;
+}
+
+uint16_t sum_fold(uint32_t sum) { ///< the final checksum
+	while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+	return static_cast<uint16_t>(~sum);
+}
+
+void put16(unsigned char * at, uint16_t value) { at[0] = value >> 8;  at[1] = value & 0xFF; }
+uint32_t get32(const unsigned char * at) {
+	return (uint32_t(at[0])<<24) | (uint32_t(at[1])<<16) | (uint32_t(at[2])<<8) | at[3];
+}
+void put32(unsigned char * at, uint32_t value) { put16(at, value >> 16);  put16(at+2, value & 0xFFFF); }
+
+} // namespace
+
+uint16_t l4_checksum_ipv6(const unsigned char * ip, size_t l4_size, unsigned char proto) {
+	uint32_t sum = sum16(ip+8, 32, 0); // src and dst address
+	sum += static_cast<uint32_t>(l4_size >> 16) + static_cast<uint32_t>(l4_size & 0xFFFF); // upper-layer length
+	sum += proto;
+	return sum_fold( sum16(ip + ipv6_header_size, l4_size, sum) );
+}
+
+const char * empty_vnet_hdr() {
+	static const char zero[vnet_hdr_size] = { 0 }; // flags=0, gso_type=vnet_gso_none
+	return zero;
+}
+
+size_t segment(const char * buf, size_t size, const t_packet_func & func, std::string & scratch) {
+	if (size < header_position_of_ipv6) throw std::invalid_argument("TUN offload: data is too short for the vnet header");
+	t_vnet_hdr hdr;
+	std::memcpy(&hdr, buf + pi_size, sizeof(hdr));
+	const unsigned char * pkt = reinterpret_cast<const unsigned char*>(buf + header_position_of_ipv6);
+	const size_t pkt_size = size - header_position_of_ipv6;
+	const unsigned char gso_type = hdr.gso_type & ~vnet_gso_ecn;
+
+	if (gso_type == vnet_gso_none) { // one normal packet, maybe with checksum to finish
+		scratch.assign(buf, pi_size);
+		scratch.append(reinterpret_cast<const char*>(pkt), pkt_size);
+		if (hdr.flags & vnet_flag_needs_csum) {
+			const size_t start = hdr.csum_start, field = start + hdr.csum_offset;
+			if (field + 2 > pkt_size) throw std::invalid_argument("TUN offload: checksum position is outside of packet");
+			unsigned char * data = reinterpret_cast<unsigned char*>(&scratch[pi_size]);
+			// the field contains already the sum of pseudo-header, so just sum all from csum_start:
+			put16(data + field, sum_fold( sum16(data + start, pkt_size - start, 0) ));
+		}
+		func(scratch.data(), scratch.size());
+		return 1;
+	}
+
+	unsigned char proto;
+	if (gso_type == vnet_gso_tcpv6) proto = ipproto_tcp;
+	else if (gso_type == vnet_gso_udp_l4) proto = ipproto_udp;
+	else throw std::invalid_argument("TUN offload: unsupported gso_type " + std::to_string(int(gso_type)));
+
+	if ((pkt_size < ipv6_header_size + 8) || ((pkt[0] >> 4) != 6)) throw std::invalid_argument("TUN offload: not an ipv6 packet");
+	if (pkt[6] != proto) throw std::invalid_argument("TUN offload: ipv6 extension headers are not supported in GSO");
+	const size_t l4_header_size = (proto == ipproto_tcp) ? size_t(pkt[ipv6_header_size + 12] >> 4) * 4 : 8;
+	const size_t headers_size = ipv6_header_size + l4_header_size;
+	if ((l4_header_size < 8) || (pkt_size < headers_size)) throw std::invalid_argument("TUN offload: bad L4 header");
+	const size_t mss = hdr.gso_size;
+	if (mss == 0) throw std::invalid_argument("TUN offload: gso_size is 0");
+
+	const size_t payload_size = pkt_size - headers_size;
+	const uint32_t tcp_seq = (proto == ipproto_tcp) ? get32(pkt + ipv6_header_size + 4) : 0;
+	size_t count = 0;
+	size_t offset = 0;
+	do {
+		const size_t chunk = std::min(mss, payload_size - offset);
+		const bool first = (offset == 0), last = (offset + chunk >= payload_size);
+		scratch.assign(buf, pi_size);
+		scratch.append(reinterpret_cast<const char*>(pkt), headers_size);
+		scratch.append(reinterpret_cast<const char*>(pkt + headers_size + offset), chunk);
+
+		unsigned char * ip = reinterpret_cast<unsigned char*>(&scratch[pi_size]);
+		unsigned char * l4 = ip + ipv6_header_size;
+		const size_t l4_size = l4_header_size + chunk;
+		put16(ip + 4, static_cast<uint16_t>(l4_size)); // ipv6 payload length
+		if (proto == ipproto_tcp) {
+			put32(l4 + 4, tcp_seq + static_cast<uint32_t>(offset));
+			if (!last) l4[13] &= ~(0x01 | 0x08); // FIN and PSH only in last segment
+			if (!first) l4[13] &= ~0x80; // CWR only in first one
+			put16(l4 + 16, 0);
+			put16(l4 + 16, l4_checksum_ipv6(ip, l4_size, proto));
+		} else {
+			put16(l4 + 4, static_cast<uint16_t>(l4_size)); // UDP length
+			put16(l4 + 6, 0);
+			uint16_t csum = l4_checksum_ipv6(ip, l4_size, proto);
+			put16(l4 + 6, csum ? csum : 0xFFFF); // in UDP 0 means "no checksum", not allowed in ipv6
+		}
+		func(scratch.data(), scratch.size());
+		++count;
+		offset += chunk;
+	} while (offset < payload_size);
+	return count;
+}
+
+} // namespace tun_offload
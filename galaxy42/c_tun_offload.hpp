@@ -0,0 +1,61 @@
+#pragma once
+#ifndef include_c_tun_offload_hpp
+#define include_c_tun_offload_hpp
+
+#include "libs1.hpp"
+
+#include <functional>
+
+/**
+ * @brief TUN with offloads (IFF_VNET_HDR + TUNSETOFFLOAD).
+ * Then kernel can give us one "super-packet" (up to 64 KiB of TCP or UDP, see GSO) in one read(),
+ * instead of one read() for each MTU-sized packet, and it leaves checksums for us to finish.
+ * Here we split such super-packet into normal packets (the same format as TUN without offloads gives:
+ * PI + ipv6 packet), so the rest of the code (encryption, routing, the wire format) does not change.
+ *
+ * Data read from such TUN is: PI (4 bytes) + virtio_net_hdr (10 bytes) + ipv6 packet;
+ * and the same format must be written into it.
+ */
+namespace tun_offload {
+
+constexpr size_t pi_size = 4; ///< the TUN packet info header (we do not use IFF_NO_PI)
+constexpr size_t vnet_hdr_size = 10; ///< sizeof(virtio_net_hdr)
+constexpr size_t header_position_of_ipv6 = pi_size + vnet_hdr_size; ///< in data read from TUN with IFF_VNET_HDR
+constexpr size_t max_read_size = pi_size + vnet_hdr_size + 65535 + 40; ///< biggest super-packet + its ipv6 header
+
+/// the struct virtio_net_hdr (the linux header can not be used in C++ - it has a field named "class")
+struct t_vnet_hdr {
+	uint8_t flags;
+	uint8_t gso_type;
+	uint16_t hdr_len;
+	uint16_t gso_size;
+	uint16_t csum_start;
+	uint16_t csum_offset;
+};
+static_assert( sizeof(t_vnet_hdr) == vnet_hdr_size , "Unexpected size of t_vnet_hdr");
+
+constexpr uint8_t vnet_flag_needs_csum = 1; ///< VIRTIO_NET_HDR_F_NEEDS_CSUM
+constexpr uint8_t vnet_gso_none = 0; ///< VIRTIO_NET_HDR_GSO_NONE
+constexpr uint8_t vnet_gso_tcpv4 = 1; ///< VIRTIO_NET_HDR_GSO_TCPV4
+constexpr uint8_t vnet_gso_tcpv6 = 4; ///< VIRTIO_NET_HDR_GSO_TCPV6
+constexpr uint8_t vnet_gso_udp_l4 = 5; ///< VIRTIO_NET_HDR_GSO_UDP_L4
+constexpr uint8_t vnet_gso_ecn = 0x80; ///< VIRTIO_NET_HDR_GSO_ECN
+
+typedef std::function<void(const char *, size_t)> t_packet_func; ///< gets one normal packet (PI + ipv6)
+
+/**
+ * Split a buffer read from TUN with IFF_VNET_HDR into normal packets (PI + ipv6 packet) with correct checksums.
+ * The packets are prepared in scratch (to reuse its memory), and func is called for each one.
+ * @return number of packets. Throws std::invalid_argument for data that we can not parse (e.g. not TCP/UDP over ipv6).
+ */
+size_t segment(const char * buf, size_t size, const t_packet_func & func, std::string & scratch);
+
+/// checksum of TCP/UDP/ICMPv6 over ipv6: l4 is ip+40 and has l4_size bytes (with the checksum field set to 0)
+uint16_t l4_checksum_ipv6(const unsigned char * ip, size_t l4_size, unsigned char proto);
+
+/// the virtio_net_hdr that says "normal packet, nothing to do", to write it to TUN before each packet
+const char * empty_vnet_hdr();
+
+} // namespace tun_offload
+
+#endif
@@ -0,0 +1,1654 @@
+#include "c_tunserver.hpp"
+
+#include <iostream>
+#include <stdexcept>
+#include <iomanip>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <signal.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <linux/if_tun.h>
+
+#include <sodium.h>
+
+#include "cjdns-code/NetPlatform.h" // from cjdns
+#include "counter.hpp"
+#include "cpputils.hpp"
+#include "c_tun_offload.hpp"
+#include "c_udp_gso.hpp"
+#include "c_pmtu.hpp"
+#include "c_multipath.hpp"
+
+// USO (Linux 6.2), older headers miss it. Kernel takes them only together (one of them alone is EINVAL)
+#ifndef TUN_F_USO4
+#define TUN_F_USO4 0x20 // I can handle USO for IPv4 packets
+#endif
+#ifndef TUN_F_USO6
+#define TUN_F_USO6 0x40 // I can handle USO for IPv6 packets
+#endif
+
+#include "trivialserialize.hpp"
+#include "galaxy_debug.hpp"
+#include "glue_sodiumpp_crypto.hpp" // e.g. show_nice_nonce()
+
+c_tunnel_use::c_tunnel_use(const antinet_crypto::c_multikeys_PAIR & ID_self,
+	const antinet_crypto::c_multikeys_pub & ID_them, const string& nicename)
+	: c_crypto_tunnel(ID_self, ID_them, nicename)
+{
+}
+
+c_tunnel_use::c_tunnel_use(const antinet_crypto::c_multikeys_PAIR & ID_self,
+	const antinet_crypto::c_multikeys_pub & ID_them,
+			const std::string & packetstart, const string& nicename )
+	: c_crypto_tunnel(ID_self, ID_them, packetstart, nicename)
+{
+}
+
+
+// ------------------------------------------------------------------
+
+using namespace std;
+
+namespace {
+volatile sig_atomic_t g_latency_dump_requests = 0; ///< count of SIGUSR1; each node prints its latency when it changes
+void latency_dump_signal_handler(int) { g_latency_dump_requests = g_latency_dump_requests + 1; }
+volatile sig_atomic_t g_exit_requested = 0; ///< SIGINT or SIGTERM: all nodes exit their loops (saving the state snapshot)
+void exit_signal_handler(int) { g_exit_requested = 1; }
+
+c_haship_addr hip_from_snapshot(const state_snapshot::t_hip & hip) {
+	return c_haship_addr( c_haship_addr::tag_constr_by_addr_bin() , std::string( hip.begin() , hip.end() ) );
+}
+
+// how often the timers of event loop fire; timers of peers (and searches) are jittered, so they are not all sent at once.
+// PMTU probes, DV adverts and DHT have no interval: their timers are set at the next due time that their owner knows
+const auto timer_hi = std::chrono::seconds( 3 ); // keepalive to each peer (or full HI, until he confirms it)
+const auto timer_hi_low = std::chrono::seconds( 1 ); // the first few full HI
+const uint64_t timer_hi_count_low = 2; // how many full HI are sent fast at first
+const auto timer_route_search = std::chrono::seconds( 2 ); // retry of search for route
+const auto timer_tun_mtu = std::chrono::seconds( 1 );
+const auto dht_find_backoff_min = std::chrono::seconds( 1 ); // after a lookup of pubkey found nothing
+const auto dht_find_backoff_max = std::chrono::seconds( 64 );
+const size_t dht_find_max = 1000; // HIPs that we remember lookups for
+const auto timer_stats = std::chrono::seconds( 10 ); // debug_peers
+const auto timer_state_snapshot = std::chrono::seconds( 60 ); // save the state snapshot (also on exit)
+const auto timer_keystore = std::chrono::seconds( 5 ); // save new pubkeys in keystore (also on exit)
+const size_t keystore_max_keys = 100*1000; // pubkeys of other nodes: the oldest ones are forgotten (they can be found in DHT)
+} // namespace
+
+void c_tunserver::add_peer_simplestring(const string & simple) {
+	_dbg1("Adding peer from simplestring=" << simple);
+	// "192.168.2.62:9042-fd42:10a9:4318:509b:80ab:8042:6275:609b"
+	size_t pos1 = simple.find('-');
+	string part_pip = simple.substr(0,pos1);
+	string part_hip = simple.substr(pos1+1);
+	try {
+		_info("Peer pip="<<part_pip<<" hip="<<part_hip);
+		auto ip_pair = tunserver_utils::parse_ip_string(part_pip);
+		_note("Physical IP: address=" << ip_pair.first << " port=" << ip_pair.second);
+		this->add_peer( t_peering_reference( ip_pair.first, ip_pair.second , part_hip ) );
+	}
+	catch (const std::exception &e) {
+		_erro("Adding peer from simplereference failed (exception): " << e.what()); // TODO throw?
+	}
+}
+
+c_tunserver::c_tunserver()
+ : m_my_name("unnamed-tunserver"), m_tun_fd(-1), m_tun_header_offset_ipv6(0), m_tun_offload(true), m_tun_offload_active(false),
+ m_tun_mtu(0), m_sock_udp(-1), m_udp_gso(true), m_compression(false),
+ m_flow_hash_seed( (uint64_t(std::random_device()()) << 32) | std::random_device()() ), m_proactive_routing(false), m_exiting(false),
+ m_latency(64), m_trace(m_latency), m_latency_dumps_done(0), //, m_rpc_server(42000)
+ m_hi_session_id( hi_session::generate_session_id() ), m_timers( std::chrono::steady_clock::now() )
+{
+//	m_rpc_server.register_function(
+//		"add_limit_points",
+//		std::bind(&c_tunserver::rpc_add_limit_points, this, std::placeholders::_1));
+}
+
+void c_tunserver::set_my_name(const string & name) {  m_my_name = name; _note("This node is now named: " << m_my_name);  }
+
+// my key
+void c_tunserver::configure_mykey() {
+	// creating new IDC from existing IDI // this should be separated
+	//and should include all chain IDP->IDM->IDI etc.  sign and verification
+
+	// getting IDC
+	std::string IDI_name;
+try {
+	IDI_name = filestorage::load_string(e_filestore_galaxy_instalation_key_conf, "IDI");
+} catch (std::invalid_argument &err) {
+	_dbg2("IDI is not set!\n gererate your permanent key ans set is as IDI!\nABORTING PROG");
+}
+	std::unique_ptr<antinet_crypto::c_multikeys_PAIR> my_IDI;
+	my_IDI = std::make_unique<antinet_crypto::c_multikeys_PAIR>();
+	my_IDI->datastore_load_PRV_and_pub(IDI_name);
+	configure_mykey_from_IDI( std::move(my_IDI) );
+}
+
+void c_tunserver::configure_mykey_generated() {
+	auto my_IDI = std::make_unique<antinet_crypto::c_multikeys_PAIR>();
+	my_IDI->generate(antinet_crypto::e_crypto_system_type_Ed25519, 1);
+	configure_mykey_from_IDI( std::move(my_IDI) );
+}
+
+void c_tunserver::configure_mykey_from_IDI(std::unique_ptr<antinet_crypto::c_multikeys_PAIR> && my_IDI) {
+	// getting HIP from IDI
+	auto IDI_hexdot = my_IDI->get_ipv6_string_hexdot() ;
+	c_haship_addr IDI_hip = c_haship_addr( c_haship_addr::tag_constr_by_addr_dot() , IDI_hexdot );
+	_info("IDI IPv6: " << IDI_hexdot);
+	_dbg1("IDI IPv6: " << IDI_hip << " (other var type)");
+	// creating IDC for this session
+	antinet_crypto::c_multikeys_PAIR my_IDC;
+	my_IDC.generate(antinet_crypto::e_crypto_system_type_X25519,1);
+	// signing it by IDI
+	std::string IDC_pub_to_sign = my_IDC.m_pub.serialize_bin();
+	antinet_crypto::c_multisign IDC_IDI_signature = my_IDI->multi_sign(IDC_pub_to_sign);
+
+	// example veryifying
+	antinet_crypto::c_multikeys_pub::multi_sign_verify(IDC_IDI_signature, IDC_pub_to_sign, my_IDI->m_pub);
+
+	// save signature and IDI publickey in tunserver
+	m_my_IDI_pub = my_IDI->m_pub;
+	m_IDI_IDC_sig = IDC_IDI_signature;
+
+	// remove IDP from RAM
+	my_IDI.reset(nullptr);
+
+	// for debug, hip from IDC
+	auto IDC_hexdot = my_IDC.get_ipv6_string_hexdot() ;
+	c_haship_addr IDC_hip = c_haship_addr( c_haship_addr::tag_constr_by_addr_dot() , IDC_hexdot );
+	_info("IDC IPv6: " << IDC_hexdot);
+	_dbg1("IDC IPv6: " << IDC_hip << " (other var type)");
+	// now we can use hash ip from IDI and IDC for encryption
+	m_my_hip = IDI_hip;
+	m_my_IDC = my_IDC;
+
+	// [protocol] e_proto_cmd_public_hi: IDC pubkey, IDI pubkey, IDI->IDC signature, our HI session ID (8)
+	trivialserialize::generator gen(8000);
+	gen.push_varstring( m_my_IDC.get_serialize_bin_pubkey() );
+	gen.push_varstring( m_my_IDI_pub.serialize_bin());
+	gen.push_varstring( m_IDI_IDC_sig.serialize_bin());
+	gen.push_integer_u<8>( m_hi_session_id );
+	m_public_hi = string_as_bin( gen.str_move() );
+}
+
+// add peer
+void c_tunserver::add_peer(const t_peering_reference & peer_ref) { ///< add this as peer
+	UNUSED(peer_ref);
+	auto peering_ptr = make_unique<c_peering_udp>(peer_ref);
+	// key is unique in map
+	const bool added = m_peer.emplace( std::make_pair( peer_ref.haship_addr ,  std::move(peering_ptr) ) ).second;
+	if (added) schedule_peer_timers( peer_ref.haship_addr );
+}
+
+void c_tunserver::add_peer_append_pubkey(const t_peering_reference & peer_ref,
+unique_ptr<c_haship_pubkey> && pubkey)
+{
+	auto find = m_peer.find( peer_ref.haship_addr );
+	if (find == m_peer.end()) { // no such peer yet
+		auto peering_ptr = make_unique<c_peering_udp>(peer_ref);
+		peering_ptr->set_pubkey(std::move(pubkey));
+		m_peer.emplace( std::make_pair( peer_ref.haship_addr ,  std::move(peering_ptr) ) );
+		schedule_peer_timers( peer_ref.haship_addr );
+	} else { // update existing
+		auto & peering_ptr = find->second;
+		peering_ptr->set_pubkey(std::move(pubkey));
+	}
+}
+
+
+void c_tunserver::add_tunnel_to_pubkey(const c_haship_pubkey & pubkey)
+{
+	_dbg1("add pubkey: " << pubkey.get_ipv6_string_hexdot());
+	c_haship_addr hip( c_haship_addr::tag_constr_by_addr_bin() , pubkey.get_ipv6_string_bin() );
+
+	auto find = m_tunnel.find(hip);
+	if (find == m_tunnel.end()) { // we don't have tunnel to him yet
+		_info("Creating a CT to HIP=" << hip);
+		// TODO nicer name?
+		auto ct = make_unique< c_tunnel_use >( m_my_IDC , pubkey , "Tunnel" );
+		ct->m_compressor.set_enabled(m_compression);
+		ct->m_pubkey_bin = pubkey.serialize_bin();
+		if (m_keystore && (! m_keystore->has(e_filestore_galaxy_pub, hip))) { // next time we will not need to look for it
+			m_keystore_queue[ hip ] = ct->m_pubkey_bin; // disk is not touched here (in the event loop, maybe for a packet)
+		}
+		m_tunnel[ hip ] = std::move(ct);
+	} else {
+		_dbg2("Tunnel already is created for HIP="<<hip);
+	}
+
+}
+
+
+void c_tunserver::add_peer_crypto_p2p(const c_haship_addr & hip, const antinet_crypto::c_multikeys_pub & his_IDC) {
+	auto find = m_peer.find(hip);
+	if (find == m_peer.end()) throw expected_not_found();
+	auto & peering = find->second;
+	auto * current = peering->get_crypto_p2p();
+	if ((current != nullptr) && (current->is_for_them(his_IDC))) {
+		_dbg2("CT-P2P already exists with HIP=" << hip);
+		return;
+	}
+	_info("Creating CT-P2P with peer HIP=" << hip << (current ? " (he changed IDC, re-keying)" : ""));
+	peering->set_crypto_p2p( make_unique<antinet_crypto::c_crypto_p2p>( m_my_IDC , his_IDC ) );
+	auto peer_udp = dynamic_cast<c_peering_udp*>( peering.get() );
+	if (peer_udp) pmtu_schedule( hip , *peer_udp ); // probes wait for CT-P2P (their acks are checked with it)
+}
+
+void c_tunserver::set_traffic_limits(double peer_rate, double peer_burst, double uplink_rate, double uplink_burst) {
+	_note("Traffic limits: each peer rate=" << peer_rate << " B/s burst=" << peer_burst
+		<< ", uplink rate=" << uplink_rate << " B/s burst=" << uplink_burst << " (0 is unlimited)");
+	m_send_scheduler.set_default_flow_limits(peer_rate, peer_burst);
+	m_uplink_bucket.set_limits(uplink_rate, uplink_burst);
+}
+
+void c_tunserver::set_tun_offload(bool enabled) {
+	m_tun_offload = enabled;
+	_note("TUN offloads (GSO super-packets) will " << (enabled ? "be used if possible" : "NOT be used"));
+}
+
+void c_tunserver::set_udp_gso(bool enabled) {
+	m_udp_gso = enabled;
+	_note("UDP offloads (GSO/GRO) will " << (enabled ? "be used if possible" : "NOT be used"));
+}
+
+void c_tunserver::set_compression(bool enabled) {
+	m_compression = enabled;
+	_note("Compression of tunneled data will " << (enabled ? "be used, with nodes that also use it" : "NOT be used"));
+}
+
+void c_tunserver::set_proactive_routing(bool enabled) {
+	m_proactive_routing = enabled;
+	_note("Routes will be " << (enabled ? "advertised to peers (proactive routing)" : "searched when needed"));
+}
+
+void c_tunserver::set_endpoints(unique_ptr<netio::c_tun_endpoint> && tun, unique_ptr<netio::c_udp_endpoint> && udp) {
+	m_tun = std::move(tun);
+	m_udp = std::move(udp);
+	m_tun_offload_active = false; // packets from/to other endpoints have no vnet header
+	m_tun_header_offset_ipv6 = g_tuntap::TUN_with_PI::header_position_of_ipv6; // but they have the PI header, as from TUN device
+	_note("Using given TUN and UDP endpoints (not the TUN device and UDP socket)");
+}
+
+void c_tunserver::set_latency_sample(unsigned int sample_every) {
+	m_latency.set_sample_every(sample_every);
+	_note("Latency of stages will be " << (sample_every ? "measured for every " + STR(sample_every) + ". packet" : "NOT measured"));
+}
+
+void c_tunserver::set_keystore(const fs::path & path) {
+	try {
+		m_keystore = make_unique<keystore::c_keystore>( path , keystore::c_keystore::e_sync::by_caller ); // see keystore_save_queued
+		m_keystore->set_max_keys( keystore_max_keys );
+	}
+	catch(const std::exception &e) { _warn("Can not open keystore, pubkeys of nodes will not be remembered: " << e.what()); }
+}
+
+void c_tunserver::set_state_snapshot(const fs::path & path) {
+	m_snapshot_path = path;
+	_note("What we learn (peers, routes, pubkeys) will be saved in " << path << ", for the next start");
+}
+
+void c_tunserver::set_rpc_port(int port, const std::string & listen_address) {
+	m_rpc_server.reset();
+	if (port == 0) return;
+	m_rpc_server = make_unique<c_rpc_server>(port, listen_address);
+	m_rpc_server->register_function( "latency_dump" , [this](const std::string &) { // RPC has no replies, so to our output
+		ostringstream oss;  print_latency(oss);
+		std::cerr << oss.str() << std::flush;
+		return true;
+	});
+	_note("RPC commands are received on TCP " << listen_address << " port " << port);
+}
+
+void c_tunserver::print_latency(std::ostream & ostr) const {
+	ostr << "Node " << m_my_name << " hip=" << m_my_hip << ". ";
+	m_latency.print(ostr);
+}
+
+void c_tunserver::help_usage() const {
+	// TODO(r) remove, using boost options
+}
+
+void c_tunserver::prepare_socket() {
+	m_tun_fd = open("/dev/net/tun", O_RDWR);
+	assert(! (m_tun_fd<0) );
+
+  as_zerofill< ifreq > ifr; // the if request
+	ifr.ifr_flags = IFF_TUN; // || IFF_MULTI_QUEUE; TODO
+	if (m_tun_offload) ifr.ifr_flags |= IFF_VNET_HDR; // each read/write has virtio_net_hdr after PI
+	strncpy(ifr.ifr_name, "galaxy%d", IFNAMSIZ);
+
+	auto errcode_ioctl =  ioctl(m_tun_fd, TUNSETIFF, (void *)&ifr);
+	// packets are always given to rest of code without the virtio_net_hdr (see route_own_tun_packet, write_to_tun)
+	m_tun_header_offset_ipv6 = g_tuntap::TUN_with_PI::header_position_of_ipv6; // matching the TUN/TAP type above
+	if (errcode_ioctl < 0)_throw( std::runtime_error("Error in ioctl")); // TODO
+	m_tun_offload_active = m_tun_offload;
+
+	if (m_tun_offload_active) {
+		// ask for super-packets of TCP, and of UDP where kernel supports USO; checksums are then done by us
+		unsigned int offload = TUN_F_CSUM | TUN_F_TSO6 | TUN_F_TSO_ECN | TUN_F_USO4 | TUN_F_USO6;
+		int errcode_offload = ioctl(m_tun_fd, TUNSETOFFLOAD, offload);
+		if ((errcode_offload < 0) && (errno == EINVAL)) { // kernel without USO (before 6.2)
+			offload &= ~(TUN_F_USO4 | TUN_F_USO6);
+			errcode_offload = ioctl(m_tun_fd, TUNSETOFFLOAD, offload);
+		}
+		if (errcode_offload < 0) {
+			_warn("Can not enable TUN offloads (TUNSETOFFLOAD): " << strerror(errno) << ", will read normal packets (with vnet header)");
+			offload = 0;
+		}
+		_note("TUN offloads enabled: flags=" << offload
+			<< " TSO=" << ((offload & TUN_F_TSO6) ? "yes" : "no")
+			<< " USO=" << ((offload & TUN_F_USO6) ? "yes" : "no")
+			<< " (read up to " << tun_offload::max_read_size << " bytes at once)");
+	}
+
+	_mark("Allocated interface:" << ifr.ifr_name);
+	m_tun_name = ifr.ifr_name;
+	m_tun = make_unique<netio::c_tun_device>(m_tun_fd, m_tun_name);
+
+	{
+		uint8_t address[16];
+		assert(m_my_hip.size() == 16 && "m_my_hip != 16");
+		for (int i=0; i<16; ++i) address[i] = m_my_hip[i];
+		// TODO: check if there is no race condition / correct ownership of the tun, that the m_tun_fd opened above is...
+		// ...to the device to which we are setting IP address here:
+		assert(address[0] == 0xFD);
+		assert(address[1] == 0x42);
+		NetPlatform_addAddress(ifr.ifr_name, address, 16, Sockaddr_AF_INET6);
+	}
+
+	// create listening socket: one dual-stack ipv6 socket (ipv4 peers are seen as ::ffff:a.b.c.d), or ipv4 only if no ipv6 here
+	int port = 9042;
+	c_ip46_addr address_for_sock;
+	m_sock_udp = socket(AF_INET6, SOCK_DGRAM, 0);
+	if (m_sock_udp >= 0) {
+		int v6only = 0;
+		if (setsockopt(m_sock_udp, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only)) != 0) _warn("Can not make UDP socket dual-stack");
+		address_for_sock = c_ip46_addr::create_ipv6("::", port);
+	} else {
+		_warn("Can not create ipv6 UDP socket, will use ipv4 only");
+		m_sock_udp = socket(AF_INET, SOCK_DGRAM, 0);
+		address_for_sock = c_ip46_addr::any_on_port(port);
+	}
+	_assert(m_sock_udp >= 0);
+
+	{
+		sockaddr_storage addr;
+		socklen_t addr_len = address_for_sock.get_sockaddr(addr);
+		int bind_result = bind(m_sock_udp, reinterpret_cast<sockaddr*>(&addr), addr_len);  // reinterpret allowed by Linux specs
+		_assert( bind_result >= 0 ); // TODO change to except
+	}
+	_info("Bind done - listening on UDP on: " << address_for_sock);
+
+	{ // send all with DF bit, so nothing is fragmented on the wire; path MTU is found by our probes (not from ICMP)
+		int pmtu_mode = IP_PMTUDISC_PROBE;
+		if (setsockopt(m_sock_udp, IPPROTO_IP, IP_MTU_DISCOVER, &pmtu_mode, sizeof(pmtu_mode)) != 0) {
+			_warn("Can not set IP_MTU_DISCOVER on UDP socket");
+		}
+		if (address_for_sock.get_ip_type() == c_ip46_addr::tag_ipv6) {
+			int pmtu_mode6 = IPV6_PMTUDISC_PROBE;
+			if (setsockopt(m_sock_udp, IPPROTO_IPV6, IPV6_MTU_DISCOVER, &pmtu_mode6, sizeof(pmtu_mode6)) != 0) {
+				_warn("Can not set IPV6_MTU_DISCOVER on UDP socket");
+			}
+		}
+	}
+	update_tun_mtu();
+
+	auto udp_socket = make_unique<netio::c_udp_socket>(m_sock_udp, m_udp_gso);
+	_note("UDP offloads: GSO " << (udp_socket->is_gso_enabled() ? "on" : "off")
+		<< ", GRO " << (udp_socket->is_gro_enabled() ? "on" : "off"));
+	m_udp = std::move(udp_socket);
+}
+
+void c_tunserver::wait_for_fd_event() { // wait for fd event
+	_info("Selecting");
+	// set the wait for read events:
+	FD_ZERO(& m_fd_set_data);
+	FD_SET(m_udp->get_fd(), &m_fd_set_data);
+	FD_SET(m_tun->get_fd(), &m_fd_set_data);
+
+	auto fd_max = std::max(m_tun->get_fd(), m_udp->get_fd());
+	_assert(fd_max < std::numeric_limits<decltype(fd_max)>::max() -1); // to be more safe, <= would be enough too
+	_assert(fd_max >= 1);
+
+	const auto now = std::chrono::steady_clock::now();
+	auto wait = std::chrono::duration_cast<std::chrono::microseconds>( m_timers.time_to_next( now , std::chrono::seconds(3) ) );
+	if (m_udp->has_pending()) wait = std::chrono::microseconds(0); // rest of coalesced datagrams is waiting for us
+	else if (! m_send_scheduler.empty()) { // wake up when traffic limits allow to send the queued data
+		wait = std::min( wait , std::chrono::duration_cast<std::chrono::microseconds>(
+			m_send_scheduler.next_wakeup( now , m_uplink_bucket ) ) );
+	}
+	const auto wait_us = wait.count();
+	timeval timeout { static_cast<time_t>(wait_us / 1000000) , static_cast<suseconds_t>(wait_us % 1000000) }; // http://pubs.opengroup.org/onlinepubs/007908775/xsh/systime.h.html
+
+	auto select_result = select( fd_max+1, &m_fd_set_data, NULL, NULL, & timeout); // <--- blocks
+	if ((select_result < 0) && (errno == EINTR)) { FD_ZERO(& m_fd_set_data);  return; } // signal, e.g. SIGUSR1
+	_assert(select_result >= 0);
+}
+
+std::pair<c_haship_addr,c_haship_addr> c_tunserver::parse_tun_ip_src_dst(const char *buff, size_t buff_size) { ///< the same, but with ipv6_offset that matches our current TUN
+	return parse_tun_ip_src_dst(buff,buff_size, m_tun_header_offset_ipv6 );
+}
+
+std::pair<c_haship_addr,c_haship_addr> c_tunserver::parse_tun_ip_src_dst(const char *buff, size_t buff_size, unsigned char ipv6_offset) {
+	// vuln-TODO(u) throw on invalid size + assert
+
+	size_t pos_src = ipv6_offset + g_ipv6_rfc::header_position_of_src , len_src = g_ipv6_rfc::header_length_of_src;
+	size_t pos_dst = ipv6_offset + g_ipv6_rfc::header_position_of_dst , len_dst = g_ipv6_rfc::header_length_of_dst;
+	assert(buff_size > pos_src+len_src);
+	assert(buff_size > pos_dst+len_dst);
+	// valid: reading pos_src up to +len_src, and same for dst
+
+	char ipv6_str[INET6_ADDRSTRLEN]; // for string e.g. "fd42:ffaa:..."
+
+	memset(ipv6_str, 0, INET6_ADDRSTRLEN);
+	inet_ntop(AF_INET6, buff + pos_src, ipv6_str, INET6_ADDRSTRLEN); // ipv6 octets from 8 is source addr, from ipv6 RFC
+	_dbg1("src ipv6_str " << ipv6_str);
+	c_haship_addr ret_src(c_haship_addr::tag_constr_by_addr_dot(), ipv6_str);
+	// TODONOW^ this works fine?
+
+	memset(ipv6_str, 0, INET6_ADDRSTRLEN);
+	inet_ntop(AF_INET6, buff + pos_dst, ipv6_str, INET6_ADDRSTRLEN); // ipv6 octets from 24 is destination addr, from
+	_dbg1("dst ipv6_str " << ipv6_str);
+	c_haship_addr ret_dst(c_haship_addr::tag_constr_by_addr_dot(), ipv6_str);
+	// TODONOW^ this works fine?
+
+	return std::make_pair( ret_src , ret_dst );
+}
+
+void c_tunserver::peering_ping_peer(c_peering_udp & peer) {
+	peer.send_keepalive( m_hi_session_id , *m_udp ); // if we have his HI: he knows that, and we are alive
+	if (peer.get_hi_session().need_full_hi( hi_session::t_clock::now() )) peering_send_hi( peer ); // he did not confirm our HI yet
+}
+
+void c_tunserver::peering_send_hi(c_peering_udp & peer) {
+	peer.send_data_udp_cmd(c_protocol::e_proto_cmd_public_hi, m_public_hi, *m_udp);
+	peer.get_hi_session().full_hi_sent();
+}
+
+void c_tunserver::nodep2p_foreach_cmd(c_protocol::t_proto_cmd cmd, string_as_bin data) {
+	_info("Sending a COMMAND to peers:");
+	for(auto & v : m_peer) { // to each peer
+		auto & target_peer = v.second;
+		auto peer_udp = unique_cast_ptr<c_peering_udp>( target_peer ); // upcast to UDP peer derived
+		peer_udp->send_data_udp_cmd(cmd, data, *m_udp);
+	}
+}
+
+const c_peering & c_tunserver::get_peer_with_hip( c_haship_addr addr , bool require_pubkey ) {
+	auto peer_iter = m_peer.find(addr);
+	if (peer_iter == m_peer.end()) throw expected_not_found();
+	c_peering & peer = * peer_iter->second;
+	if (require_pubkey) {
+		if (! peer.is_pubkey()) throw expected_not_found_missing_pubkey();
+	}
+	return peer;
+}
+
+void c_tunserver::debug_peers() {
+	string xx(10,'-');
+	_info('\n' << xx << " Node " << m_my_name << " hip=" << m_my_hip << xx << "\n\n");
+	_note("=== Debug peers ===");
+	for(auto & v : m_peer) { // to each peer
+		auto & target_peer = v.second;
+		_info("  * Known peer on key [ " << v.first << " ] => " << (* target_peer) );
+	}
+	ostringstream oss; m_send_scheduler.print(oss);
+	_info("Send queues:\n" << oss.str());
+	if (m_compression) {
+		for(auto & v : m_tunnel) {
+			ostringstream oss_ct; v.second->m_compressor.print(oss_ct);
+			_info("  * Tunnel to [ " << v.first << " ] " << oss_ct.str());
+		}
+	}
+}
+
+bool c_tunserver::route_tun_data_to_its_destination_detail(t_route_method method,
+	const char *buff, size_t buff_size,
+	c_haship_addr src_hip, c_haship_addr dst_hip,
+	c_haship_addr next_hip,
+	c_routing_manager::c_route_reason reason,
+	int recurse_level, int data_route_ttl, antinet_crypto::t_crypto_nonce nonce_used,
+	c_haship_addr flow_hip, uint64_t flow_hash)
+{
+	// --- choose next hop in peering ---
+
+	// try direct peers:
+	auto peer_it = m_peer.find(next_hip); // find c_peering to send to // TODO(r) this functionallity will be soon doubled with the route search in m_routing_manager below, remove it then
+
+	if (peer_it == m_peer.end()) { // not a direct peer!
+		_info("ROUTE: can not find in direct peers next_hip="<<next_hip);
+		if (recurse_level>1) {
+			_warn("DROP: Recruse level too big in choosing peer");
+			return false; // <---
+		}
+
+		c_haship_addr via_hip;
+		if (m_route_dv && (buff_size > 0)) { // proactive: the table is ready, data never waits for a search
+			try { via_hip = m_route_dv->get_nexthop(next_hip); }
+			catch(expected_not_found) { _info("DROP: no proactive route to " << next_hip); return false; }
+			return this->route_tun_data_to_its_destination_detail(method, buff, buff_size,
+				src_hip, dst_hip, via_hip, reason, recurse_level+1, data_route_ttl, nonce_used, flow_hip, flow_hash);
+		}
+		try {
+			_info("Trying to find a route to it");
+			const int default_ttl = c_protocol::ttl_max_accepted; // for this case [confroute]
+			const auto & route = m_routing_manager.get_route_or_maybe_search(*this, next_hip , reason , true, default_ttl);
+			_info("Found route: " << route);
+			via_hip = route.m_nexthop;
+		} catch(...) { _info("ROUTE MANAGER: can not find route at all"); return false; }
+		try { // multipath: this flow always goes by the same one of the (near) best routes
+			if (flow_hash == 0) { // e.g. we are not the sender: then we know only the ends of the tunnel, the rest is encrypted
+				std::string ends(src_hip.begin(), src_hip.end());
+				ends.append(dst_hip.begin(), dst_hip.end());
+				flow_hash = multipath::hash_bytes( ends.data() , ends.size() , m_flow_hash_seed );
+			}
+			via_hip = m_routing_manager.pick_nexthop( next_hip , flow_hash ,
+				[this](const c_haship_addr & hip) { return this->nexthop_weight(hip); } );
+		} catch(expected_not_found) { _dbg1("No other usable route, using the main one"); }
+		_info("Route found via hip: via_hip = " << via_hip);
+		bool ok = this->route_tun_data_to_its_destination_detail(method, buff, buff_size,
+			src_hip, dst_hip, via_hip, reason, recurse_level+1, data_route_ttl, nonce_used, flow_hip, flow_hash);
+		if (!ok) { _info("Routing failed"); return false; } // <---
+		_info("Routing seems to succeed");
+	}
+	else { // next_hip is a direct peer, send to it:
+		auto & target_peer = peer_it->second;
+		_info("ROUTE-PEER (found the goal in direct peer) selected peerig next hop is: " << (*target_peer) );
+		auto peer_udp = unique_cast_ptr<c_peering_udp>( target_peer ); // upcast to UDP peer derived
+
+		m_trace.mark(latency::e_stage::route);
+
+		// queue it for sending on wire:
+		string frame = peer_udp->prepare_data_udp(buff, buff_size, src_hip, dst_hip, data_route_ttl, nonce_used);
+		if (frame.empty()) return false;
+		m_trace.mark(latency::e_stage::serialize);
+		if (! m_send_scheduler.enqueue( flow_hip , next_hip , std::move(frame) , std::chrono::steady_clock::now() )) {
+			_info("DROP: send queue is full for flow of " << flow_hip);
+			return false;
+		}
+		m_trace.mark(latency::e_stage::enqueue);
+	}
+	return true;
+}
+
+void c_tunserver::route_own_tun_packet(const char *buff, size_t buff_size) {
+	const int data_route_ttl = 5; // we want to ask others with this TTL to route data sent actually by our programs
+
+	c_haship_addr src_hip, dst_hip;
+	std::tie(src_hip, dst_hip) = parse_tun_ip_src_dst(buff, buff_size);
+	// TODO warn if src_hip is not our hip
+
+	const size_t packet_size = buff_size - m_tun_header_offset_ipv6;
+	if (packet_size > m_tun_mtu) { // TUN MTU was lowered after it was sent, so tell the sender (it would not fit in path MTU)
+		const std::string ptb = pmtu::make_packet_too_big(buff + m_tun_header_offset_ipv6, packet_size, m_tun_mtu);
+		if (! ptb.empty()) {
+			const std::string tundata = std::string(buff, m_tun_header_offset_ipv6) + ptb; // the same PI
+			write_to_tun(tundata.c_str(), tundata.size());
+		}
+		_info("DROP: packet from TUN is bigger (" << packet_size << ") then MTU " << m_tun_mtu << ", sent Packet Too Big");
+		return;
+	}
+
+	auto find_tunnel = m_tunnel.find( dst_hip ); // find end2end tunnel
+	if ((find_tunnel == m_tunnel.end()) && keystore_load_pubkey(dst_hip)) find_tunnel = m_tunnel.find( dst_hip );
+	if (find_tunnel == m_tunnel.end()) {
+		_warn("end2end tunnel does not exist, can not send OUR data from TUN to dst_hip="<<dst_hip);
+		dht_find_pubkey( dst_hip ); // finds it also beyond the search TTL
+
+		std::string dump; // just to trigger a search (for path - and btw for the pubkey!)
+		_note("GET KEYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYY - will look for key for " << dst_hip << " so we can SEND THERE");
+		this->route_tun_data_to_its_destination_top(
+			e_route_method_from_me,
+			dump.c_str(), dump.size(),
+			src_hip, dst_hip,
+			c_routing_manager::c_route_reason( c_haship_addr() , c_routing_manager::e_search_mode_route_own_packet),
+			data_route_ttl
+			,antinet_crypto::t_crypto_nonce()
+			,m_my_hip
+		); // push the tunneled data to where they belong
+
+	} else {
+		_mark("Using CT tunnel to send our own data");
+		auto & ct = * find_tunnel->second;
+		antinet_crypto::t_crypto_nonce nonce_used;
+		std::string data_cleartext = ct.m_compressor.encode(buff, buff_size); // maybe compressed
+		std::string data_encrypted = ct.box_ab(data_cleartext, nonce_used);
+		const uint64_t flow_hash = multipath::flow_hash( buff + m_tun_header_offset_ipv6 , packet_size , m_flow_hash_seed );
+		m_trace.mark(latency::e_stage::tun_box);
+
+		this->route_tun_data_to_its_destination_top(
+			e_route_method_from_me,
+			data_encrypted.c_str(), data_encrypted.size(), // blob
+			src_hip, dst_hip,
+			c_routing_manager::c_route_reason( c_haship_addr() , c_routing_manager::e_search_mode_route_own_packet),
+			data_route_ttl, nonce_used, m_my_hip, flow_hash
+		); // push the tunneled data to where they belong
+	}
+}
+
+void c_tunserver::schedule_peer_timers(const c_haship_addr & hip) {
+	const auto now = std::chrono::steady_clock::now();
+	m_timers.schedule( t_timer_key{ e_timer::peer_hi , hip } , now , timer_hi_low );
+	m_timers.schedule( t_timer_key{ e_timer::peer_ping , hip } , now , link_quality::c_link_quality::ping_interval );
+	m_timers.schedule( t_timer_key{ e_timer::peer_pmtu , hip } , now ); // (if he has no CT-P2P yet, add_peer_crypto_p2p does it)
+}
+
+void c_tunserver::route_search_started( c_haship_addr dst ) {
+	m_timers.schedule( t_timer_key{ e_timer::route_search , dst } , std::chrono::steady_clock::now() + timer_route_search ,
+		timer_route_search / 4 );
+}
+
+void c_tunserver::run_timers() {
+	const auto now = std::chrono::steady_clock::now();
+	for (const auto & key : m_timers.expire(now)) {
+		if (key.m_kind == e_timer::route_search) {
+			if (m_routing_manager.retry_route_search( *this , key.m_hip ))
+				m_timers.schedule( key , now + timer_route_search , timer_route_search / 4 );
+			continue;
+		}
+		if ((key.m_kind == e_timer::peer_hi) || (key.m_kind == e_timer::peer_ping) || (key.m_kind == e_timer::peer_pmtu)) {
+			auto peer_iter = m_peer.find( key.m_hip );
+			if (peer_iter == m_peer.end()) continue; // peer is gone, so are his timers
+			auto peer_udp = unique_cast_ptr<c_peering_udp>( peer_iter->second ); // upcast to UDP peer derived
+			if (key.m_kind == e_timer::peer_hi) {
+				peering_ping_peer( *peer_udp );
+				const bool low = peer_udp->get_hi_session().get_count_full_hi() < timer_hi_count_low;
+				const std::chrono::steady_clock::duration interval = low ? timer_hi_low : timer_hi;
+				m_timers.schedule( key , now + interval , interval / 10 );
+			}
+			else if (key.m_kind == e_timer::peer_ping) {
+				ping_peer( *peer_udp );
+				const auto interval = link_quality::c_link_quality::ping_interval;
+				m_timers.schedule( key , now + interval , interval / 10 );
+				if (m_route_dv) { // pings that were lost are counted now, the cost could change
+					route_dv_set_link( key.m_hip , *peer_udp );
+					route_dv_schedule();
+				}
+			}
+			else {
+				pmtu_probe_peer( key.m_hip , *peer_udp );
+				pmtu_schedule( key.m_hip , *peer_udp );
+			}
+			continue;
+		}
+		switch (key.m_kind) {
+			case e_timer::tun_mtu: update_tun_mtu();  m_timers.schedule( key , now + timer_tun_mtu );  break; // probes could be acked
+			case e_timer::route_dv: route_dv_advertise();  route_dv_schedule();  break;
+			case e_timer::dht: m_dht->tick( now );  dht_schedule();  break;
+			case e_timer::stats: debug_peers();  m_timers.schedule( key , now + timer_stats );  break;
+			case e_timer::state_snapshot: save_state_snapshot();  m_timers.schedule( key , now + timer_state_snapshot );  break;
+			case e_timer::keystore: keystore_save_queued();  m_timers.schedule( key , now + timer_keystore );  break;
+			default: _warn("Unknown timer " << static_cast<int>(key.m_kind));
+		}
+	}
+}
+
+void c_tunserver::pmtu_probe_peer(const c_haship_addr & hip, c_peering_udp & peer) {
+	if (peer.get_crypto_p2p() == nullptr) return; // no HI from him yet, probes would be lost and look like black hole
+	size_t probe_size = peer.get_path_mtu().probe_to_send( pmtu::c_path_mtu::t_clock::now() );
+	if (probe_size == 0) return;
+	_info("Sending PMTU probe of size " << probe_size << " to " << hip);
+	peer.send_pmtu_probe(probe_size, peer.get_path_mtu().get_probe_nonce(), *m_udp);
+}
+
+void c_tunserver::pmtu_schedule(const c_haship_addr & hip, c_peering_udp & peer) {
+	if (peer.get_crypto_p2p() == nullptr) return;
+	const auto now = pmtu::c_path_mtu::t_clock::now();
+	m_timers.schedule( t_timer_key{ e_timer::peer_pmtu , hip } , peer.get_path_mtu().next_probe_time(now) );
+}
+
+void c_tunserver::ping_peer(c_peering_udp & peer) {
+	const uint32_t seq = peer.get_link_quality().ping_to_send( link_quality::c_link_quality::t_clock::now() );
+	m_routing_manager.set_link_cost( peer.get_hip() , peer.get_link_quality().get_cost() ); // lost pings are counted above
+	if (seq == 0) return;
+	peer.send_ping(seq, *m_udp);
+}
+
+void c_tunserver::route_dv_advertise() {
+	if (! m_route_dv) return;
+	const auto now = route_dv::c_dv_table<c_haship_addr>::t_clock::now();
+	for(auto & v : m_peer) route_dv_set_link( v.first , *v.second );
+	const auto update = m_route_dv->start_update(now);
+	if (update == route_dv::c_dv_table<c_haship_addr>::e_update::none) return;
+	const bool only_changed = (update == route_dv::c_dv_table<c_haship_addr>::e_update::changed);
+	for(auto & v : m_peer) {
+		if (v.second->get_crypto_p2p() == nullptr) continue;
+		auto peer_udp = unique_cast_ptr<c_peering_udp>( v.second ); // upcast to UDP peer derived
+		peer_udp->send_route_adv( m_route_dv->make_adv( v.first , only_changed ) , *m_udp );
+	}
+	m_route_dv->update_sent();
+	_info("Sent " << (only_changed ? "changed" : "all") << " routes to peers, we know " << m_route_dv->size() << " routes");
+}
+
+void c_tunserver::route_dv_set_link(const c_haship_addr & hip, const c_peering & peer) {
+	if (peer.get_crypto_p2p() == nullptr) return; // only links to peers that can check our adverts
+	const auto & link = peer.get_link_quality();
+	const auto now = route_dv::c_dv_table<c_haship_addr>::t_clock::now();
+	m_route_dv->set_link( hip , link.is_dead() ? route_dv::cost_infinity : link.get_cost() , now ); // dead: link_down
+}
+
+void c_tunserver::route_dv_schedule() {
+	if (! m_route_dv) return;
+	m_timers.schedule( t_timer_key{ e_timer::route_dv , c_haship_addr() } , m_route_dv->next_update_time() );
+}
+
+void c_tunserver::dht_schedule() {
+	m_timers.schedule( t_timer_key{ e_timer::dht , c_haship_addr() } , m_dht->next_tick_time() );
+}
+
+void c_tunserver::dht_start() {
+	m_dht_cookie_key.resize( crypto_shorthash_KEYBYTES );
+	randombytes_buf( & m_dht_cookie_key[0] , m_dht_cookie_key.size() );
+	m_dht = make_unique<t_dht>( m_my_hip ,
+		[this](const c_ip46_addr & to, const t_dht::t_message_type & msg) {
+			// [protocol] e_proto_cmd_dht: the message (request or reply), not authenticated - records are signed
+			std::string data;
+			data += static_cast<char>( c_protocol::current_version );
+			data += static_cast<char>( c_protocol::e_proto_cmd_dht );
+			data += dht::message_to_bin(msg);
+			sockaddr_storage addr;
+			socklen_t addr_len = to.get_sockaddr(addr);
+			m_udp->send( reinterpret_cast<const sockaddr*>( & addr ), addr_len, data.c_str(), data.size() );
+		},
+		&c_tunserver::dht_check_record ,
+		[this](const c_ip46_addr & from) { // keyed hash of the address: only who gets our data there knows it
+			trivialserialize::generator gen(32);
+			gen.push_object(from);
+			const std::string bin = gen.str_move();
+			unsigned char hash[crypto_shorthash_BYTES];
+			crypto_shorthash( hash , reinterpret_cast<const unsigned char*>(bin.data()) , bin.size() ,
+				reinterpret_cast<const unsigned char*>(m_dht_cookie_key.data()) );
+			uint32_t cookie = 0;
+			for (size_t i=0; i<4; ++i) cookie = (cookie << 8) | hash[i];
+			return 1 + (cookie % dht::max_cookie); // 1..max_cookie
+		} );
+	for(auto & v : m_peer) m_dht->add_contact( t_dht::t_contact_type{ v.first , v.second->get_pip() } );
+	const auto now = t_dht::t_clock::now();
+	m_dht->publish( m_my_hip , dht_my_record() , now );
+	m_dht->bootstrap(now);
+	dht_schedule();
+	_info("DHT started with " << m_dht->get_routing_table().size() << " contacts");
+}
+
+void c_tunserver::dht_find_pubkey(const c_haship_addr & hip) {
+	const auto now = t_dht::t_clock::now();
+	auto found = m_dht_find.find(hip);
+	if (found != m_dht_find.end()) {
+		if (found->second.m_running || (now < found->second.m_next)) return;
+	} else {
+		if (m_dht_find.size() >= dht_find_max) { // forget the ones that may be looked for again
+			for (auto it = m_dht_find.begin(); it != m_dht_find.end(); ) {
+				if ((! it->second.m_running) && (now >= it->second.m_next)) it = m_dht_find.erase(it);
+				else ++it;
+			}
+			if (m_dht_find.size() >= dht_find_max) { _dbg1("DHT: too many lookups, not looking for " << hip);  return; }
+		}
+		found = m_dht_find.emplace( hip , t_dht_find{ false , now , dht_find_backoff_min } ).first;
+	}
+
+	found->second.m_running = true;
+	const bool started = m_dht->find_value( hip , // (if the record is here, found is called at once, and erases the entry)
+		[this](const c_haship_addr & key, const std::string & record, const std::vector<t_dht::t_contact_type> & nearest) {
+			auto & find = m_dht_find[key];
+			find.m_running = false;
+			if (record.empty()) {
+				find.m_next = t_dht::t_clock::now() + find.m_backoff;
+				_info("DHT: no record of " << key << ", not looking again for "
+					<< std::chrono::duration_cast<std::chrono::seconds>(find.m_backoff).count() << " s");
+				find.m_backoff = std::min<t_dht::t_clock::duration>( find.m_backoff * 2 , dht_find_backoff_max );
+				return;
+			}
+			m_dht_find.erase(key);
+			trivialserialize::parser parser( trivialserialize::parser::tag_caller_must_keep_this_string_valid() , record );
+			parser.pop_varstring(); // IDC, we get current one in his HI
+			c_haship_pubkey pubkey; pubkey.load_from_bin( parser.pop_varstring() ); // checked by dht_check_record
+			_note("DHT: found pubkey of " << key);
+			add_tunnel_to_pubkey( pubkey );
+			if ((! nearest.empty()) && (nearest.front().m_id == key) && (m_peer.count(key) == 0)) { // a node with his ID answered
+				// the address is his (it answered our query), but the ID in a nodes reply is not authenticated: the peer is added
+				// when his HI (signed, with this HIP) comes from there
+				_note("DHT: node " << key << " is at " << nearest.front().m_locator << ", sending him our HI");
+				send_hi_to( nearest.front().m_locator );
+			}
+		},
+		now );
+	if (! started) {
+		_dbg1("DHT: too many lookups running, not looking for " << hip);
+		m_dht_find.erase(hip);
+	}
+	dht_schedule();
+}
+
+void c_tunserver::send_hi_to(const c_ip46_addr & pip) {
+	std::string data;
+	data += static_cast<char>( c_protocol::current_version );
+	data += static_cast<char>( c_protocol::e_proto_cmd_public_hi );
+	data += m_public_hi.bytes;
+	sockaddr_storage addr;
+	socklen_t addr_len = pip.get_sockaddr(addr);
+	m_udp->send( reinterpret_cast<const sockaddr*>( & addr ), addr_len, data.c_str(), data.size() );
+}
+
+void c_tunserver::keystore_save_queued() {
+	if (! m_keystore) return;
+	try {
+		for (const auto & pubkey : m_keystore_queue) m_keystore->put(e_filestore_galaxy_pub, pubkey.first, pubkey.second);
+		m_keystore->sync();
+		if (! m_keystore_queue.empty()) _dbg1("Saved " << m_keystore_queue.size() << " pubkeys in keystore");
+	}
+	catch(const std::exception &e) { _warn("Can not save pubkeys in keystore: " << e.what()); }
+	m_keystore_queue.clear();
+}
+
+bool c_tunserver::keystore_load_pubkey(const c_haship_addr & hip) {
+	if (! m_keystore) return false;
+	try {
+		c_haship_pubkey pubkey;
+		pubkey.load_from_bin( m_keystore->get(e_filestore_galaxy_pub, hip).to_string() );
+		if (c_haship_addr( c_haship_addr::tag_constr_by_addr_bin() , pubkey.get_ipv6_string_bin() ) != hip) {
+			_warn("Keystore has wrong pubkey for " << hip << ", ignoring it");
+			return false;
+		}
+		_info("Pubkey of " << hip << " is known from keystore");
+		add_tunnel_to_pubkey(pubkey);
+		return true;
+	}
+	catch(const expected_not_found &) { return false; }
+	catch(const std::exception &e) { _warn("Can not load pubkey of " << hip << " from keystore: " << e.what()); }
+	return false;
+}
+
+state_snapshot::c_snapshot c_tunserver::make_state_snapshot() const {
+	state_snapshot::c_snapshot snapshot;
+	const auto now = std::chrono::steady_clock::now();
+	auto age_of = [now](std::chrono::steady_clock::time_point when) { return std::chrono::duration_cast<state_snapshot::t_age>(now - when); };
+
+	for(const auto & v : m_peer) {
+		const auto & peer = v.second;
+		if (! peer->is_pubkey()) continue; // no HI from him yet
+		state_snapshot::t_age age(0);
+		const auto & quality = peer->get_link_quality();
+		if (! (quality.is_measured() && (quality.get_loss() < 0.9))) { // he does not answer now
+			auto seen = m_snapshot_peer_seen.find(v.first);
+			if (seen == m_snapshot_peer_seen.end()) continue;
+			age = age_of(seen->second); // still the time from snapshot
+		}
+		snapshot.m_peers.push_back( state_snapshot::t_peer{ v.first , peer->get_pip() , age } );
+		snapshot.m_pubkeys[ v.first ] = peer->get_pub()->serialize_bin();
+	}
+	for(const auto & dst : m_routing_manager.m_route_multipath) {
+		for(const auto & path : dst.second) {
+			const auto & route = path.second;
+			const auto age = age_of(route.m_time);
+			if ((route.m_state == c_routing_manager::e_route_state_dead) || (age > state_snapshot::c_snapshot::max_route_age)) continue;
+			snapshot.m_routes.push_back( state_snapshot::t_route{ dst.first , path.first , route.get_cost() , age } );
+			snapshot.m_pubkeys[ dst.first ] = route.m_pubkey.serialize_bin();
+		}
+	}
+	for(const auto & v : m_tunnel) {
+		if (v.second->m_pubkey_bin.empty()) continue;
+		snapshot.m_tunnels.push_back( v.first );
+		snapshot.m_pubkeys[ v.first ] = v.second->m_pubkey_bin;
+	}
+	return snapshot;
+}
+
+void c_tunserver::save_state_snapshot() {
+	if (m_snapshot_path.empty()) return;
+	try {
+		const auto snapshot = make_state_snapshot();
+		snapshot.save(m_snapshot_path);
+		_info("Saved state snapshot: " << snapshot.m_peers.size() << " peers, " << snapshot.m_routes.size() << " routes, "
+			<< snapshot.m_tunnels.size() << " tunnels");
+	}
+	catch(const std::exception &e) { _warn("Can not save state snapshot in " << m_snapshot_path << ": " << e.what()); }
+}
+
+void c_tunserver::load_state_snapshot() {
+	if (m_snapshot_path.empty()) return;
+	state_snapshot::c_snapshot snapshot;
+	try { snapshot = state_snapshot::c_snapshot::load(m_snapshot_path); }
+	catch(const expected_not_found &) { _info("No state snapshot in " << m_snapshot_path << " yet"); return; }
+	catch(const std::exception &e) { _warn("Can not load state snapshot from " << m_snapshot_path << " (will learn all again): " << e.what()); return; }
+
+	std::map<state_snapshot::t_hip, c_haship_pubkey> pubkeys; // only these that match their HIP
+	for(const auto & item : snapshot.m_pubkeys) {
+		try {
+			c_haship_pubkey pubkey;
+			pubkey.load_from_bin(item.second);
+			const c_haship_addr hip( c_haship_addr::tag_constr_by_addr_bin() , pubkey.get_ipv6_string_bin() );
+			if (static_cast<const state_snapshot::t_hip &>(hip) == item.first) pubkeys.emplace(item.first, pubkey);
+			else _warn("State snapshot has wrong pubkey for " << hip << ", ignoring it");
+		}
+		catch(const std::exception &e) { _warn("Can not load pubkey from state snapshot: " << e.what()); }
+	}
+
+	const auto now = std::chrono::steady_clock::now();
+	for(const auto & peer : snapshot.m_peers) {
+		const auto pubkey = pubkeys.find(peer.m_hip);
+		if (pubkey == pubkeys.end()) continue;
+		const c_haship_addr hip = hip_from_snapshot(peer.m_hip);
+		auto found = m_peer.find(hip);
+		if (found == m_peer.end()) add_peer_append_pubkey( t_peering_reference( peer.m_pip , pubkey->second.get_ipv6_string_hexdot() ) ,
+			make_unique<c_haship_pubkey>(pubkey->second) );
+		else if (! found->second->is_pubkey()) found->second->set_pubkey( make_unique<c_haship_pubkey>(pubkey->second) ); // his address from options wins
+		m_snapshot_peer_seen[ hip ] = now - peer.m_age;
+	}
+	for(const auto & route : snapshot.m_routes) {
+		const auto pubkey = pubkeys.find(route.m_dst);
+		if (pubkey == pubkeys.end()) continue; // we could not tell it to others (findhip reply has his pubkey)
+		const int link_cost = std::min<int>( link_quality::c_link_quality::hop_cost , route.m_cost ); // not measured yet
+		c_routing_manager::c_route_info route_info( hip_from_snapshot(route.m_nexthop) , link_cost , route.m_cost - link_cost ,
+			pubkey->second );
+		route_info.m_state = c_routing_manager::e_route_state_provisional;
+		route_info.m_time = now - route.m_age;
+		m_routing_manager.add_route_info_and_return( hip_from_snapshot(route.m_dst) , route_info );
+	}
+	for(const auto & hip : snapshot.m_tunnels) {
+		const auto pubkey = pubkeys.find(hip);
+		if (pubkey != pubkeys.end()) add_tunnel_to_pubkey(pubkey->second); // no need to wait for HI, findhip or DHT
+	}
+	_note("Loaded state snapshot: " << snapshot.m_peers.size() << " peers, " << snapshot.m_routes.size() << " routes, "
+		<< snapshot.m_tunnels.size() << " tunnels (peers and routes are provisional, until checked again)");
+}
+
+std::string c_tunserver::dht_my_record() const {
+	trivialserialize::generator gen(8000);
+	gen.push_varstring( m_my_IDC.get_serialize_bin_pubkey() );
+	gen.push_varstring( m_my_IDI_pub.serialize_bin() );
+	gen.push_varstring( m_IDI_IDC_sig.serialize_bin() );
+	return gen.str_move();
+}
+
+bool c_tunserver::dht_check_record(const c_haship_addr & hip, const std::string & record) {
+	try {
+		trivialserialize::parser parser( trivialserialize::parser::tag_caller_must_keep_this_string_valid() , record );
+		const std::string bin_IDC_pub = parser.pop_varstring();
+		const std::string bin_IDI_pub = parser.pop_varstring();
+		antinet_crypto::c_multisign IDI_IDC_sig;
+		IDI_IDC_sig.load_from_bin( parser.pop_varstring() );
+		if (! parser.is_end()) return false;
+		c_haship_pubkey pubkey;
+		pubkey.load_from_bin( bin_IDI_pub );
+		if (c_haship_addr( c_haship_addr::tag_constr_by_addr_bin() , pubkey.get_ipv6_string_bin() ) != hip) return false; // not his key
+		antinet_crypto::c_multikeys_pub IDI;
+		IDI.load_from_bin( bin_IDI_pub );
+		antinet_crypto::c_multikeys_pub::multi_sign_verify( IDI_IDC_sig , bin_IDC_pub , IDI ); // throws if not valid
+		return true;
+	} catch(const std::exception &) { return false; }
+}
+
+void c_tunserver::update_tun_mtu() {
+	// what a tunneled packet gets on wire (the PI header is encrypted with the packet):
+	const size_t overhead = c_protocol::tunneled_data_header_size + c_protocol::p2p_mac_size
+		+ 3 // uvarint of blob size
+		+ crypto_box_MACBYTES + g_tuntap::TUN_with_PI::header_position_of_ipv6;
+
+	size_t payload = pmtu::payload_for_link_mtu( pmtu::ethernet_mtu , true );
+	for(auto & v : m_peer) {
+		auto peer_udp = unique_cast_ptr<c_peering_udp>( v.second ); // upcast to UDP peer derived
+		payload = std::min( payload , peer_udp->get_path_mtu().get_mtu() );
+	}
+	if (m_peer.empty()) payload = pmtu::base_payload; // nothing known yet
+	const size_t mtu = pmtu::tun_mtu_for_payload(payload, overhead);
+	if (mtu == m_tun_mtu) return;
+
+	_note("Setting MTU of TUN " << m_tun_name << " to " << mtu << " (path MTU to peers, UDP payload: " << payload << ")");
+	m_tun->set_mtu(mtu);
+	m_tun_mtu = mtu;
+}
+
+void c_tunserver::write_to_tun(const char *buff, size_t buff_size) {
+	ssize_t write_bytes = -1;
+	if (m_tun_offload_active) { // insert empty virtio_net_hdr after PI (data on wire never has it)
+		if (buff_size < tun_offload::pi_size) throw std::runtime_error("Too short data to write to TUN");
+		iovec iov[3];
+		iov[0].iov_base = const_cast<char*>(buff);  iov[0].iov_len = tun_offload::pi_size;
+		iov[1].iov_base = const_cast<char*>(tun_offload::empty_vnet_hdr());  iov[1].iov_len = tun_offload::vnet_hdr_size;
+		iov[2].iov_base = const_cast<char*>(buff + tun_offload::pi_size);  iov[2].iov_len = buff_size - tun_offload::pi_size;
+		write_bytes = m_tun->writev(iov, 3);
+	}
+	else {
+		iovec iov{ const_cast<char*>(buff) , buff_size };
+		write_bytes = m_tun->writev(&iov, 1);
+	}
+	if (write_bytes == -1) throw std::runtime_error("Fail to send UDP to TUN");
+}
+
+void c_tunserver::send_scheduled_frames() {
+	if (m_send_scheduler.empty()) return;
+	latency::c_trace trace(m_latency); // on its own: frames of many packets (of earlier events too) are sent together
+	trace.start( latency::c_stages::t_clock::now() );
+	m_send_scheduler.run( std::chrono::steady_clock::now() , m_uplink_bucket ,
+		[this](const c_haship_addr & next_hip, const std::string & frame) {
+			auto peer_it = m_peer.find(next_hip);
+			if (peer_it == m_peer.end()) { _info("DROP: queued data for peer that is gone: " << next_hip); return; }
+			try {
+				auto peer_udp = unique_cast_ptr<c_peering_udp>( peer_it->second ); // upcast to UDP peer derived
+				peer_udp->send_frame_udp(frame, *m_udp); // <--- *** actually send the data (or in flush below)
+			} catch(std::exception &e) { _warn("Can not send to peer " << next_hip << ", because:" << e.what()); }
+		}
+	);
+	m_udp->flush(); // frames to same peer were sent together (GSO)
+	trace.mark(latency::e_stage::udp_send);
+}
+
+bool c_tunserver::route_tun_data_to_its_destination_top(t_route_method method,
+	const char *buff, size_t buff_size,
+	c_haship_addr src_hip, c_haship_addr dst_hip,
+	c_routing_manager::c_route_reason reason, int data_route_ttl, antinet_crypto::t_crypto_nonce nonce_used,
+	c_haship_addr flow_hip, uint64_t flow_hash) {
+	try {
+		_info("Sending data between end2end " << src_hip <<"--->" << dst_hip);
+		bool ok = this->route_tun_data_to_its_destination_detail(method, buff, buff_size,
+			src_hip, dst_hip, dst_hip, reason, 0, data_route_ttl, nonce_used, flow_hip, flow_hash);
+		if (!ok) { _info("Routing/sending failed (top level)"); return false; }
+	} catch(std::exception &e) {
+		_warn("Can not send to peer, because:" << e.what()); // TODO more info (which peer, addr, number)
+	} catch(...) {
+		_warn("Can not send to peer (unknown)"); // TODO more info (which peer, addr, number)
+	}
+	_info("Routing/sending OK (top level)");
+	return true;
+}
+
+double c_tunserver::nexthop_weight(const c_haship_addr & hip) const {
+	auto peer_it = m_peer.find(hip);
+	if (peer_it == m_peer.end()) return 0; // gone
+	if (peer_it->second->get_crypto_p2p() == nullptr) return 0; // he would drop our frames
+	return peer_it->second->get_link_quality().get_weight(); // slow or lossy peer gets less flows
+}
+
+c_peering & c_tunserver::find_peer_by_sender_peering_addr( c_ip46_addr ip ) const {
+	for(auto & v : m_peer) { if (v.second->get_pip() == ip) return * v.second.get(); }
+	throw std::runtime_error("We do not know a peer with such IP=" + STR(ip));
+}
+
+//bool c_tunserver::rpc_add_limit_points(const string &peer_ip) {
+//	c_haship_addr peer_hip(c_haship_addr::tag_constr_by_addr_dot(), peer_ip);
+//	try {
+//		m_peer.at(peer_hip)->add_limit_points(1000);
+//	}
+//	catch (const std::out_of_range &e) {
+//		_warn("not found peer " << peer_ip);
+//		return false;
+//	}
+//	return true;
+//}
+
+void c_tunserver::event_loop() {
+	_info("Entering the event loop");
+	c_counter counter(2,true);
+	c_counter counter_big(10,false);
+
+	{ // timers of peers are scheduled when they are added; these are for the whole node
+		const auto now = std::chrono::steady_clock::now();
+		m_timers.schedule( t_timer_key{ e_timer::tun_mtu , c_haship_addr() } , now );
+		m_timers.schedule( t_timer_key{ e_timer::route_dv , c_haship_addr() } , now );
+		m_timers.schedule( t_timer_key{ e_timer::dht , c_haship_addr() } , now );
+		m_timers.schedule( t_timer_key{ e_timer::stats , c_haship_addr() } , now );
+		m_timers.schedule( t_timer_key{ e_timer::state_snapshot , c_haship_addr() } , now + timer_state_snapshot );
+		m_timers.schedule( t_timer_key{ e_timer::keystore , c_haship_addr() } , now + timer_keystore );
+	}
+
+	ostringstream oss;
+	oss <<	" Node " << m_my_name << " hip=" << m_my_hip;
+	const string node_title_bar = oss.str();
+
+
+	// low level receive buffer
+	const int buf_size=std::max<int>(65536, tun_offload::max_read_size); // TUN super-packet must fit
+	char buf[buf_size];
+
+	while (! m_exiting) {
+		// std::this_thread::sleep_for( std::chrono::milliseconds(100) ); // was needeed to avoid any self-DoS in case of TTL bugs
+
+		auto time_now = std::chrono::steady_clock::now(); // time now
+		m_trace.start(time_now); // maybe this event is sampled
+
+		run_timers(); // keepalives, pings, probes, adverts, stats... - only those that are due now
+		m_trace.mark(latency::e_stage::wakeup);
+		wait_for_fd_event();
+		m_trace.mark_idle();
+
+		if (g_exit_requested) { // SIGINT, SIGTERM
+			_note("Exiting, on signal");
+			m_exiting = true;
+			continue;
+		}
+		if (m_latency_dumps_done != g_latency_dump_requests) { // SIGUSR1
+			m_latency_dumps_done = g_latency_dump_requests;
+			ostringstream oss;  print_latency(oss);
+			std::cerr << oss.str() << std::flush;
+		}
+
+		// TODO(r): program can be hanged/DoS with bad routing, no TTL field yet
+		// ^--- or not fully checked. need scoring system anyway
+
+		try { // ---
+
+		if (FD_ISSET(m_tun->get_fd(), &m_fd_set_data)) { // data incoming on TUN - send it out to peers
+			auto size_read = m_tun->read(buf, sizeof(buf)); // <-- read data from TUN
+			m_trace.mark(latency::e_stage::tun_read);
+			_info("TTTTTTTTTTTTTTTTTTTTTTTTTT ###### ------> TUN read " << size_read << " bytes: [" << string(buf,size_read)<<"]");
+			if (size_read < 0) { _warn("Error reading from TUN"); continue; }
+
+			if (m_tun_offload_active) { // maybe a super-packet, split it into packets, each is encrypted and sent alone
+				auto count = tun_offload::segment(buf, size_read,
+					[this](const char *packet, size_t packet_size) { this->route_own_tun_packet(packet, packet_size); },
+					m_tun_segment_buf );
+				_info("TUN read was split into " << count << " packet(s)");
+			}
+			else route_own_tun_packet(buf, size_read);
+		}
+		else if (FD_ISSET(m_udp->get_fd(), &m_fd_set_data) || m_udp->has_pending()) { // data incoming on peer (UDP) - will route it or send to our TUN
+			sockaddr_storage from_addr_raw; // peering address of peer (socket sender), raw format
+			socklen_t from_addr_raw_size; // ^ size of it
+
+			c_ip46_addr sender_pip; // peer-IP of peer who sent it
+
+			// ***
+			from_addr_raw_size = sizeof(from_addr_raw); // IN/OUT parameter to recvfrom, sending it for IN to be the address "buffer" size
+			auto size_read = m_udp->receive(buf, sizeof(buf), reinterpret_cast<sockaddr*>( & from_addr_raw), & from_addr_raw_size);
+			m_trace.mark(latency::e_stage::udp_receive);
+			if (size_read < 0) { _warn("Error reading from UDP socket"); continue; }
+			_info("###### ======> UDP read " << size_read << " bytes: [" << string(buf,size_read)<<"]");
+			// ^- reinterpret allowed by linux specs (TODO)
+			// sockaddr *src_addr, socklen_t *addrlen);
+
+			// ipv4 peer (also when seen as ::ffff:a.b.c.d on our dual-stack socket), or ipv6 peer:
+			sender_pip.set_sockaddr( reinterpret_cast<sockaddr*>( & from_addr_raw ) , from_addr_raw_size );
+
+			_info("UDP Socket read from direct sender_pip = " << sender_pip <<", size " << size_read << " bytes: " << string_as_dbg( string_as_bin(buf,size_read)).get());
+			// ------------------------------------
+
+			// parse version and command:
+			if (! (size_read >= 2) ) { _warn("INVALIDA DATA, size_read="<<size_read); continue; } // !
+			assert( size_read >= 2 ); // buf: reads from position 0..1 are asserted as valid now
+
+			int proto_version = static_cast<int>( static_cast<unsigned char>(buf[0]) ); // TODO
+			_assert(proto_version >= c_protocol::current_version ); // let's assume we will be backward compatible (but this will be not the case untill official stable version probably)
+			c_protocol::t_proto_cmd cmd = static_cast<c_protocol::t_proto_cmd>( buf[1] );
+
+			// recognize the peering HIP/CA (cryptoauth is TODO)
+			c_haship_addr sender_hip;
+			c_peering * sender_as_peering_ptr  = nullptr; // TODO(r)-security review usage of this, and is it needed
+			if (! c_protocol::command_is_valid_from_unknown_peer( cmd )) {
+				c_peering & sender_as_peering = find_peer_by_sender_peering_addr( sender_pip ); // warn: returned value depends on m_peer[], do not invalidate that!!!
+				_info("We recognize the sender, as: " << sender_as_peering);
+				sender_hip = sender_as_peering.get_hip(); // this is not yet confirmed/authenticated(!)
+				sender_as_peering_ptr = & sender_as_peering; // pointer to owned-by-us m_peer[] element. But can be invalidated, use with care! TODO(r) check this TODO(r) cast style
+			}
+			_info("@@@@@@@@@@@@@@@@@@@@@@@@@@@@@ Command: " << cmd << " from peering ip = " << sender_pip << " -> peer HIP=" << sender_hip);
+
+			if ((cmd == c_protocol::e_proto_cmd_tunneled_data) || (cmd == c_protocol::e_proto_cmd_tunneled_data_compact)) { // [protocol] tunneled data
+				_dbg1("Tunneled data");
+				const bool compact = (cmd == c_protocol::e_proto_cmd_tunneled_data_compact);
+				auto peer_udp = dynamic_cast<c_peering_udp*>( sender_as_peering_ptr ); // upcast to UDP peer derived
+
+				// CT-P2P: authenticate this hop first - before parsing, routing or decrypting anything
+				const size_t header_size = compact ? c_protocol::tunneled_data_compact_header_size : c_protocol::tunneled_data_header_size;
+				{
+					if (! (static_cast<size_t>(size_read) >= header_size + c_protocol::p2p_mac_size) ) {
+						_warn("INVALIDA DATA (too short tunneled data), size_read="<<size_read); continue;
+					}
+					auto * crypto_p2p = sender_as_peering_ptr->get_crypto_p2p(); // sender is known, see above
+					if (crypto_p2p == nullptr) { _dbg1("DROP: no CT-P2P with sender yet (no HI from him)"); continue; }
+					if (! crypto_p2p->check_frame( buf , size_read )) { // MAC of header and blob, at end of the frame
+						_dbg1("DROP: wrong CT-P2P MAC from " << sender_pip);
+						continue;
+					}
+				}
+				m_trace.mark(latency::e_stage::udp_auth);
+
+				const size_t frame_size = size_read - c_protocol::p2p_mac_size; // without the MAC (checked above)
+				trivialserialize::parser parser( trivialserialize::parser::tag_caller_must_keep_this_buffer_valid() , buf, frame_size );
+				parser.skip_bytes_n(2);
+				c_haship_addr src_hip, dst_hip;
+				int requested_ttl; // the TTL of data that we are asked to forward
+				string nonce_used_raw;
+				string blob;
+				if (compact) { // src,dst and the nonce are known from his connection ID
+					const uint32_t conn_id = conn_ids::bin_to_u32( parser.pop_bytes_n( c_protocol::conn_id_size ).data() );
+					requested_ttl = parser.pop_byte_u();
+					const uint32_t seq_truncated = conn_ids::bin_to_u32( parser.pop_bytes_n( conn_ids::seq_truncated_size ).data() );
+					if (! peer_udp->get_conn_ids().seen_compact(conn_id, seq_truncated, src_hip, dst_hip, nonce_used_raw)) {
+						_info("DROP: unknown connection ID " << conn_id << " from " << sender_hip);
+						continue;
+					}
+					blob.assign( buf + header_size , frame_size - header_size ); // [protocol] blob is the rest (till MAC) TODO view-string
+				} else {
+					src_hip = c_haship_addr(c_haship_addr::tag_constr_by_addr_bin() , parser.pop_bytes_n(g_ipv6_rfc::length_of_addr) );
+					dst_hip = c_haship_addr(c_haship_addr::tag_constr_by_addr_bin() , parser.pop_bytes_n(g_ipv6_rfc::length_of_addr) );
+					requested_ttl = parser.pop_byte_u();
+					nonce_used_raw = parser.pop_bytes_n( crypto_box_NONCEBYTES );
+					blob =	parser.pop_varstring(); // TODO view-string
+
+					// give him ID for this (src,dst), so he can send next frames in compact format
+					const uint32_t offer_id = peer_udp->get_conn_ids().seen_full(src_hip, dst_hip, nonce_used_raw,
+						std::chrono::steady_clock::now());
+					if (offer_id != 0) peer_udp->send_conn_id_offer(src_hip, dst_hip, conn_ids::nonce_prefix(nonce_used_raw), offer_id, *m_udp);
+				}
+				_dbg1("nonce_used_raw="<<to_debug(nonce_used_raw));
+				antinet_crypto::t_crypto_nonce nonce_used(
+					sodiumpp::encoded_bytes(nonce_used_raw , sodiumpp::encoding::binary)
+				);
+				_warn("Received NONCE=" << antinet_crypto::show_nice_nonce(nonce_used) );
+				m_trace.mark(latency::e_stage::udp_parse);
+
+				// TODONOW optimize? make sure the proper binary format is cached:
+				if (dst_hip == m_my_hip) { // received data addresses to us as finall destination:
+					_info("UDP data is addressed to us as finall dst, sending it to TUN (after decryption) blob="<<to_debug(blob));
+
+					auto find_tunnel = m_tunnel.find( src_hip ); // find end2end tunnel
+					if ((find_tunnel == m_tunnel.end()) && keystore_load_pubkey(src_hip)) find_tunnel = m_tunnel.find( src_hip );
+					if (find_tunnel == m_tunnel.end()) {
+						_warn("end2end tunnel does not exist, can not DECRYPT this data for us (yet?)...");
+						dht_find_pubkey( src_hip );
+
+						std::string dump; // just to trigger a search (for path - and btw for the pubkey!)
+						_note("GET KEYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYY - will look for key for "
+							<< dst_hip << " so we can READ DATA from there");
+						this->route_tun_data_to_its_destination_top(
+							e_route_method_from_me,
+							dump.c_str(), dump.size(),
+							dst_hip, src_hip, // return back to sender (from us)
+							c_routing_manager::c_route_reason( c_haship_addr() , c_routing_manager::e_search_mode_route_own_packet),
+							requested_ttl, // we assume sender is that far away from us, since the data reached us
+							antinet_crypto::t_crypto_nonce(), // any nonce - just dummy
+							m_my_hip
+						);
+
+					} else {
+						_mark("Using CT tunnel to decrypt data for us");
+						auto & ct = * find_tunnel->second;
+						std::string tundata;
+						try { tundata = ct.unbox_ab( blob , nonce_used ); }
+						catch(const antinet_crypto::replay_error &) {
+							_info("DROP: replayed data from " << src_hip << " (dropped so far: " << ct.get_count_replay() << ")");
+							continue; // skip this packet (main loop)
+						}
+						tundata = ct.m_compressor.decode(tundata); // throws on invalid data
+						m_trace.mark(latency::e_stage::udp_unbox);
+						_note("<<<====== TUN INPUT: " << to_debug(tundata));
+						write_to_tun(tundata.c_str(), tundata.size());
+						m_trace.mark(latency::e_stage::tun_write);
+					} // we have CT
+				}
+				else
+				{ // received data that is addresses to someone else
+					auto data_route_ttl = requested_ttl - 1;
+					const int limit_incoming_ttl = c_protocol::ttl_max_accepted;
+					if (data_route_ttl > limit_incoming_ttl) {
+						_info("We were requested to route (data) at high TTL (rude) by peer " << sender_hip <<  " - so reducing it.");
+						data_route_ttl=limit_incoming_ttl;
+					}
+
+					_info("RRRRRRRRRRRRRRRRRRRRRRRRRRR UDP data is addressed to someone-else as finall dst, ROUTING it, at data_route_ttl="<<data_route_ttl);
+					// the data is queued in flow of sender, so his traffic is shaped to his rate and is fair to others
+					this->route_tun_data_to_its_destination_top(
+						e_route_method_default,
+						blob.c_str(), blob.size(),
+						src_hip, dst_hip,
+						c_routing_manager::c_route_reason( src_hip , c_routing_manager::e_search_mode_route_other_packet ),
+						data_route_ttl,
+						nonce_used, // forward the nonce for blob
+						sender_hip
+					); // push the tunneled data to where they belong // reinterpret char-signess
+				}
+
+			} // e_proto_cmd_tunneled_data
+			else if (cmd == c_protocol::e_proto_cmd_public_hi) { // [protocol]
+				_note("hhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhh --> Command HI received");
+				int offset1=2; assert( size_read >= offset1); // skip CMD headers (TODO instead use one parser)
+
+				trivialserialize::parser parser( trivialserialize::parser::tag_caller_must_keep_this_buffer_valid() ,
+					buf+offset1 , size_read-offset1);
+
+				// TODONOW: size of pubkey is different, use serialize
+				// if (cmd_data.bytes.at(pos1)!=';') throw std::runtime_error("Invalid protocol format, missing coma"); // [protocol]
+				string_as_bin bin_his_IDC_pub( parser.pop_varstring() ); // PARSE
+				string_as_bin bin_his_IDI_pub( parser.pop_varstring() ); // PARSE
+				string_as_bin bin_his_IDI_IDC_sig( parser.pop_varstring() ); // PARSE
+				const hi_session::t_session_id his_session = parser.is_end() ? 0 : parser.pop_integer_u<8, uint64_t>(); // older: none
+
+				_info("We received IDC pubkey=" << to_debug( bin_his_IDC_pub ) );
+				_info("We received IDI pubkey=" << to_debug( bin_his_IDI_pub ) );
+				_info("We received IDI --> IDC signature=" << to_debug( bin_his_IDI_IDC_sig ) );
+
+			try {
+				antinet_crypto::c_multikeys_pub his_IDI;
+				his_IDI.load_from_bin(bin_his_IDI_pub.bytes);
+				antinet_crypto::c_multisign his_IDI_IDC_sig;
+				his_IDI_IDC_sig.load_from_bin(bin_his_IDI_IDC_sig.bytes);
+				antinet_crypto::c_multikeys_pub::multi_sign_verify(his_IDI_IDC_sig, bin_his_IDC_pub.bytes, his_IDI);
+
+				{ // add peer
+					auto his_pubkey = make_unique<c_haship_pubkey>();
+					his_pubkey->load_from_bin( bin_his_IDI_pub.bytes );
+					_info("Parsed pubkey into: " << his_pubkey->to_debug());
+					t_peering_reference his_ref( sender_pip , his_pubkey->get_ipv6_string_hexdot() );
+					add_peer_append_pubkey( his_ref , std::move( his_pubkey ) );
+
+					antinet_crypto::c_multikeys_pub his_IDC; // verified above
+					his_IDC.load_from_bin( bin_his_IDC_pub.bytes );
+					add_peer_crypto_p2p( his_ref.haship_addr , his_IDC );
+
+					auto peer_udp = dynamic_cast<c_peering_udp*>( m_peer.at( his_ref.haship_addr ).get() );
+					if (peer_udp && peer_udp->get_hi_session().hi_received(his_session)) {
+						peering_send_hi( *peer_udp ); // his new session (e.g. he restarted): he needs our HI, do not wait for the timer
+					}
+
+					// he is a DHT node too; if we had no contacts (e.g. all timed out), start again with him
+					const bool dht_was_empty = (m_dht->get_routing_table().size() == 0);
+					m_dht->add_contact( t_dht::t_contact_type{ his_ref.haship_addr , sender_pip } );
+					if (dht_was_empty) {
+						m_dht->publish( m_my_hip , dht_my_record() , t_dht::t_clock::now() );
+						m_dht->bootstrap( t_dht::t_clock::now() );
+						dht_schedule();
+					}
+				}
+
+				{ // add node
+					c_haship_pubkey his_pubkey;
+					his_pubkey.load_from_bin( bin_his_IDI_pub.bytes );
+					add_tunnel_to_pubkey( his_pubkey );
+				}
+
+			} catch (std::invalid_argument &err) {
+				_warn("Fail to verificate his IDC, probably bad public keys or signatures!!!");
+			}
+			}
+			else if (cmd == c_protocol::e_proto_cmd_findhip_query) { // [protocol]
+				_warn("QQQQQQQQQQQQQQQQQQQQQQQ - we are QUERIED to find HIP");
+				// [protocol] for search query - format is: HIP_BINARY;TTL_BINARY;
+				int offset1=2; assert( size_read >= offset1);  string_as_bin cmd_data( buf+offset1 , size_read-offset1); // buf -> bin for comfortable use
+
+				auto pos1 = cmd_data.bytes.find_first_of(';',offset1); // [protocol] size of HIP is dynamic  TODO(r)-ERROR XXX ';' is not escaped! will cause mistaken protocol errors
+				decltype (pos1) size_hip = g_haship_addr_size; // possible size of HIP if ipv6
+				if ((pos1==string::npos) || (pos1 != size_hip)) throw std::runtime_error("Invalid protocol format, wrong size of HIP field");
+
+				string_as_bin bin_hip( cmd_data.bytes.substr(0,pos1) );
+				c_haship_addr requested_hip( c_haship_addr::tag_constr_by_addr_bin(), bin_hip.bytes ); // *
+
+				string_as_bin bin_ttl( cmd_data.bytes.substr(pos1+1,1) );
+				int requested_ttl = static_cast<int>( bin_ttl.bytes.at(0) ); // char to integer
+
+				auto data_route_ttl = requested_ttl - 1;
+				const int limit_incoming_ttl = c_protocol::ttl_max_accepted;
+				if (data_route_ttl > limit_incoming_ttl) {
+					_info("We were requested to route (help search route) at high TTL (rude) by peer " << sender_hip <<  " - so reducing it.");
+					data_route_ttl=limit_incoming_ttl;
+                    UNUSED(data_route_ttl); // TODO is it should be used?
+                }
+
+				_info("We received request for HIP=" << string_as_hex( bin_hip ) << " = " << requested_hip << " and TTL=" << requested_ttl );
+				if (requested_ttl < 1) {
+					_info("Too low TTL, dropping the request");
+				} else {
+					c_routing_manager::c_route_reason reason( sender_hip , c_routing_manager::e_search_mode_help_find );
+					try {
+						_mark("Searching for the route he asks about");
+						const auto & route = m_routing_manager.get_route_or_maybe_search(*this, requested_hip , reason , true, requested_ttl - 1);
+						_note("We found the route thas he asks about, as: " << route);
+
+						const int reply_ttl = requested_ttl; // will reply as much as needed
+
+						// [protocol] e_proto_cmd_findhip_reply write "TTL;COST:HIP_OF_GOAL"
+						trivialserialize::generator gen(50); // TODO optimal size
+						gen.push_byte_u( reply_ttl );
+						gen.push_byte_u( ';' );
+						gen.push_byte_u( std::min<int>( route.get_cost() , c_protocol::route_cost_max ) );
+						gen.push_byte_u( ';' );
+						gen.push_bytes_n( g_haship_addr_size , string_as_bin( requested_hip ).bytes ); // the hip of goal
+						gen.push_byte_u( ';' );
+						gen.push_varstring( route.m_pubkey.serialize_bin() );
+						gen.push_byte_u( ';' );
+						gen.push_byte_u( c_protocol::findhip_cost_link_quality ); // not in older versions (they stop reading before)
+
+						auto data = gen.str();
+
+						_info("DDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDD Will send data to sender_as_peering_ptr="
+							<< sender_as_peering_ptr
+							<< " data: " << to_debug_b( data ) );
+						auto peer_udp = dynamic_cast<c_peering_udp*>( sender_as_peering_ptr ); // upcast to UDP peer derived
+						peer_udp->send_data_udp_cmd(c_protocol::e_proto_cmd_findhip_reply, string_as_bin(data), *m_udp); // <---
+						_note("Send the route reply");
+					} catch(...) {
+						_info("Can not yet reply to that route query.");
+						// a background should be running in background usually
+					}
+				}
+
+			}
+			else if (cmd == c_protocol::e_proto_cmd_findhip_reply) { // [protocol]
+				_warn("ROUTE GOT REPLY ggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggg");
+				// TODO-NOW format with hip etc
+				// TODO-NOW here we will parse pubkey probably
+
+				// [protocol] e_proto_cmd_findhip_reply read "TTL;COST:HIP_OF_GOAL"
+				int offset1=2; // version, cmd
+				trivialserialize::parser parser( trivialserialize::parser::tag_caller_must_keep_this_buffer_valid() ,  buf+offset1 , size_read-offset1);
+				int given_ttl = parser.pop_byte_u(); // ttl
+				parser.pop_byte_skip(';');
+				int given_cost = parser.pop_byte_u(); // cost
+				parser.pop_byte_skip(';');
+				c_haship_addr given_goal_hip( c_haship_addr::tag_constr_by_addr_bin(),
+					parser.pop_bytes_n( g_haship_addr_size ) ); // hip
+				parser.pop_byte_skip(';');
+				c_haship_pubkey pubkey; pubkey.load_from_bin( parser.pop_varstring() );
+				parser.pop_byte_skip(';');
+				if (parser.is_end()) { // older node: his cost is in hops, we count link costs (each at least hop_cost)
+					given_cost = std::min<int>( given_cost * link_quality::c_link_quality::hop_cost , c_protocol::route_cost_max );
+				} else if (parser.pop_byte_u() != c_protocol::findhip_cost_link_quality) {
+					_info("Unknown format of cost in findhip reply, dropping it"); continue;
+				}
+				_info("We have a TTL reply: ttl="<<given_ttl<<" goal="<<given_goal_hip<<" cost="<<given_cost);
+
+				auto data_route_ttl = given_ttl - 1;
+				const int limit_incoming_ttl = c_protocol::ttl_max_accepted;
+				if (data_route_ttl > limit_incoming_ttl) {
+					_info("Got command at high TTL (rude) by peer " << sender_hip <<  " - so reducing it.");
+					data_route_ttl=limit_incoming_ttl;
+				}
+
+				if (given_ttl < 1) {
+					_info("Too low TTL, dropping the request");
+				} else {
+					_info("GOT CORRECT REPLY - USING IT");
+
+					_warn("Cool, we got there a pubkey.");
+					add_tunnel_to_pubkey( pubkey );
+
+					// cost from us: his cost plus our link to him
+					c_routing_manager::c_route_info route_info( sender_hip , sender_as_peering_ptr->get_link_quality().get_cost() ,
+						given_cost , pubkey );
+					_info("rrrrrrrrrrrrrrrrrrr route known thanks to peer help:" << route_info);
+					// store it, so that we own this object:
+					const auto & route_info_ref_we_own = m_routing_manager.add_route_info_and_return( given_goal_hip , route_info );
+					UNUSED(route_info_ref_we_own); // TODO TODONOW and reply to others who asked us
+				}
+			}
+			else if (cmd == c_protocol::e_proto_cmd_conn_id_offer) { // [protocol] he gives us ID for compact tunneled data
+				const size_t offer_size = c_protocol::conn_id_offer_size;
+				if (! (static_cast<size_t>(size_read) >= offer_size + c_protocol::p2p_mac_size) ) {
+					_warn("INVALIDA DATA (too short connection ID offer), size_read="<<size_read); continue;
+				}
+				auto * crypto_p2p = sender_as_peering_ptr->get_crypto_p2p();
+				if ((crypto_p2p == nullptr) || (! crypto_p2p->check_mac( buf , offer_size , buf + offer_size ))) {
+					_dbg1("DROP: connection ID offer without correct CT-P2P MAC from " << sender_pip);
+					continue;
+				}
+				trivialserialize::parser parser( trivialserialize::parser::tag_caller_must_keep_this_buffer_valid() , buf, offer_size );
+				parser.skip_bytes_n(2);
+				c_haship_addr src_hip(c_haship_addr::tag_constr_by_addr_bin() , parser.pop_bytes_n(g_ipv6_rfc::length_of_addr) );
+				c_haship_addr dst_hip(c_haship_addr::tag_constr_by_addr_bin() , parser.pop_bytes_n(g_ipv6_rfc::length_of_addr) );
+				const uint32_t conn_id = conn_ids::bin_to_u32( parser.pop_bytes_n( c_protocol::conn_id_size ).data() );
+				const std::string nonce_prefix = parser.pop_bytes_n( conn_ids::nonce_prefix_size );
+				auto peer_udp = dynamic_cast<c_peering_udp*>( sender_as_peering_ptr ); // upcast to UDP peer derived
+				peer_udp->get_conn_ids().set_remote(src_hip, dst_hip, nonce_prefix, conn_id);
+				_info("Peer " << sender_hip << " gave us connection ID " << conn_id << " for " << src_hip << "--->" << dst_hip);
+			}
+			else if (cmd == c_protocol::e_proto_cmd_route_adv) { // [protocol] routes of this peer
+				const size_t data_size = static_cast<size_t>(size_read) - c_protocol::p2p_mac_size;
+				if ((static_cast<size_t>(size_read) < 2 + c_protocol::p2p_mac_size)
+					|| ((data_size - 2) % c_protocol::route_adv_entry_size != 0)) {
+					_warn("INVALIDA DATA (wrong size of route advert), size_read="<<size_read); continue;
+				}
+				auto * crypto_p2p = sender_as_peering_ptr->get_crypto_p2p();
+				if ((crypto_p2p == nullptr) || (! crypto_p2p->check_mac( buf , data_size , buf + data_size ))) {
+					_dbg1("DROP: route advert without correct CT-P2P MAC from " << sender_pip);
+					continue;
+				}
+				if (! m_route_dv) { _dbg1("Ignoring route advert, we do not use proactive routing"); continue; }
+				const auto now = route_dv::c_dv_table<c_haship_addr>::t_clock::now();
+				trivialserialize::parser parser( trivialserialize::parser::tag_caller_must_keep_this_buffer_valid() , buf, data_size );
+				parser.skip_bytes_n(2);
+				size_t changed = 0;
+				for (size_t i = 0; i < (data_size - 2) / c_protocol::route_adv_entry_size; ++i) {
+					route_dv::t_adv<c_haship_addr> adv;
+					adv.m_dst = c_haship_addr(c_haship_addr::tag_constr_by_addr_bin() , parser.pop_bytes_n(g_ipv6_rfc::length_of_addr) );
+					adv.m_cost = parser.pop_byte_u();
+					adv.m_seqno = conn_ids::bin_to_u32( parser.pop_bytes_n(4).data() );
+					if (m_route_dv->got_adv( sender_hip , adv , now )) ++changed;
+				}
+				route_dv_schedule(); // changes are sent in a triggered update
+				_info("Route advert from " << sender_hip << " changed " << changed << " routes");
+			}
+			else if (cmd == c_protocol::e_proto_cmd_keepalive) { // [protocol] peer has our HI, and is alive
+				if (static_cast<size_t>(size_read) != c_protocol::keepalive_size + c_protocol::p2p_mac_size) {
+					_warn("INVALIDA DATA (wrong size of keepalive), size_read="<<size_read); continue;
+				}
+				auto * crypto_p2p = sender_as_peering_ptr->get_crypto_p2p();
+				if ((crypto_p2p == nullptr) || (! crypto_p2p->check_mac( buf , c_protocol::keepalive_size , buf + c_protocol::keepalive_size ))) {
+					_dbg1("DROP: keepalive without correct CT-P2P MAC from " << sender_pip);
+					continue;
+				}
+				trivialserialize::parser parser( trivialserialize::parser::tag_caller_must_keep_this_buffer_valid() , buf, c_protocol::keepalive_size );
+				parser.skip_bytes_n(2);
+				const hi_session::t_session_id his_session = parser.pop_integer_u<8, uint64_t>();
+				const uint64_t counter = parser.pop_integer_u<8, uint64_t>();
+				if (! sender_as_peering_ptr->get_hi_session().keepalive_received( his_session , counter , hi_session::t_clock::now() )) {
+					_dbg1("DROP: keepalive from other session of " << sender_hip << " (or replayed), counter=" << counter);
+				}
+				else if (sender_as_peering_ptr->get_hi_session().pop_restart_confirmed()) {
+					auto tunnel = m_tunnel.find( sender_hip ); // same KCT as before his restart, but his nonces start again
+					if (tunnel != m_tunnel.end()) {
+						_info("Peer " << sender_hip << " restarted, his data nonces start again: reset replay window of CT");
+						tunnel->second->reset_replay_window();
+					}
+				}
+			}
+			else if (cmd == c_protocol::e_proto_cmd_dht) { // [protocol] Kademlia message, from any node
+				const auto msg = dht::message_from_bin<c_haship_addr, c_ip46_addr>( std::string( buf + 2 , size_read - 2 ) ); // throws if bad
+				m_dht->receive( sender_pip , msg , t_dht::t_clock::now() );
+				dht_schedule();
+			}
+			else if (cmd == c_protocol::e_proto_cmd_public_ping_request) { // [protocol] reply with the same seq
+				if (! (static_cast<size_t>(size_read) >= c_protocol::ping_size) ) { _warn("INVALIDA DATA (too short ping), size_read="<<size_read); continue; }
+				std::string reply( buf , c_protocol::ping_size ); // not bigger then the request: no amplification, also to unknown peer
+				reply[1] = static_cast<char>( c_protocol::e_proto_cmd_public_ping_reply );
+				m_udp->send( reinterpret_cast<const sockaddr*>( & from_addr_raw ), from_addr_raw_size, reply.c_str(), reply.size() );
+			}
+			else if (cmd == c_protocol::e_proto_cmd_public_ping_reply) { // [protocol] 4 bytes: seq of our ping
+				if (! (static_cast<size_t>(size_read) >= c_protocol::ping_size) ) { _warn("INVALIDA DATA (too short ping reply), size_read="<<size_read); continue; }
+				const uint32_t seq = conn_ids::bin_to_u32( buf + 2 );
+				c_peering * peer = nullptr;
+				try { peer = & find_peer_by_sender_peering_addr( sender_pip ); }
+				catch(const std::runtime_error &) { _dbg1("DROP: ping reply from unknown peer " << sender_pip); continue; }
+				if (! peer->get_link_quality().pong_received( seq , link_quality::c_link_quality::t_clock::now() )) {
+					_dbg1("DROP: ping reply that is not for our ping (or late) from " << sender_pip);
+					continue;
+				}
+				_dbg1("Ping reply from " << peer->get_hip() << ": " << peer->get_link_quality());
+				m_routing_manager.set_link_cost( peer->get_hip() , peer->get_link_quality().get_cost() );
+			}
+			else if (cmd == c_protocol::e_proto_cmd_pmtu_probe) { // [protocol] reply with the size that we got, and its nonce
+				if (! (static_cast<size_t>(size_read) >= c_protocol::pmtu_ack_size) ) {
+					_warn("INVALIDA DATA (too short PMTU probe), size_read="<<size_read); continue;
+				}
+				auto peer_udp = dynamic_cast<c_peering_udp*>( sender_as_peering_ptr ); // upcast to UDP peer derived
+				if (peer_udp == nullptr) continue;
+				peer_udp->send_pmtu_ack( size_read , conn_ids::bin_to_u32( buf + 4 ) , *m_udp );
+			}
+			else if (cmd == c_protocol::e_proto_cmd_pmtu_ack) { // [protocol] size of probe that he got, its nonce; CT-P2P MAC
+				if (static_cast<size_t>(size_read) != c_protocol::pmtu_ack_size + c_protocol::p2p_mac_size) {
+					_warn("INVALIDA DATA (wrong size of PMTU ack), size_read="<<size_read); continue;
+				}
+				auto * crypto_p2p = sender_as_peering_ptr->get_crypto_p2p();
+				if ((crypto_p2p == nullptr) || (! crypto_p2p->check_mac( buf , c_protocol::pmtu_ack_size , buf + c_protocol::pmtu_ack_size ))) {
+					_dbg1("DROP: PMTU ack without correct CT-P2P MAC from " << sender_pip);
+					continue;
+				}
+				const size_t probe_size = (size_t( static_cast<unsigned char>(buf[2]) ) << 8) | static_cast<unsigned char>(buf[3]);
+				const uint32_t nonce = conn_ids::bin_to_u32( buf + 4 );
+				auto peer_udp = dynamic_cast<c_peering_udp*>( sender_as_peering_ptr ); // upcast to UDP peer derived
+				if (peer_udp == nullptr) continue;
+				if (! peer_udp->get_path_mtu().probe_acked(probe_size, nonce)) {
+					_dbg1("DROP: PMTU ack that is not for our probe (or late) from " << sender_hip << ", size=" << probe_size);
+					continue;
+				}
+				_info("PMTU probe of size " << probe_size << " acked by " << sender_hip
+					<< ", path MTU now: " << peer_udp->get_path_mtu().get_mtu());
+				pmtu_schedule( sender_hip , *peer_udp ); // the next size of the search, at once
+			}
+			else {
+				_warn("??????????????????? Unknown protocol command, cmd="<<cmd);
+				continue; // skip this packet (main loop)
+			}
+			// ------------------------------------
+
+		}
+		else _info("Idle. " << node_title_bar);
+
+		}
+		catch (std::exception &e) {
+			_warn("### !!! ### Parsing network data caused an exception: " << e.what());
+		}
+
+		send_scheduled_frames(); // data queued above, or earlier when limits did not allow it
+
+// stats-TODO(r) counters
+//		int sent=0;
+//		counter.tick(sent, std::cout);
+//		counter_big.tick(sent, std::cout);
+	}
+}
+
+void c_tunserver::stop() { m_exiting = true; }
+
+const c_haship_addr & c_tunserver::get_my_hip() const { return m_my_hip; }
+
+void c_tunserver::run() {
+	std::cout << "Stating the TUN router." << std::endl;
+	m_send_scheduler.set_flow_limits(m_my_hip, 0, 0); // our own data is limited only by the uplink
+	if (! m_tun) prepare_socket(); // else set_endpoints gave them
+	else update_tun_mtu();
+	struct sigaction action{}; // no SA_RESTART: select() returns at once, so the dump is not delayed
+	action.sa_handler = latency_dump_signal_handler;
+	sigaction(SIGUSR1, &action, nullptr);
+	struct sigaction exit_action{};
+	exit_action.sa_handler = exit_signal_handler;
+	exit_action.sa_flags = SA_RESETHAND; // the next one kills us, if we hang
+	sigaction(SIGINT, &exit_action, nullptr);
+	sigaction(SIGTERM, &exit_action, nullptr);
+	if (m_proactive_routing) m_route_dv = make_unique<route_dv::c_dv_table<c_haship_addr>>( m_my_hip );
+	load_state_snapshot(); // before dht_start: its peers are also the first contacts of DHT
+	dht_start();
+	for(auto & v : m_peer) { if (m_tunnel.count(v.first) == 0) keystore_load_pubkey(v.first); } // tunnels to peers at once
+	event_loop();
+	save_state_snapshot();
+	keystore_save_queued();
+}
+
@@ -0,0 +1,249 @@
+#pragma once
+#ifndef include_c_tunserver_hpp
+#define include_c_tunserver_hpp
+
+#include "libs1.hpp"
+
+#include <atomic>
+#include <map>
+
+#include <sys/select.h>
+
+#include "filestorage.hpp"
+#include "c_ip46_addr.hpp"
+#include "c_peering.hpp"
+#include "c_routing_manager.hpp"
+#include "c_traffic_shaper.hpp"
+#include "c_compress.hpp"
+#include "c_route_dv.hpp"
+#include "c_dht.hpp"
+#include "c_netio.hpp"
+#include "c_latency.hpp"
+#include "c_keystore.hpp"
+#include "c_state_snapshot.hpp"
+#include "c_hi_session.hpp"
+#include "c_timer_wheel.hpp"
+
+#include "crypto/crypto.hpp"
+#include "rpc/rpc.hpp"
+
+class c_tunnel_use : public antinet_crypto::c_crypto_tunnel {
+	public:
+		int m_state; // s1..s4 (draft) TODO
+		tunnel_compress::c_compressor m_compressor; ///< (optional) compression of data in this tunnel, before encryption
+		std::string m_pubkey_bin; ///< his pubkey (serialize_bin), e.g. for the state snapshot
+
+	public:
+		c_tunnel_use(const antinet_crypto::c_multikeys_PAIR & ID_self,
+			const antinet_crypto::c_multikeys_pub & ID_them, const string& nicename);
+		c_tunnel_use(const antinet_crypto::c_multikeys_PAIR & ID_self,
+			const antinet_crypto::c_multikeys_pub & ID_them,
+			const std::string & packetstart, const string& nicename );
+};
+
+// ------------------------------------------------------------------
+
+// ------------------------------------------------------------------
+
+class c_tunserver : public c_galaxy_node {
+	public:
+		c_tunserver();
+
+		void configure_mykey(); ///<  load my (this node's) keypair
+		void configure_mykey_generated(); ///< new keypair, only in memory (e.g. for nodes in virtual network)
+		void run(); ///< run the main loop
+		void stop(); ///< the main loop (run) returns soon; can be called from other thread
+		const c_haship_addr & get_my_hip() const;
+
+		void set_my_name(const string & name); ///< set a nice name of this peer (shown in debug for example)
+
+		void add_peer(const t_peering_reference & peer_ref); ///< add this as peer (just from reference)
+		void add_peer_simplestring(const string & simple); ///< add this as peer, from a simple string like "ip-pub" TODO(r) instead move that to ctor of t_peering_reference
+		///! add this user (or append existing user) with his actuall public key data
+		void add_peer_append_pubkey(const t_peering_reference & peer_ref, unique_ptr<c_haship_pubkey> && pubkey);
+		void add_tunnel_to_pubkey(const c_haship_pubkey & pubkey);
+		///! (re)create CT-P2P with this peer, from his IDC (that he sent in HI). Does nothing if we already have CT-P2P for that IDC
+		void add_peer_crypto_p2p(const c_haship_addr & hip, const antinet_crypto::c_multikeys_pub & his_IDC);
+
+		///! limits in bytes/second and bytes (0 is unlimited): for traffic of each one peer that we send, and for all our uplink
+		void set_traffic_limits(double peer_rate, double peer_burst, double uplink_rate, double uplink_burst);
+
+		void set_tun_offload(bool enabled); ///< should we try to use TUN offloads (GSO super-packets), call before run()
+		void set_udp_gso(bool enabled); ///< should we try to use UDP_SEGMENT/UDP_GRO on peering socket, call before run()
+		void set_compression(bool enabled); ///< compress data in end2end tunnels (where other side agrees), call before run()
+		void set_proactive_routing(bool enabled); ///< advertise routes to peers, and forward data by them; call before run()
+		///! use these instead of the TUN device and UDP socket (e.g. virtual_net, many nodes in one process); call before run()
+		void set_endpoints(unique_ptr<netio::c_tun_endpoint> && tun, unique_ptr<netio::c_udp_endpoint> && udp);
+		void set_latency_sample(unsigned int sample_every); ///< measure latency of stages for every Nth packet (0 - none), before run()
+		///! listen for RPC commands (e.g. latency_dump) on this TCP port (0 - no RPC), only on this address: they are not authenticated
+		void set_rpc_port(int port, const std::string & listen_address = "127.0.0.1");
+		void print_latency(std::ostream & ostr) const; ///< latency histograms of stages on the packet path; from any thread
+		void set_keystore(const fs::path & path); ///< remember pubkeys of nodes there (e.g. c_keystore::default_path()), before run()
+		///! load what we learned (peers, routes, pubkeys) from there in run(), and save it there from time to time and on exit
+		void set_state_snapshot(const fs::path & path);
+
+
+		void help_usage() const; ///< show help about usage of the program
+
+		typedef enum {
+			e_route_method_from_me=1, ///< I am the oryginal sender (try hard to send it)
+			e_route_method_if_direct_peer=2, ///< Send data only if if I know the direct peer (e.g. I just route it for someone else - in star protocol the center node)
+			e_route_method_default=3, ///< The default routing method
+		} t_route_method;
+
+		void nodep2p_foreach_cmd(c_protocol::t_proto_cmd cmd, string_as_bin data) override;
+		const c_peering & get_peer_with_hip( c_haship_addr addr , bool require_pubkey ) override;
+		void route_search_started( c_haship_addr dst ) override;
+		c_peering & find_peer_by_sender_peering_addr( c_ip46_addr ip ) const; ///< who sent us this UDP (for each one). Throws if no peer
+
+	protected:
+		void prepare_socket(); ///< make sure that the lower level members of handling the socket are ready to run
+		///! my IDC for this session, signed by IDI (then private key of IDI is forgotten)
+		void configure_mykey_from_IDI(std::unique_ptr<antinet_crypto::c_multikeys_PAIR> && my_IDI);
+		void event_loop(); ///< the main loop
+		void wait_for_fd_event(); ///< waits for event of I/O being ready, needs valid m_tun and others, saves the fd_set into m_fd_set_data
+
+		std::pair<c_haship_addr,c_haship_addr> parse_tun_ip_src_dst(const char *buff, size_t buff_size, unsigned char ipv6_offset); ///< from buffer of TUN-format, with ipv6 bytes at ipv6_offset, extract ipv6 (hip) destination
+		std::pair<c_haship_addr,c_haship_addr> parse_tun_ip_src_dst(const char *buff, size_t buff_size); ///< the same, but with ipv6_offset that matches our current TUN
+
+		///@brief push the tunneled data to where they belong. On failure returns false or throws, true if ok.
+		///flow_hip is the peer that gave us this data (or our HIP for own data) - it is queued for sending in his flow
+		///flow_hash is multipath::flow_hash of the inner packet (0 if not known - then all data src->dst is one flow)
+		bool route_tun_data_to_its_destination_top(t_route_method method,
+			const char *buff, size_t buff_size,
+			c_haship_addr src_hip, c_haship_addr dst_hip,
+			c_routing_manager::c_route_reason reason, int data_route_ttl, antinet_crypto::t_crypto_nonce nonce_used,
+			c_haship_addr flow_hip, uint64_t flow_hash = 0);
+
+		///@brief more advanced version for use in routing
+		bool route_tun_data_to_its_destination_detail(t_route_method method,
+			const char *buff, size_t buff_size,
+			c_haship_addr src_hip, c_haship_addr dst_hip,
+			c_haship_addr next_hip,
+			c_routing_manager::c_route_reason reason,
+			int recurse_level, int data_route_ttl, antinet_crypto::t_crypto_nonce nonce_used,
+			c_haship_addr flow_hip, uint64_t flow_hash);
+
+		double nexthop_weight(const c_haship_addr & hip) const; ///< for multipath: how good is this peer as next hop (0 - not usable)
+
+		void send_scheduled_frames(); ///< send the queued tunneled data, as much as the traffic limits allow now
+
+		void route_own_tun_packet(const char *buff, size_t buff_size); ///< one packet from our TUN (PI + ipv6): encrypt, send
+		void schedule_peer_timers(const c_haship_addr & hip); ///< HI, pings and PMTU probes of a new peer: soon, jittered
+		void run_timers(); ///< the work of timers (m_timers) that expired now
+		void pmtu_probe_peer(const c_haship_addr & hip, c_peering_udp & peer); ///< send the path MTU probe if one is due now
+		/// the PMTU timer of this peer at his next probe (c_path_mtu knows when); not while he has no CT-P2P (no probes then)
+		void pmtu_schedule(const c_haship_addr & hip, c_peering_udp & peer);
+		void ping_peer(c_peering_udp & peer); ///< send the ping if it is due now (measuring link quality)
+		void route_dv_advertise(); ///< send our routes to peers, if it is time for that (proactive routing)
+		void route_dv_set_link(const c_haship_addr & hip, const c_peering & peer); ///< cost of link to him (from pings) to the DV table
+		void route_dv_schedule(); ///< the route_dv timer at the next update of the DV table (c_dv_table knows when)
+		void dht_start(); ///< DHT node: first contacts are our peers, publish our record, find nodes near us
+		void dht_schedule(); ///< the dht timer at the next tick that has work (c_dht knows when): after each call into m_dht
+		///! look for his record in DHT, when found: tunnel to him (and HI to him, peering if he answers). Not again while it
+		///! runs, and after it found nothing not again for a while (this is called for each packet that has no tunnel)
+		void dht_find_pubkey(const c_haship_addr & hip);
+		void send_hi_to(const c_ip46_addr & pip); ///< our full HI to this address (no peer yet): he is our peer when his HI comes
+		bool keystore_load_pubkey(const c_haship_addr & hip); ///< tunnel to him, if we know his pubkey from earlier. @return done
+		void keystore_save_queued(); ///< pubkeys from m_keystore_queue into m_keystore, synced to disk once for all of them
+		state_snapshot::c_snapshot make_state_snapshot() const; ///< peers that answer us, known routes, tunnels
+		void save_state_snapshot(); ///< to m_snapshot_path (if set)
+		void load_state_snapshot(); ///< from m_snapshot_path (if set): provisional peers (until they answer) and routes (until found again)
+		std::string dht_my_record() const; ///< [protocol] our record in DHT: IDC pubkey, IDI pubkey, IDI->IDC signature
+		static bool dht_check_record(const c_haship_addr & hip, const std::string & record); ///< signed by IDI whose hash is hip
+		void update_tun_mtu(); ///< set MTU of our TUN so that tunneled packets fit in path MTU to each peer
+		void write_to_tun(const char *buff, size_t buff_size); ///< one packet (PI + ipv6) into our TUN
+
+		void peering_ping_peer(c_peering_udp & peer); ///< full HI if he needs it, and keepalive
+		void peering_send_hi(c_peering_udp & peer); ///< our full HI (m_public_hi)
+		void debug_peers();
+
+	private:
+		string m_my_name; ///< a nice name, see set_my_name
+		int m_tun_fd; ///< fd of TUN file
+		unsigned char m_tun_header_offset_ipv6; ///< current offset in TUN/TAP data to the position of ipv6
+		bool m_tun_offload; ///< should we try IFF_VNET_HDR (offloads) on the TUN
+		bool m_tun_offload_active; ///< TUN is opened with IFF_VNET_HDR (data from/to it has the virtio_net_hdr)
+		std::string m_tun_segment_buf; ///< buffer for packets split from TUN super-packet
+		std::string m_tun_name; ///< name of our TUN interface, e.g. galaxy0
+		size_t m_tun_mtu; ///< MTU that we set on TUN (ipv6 packet size), bigger packets get ICMPv6 Packet Too Big
+
+		int m_sock_udp; ///< the main network socket (UDP listen, send UDP to each peer)
+		bool m_udp_gso; ///< should we try UDP_SEGMENT/UDP_GRO on m_sock_udp
+		bool m_compression; ///< do we compress data in (new) end2end tunnels
+		const uint64_t m_flow_hash_seed; ///< random, so that each node splits flows between paths differently
+		bool m_proactive_routing; ///< do we use m_route_dv
+		unique_ptr<route_dv::c_dv_table<c_haship_addr>> m_route_dv; ///< proactive routes (created in run() if enabled)
+		typedef dht::c_dht<c_haship_addr, c_ip46_addr> t_dht;
+		unique_ptr<t_dht> m_dht; ///< directory of pubkeys (records) of all nodes, by HIP (created in run())
+		std::string m_dht_cookie_key; ///< random secret for DHT cookies (see dht::e_msg::cookie)
+		struct t_dht_find {
+			bool m_running;
+			t_dht::t_clock::time_point m_next; ///< not looked for again before that
+			t_dht::t_clock::duration m_backoff; ///< wait after next failed lookup (doubles each time)
+		};
+		std::map<c_haship_addr, t_dht_find> m_dht_find; ///< lookups of pubkeys by dht_find_pubkey
+		unique_ptr<netio::c_tun_endpoint> m_tun; ///< our TUN (the m_tun_fd device, or other endpoint given in set_endpoints)
+		unique_ptr<netio::c_udp_endpoint> m_udp; ///< to/from peers (the m_sock_udp socket, or other endpoint)
+		std::atomic<bool> m_exiting; ///< main loop should return
+		latency::c_stages m_latency; ///< histograms of stages on the packet path, see m_trace
+		latency::c_trace m_trace; ///< the packet (event) that we handle now
+		unique_ptr<c_rpc_server> m_rpc_server; ///< if enabled by set_rpc_port
+		int m_latency_dumps_done; ///< g_latency_dump_requests that we already printed
+		unique_ptr<keystore::c_keystore> m_keystore; ///< pubkeys of all nodes that we had tunnels with (if enabled)
+		std::map<c_haship_addr, std::string> m_keystore_queue; ///< pubkeys to save in m_keystore (by a timer, not for each tunnel)
+		fs::path m_snapshot_path; ///< of the state snapshot (empty - not used)
+		std::map<c_haship_addr, std::chrono::steady_clock::time_point> m_snapshot_peer_seen; ///< peers from snapshot: when they answered us
+
+		fd_set m_fd_set_data; ///< select events e.g. wait for UDP peering or TUN input
+
+		typedef std::map< c_haship_addr, unique_ptr<c_peering> > t_peers_by_haship; ///< peers (we always know their IPv6 - we assume here), indexed by their hash-ip
+		t_peers_by_haship m_peer; ///< my peers, indexed by their hash-ip
+
+		t_peers_by_haship m_nodes; ///< all the nodes that I know about to some degree
+
+		antinet_crypto::c_multikeys_PAIR m_my_IDC; ///< my keys!
+		antinet_crypto::c_multikeys_pub	m_my_IDI_pub;	/// IDI public keys
+		antinet_crypto::c_multisign m_IDI_IDC_sig;	/// 'signature' - msg=IDC_pub, signer=IDI
+		const hi_session::t_session_id m_hi_session_id; ///< random for each run, so peers know when we restarted (and lost their HI)
+		string_as_bin m_public_hi; ///< [protocol] our HI, built once when we have our keys
+
+		c_haship_addr m_my_hip; ///< my HIP that results from m_my_IDC, already cached in this format
+
+		std::map< c_haship_addr, unique_ptr<c_tunnel_use> > m_tunnel; ///< my crypto tunnels
+
+//		c_haship_pubkey m_haship_pubkey; ///< pubkey of my IP
+//		c_haship_addr m_haship_addr; ///< my haship addres
+
+		c_routing_manager m_routing_manager; ///< the routing engine used for most things
+
+		/// outgoing tunneled data: flows are the peers whose data we send (or us), frames go to next hop HIP
+		c_drr_scheduler<c_haship_addr, c_haship_addr> m_send_scheduler;
+		c_token_bucket m_uplink_bucket; ///< limit of all our sending (0 - unlimited)
+
+		enum class e_timer { peer_hi, peer_ping, peer_pmtu, route_search, tun_mtu, route_dv, dht, stats, state_snapshot, keystore };
+		struct t_timer_key { ///< one timer of each kind for each peer (or route search); m_hip is not used for the other kinds
+			e_timer m_kind;
+			c_haship_addr m_hip;
+			bool operator<(const t_timer_key & other) const {
+				return (m_kind != other.m_kind) ? (m_kind < other.m_kind) : (m_hip < other.m_hip);
+			}
+		};
+		timer_wheel::c_timer_wheel<t_timer_key> m_timers; ///< all the periodic work of the event loop
+		/**
+		 * @param ip_string contain ip address and port, i.e. 127.0.0.1:5000
+		 * @retrun pair with ip string ad first and port as second
+		 * @throw std::invalid_argument
+		 * Exception safety: strong exception guarantee
+		 */
+		std::pair<string,int> parse_ip_string(const std::string &ip_string);
+//		c_rpc_server m_rpc_server;
+//		/**
+//		 * @brief rpc_add_limit_points
+//		 * @param peer_ip peer hash ip
+//		 */
+//		bool rpc_add_limit_points(const std::string &peer_ip);
+};
+
+#endif
+
@@ -0,0 +1,151 @@
+
+#include "c_udp_gso.hpp"
+
+#include <netinet/udp.h>
+
+#include <cerrno>
+#include <cstring>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103 // on older libc headers
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+namespace udp_gso {
+
+// ------------------------------------------------------------------
+
+c_batch_sender::c_batch_sender(int sock)
+	: m_sock(sock), m_gso_enabled(true), m_addr(), m_addr_len(0), m_segment_size(0), m_segments(0), m_closed(false),
+	m_count_datagrams(0), m_count_syscalls(0)
+{
+	m_buf.reserve(max_batch_bytes);
+}
+
+void c_batch_sender::set_gso_enabled(bool enabled) { flush();  m_gso_enabled = enabled; }
+bool c_batch_sender::is_gso_enabled() const { return m_gso_enabled; }
+
+void c_batch_sender::add(const sockaddr * addr, socklen_t addr_len, const char * data, size_t size) {
+	if (m_segments > 0) {
+		bool same_addr = (addr_len == m_addr_len) && (0 == std::memcmp(addr, &m_addr, addr_len));
+		if (!same_addr || m_closed || (size > m_segment_size) || (size == 0)
+			|| (m_segments >= max_segments) || (m_buf.size() + size > max_batch_bytes)) flush();
+	}
+	if (m_segments == 0) {
+		if (addr_len > sizeof(m_addr)) throw std::invalid_argument("Address is too long for UDP batch");
+		std::memcpy(&m_addr, addr, addr_len);
+		m_addr_len = addr_len;
+		m_segment_size = size;
+		m_closed = false;
+	}
+	m_buf.append(data, size);
+	++m_segments;
+	if ((size < m_segment_size) || (size == 0)) m_closed = true; // smaller datagram can be only the last one
+	if (!m_gso_enabled) flush(); // nothing to gain from waiting
+}
+
+void c_batch_sender::flush() {
+	if (m_segments == 0) return;
+	if ((m_segments == 1) || !m_gso_enabled) send_each();
+	else {
+		iovec iov;
+		iov.iov_base = &m_buf[0];  iov.iov_len = m_buf.size();
+		char control[CMSG_SPACE(sizeof(uint16_t))];
+		std::memset(control, 0, sizeof(control));
+		msghdr msg;
+		std::memset(&msg, 0, sizeof(msg));
+		msg.msg_name = &m_addr;  msg.msg_namelen = m_addr_len;
+		msg.msg_iov = &iov;  msg.msg_iovlen = 1;
+		msg.msg_control = control;  msg.msg_controllen = sizeof(control);
+		cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_UDP;  cmsg->cmsg_type = UDP_SEGMENT;  cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+		const uint16_t segment_size = static_cast<uint16_t>(m_segment_size);
+		std::memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+
+		++m_count_syscalls;
+		if (sendmsg(m_sock, &msg, 0) >= 0) m_count_datagrams += m_segments;
+		else if ((errno == EINVAL) || (errno == ENOPROTOOPT) || (errno == EOPNOTSUPP) || (errno == EIO)) {
+			_warn("UDP GSO (UDP_SEGMENT) is not supported here (errno=" << errno << "), will send each datagram alone");
+			m_gso_enabled = false;
+			send_each();
+		}
+		else _info("UDP send (GSO) failed, errno=" << errno);
+	}
+	m_buf.clear();
+	m_segments = 0;
+	m_segment_size = 0;
+	m_closed = false;
+}
+
+void c_batch_sender::send_each() {
+	size_t pos = 0;
+	for (size_t i=0; i<m_segments; ++i) {
+		const size_t size = std::min(m_segment_size, m_buf.size() - pos);
+		++m_count_syscalls;
+		if (sendto(m_sock, m_buf.data() + pos, size, 0, reinterpret_cast<const sockaddr*>(&m_addr), m_addr_len) >= 0) ++m_count_datagrams;
+		pos += size;
+	}
+}
+
+uint64_t c_batch_sender::get_count_datagrams() const { return m_count_datagrams; }
+uint64_t c_batch_sender::get_count_syscalls() const { return m_count_syscalls; }
+
+// ------------------------------------------------------------------
+
+c_gro_receiver::c_gro_receiver(int sock, bool enable_gro)
+	: m_sock(sock), m_gro_enabled(false), m_buf(65535, 0), m_buf_size(0), m_pos(0), m_segment_size(0), m_from(), m_from_len(0)
+{
+	if (enable_gro) {
+		int one = 1;
+		m_gro_enabled = (0 == setsockopt(m_sock, SOL_UDP, UDP_GRO, &one, sizeof(one)));
+		if (!m_gro_enabled) _note("UDP GRO is not supported here (errno=" << errno << "), will receive each datagram alone");
+	}
+}
+
+bool c_gro_receiver::is_gro_enabled() const { return m_gro_enabled; }
+bool c_gro_receiver::has_pending() const { return m_pos < m_buf_size; }
+
+ssize_t c_gro_receiver::receive(char * buf, size_t buf_size, sockaddr * from, socklen_t * from_len) {
+	if (!has_pending()) {
+		if (!m_gro_enabled) return recvfrom(m_sock, buf, buf_size, 0, from, from_len);
+
+		iovec iov;
+		iov.iov_base = &m_buf[0];  iov.iov_len = m_buf.size();
+		char control[CMSG_SPACE(sizeof(int))];
+		msghdr msg;
+		std::memset(&msg, 0, sizeof(msg));
+		msg.msg_name = &m_from;  msg.msg_namelen = sizeof(m_from);
+		msg.msg_iov = &iov;  msg.msg_iovlen = 1;
+		msg.msg_control = control;  msg.msg_controllen = sizeof(control);
+		ssize_t size_read = recvmsg(m_sock, &msg, 0);
+		if (size_read < 0) return size_read;
+
+		m_from_len = msg.msg_namelen;
+		m_buf_size = size_read;
+		m_pos = 0;
+		m_segment_size = size_read; // not coalesced: it is one datagram
+		for (cmsghdr * cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if ((cmsg->cmsg_level == SOL_UDP) && (cmsg->cmsg_type == UDP_GRO)) {
+				int segment_size = 0;
+				std::memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+				if (segment_size > 0) m_segment_size = segment_size;
+			}
+		}
+		if (size_read == 0) { // empty datagram
+			std::memcpy(from, &m_from, std::min(*from_len, m_from_len));  *from_len = m_from_len;
+			return 0;
+		}
+	}
+
+	const size_t size = std::min(m_segment_size, m_buf_size - m_pos);
+	const size_t size_copy = std::min(size, buf_size); // like recvfrom, too long datagram is truncated
+	std::memcpy(buf, m_buf.data() + m_pos, size_copy);
+	m_pos += size;
+	std::memcpy(from, &m_from, std::min(*from_len, m_from_len));
+	*from_len = m_from_len;
+	return size_copy;
+}
+
+} // namespace udp_gso
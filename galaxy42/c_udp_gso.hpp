@@ -0,0 +1,82 @@
+#pragma once
+#ifndef include_c_udp_gso_hpp
+#define include_c_udp_gso_hpp
+
+#include "libs1.hpp"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+/**
+ * @brief UDP segmentation offloads of Linux for the peering socket.
+ * Sending: consecutive datagrams to same address, of same size (the last one can be smaller), are given to kernel
+ * in one sendmsg() with UDP_SEGMENT, and it splits them (on Linux >= 4.18).
+ * Receiving: with UDP_GRO the kernel can give us many datagrams from same sender coalesced in one buffer.
+ * Where this is not supported, it falls back to one sendto()/recvfrom() per datagram.
+ */
+namespace udp_gso {
+
+constexpr size_t max_segments = 64; ///< UDP_MAX_SEGMENTS on older kernels
+constexpr size_t max_batch_bytes = 65000; ///< all datagrams in one send, must fit in one IP packet before splitting
+
+/// Collects datagrams and sends them in batches. Call flush() when there is nothing more to send now.
+class c_batch_sender final {
+	public:
+		explicit c_batch_sender(int sock); ///< sock is not owned
+		c_batch_sender(const c_batch_sender &) = delete;
+		c_batch_sender & operator=(const c_batch_sender &) = delete;
+
+		void set_gso_enabled(bool enabled); ///< false: always send each datagram alone
+		bool is_gso_enabled() const; ///< false also after kernel refused UDP_SEGMENT once
+
+		/// send datagram (now or in flush)
+		void add(const sockaddr * addr, socklen_t addr_len, const char * data, size_t size);
+		void flush(); ///< send all that is collected
+
+		uint64_t get_count_datagrams() const;
+		uint64_t get_count_syscalls() const;
+
+	private:
+		void send_each(); ///< fallback: one sendto() per datagram of the batch
+
+		const int m_sock;
+		bool m_gso_enabled;
+
+		sockaddr_storage m_addr; ///< destination of current batch
+		socklen_t m_addr_len;
+		std::string m_buf; ///< datagrams of current batch, one after another
+		size_t m_segment_size; ///< size of each datagram in batch (0 if batch is empty)
+		size_t m_segments;
+		bool m_closed; ///< the last datagram was smaller, so nothing more can be added to this batch
+
+		uint64_t m_count_datagrams;
+		uint64_t m_count_syscalls;
+};
+
+/// Receives one datagram at a time, but asks kernel for coalesced (GRO) buffers and splits them
+class c_gro_receiver final {
+	public:
+		explicit c_gro_receiver(int sock, bool enable_gro=true); ///< sock is not owned
+		c_gro_receiver(const c_gro_receiver &) = delete;
+		c_gro_receiver & operator=(const c_gro_receiver &) = delete;
+
+		bool is_gro_enabled() const;
+		bool has_pending() const; ///< there are datagrams from last coalesced buffer - receive() will not block
+
+		/// like recvfrom(): copies one datagram into buf. @return its size, or -1 with errno on error
+		ssize_t receive(char * buf, size_t buf_size, sockaddr * from, socklen_t * from_len);
+
+	private:
+		const int m_sock;
+		bool m_gro_enabled;
+		std::string m_buf; ///< last coalesced buffer
+		size_t m_buf_size; ///< how much of m_buf was received
+		size_t m_pos; ///< next datagram in m_buf
+		size_t m_segment_size;
+		sockaddr_storage m_from;
+		socklen_t m_from_len;
+};
+
+} // namespace udp_gso
+
+#endif
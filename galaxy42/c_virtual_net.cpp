@@ -0,0 +1,219 @@
+#include "c_virtual_net.hpp"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace virtual_net {
+
+// ------------------------------------------------------------------
+
+c_event::c_event() : m_fd( eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) ) {
+	if (m_fd < 0) throw std::runtime_error("Can not create eventfd");
+}
+
+c_event::~c_event() { close(m_fd); }
+
+int c_event::get_fd() const { return m_fd; }
+
+void c_event::set() {
+	const uint64_t one = 1;
+	if (write(m_fd, &one, sizeof(one)) < 0) { } // full counter is readable anyway
+}
+
+void c_event::clear() {
+	uint64_t value;
+	if (::read(m_fd, &value, sizeof(value)) < 0) { } // was not set
+}
+
+// ------------------------------------------------------------------
+
+constexpr size_t c_tun::max_queue;
+
+c_tun::c_tun(t_output_func output) : m_output(output), m_mtu(0) { }
+
+int c_tun::get_fd() const { return m_event.get_fd(); }
+
+ssize_t c_tun::read(char * buf, size_t buf_size) {
+	std::string packet;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_input.empty()) { m_event.clear();  errno = EAGAIN;  return -1; }
+		packet = std::move( m_input.front() );
+		m_input.pop_front();
+		if (m_input.empty()) m_event.clear();
+	}
+	if (packet.size() > buf_size) { errno = EMSGSIZE;  return -1; }
+	std::memcpy(buf, packet.data(), packet.size());
+	return packet.size();
+}
+
+ssize_t c_tun::writev(const iovec * iov, int iov_count) {
+	std::string packet;
+	for (int i=0; i<iov_count; ++i) packet.append( static_cast<const char*>(iov[i].iov_base) , iov[i].iov_len );
+	m_output(packet.data(), packet.size());
+	return packet.size();
+}
+
+void c_tun::set_mtu(size_t mtu) { m_mtu = mtu; }
+
+bool c_tun::inject(std::string packet) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_input.size() >= max_queue) return false;
+	m_input.push_back( std::move(packet) );
+	if (m_input.size() == 1) m_event.set();
+	return true;
+}
+
+size_t c_tun::get_mtu() const { return m_mtu; }
+
+void c_tun::wake() { m_event.set(); }
+
+// ------------------------------------------------------------------
+
+constexpr size_t c_network::max_inbox_bytes;
+
+bool c_network::t_datagram::operator<(const t_datagram & other) const {
+	if (m_due != other.m_due) return m_due > other.m_due;
+	return m_order > other.m_order;
+}
+
+c_network::c_network(unsigned int seed)
+	: m_default_link{ std::chrono::microseconds(0) , 0 }, m_order(0), m_gen(seed), m_exiting(false),
+	m_count_sent(0), m_count_lost(0), m_count_delivered(0),
+	m_thread( [this]() { this->run(); } )
+{ }
+
+c_network::~c_network() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_exiting = true;
+	}
+	m_cv.notify_all();
+	m_thread.join();
+	_assert( m_endpoints.empty() );
+}
+
+void c_network::set_default_link(const t_link_params & params) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_default_link = params;
+}
+
+void c_network::set_link(const c_ip46_addr & a, const c_ip46_addr & b, const t_link_params & params) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_links[ std::make_pair(a, b) ] = params;
+	m_links[ std::make_pair(b, a) ] = params;
+}
+
+std::unique_ptr<c_udp> c_network::bind(const c_ip46_addr & addr) { return std::make_unique<c_udp>(*this, addr); }
+
+void c_network::detach(const c_ip46_addr & addr) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_endpoints.erase(addr);
+}
+
+void c_network::send(const c_ip46_addr & from, const c_ip46_addr & to, const char * data, size_t size) {
+	++m_count_sent;
+	std::unique_lock<std::mutex> lock(m_mutex);
+	auto link = m_links.find( std::make_pair(from, to) );
+	const t_link_params & params = (link != m_links.end()) ? link->second : m_default_link;
+	if ((params.m_loss > 0) && (std::uniform_real_distribution<double>(0, 1)(m_gen) < params.m_loss)) { ++m_count_lost;  return; }
+	t_datagram datagram{ t_clock::now() + params.m_latency , m_order++ , from , to , std::string(data, size) };
+	if (params.m_latency.count() == 0) { deliver_locked( std::move(datagram) );  return; }
+	const bool first = m_delayed.empty() || (datagram.m_due < m_delayed.top().m_due);
+	m_delayed.push( std::move(datagram) );
+	lock.unlock();
+	if (first) m_cv.notify_all(); // thread waits for a later one now
+}
+
+void c_network::deliver_locked(t_datagram && datagram) {
+	auto endpoint = m_endpoints.find(datagram.m_to);
+	if ((endpoint == m_endpoints.end()) || (! endpoint->second->deliver( datagram.m_from , std::move(datagram.m_data) ))) {
+		++m_count_lost;
+		return;
+	}
+	++m_count_delivered;
+}
+
+void c_network::run() {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (! m_exiting) {
+		if (m_delayed.empty()) { m_cv.wait(lock);  continue; }
+		const auto due = m_delayed.top().m_due;
+		if (t_clock::now() < due) { m_cv.wait_until(lock, due);  continue; }
+		t_datagram datagram = m_delayed.top(); // priority_queue gives only const top
+		m_delayed.pop();
+		deliver_locked( std::move(datagram) );
+	}
+}
+
+void c_network::wake_all() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto & endpoint : m_endpoints) endpoint.second->wake();
+}
+
+uint64_t c_network::get_count_sent() const { return m_count_sent; }
+uint64_t c_network::get_count_lost() const { return m_count_lost; }
+uint64_t c_network::get_count_delivered() const { return m_count_delivered; }
+
+// ------------------------------------------------------------------
+
+c_udp::c_udp(c_network & network, const c_ip46_addr & addr) : m_network(network), m_addr(addr), m_inbox_bytes(0) {
+	std::lock_guard<std::mutex> lock(m_network.m_mutex);
+	if (! m_network.m_endpoints.emplace(addr, this).second) throw std::invalid_argument("Address is already bound in virtual network");
+}
+
+c_udp::~c_udp() { m_network.detach(m_addr); }
+
+int c_udp::get_fd() const { return m_event.get_fd(); }
+
+bool c_udp::has_pending() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return ! m_inbox.empty();
+}
+
+ssize_t c_udp::receive(char * buf, size_t buf_size, sockaddr * from, socklen_t * from_len) {
+	std::pair<c_ip46_addr, std::string> datagram;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_inbox.empty()) { m_event.clear();  errno = EAGAIN;  return -1; }
+		datagram = std::move( m_inbox.front() );
+		m_inbox.pop_front();
+		m_inbox_bytes -= datagram.second.size();
+		if (m_inbox.empty()) m_event.clear();
+	}
+	sockaddr_storage addr;
+	const socklen_t addr_len = datagram.first.get_sockaddr(addr);
+	std::memcpy(from, &addr, std::min(addr_len, *from_len));
+	*from_len = addr_len;
+	const size_t size = std::min(datagram.second.size(), buf_size); // truncated, as recvfrom does
+	std::memcpy(buf, datagram.second.data(), size);
+	return size;
+}
+
+void c_udp::send(const sockaddr * to, socklen_t to_len, const char * data, size_t size) {
+	c_ip46_addr to_addr;
+	to_addr.set_sockaddr(to, to_len);
+	m_network.send(m_addr, to_addr, data, size);
+}
+
+void c_udp::send_batched(const sockaddr * to, socklen_t to_len, const char * data, size_t size) { send(to, to_len, data, size); }
+
+void c_udp::flush() { }
+
+const c_ip46_addr & c_udp::get_addr() const { return m_addr; }
+
+bool c_udp::deliver(const c_ip46_addr & from, std::string && data) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_inbox_bytes + data.size() > c_network::max_inbox_bytes) return false;
+	m_inbox_bytes += data.size();
+	m_inbox.emplace_back( from , std::move(data) );
+	if (m_inbox.size() == 1) m_event.set();
+	return true;
+}
+
+void c_udp::wake() { m_event.set(); }
+
+} // namespace virtual_net
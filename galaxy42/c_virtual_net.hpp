@@ -0,0 +1,156 @@
+#pragma once
+#ifndef include_c_virtual_net_hpp
+#define include_c_virtual_net_hpp
+
+#include "libs1.hpp"
+#include "c_netio.hpp"
+#include "c_ip46_addr.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <thread>
+
+/**
+ * @brief Network in memory, for many tunserver nodes in one process (tests and benchmarks without root or TUN devices).
+ * Each node gets a c_tun (we inject packets of "programs" into it, and see what the node writes to it) and a c_udp
+ * bound to its own IP in c_network. Datagrams between two IPs go by a link that can lose some of them and delay them.
+ * Endpoints are readable by select() on an eventfd, so the normal event loop of tunserver works with them.
+ */
+namespace virtual_net {
+
+struct t_link_params {
+	std::chrono::microseconds m_latency; ///< one way
+	double m_loss; ///< each datagram is lost with this probability (0..1)
+};
+
+/// readiness of an endpoint for select(): eventfd that is readable while the endpoint has something
+class c_event final {
+	public:
+		c_event();
+		~c_event();
+		c_event(const c_event &) = delete;
+		c_event & operator=(const c_event &) = delete;
+
+		int get_fd() const;
+		void set();
+		void clear();
+
+	private:
+		const int m_fd;
+};
+
+/// TUN of a node: the node reads what we inject (as if programs sent it), and our output function gets what it writes
+class c_tun final : public netio::c_tun_endpoint {
+	public:
+		typedef std::function<void(const char * packet, size_t size)> t_output_func;
+
+		static constexpr size_t max_queue = 1000; ///< packets waiting for the node, more are dropped (as TUN txqueuelen)
+
+		explicit c_tun(t_output_func output); ///< output is called in the thread of the node
+
+		int get_fd() const override;
+		ssize_t read(char * buf, size_t buf_size) override;
+		ssize_t writev(const iovec * iov, int iov_count) override;
+		void set_mtu(size_t mtu) override;
+
+		bool inject(std::string packet); ///< from any thread. @return false if it was dropped (queue is full)
+		size_t get_mtu() const; ///< as set by the node (0 before that)
+		void wake(); ///< make it readable (e.g. so that event loop notices that it should exit)
+
+	private:
+		const t_output_func m_output;
+		c_event m_event;
+		std::mutex m_mutex;
+		std::deque<std::string> m_input; ///< guarded by m_mutex
+		std::atomic<size_t> m_mtu;
+};
+
+class c_udp;
+
+class c_network final {
+	public:
+		static constexpr size_t max_inbox_bytes = 4*1024*1024; ///< like socket receive buffer, more datagrams are lost
+
+		explicit c_network(unsigned int seed);
+		~c_network(); ///< all c_udp must be gone before
+		c_network(const c_network &) = delete;
+		c_network & operator=(const c_network &) = delete;
+
+		void set_default_link(const t_link_params & params); ///< between IPs that have no own link params
+		void set_link(const c_ip46_addr & a, const c_ip46_addr & b, const t_link_params & params); ///< both directions
+
+		std::unique_ptr<c_udp> bind(const c_ip46_addr & addr); ///< one endpoint per IP (ports are not looked at)
+		void send(const c_ip46_addr & from, const c_ip46_addr & to, const char * data, size_t size); ///< from any thread
+		void wake_all(); ///< make all endpoints readable
+
+		uint64_t get_count_sent() const;
+		uint64_t get_count_lost() const; ///< by the link loss, or to full inbox, or to nobody
+		uint64_t get_count_delivered() const;
+
+	private:
+		friend class c_udp;
+		typedef std::chrono::steady_clock t_clock;
+
+		struct t_datagram {
+			t_clock::time_point m_due;
+			uint64_t m_order; ///< datagrams due at the same time are delivered as they were sent
+			c_ip46_addr m_from, m_to;
+			std::string m_data;
+			bool operator<(const t_datagram & other) const; ///< later first (for priority_queue)
+		};
+
+		void detach(const c_ip46_addr & addr);
+		void deliver_locked(t_datagram && datagram); ///< with m_mutex locked
+		void run(); ///< thread: delivers delayed datagrams when they are due
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_cv;
+		std::map<c_ip46_addr, c_udp*> m_endpoints;
+		std::map<std::pair<c_ip46_addr, c_ip46_addr>, t_link_params> m_links;
+		t_link_params m_default_link;
+		std::priority_queue<t_datagram> m_delayed;
+		uint64_t m_order;
+		std::mt19937 m_gen;
+		bool m_exiting;
+
+		std::atomic<uint64_t> m_count_sent, m_count_lost, m_count_delivered;
+
+		std::thread m_thread; ///< last, started when all above is ready
+};
+
+/// UDP socket of a node, bound to its IP in c_network
+class c_udp final : public netio::c_udp_endpoint {
+	public:
+		c_udp(c_network & network, const c_ip46_addr & addr); ///< use c_network::bind
+		~c_udp();
+
+		int get_fd() const override;
+		bool has_pending() const override;
+		ssize_t receive(char * buf, size_t buf_size, sockaddr * from, socklen_t * from_len) override;
+		void send(const sockaddr * to, socklen_t to_len, const char * data, size_t size) override;
+		void send_batched(const sockaddr * to, socklen_t to_len, const char * data, size_t size) override; ///< the same as send
+		void flush() override;
+
+		const c_ip46_addr & get_addr() const;
+		bool deliver(const c_ip46_addr & from, std::string && data); ///< from network. @return false if inbox is full
+		void wake();
+
+	private:
+		c_network & m_network;
+		const c_ip46_addr m_addr;
+		c_event m_event;
+		mutable std::mutex m_mutex;
+		std::deque<std::pair<c_ip46_addr, std::string>> m_inbox; ///< guarded by m_mutex
+		size_t m_inbox_bytes;
+};
+
+} // namespace virtual_net
+
+#endif
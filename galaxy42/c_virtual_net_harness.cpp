@@ -0,0 +1,76 @@
+#include "c_virtual_net_harness.hpp"
+
+#include <iomanip>
+
+#include "c_tunserver.hpp"
+
+namespace developer_tests {
+
+c_virtual_net_harness::c_virtual_net_harness(size_t nodes_count, const virtual_net::t_link_params & link, t_receive_func receive)
+	: m_network(42), m_nodes(nodes_count), m_receive(receive)
+{
+	m_network.set_default_link(link);
+	for (size_t i=0; i<nodes_count; ++i) {
+		auto & node = m_nodes.at(i);
+		node.m_ip = c_ip46_addr::create_ipv4( "10.42." + std::to_string(i / 250) + "." + std::to_string(i % 250 + 1) , 9042 );
+		auto tun = make_unique<virtual_net::c_tun>( [this, i](const char * packet, size_t size) { m_receive(i, packet, size); } );
+		node.m_tun = tun.get();
+		node.m_server = make_unique<c_tunserver>();
+		node.m_server->configure_mykey_generated();
+		node.m_server->set_my_name( "vnode-" + std::to_string(i) );
+		node.m_server->set_proactive_routing(true); // routes also beyond the search TTL
+		node.m_server->set_endpoints( std::move(tun) , m_network.bind(node.m_ip) );
+	}
+}
+
+c_virtual_net_harness::~c_virtual_net_harness() {
+	for (auto & node : m_nodes) node.m_server->stop();
+	m_network.wake_all();
+	for (auto & node : m_nodes) {
+		node.m_tun->wake();
+		if (node.m_thread.joinable()) node.m_thread.join();
+	}
+	m_nodes.clear(); // endpoints unbind from m_network
+}
+
+std::string c_virtual_net_harness::hip_to_hexdot(const c_haship_addr & hip) {
+	std::ostringstream oss;
+	for (size_t i=0; i<hip.size(); i+=2) {
+		if (i) oss << ':';
+		oss << std::hex << std::setfill('0') << std::setw(2) << int(hip[i]) << std::setw(2) << int(hip[i+1]);
+	}
+	return oss.str();
+}
+
+void c_virtual_net_harness::add_link(size_t a, size_t b) {
+	m_nodes.at(a).m_server->add_peer( t_peering_reference( m_nodes.at(b).m_ip , hip_to_hexdot( m_nodes.at(b).m_server->get_my_hip() ) ) );
+	m_nodes.at(b).m_server->add_peer( t_peering_reference( m_nodes.at(a).m_ip , hip_to_hexdot( m_nodes.at(a).m_server->get_my_hip() ) ) );
+}
+
+void c_virtual_net_harness::start() {
+	for (auto & node : m_nodes) {
+		c_tunserver * server = node.m_server.get();
+		node.m_thread = std::thread( [server]() { server->run(); } );
+	}
+}
+
+bool c_virtual_net_harness::send(size_t src, size_t dst, const std::string & payload) {
+	// [TUN] PI header (ipv6), then ipv6 header with no next header (59), then payload
+	std::string packet = { 0 , 0 , char(0x86) , char(0xDD) };
+	packet += char(0x60);  packet.append(3, char(0));
+	packet += char(payload.size() >> 8);  packet += char(payload.size() & 0xFF);
+	packet += char(59);  packet += char(64);
+	const auto & src_hip = m_nodes.at(src).m_server->get_my_hip();
+	const auto & dst_hip = m_nodes.at(dst).m_server->get_my_hip();
+	packet.append( src_hip.begin() , src_hip.end() );
+	packet.append( dst_hip.begin() , dst_hip.end() );
+	packet += payload;
+	return m_nodes.at(src).m_tun->inject( std::move(packet) );
+}
+
+size_t c_virtual_net_harness::size() const { return m_nodes.size(); }
+
+const virtual_net::c_network & c_virtual_net_harness::get_network() const { return m_network; }
+
+} // namespace developer_tests
+
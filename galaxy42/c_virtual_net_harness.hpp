@@ -0,0 +1,50 @@
+#pragma once
+#ifndef include_c_virtual_net_harness_hpp
+#define include_c_virtual_net_harness_hpp
+
+#include "libs1.hpp"
+
+#include <functional>
+#include <thread>
+
+#include "c_ip46_addr.hpp"
+#include "haship.hpp"
+#include "c_virtual_net.hpp"
+
+class c_tunserver;
+
+namespace developer_tests {
+
+/// many nodes (c_tunserver) in one process, connected by virtual_net - no root, no TUN devices, no real network
+class c_virtual_net_harness final {
+	public:
+		typedef std::function<void(size_t node, const char * packet, size_t size)> t_receive_func;
+
+		c_virtual_net_harness(size_t nodes_count, const virtual_net::t_link_params & link, t_receive_func receive);
+		~c_virtual_net_harness(); ///< stops all nodes
+
+		void add_link(size_t a, size_t b); ///< they are peers
+		void start(); ///< each node runs in own thread
+		bool send(size_t src, size_t dst, const std::string & payload); ///< ipv6 packet from a program on src. false if TUN is full
+		size_t size() const;
+		const virtual_net::c_network & get_network() const;
+
+	private:
+		struct t_node {
+			unique_ptr<c_tunserver> m_server;
+			virtual_net::c_tun * m_tun; ///< owned by m_server
+			c_ip46_addr m_ip;
+			std::thread m_thread;
+		};
+
+		static std::string hip_to_hexdot(const c_haship_addr & hip); ///< full form (no ::), as c_haship_addr can parse
+
+		virtual_net::c_network m_network; ///< first: endpoints of nodes are gone before it
+		std::vector<t_node> m_nodes;
+		const t_receive_func m_receive;
+};
+
+} // namespace developer_tests
+
+#endif
+
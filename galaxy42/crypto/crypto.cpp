@@ -145,11 +145,28 @@ std::string c_stream::unbox(const std::string & msg) {
 	return unbox(msg,n,false);
 }
 
+namespace {
+/// the sequential part of nonce, as number. Nonces of one side are all odd or all even, so they step by 2
+uint64_t nonce_to_sequence(const t_crypto_nonce & nonce) {
+	const std::string bin = nonce.get().to_binary();
+	assert(bin.size() >= sizeof(uint64_t));
+	uint64_t ret = 0;
+	for (size_t i = bin.size() - sizeof(uint64_t); i < bin.size(); ++i) ret = (ret << 8) | static_cast<unsigned char>(bin[i]);
+	return ret;
+}
+} // namespace
+
 std::string c_stream::unbox(const std::string & msg, t_crypto_nonce nonce, bool force_nonce) {
 	auto & cb = * PTR(m_unboxer); // my crypto (un)boxer
 	const auto N = force_nonce ? nonce : cb.get_nonce(); // nonce (before operation)
+	const uint64_t seq = nonce_to_sequence(N);
+	if (force_nonce && !m_replay_window.check(seq)) { // before doing the authentication, it is cheap
+		_info("Crypto dropped replayed (or too old) nonce N=" << show_nice_nonce(N));
+		throw replay_error("nonce was already used or is too old");
+	}
 	try {
 		auto ret = cb.unbox(sodiumpp::encoded_bytes(msg , sodiumpp::encoding::binary) , N);
+		if (force_nonce) m_replay_window.mark(seq); // only authenticated data moves the window
 		_dbg1n(
 			"Decrypt N="<<show_nice_nonce(N)<<(force_nonce ? "(given)":"(auto)")
 			<<" text " << to_debug(ret) << " <--- " << to_debug(msg)
@@ -166,6 +183,9 @@ std::string c_stream::unbox(const std::string & msg, t_crypto_nonce nonce, bool
 
 // ---------------------------------------------------------------------------
 
+const c_replay_window & c_stream::get_replay_window() const { return m_replay_window; }
+void c_stream::reset_replay_window() { m_replay_window.reset(); }
+
 t_crypto_system_count c_stream::get_cryptolists_count_for_KCTf() const {
 	return m_cryptolists_count;
 }
@@ -579,6 +599,20 @@ std::string c_crypto_tunnel::unbox(const std::string & msg, t_crypto_nonce nonce
 	return PTR(m_stream_crypto_final)->unbox(msg,nonce);
 }
 
+uint64_t c_crypto_tunnel::get_count_replay() const {
+	uint64_t ret = 0;
+	for (const auto * stream : { m_stream_crypto_ab.get() , m_stream_crypto_final.get() }) {
+		if (stream) ret += stream->get_replay_window().get_count_replay() + stream->get_replay_window().get_count_stale();
+	}
+	return ret;
+}
+
+void c_crypto_tunnel::reset_replay_window() {
+	for (auto * stream : { m_stream_crypto_ab.get() , m_stream_crypto_final.get() }) {
+		if (stream) stream->reset_replay_window();
+	}
+}
+
 std::string c_crypto_tunnel::box_ab(const std::string & msg) {
 	return PTR(m_stream_crypto_ab)->box(msg);
 }
@@ -937,207 +971,5 @@ map_size
 
 }
 
-void generate_keypairs_benchmark(const size_t seconds_for_test_case) {
-	_mark("test_crypto_benchmark");
-
-	// X25519
-	size_t generated_keys_x25519 = 0;
-	auto start_point = std::chrono::steady_clock::now();
-	while (std::chrono::steady_clock::now() - start_point < std::chrono::seconds(seconds_for_test_case)) {
-		auto pair = c_multikeys_PAIR::generate_x25519_key_pair();
-		++generated_keys_x25519;
-	}
-	auto stop_point = std::chrono::steady_clock::now();
-	unsigned int x25519_ms = std::chrono::duration_cast<std::chrono::milliseconds>(stop_point - start_point).count();
-
-	// ed25519
-	size_t generated_keys_ed25519 = 0;
-	start_point = std::chrono::steady_clock::now();
-	while (std::chrono::steady_clock::now() - start_point < std::chrono::seconds(seconds_for_test_case)) {
-		auto pair = c_multikeys_PAIR::generate_ed25519_key_pair();
-		++generated_keys_ed25519;
-	}
-	stop_point = std::chrono::steady_clock::now();
-	unsigned int ed25519_ms = std::chrono::duration_cast<std::chrono::milliseconds>(stop_point - start_point).count();
-
-	// ntru encrypt
-	size_t generated_keys_ntru_encrypt = 0;
-	start_point = std::chrono::steady_clock::now();
-	while (std::chrono::steady_clock::now() - start_point < std::chrono::seconds(seconds_for_test_case)) {
-		auto pair = c_multikeys_PAIR::generate_nrtu_encrypt_key_pair();
-		++generated_keys_ntru_encrypt;
-	}
-	stop_point = std::chrono::steady_clock::now();
-	unsigned int ntru_ms_encrypt = std::chrono::duration_cast<std::chrono::milliseconds>(stop_point - start_point).count();
-
-	// ntru sign
-	size_t generated_keys_ntru_sign = 0;
-	start_point = std::chrono::steady_clock::now();
-	while (std::chrono::steady_clock::now() - start_point < std::chrono::seconds(seconds_for_test_case)) {
-		auto pair = c_multikeys_PAIR::generate_nrtu_encrypt_key_pair();
-		++generated_keys_ntru_sign;
-	}
-	stop_point = std::chrono::steady_clock::now();
-	unsigned int ntru_ms_sign = std::chrono::duration_cast<std::chrono::milliseconds>(stop_point - start_point).count();
-
-	//sidh
-	size_t generated_keys_sidh = 0;
-	start_point = std::chrono::steady_clock::now();
-	while (std::chrono::steady_clock::now() - start_point < std::chrono::seconds(seconds_for_test_case)) {
-		auto pair = c_multikeys_PAIR::generate_sidh_key_pair();
-		++generated_keys_sidh;
-	}
-	stop_point = std::chrono::steady_clock::now();
-	unsigned int sidh_ms = std::chrono::duration_cast<std::chrono::milliseconds>(stop_point - start_point).count();
-
-
-	_info("X25519");
-	_info("Generated " << generated_keys_x25519 << " in " << x25519_ms << " ms");
-	_info(static_cast<double>(generated_keys_x25519) / x25519_ms * 1000 << " key pairs per second");
-
-	_info("ed25519");
-	_info("Generated " << generated_keys_ed25519 << " in " << ed25519_ms << " ms");
-	_info(static_cast<double>(generated_keys_ed25519) / ed25519_ms * 1000 << " key pairs per second");
-
-	_info("NTRU encrypt");
-	_info("Generated " << generated_keys_ntru_encrypt << " in " << ntru_ms_encrypt << " ms");
-	_info(static_cast<double>(generated_keys_ntru_encrypt) / ntru_ms_encrypt * 1000 << " key pairs per second");
-
-	_info("NTRU sign");
-	_info("Generated " << generated_keys_ntru_sign << " in " << ntru_ms_sign << " ms");
-	_info(static_cast<double>(generated_keys_ntru_sign) / ntru_ms_sign * 1000 << " key pairs per second");
-
-	_info("SIDH");
-	_info("Generated " << generated_keys_sidh << " in " << sidh_ms << " ms");
-	_info(static_cast<double>(generated_keys_sidh) / sidh_ms * 1000 << " key pairs per second");
-
-}
-
-void stream_encrypt_benchmark(const size_t seconds_for_test_case) {
-	const std::string message(10240, 'm');
-	const std::string nonce(crypto_box_NONCEBYTES, 'n');
-	const std::string shared_key(crypto_stream_KEYBYTES, 'k');
-
-	size_t encrypted_data_size = 0;
-	size_t number_of_loop = 0;
-	auto start_point = std::chrono::steady_clock::now();
-	while (std::chrono::steady_clock::now() - start_point < std::chrono::seconds(seconds_for_test_case)) {
-		auto encrypted = sodiumpp::crypto_stream_xor(message, nonce, shared_key);
-		++number_of_loop;
-		encrypted_data_size += message.size();
-	}
-	auto stop_point = std::chrono::steady_clock::now();
-	unsigned int loop_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(stop_point - start_point).count();
-	std::cout << "xsalsa20 performance" << std::endl;
-	std::cout << number_of_loop << " encryptions in " << loop_time_ms << " ms" << std::endl;
-	std::cout << "Encrypted data size = " << encrypted_data_size << " bytes" << std::endl;
-	std::cout << static_cast<double>(encrypted_data_size) / seconds_for_test_case / 1024 / 1024 << " MB per second" << std::endl;
-
-	std::cout << "**************************************************" << std::endl;
-	std::cout << "Encrypt using boxer" << std::endl;
-	const auto locked_shared_key = sodiumpp::locked_string(shared_key);
-	const sodiumpp::encoded_bytes nonce_zero =
-		sodiumpp::encoded_bytes( string( t_crypto_nonce::constantbytes , char(0)), sodiumpp::encoding::binary);
-	sodiumpp::boxer< t_crypto_nonce > boxer(
-					sodiumpp::boxer_base::boxer_type_shared_key(),
-					false,
-					locked_shared_key,
-					nonce_zero);
-	start_point = std::chrono::steady_clock::now();
-	while (std::chrono::steady_clock::now() - start_point < std::chrono::seconds(seconds_for_test_case)) {
-		boxer.box(message);
-		++number_of_loop;
-		encrypted_data_size += message.size();
-	}
-	stop_point = std::chrono::steady_clock::now();
-	loop_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(stop_point - start_point).count();
-	std::cout << number_of_loop << " encryptions in " << loop_time_ms << " ms" << std::endl;
-	std::cout << "Encrypted data size = " << encrypted_data_size << " bytes" << std::endl;
-	std::cout << static_cast<double>(encrypted_data_size) / seconds_for_test_case / 1024 / 1024 << " MB per second" << std::endl;
-
-/*	std::cout << "**************************************************" << std::endl;
-	std::string encrypted = boxer.box(message).bytes;
-	std::cout << "Decrypt using unboxer" << std::endl;
-	sodiumpp::unboxer< t_crypto_nonce > unboxer(
-					sodiumpp::boxer_base::boxer_type_shared_key(),
-					false,
-					locked_shared_key,
-					nonce_zero);
-	auto decrypted = unboxer.unbox(sodiumpp::encoded_bytes(encrypted, sodiumpp::encoding::binary));
-*/
-}
-
-void multi_key_sign_generation_benchmark(const size_t seconds_for_test_case) {
-	g_dbg_level_set(160, "start benchmark");
-	std::cout << "Generate normal multikey" << std::endl;
-	c_multikeys_PAIR keypairA;
-	auto start_point = std::chrono::steady_clock::now();
-	keypairA.generate(e_crypto_system_type_Ed25519, 2);
-	keypairA.generate(e_crypto_system_type_NTRU_sign, 1);
-	auto stop_point = std::chrono::steady_clock::now();
-	std::cout << "generated in "
-		<< std::chrono::duration_cast<std::chrono::milliseconds>(stop_point - start_point).count() << "ms" << std::endl;
-
-	c_multikeys_PAIR keypairB;
-	keypairB.generate(e_crypto_system_type_Ed25519, 2);
-	keypairB.generate(e_crypto_system_type_NTRU_sign, 1);
-
-	c_multikeys_pub keypubA = keypairA.m_pub;
-	c_multikeys_pub keypubB = keypairB.m_pub;
-	size_t number_of_loops = 0;
-	start_point = std::chrono::steady_clock::now();
-	while (std::chrono::steady_clock::now() - start_point < std::chrono::seconds(seconds_for_test_case)) {
-		c_crypto_tunnel AliceCT(keypairA, keypubB, "Alice");
-		++number_of_loops;
-	}
-	stop_point = std::chrono::steady_clock::now();
-	auto create_ct_loop_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(stop_point - start_point).count();
-	std::cout << "Generated " << number_of_loops << " crypto tunnels in "
-		<< create_ct_loop_time_ms << "ms" << std::endl;
-	std::cout << static_cast<double>(number_of_loops) / create_ct_loop_time_ms * 1000 << " per second" << std::endl;
-
-	number_of_loops = 0;
-	start_point = std::chrono::steady_clock::now();
-	while (std::chrono::steady_clock::now() - start_point < std::chrono::seconds(seconds_for_test_case)) {
-		c_crypto_tunnel AliceCT(keypairA, keypubB, "Alice");
-		AliceCT.create_IDe();
-		string packetstart_1 = AliceCT.get_packetstart_ab(); // A--->>>
-		c_crypto_tunnel BobCT(keypairB, keypubA, packetstart_1, "Bobby");
-		string packetstart_2 = BobCT.get_packetstart_final(); // B--->>>
-		AliceCT.create_CTf(packetstart_2); // A<<<---
-		++number_of_loops;
-	}
-	stop_point = std::chrono::steady_clock::now();
-	auto loop_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(stop_point - start_point).count();
-	std::cout << "Created " << number_of_loops << " crypto tunnels in "
-		<< loop_time_ms << "ms" << std::endl;
-	std::cout << static_cast<double>(number_of_loops) / loop_time_ms * 1000 << " per second" << std::endl;
-
-	// create CT
-	c_crypto_tunnel AliceCT(keypairA, keypubB, "Alice");
-	AliceCT.create_IDe();
-	string packetstart_1 = AliceCT.get_packetstart_ab(); // A--->>>
-	c_crypto_tunnel BobCT(keypairB, keypubA, packetstart_1, "Bobby");
-	string packetstart_2 = BobCT.get_packetstart_final(); // B--->>>
-	AliceCT.create_CTf(packetstart_2); // A<<<---
-
-	const std::string msg(1024, 'm');
-	size_t encryption_data_size = 0;
-	start_point = std::chrono::steady_clock::now();
-	while (std::chrono::steady_clock::now() - start_point < std::chrono::seconds(seconds_for_test_case)) {
-		t_crypto_nonce nonce_used;
-		auto msg1s = AliceCT.box(msg, nonce_used);
-		BobCT.unbox(msg1s, nonce_used);
-		encryption_data_size += msg.size();
-	}
-	stop_point = std::chrono::steady_clock::now();
-	loop_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(stop_point - start_point).count();
-	std::cout << "Send " <<  static_cast<double>(encryption_data_size) / 1024 / 1024 << " MB in "
-		<< loop_time_ms << "ms" << std::endl;
-	std::cout << static_cast<double>(encryption_data_size) / 1024 / 1024 / seconds_for_test_case
-		<< "MB per second" << std::endl;
-	g_dbg_level_set(0, "restore to default");
-}
-
 
 } // namespace
@@ -43,6 +43,7 @@ it has bugs and 'typpos'.
 
 #include "crypto_basic.hpp"
 #include "multikeys.hpp"
+#include "replay_window.hpp"
 
 /**
  * @defgroup antinet_crypto Antinet Crypto
@@ -263,6 +264,8 @@ class c_stream final /* because strange ctor init list functions */
 
 		string m_nicename; ///< my nice name for logging/debugging
 
+		c_replay_window m_replay_window; ///< nonces that we already received (for unbox with given nonce)
+
 	public:
 		c_stream(bool side_initiator, const string& nicename);
 		std::string debug_this() const;
@@ -289,7 +292,11 @@ class c_stream final /* because strange ctor init list functions */
 		std::string box(const std::string & msg);
 		std::string box(const std::string & msg, t_crypto_nonce & nonce); ///< box this cleartext, and OUT the nonce that was used
 		std::string unbox(const std::string & msg);
-		std::string unbox(const std::string & msg, t_crypto_nonce nonce, bool force_nonce=1); ///< unbox, but using given nonce
+		/// unbox, but using given nonce. Given nonce that was already used (or is very old) throws replay_error
+		std::string unbox(const std::string & msg, t_crypto_nonce nonce, bool force_nonce=1);
+
+		const c_replay_window & get_replay_window() const;
+		void reset_replay_window(); ///< the other side restarted this stream (same KCT, nonces from the start again)
 
 		virtual t_crypto_system_type get_system_type() const;
 
@@ -326,7 +333,6 @@ class c_crypto_tunnel {
 		c_crypto_tunnel(const c_multikeys_PAIR & ID_self, const c_multikeys_pub & ID_them, const string& nicename);
 		c_crypto_tunnel(const c_multikeys_PAIR & ID_self, const c_multikeys_pub & ID_them,
 			const std::string & packetstart, const string& nicename );
-
 		virtual ~c_crypto_tunnel()=default;
 
 		std::string debug_this() const;
@@ -349,15 +355,16 @@ class c_crypto_tunnel {
 		std::string unbox(const std::string & msg);
 		std::string unbox(const std::string & msg, t_crypto_nonce nonce); ///< unbox, but using given nonce
 
+		uint64_t get_count_replay() const; ///< how many received data was dropped as replayed (or too old nonce)
+		/// the other side restarted (and created this CT again - with same KCT, but his nonces start again); only after
+		/// that is authenticated (e.g. see hi_session::c_hi_session::pop_restart_confirmed), else old data could be replayed
+		void reset_replay_window();
 };
 
 
 // === high level tests ===
 
-void test_crypto();
-void generate_keypairs_benchmark(const size_t seconds_for_test_case);
-void stream_encrypt_benchmark(const size_t seconds_for_test_case);
-void multi_key_sign_generation_benchmark(const size_t seconds_for_test_case);
+void test_crypto(); ///< benchmarks are in bench/ (bench.elf)
 
 
 } // namespace antinet_crypto
@@ -0,0 +1,55 @@
+
+#include "crypto_p2p.hpp"
+
+namespace antinet_crypto {
+
+constexpr size_t c_crypto_p2p::mac_size;
+
+c_crypto_p2p::c_crypto_p2p(const c_multikeys_PAIR & ID_self, const c_multikeys_pub & ID_them)
+	: m_K(crypto_shorthash_KEYBYTES), m_them_hash( ID_them.get_hash() ), m_count_ok(0), m_count_bad(0)
+{
+	const auto sys = e_crypto_system_type_X25519;
+	if ((ID_self.m_pub.get_count_keys_in_system(sys) < 1) || (ID_them.get_count_keys_in_system(sys) < 1))
+		throw std::invalid_argument("Can not create CT-P2P: both sides need an X25519 key");
+
+	auto const key_A_pub = ID_self.m_pub.get_public(sys, 0);
+	auto const key_A_PRV = ID_self.m_PRV.get_PRIVATE(sys, 0);
+	auto const key_B_pub = ID_them.get_public(sys, 0);
+
+	using namespace string_binary_op; // operator^
+	sodiumpp::locked_string k_dh_raw( sodiumpp::key_agreement_locked( key_A_PRV, key_B_pub ) );
+	// same as in KCT kagr (symmetrical for both sides), plus a constant, so this key is not equal to any KCT part
+	sodiumpp::locked_string k_dh_agreed = Hash1_PRV(
+		Hash1_PRV( k_dh_raw ) ^ Hash1( key_A_pub ) ^ Hash1( key_B_pub ) ^ Hash1( "galaxy42-CT-P2P-hop-mac" )
+	);
+	m_K = substr( k_dh_agreed , crypto_shorthash_KEYBYTES );
+	_info("Created CT-P2P, K=" << to_debug_locked(m_K));
+}
+
+void c_crypto_p2p::write_mac(const char * data, size_t data_size, char * mac_out) const {
+	crypto_shorthash( reinterpret_cast<unsigned char*>(mac_out),
+		reinterpret_cast<const unsigned char*>(data), data_size,
+		reinterpret_cast<const unsigned char*>(m_K.c_str()) );
+}
+
+bool c_crypto_p2p::check_mac(const char * data, size_t data_size, const char * mac) {
+	char expected[mac_size];
+	write_mac(data, data_size, expected);
+	bool ok = (0 == sodium_memcmp(expected, mac, mac_size));
+	if (ok) ++m_count_ok; else ++m_count_bad;
+	return ok;
+}
+
+bool c_crypto_p2p::check_frame(const char * frame, size_t frame_size) {
+	if (frame_size < mac_size) { ++m_count_bad; return false; }
+	return check_mac( frame , frame_size - mac_size , frame + frame_size - mac_size );
+}
+
+bool c_crypto_p2p::is_for_them(const c_multikeys_pub & ID_them) const {
+	return safe_string_cmp( m_them_hash , ID_them.get_hash() );
+}
+
+uint64_t c_crypto_p2p::get_count_ok() const { return m_count_ok; }
+uint64_t c_crypto_p2p::get_count_bad() const { return m_count_bad; }
+
+} // namespace antinet_crypto
@@ -0,0 +1,48 @@
+#pragma once
+#ifndef include_crypto_p2p_hpp
+#define include_crypto_p2p_hpp
+
+#include "../libs1.hpp"
+#include <sodium.h>
+#include <sodiumpp/sodiumpp.h>
+
+#include "crypto_basic.hpp"
+#include "multikeys.hpp"
+
+namespace antinet_crypto {
+
+/**
+ * The CT-P2P with one direct peer (see @ref cryptoglossary) - it is a CTNE: authenticates each hop, does not encrypt.
+ * The data itself is already protected end-to-end by CT-E2E, so here we only need to know cheaply
+ * that a frame really comes from this peer, and drop forged frames before doing any other work on them.
+ *
+ * The key is agreed by DH from the IDC keys that we exchange in public_hi anyway (no extra packets),
+ * the MAC is SipHash-2-4 (crypto_shorthash) - mac_size bytes at end of the frame, over all of the frame before it
+ * (header and payload: a hop could else keep a valid header and change the data, that we then route further).
+ */
+class c_crypto_p2p final {
+	public:
+		static constexpr size_t mac_size = crypto_shorthash_BYTES;
+
+		c_crypto_p2p(const c_multikeys_PAIR & ID_self, const c_multikeys_pub & ID_them); ///< throws if we have no common DH system
+
+		void write_mac(const char * data, size_t data_size, char * mac_out) const; ///< writes mac_size bytes to mac_out
+		bool check_mac(const char * data, size_t data_size, const char * mac); ///< constant-time; counts ok/bad frames
+		bool check_frame(const char * frame, size_t frame_size); ///< check_mac() of frame that ends with the MAC; false if too short
+
+		bool is_for_them(const c_multikeys_pub & ID_them) const; ///< is this session keyed with exactly this key of them
+
+		uint64_t get_count_ok() const;
+		uint64_t get_count_bad() const;
+
+	private:
+		sodiumpp::locked_string m_K; ///< SipHash key (crypto_shorthash_KEYBYTES)
+		t_hash m_them_hash; ///< hash of ID_them, to notice when peer changes his IDC (then we must re-key)
+
+		uint64_t m_count_ok; ///< frames that had correct MAC
+		uint64_t m_count_bad; ///< frames dropped because of wrong MAC
+};
+
+} // namespace antinet_crypto
+
+#endif
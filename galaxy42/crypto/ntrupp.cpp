@@ -2,6 +2,11 @@
 
 #include "../trivialserialize.hpp"
 
+#include <sodium.h>
+#include <unistd.h>
+
+#include <mutex>
+
 #include "ntru/include/ntru_crypto.h"
 #include "ntru/include/ntru_crypto_drbg.h"
 
@@ -28,13 +33,8 @@ void NTRU_exec_or_throw( uint32_t errcode , const std::string &info="") {
 }
 
 uint8_t get_entropy(ENTROPY_CMD cmd, uint8_t *out) {
-	static std::ifstream rand_source;
-	static sodiumpp::locked_string random_byte(1);
-
 	if (cmd == INIT) {
-		/* Any initialization for a real entropy source goes here. */
-		rand_source.open("/dev/urandom");
-		return 1;
+		return 1; // libsodium needs no init here, and it is safe to use from many threads (and after fork)
 	}
 
 	if (out == nullptr)
@@ -49,48 +49,70 @@ uint8_t get_entropy(ENTROPY_CMD cmd, uint8_t *out) {
 	}
 
 	if (cmd == GET_BYTE_OF_ENTROPY) {
-		if (!rand_source.is_open())
-			return 0;
-
-		rand_source.get(random_byte[0]);
-		*out = static_cast<uint8_t>(random_byte[0]);
+		randombytes_buf(out, 1);
 		return 1;
 	}
 	return 0;
 }
 
+void ntt_setup_once() {
+	static std::once_flag once;
+	std::call_once(once, [] { // if it throws, next call will try again
+		_note("Preparing FFTW tables for ntt (once)");
+		if(ntt_setup() == -1) {
+			throw std::runtime_error("ERROR: Could not initialize FFTW. Bad wisdom?");
+		}
+	});
+}
+
+constexpr uint32_t c_thread_DRBG::reseed_after_uses;
+
+c_thread_DRBG::c_thread_DRBG(size_t size)
+	: m_handle(0), m_pid(getpid()), m_uses(0)
+{
+	_note("Creating DRBG for size=" << size << " for this thread");
+	NTRU_DRBG_exec_or_throw(
+				ntru_crypto_drbg_instantiate(numeric_cast<uint32_t>(size), nullptr, 0, get_entropy, &m_handle)
+				,"random init"
+				);
+	_note("Creating DRBG for size=" << size << " - ready, as drgb handler=" << m_handle);
+}
+
+c_thread_DRBG::~c_thread_DRBG() {
+	ntru_crypto_drbg_uninstantiate(m_handle);
+}
+
+DRBG_HANDLE c_thread_DRBG::get() {
+	const pid_t pid = getpid();
+	if ((pid != m_pid) || (m_uses >= reseed_after_uses)) {
+		// after fork the child has a copy of the parent state, so it would make the same "random" data as parent
+		_dbg1("Reseeding DRBG " << m_handle << (pid != m_pid ? " (we are forked child)" : ""));
+		NTRU_DRBG_exec_or_throw( ntru_crypto_drbg_reseed(m_handle) , "random reseed" );
+		m_pid = pid;
+		m_uses = 0;
+	}
+	++m_uses;
+	return m_handle;
+}
+
 DRBG_HANDLE get_DRBG(size_t size) {
-	// TODO(r) use std::once / lock? - not thread safe now
-	static map<size_t , DRBG_HANDLE> drbg_tab;
+	thread_local map<size_t , unique_ptr<c_thread_DRBG>> drbg_tab; // freed (uninstantiated) when thread ends
 
 	auto found = drbg_tab.find(size);
 	if (found == drbg_tab.end()) { // not created yet
 		try {
-			_note("Creating DRBG for size=" << size);
-			DRBG_HANDLE newone;
-			NTRU_DRBG_exec_or_throw(
-						ntru_crypto_drbg_instantiate(size, nullptr, 0, get_entropy, &newone)
-						,"random init"
-						);
-			drbg_tab[ size ] = newone;
-			_note("Creating DRBG for size=" << size << " - ready, as drgb handler=" << newone);
-			return newone;
+			found = drbg_tab.emplace( size , make_unique<c_thread_DRBG>(size) ).first;
 		} catch(...) {
 			_erro("Can not init DRBG! (exception)");
 			throw;
 		}
-	} // not found
-	else {
-		return found->second;
 	}
-	assert(false);
+	return found->second->get();
 }
 
 std::pair<sodiumpp::locked_string, std::string> generate_encrypt_keypair() {
 
-	if(ntt_setup() == -1) {
-		throw std::runtime_error("ERROR: Could not initialize FFTW. Bad wisdom?");
-	}
+	ntt_setup_once();
 
 	// generate key pair
 	uint16_t public_key_len = 0, private_key_len = 0;
@@ -121,8 +143,6 @@ std::pair<sodiumpp::locked_string, std::string> generate_encrypt_keypair() {
 								reinterpret_cast<uint8_t *>(private_key.buffer_writable()))
 				,"generate keypair");
 
-	ntt_cleanup();
-
 	return std::make_pair(std::move(private_key), std::move(public_key));
 }
 
@@ -134,9 +154,7 @@ std::pair<sodiumpp::locked_string, std::string> generate_sign_keypair() {
 	int64_t * const private_key_ptr = reinterpret_cast<int64_t * const>(&private_key[0]);
 	int64_t * const public_key_ptr = reinterpret_cast<int64_t * const>(&public_key[0]);
 
-	if(ntt_setup() == -1) {
-		throw std::runtime_error("ERROR: Could not initialize FFTW. Bad wisdom?");
-	}
+	ntt_setup_once();
 
 	gen_key(private_key_ptr);
 	gen_pubkey(public_key_ptr, private_key_ptr);
@@ -147,16 +165,13 @@ std::pair<sodiumpp::locked_string, std::string> generate_sign_keypair() {
 	};
 	trivialserialize::generator gen(1);
 	gen.push_vector_string(public_key_data_vector);
-	ntt_cleanup();
 
 	return std::make_pair(std::move(private_key), std::move(gen.str_move()));
 }
 
 std::string sign(const std::string &msg, const sodiumpp::locked_string &private_key) {
 
-	if(ntt_setup() == -1) {
-		throw std::runtime_error("ERROR: Could not initialize FFTW. Bad wisdom?");
-	}
+	ntt_setup_once();
 
 	int64_t z[PASS_N];
 
@@ -176,15 +191,12 @@ std::string sign(const std::string &msg, const sodiumpp::locked_string &private_
 	// signature = z + hash
 	signature.append(reinterpret_cast<char *>(hash), HASH_BYTES);
 
-	ntt_cleanup();
 	return signature;
 }
 
 bool verify(const std::string &sign, const std::string &msg, const std::string &public_key) {
 
-	if(ntt_setup() == -1) {
-		throw std::runtime_error("ERROR: Could not initialize FFTW. Bad wisdom?");
-	}
+	ntt_setup_once();
 
 	trivialserialize::parser parser(trivialserialize::parser::tag_caller_must_keep_this_string_valid(), public_key);
 	auto public_key_vector_data = parser.pop_vector_string();
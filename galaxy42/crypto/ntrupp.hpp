@@ -4,6 +4,8 @@
 #include "../libs0.hpp"
 #include "sodiumpp/locked_string.h"
 
+#include <sys/types.h>
+
 #include "../trivialserialize.hpp"
 
 #include "ntru/include/ntru_crypto.h"
@@ -22,7 +24,29 @@ extern "C" {
 namespace ntrupp {
 
 	uint8_t get_entropy(ENTROPY_CMD cmd, uint8_t *out);
+
+	/// NTRU DRBG of one thread: long-lived, reseeded after reseed_after_uses, and also in the child after fork()
+	class c_thread_DRBG final {
+		public:
+			static constexpr uint32_t reseed_after_uses = 10000;
+
+			explicit c_thread_DRBG(size_t size); ///< size is the security strength in bits
+			~c_thread_DRBG();
+			c_thread_DRBG(const c_thread_DRBG &) = delete;
+			c_thread_DRBG & operator=(const c_thread_DRBG &) = delete;
+
+			DRBG_HANDLE get(); ///< for one operation (e.g. encrypt), reseeds first if needed
+
+		private:
+			DRBG_HANDLE m_handle;
+			pid_t m_pid; ///< of process where it was last seeded
+			uint32_t m_uses; ///< since last seeding
+	};
+
+	/// DRBG of this thread for given strength (each thread has own one, the NTRU library allows only few of them at once)
 	DRBG_HANDLE get_DRBG(size_t size);
+	/// FFTW tables (plans) of ntt for NTRU sign: made at first use, then kept for all next calls. Thread safe
+	void ntt_setup_once();
 
 	/// @return pair of <private key, hash_sha512(private_key) + pubkey>
 	/// pricate_key hash before publickey is necessary for verifying signatures
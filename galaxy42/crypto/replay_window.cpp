@@ -0,0 +1,52 @@
+
+#include "replay_window.hpp"
+
+namespace antinet_crypto {
+
+replay_error::replay_error(const std::string &msg) : std::runtime_error(msg)
+{ }
+
+constexpr uint64_t c_replay_window::window_size;
+constexpr unsigned c_replay_window::block_bits;
+constexpr size_t c_replay_window::block_count;
+
+c_replay_window::c_replay_window()
+	: m_top(0), m_any(false), m_count_replay(0), m_count_stale(0)
+{
+	m_bitmap.fill(0);
+}
+
+bool c_replay_window::check(uint64_t seq) {
+	if (!m_any) return true;
+	if (seq > m_top) return true; // newer then all - the window will move
+	if (m_top - seq >= window_size) { ++m_count_stale; return false; }
+	const t_block bit = t_block(1) << (seq % block_bits);
+	if (m_bitmap[ (seq / block_bits) % block_count ] & bit) { ++m_count_replay; return false; }
+	return true;
+}
+
+void c_replay_window::mark(uint64_t seq) {
+	if (!m_any || seq > m_top) {
+		const uint64_t block_new = seq / block_bits;
+		const uint64_t block_top = m_top / block_bits;
+		if (!m_any || (block_new - block_top >= block_count)) m_bitmap.fill(0); // jumped over entire window
+		else {
+			for (uint64_t b = block_top+1; b <= block_new; ++b) m_bitmap[ b % block_count ] = 0; // blocks that fall out
+		}
+		m_top = seq;
+		m_any = true;
+	}
+	else if (m_top - seq >= window_size) return; // too old, nothing to remember
+	m_bitmap[ (seq / block_bits) % block_count ] |= t_block(1) << (seq % block_bits);
+}
+
+void c_replay_window::reset() {
+	m_bitmap.fill(0);
+	m_top = 0;
+	m_any = false;
+}
+
+uint64_t c_replay_window::get_count_replay() const { return m_count_replay; }
+uint64_t c_replay_window::get_count_stale() const { return m_count_stale; }
+
+} // namespace antinet_crypto
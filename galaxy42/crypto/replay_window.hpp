@@ -0,0 +1,53 @@
+#pragma once
+#ifndef include_replay_window_hpp
+#define include_replay_window_hpp
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace antinet_crypto {
+
+/// thrown when received data has a nonce that we already accepted, or that is too old to check
+class replay_error : public std::runtime_error {
+	public:
+		explicit replay_error(const std::string &msg);
+};
+
+/**
+ * @brief Sliding window of received sequence numbers (nonces) - to block replay attack, like in IPsec (RFC 6479).
+ * It remembers the highest accepted number and a bitmap of window_size numbers below it, so check is O(1).
+ * Use: check() before doing the (expensive) authentication, and mark() only after the data was authenticated,
+ * so forged packets can not move the window.
+ */
+class c_replay_window final {
+	public:
+		static constexpr uint64_t window_size = 2048; ///< how far back we still accept (in nonce values)
+
+		c_replay_window();
+
+		/// is this number new (not seen yet, and not older then the window). Counts rejected ones
+		bool check(uint64_t seq);
+		void mark(uint64_t seq); ///< remember this number as accepted (call after authentication)
+		void reset(); ///< forget all accepted numbers, e.g. the sender restarted and his nonces start again (counters stay)
+
+		uint64_t get_count_replay() const; ///< rejected because this number was already accepted
+		uint64_t get_count_stale() const; ///< rejected because number was older then the window
+
+	private:
+		typedef uint64_t t_block;
+		static constexpr unsigned block_bits = 64;
+		static constexpr size_t block_count = window_size / block_bits + 1; ///< one more block, that is being cleared
+
+		std::array<t_block, block_count> m_bitmap;
+		uint64_t m_top; ///< highest accepted number
+		bool m_any; ///< was anything accepted yet
+
+		uint64_t m_count_replay;
+		uint64_t m_count_stale;
+};
+
+} // namespace antinet_crypto
+
+#endif
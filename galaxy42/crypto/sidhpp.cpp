@@ -2,6 +2,8 @@
 #include <SIDH.h>
 #include "crypto_basic.hpp"
 
+#include <mutex>
+
 using namespace antinet_crypto;
 
 std::pair<sodiumpp::locked_string, std::string> sidhpp::generate_keypair()
@@ -18,10 +20,8 @@ std::pair<sodiumpp::locked_string, std::string> sidhpp::generate_keypair()
 		std::string public_key_a(public_key_len, 0);
 		std::string public_key_b(public_key_len, 0);
 		CRYPTO_STATUS status = CRYPTO_SUCCESS;
-		PCurveIsogenyStruct curveIsogeny = SIDH_curve_allocate(curveIsogenyData);
+		const PCurveIsogenyStruct curveIsogeny = get_curve();
 		try {
-			if (curveIsogeny == nullptr) throw std::runtime_error("SIDH_curve_allocate error");
-			status = SIDH_curve_initialize(curveIsogeny, &sidhpp::random_bytes_sidh, curveIsogenyData);
 			// generate keys
 			status = KeyGeneration_A(
 				reinterpret_cast<unsigned char*>(&private_key_a[0]),
@@ -55,14 +55,12 @@ std::pair<sodiumpp::locked_string, std::string> sidhpp::generate_keypair()
 			assert(private_key_a != private_key_b);
 		}
 		catch(const std::exception &e) {
-			SIDH_curve_free(curveIsogeny);
 			clear_words(static_cast<void*>(&private_key_a[0]), NBYTES_TO_NWORDS(private_key_len));
 			clear_words(static_cast<void*>(&private_key_b[0]), NBYTES_TO_NWORDS(private_key_len));
 			clear_words(static_cast<void*>(&public_key_a[0]), NBYTES_TO_NWORDS(public_key_len));
 			clear_words(static_cast<void*>(&public_key_b[0]), NBYTES_TO_NWORDS(public_key_len));
 			throw e;
 		}
-		SIDH_curve_free(curveIsogeny);
 		sodiumpp::locked_string private_key_main(2 * private_key_len);
 		std::copy_n(private_key_a.begin(), private_key_len, private_key_main.begin());
 		std::copy_n(private_key_b.begin(), private_key_len, private_key_main.begin() + private_key_len);
@@ -99,13 +97,7 @@ sodiumpp::locked_string sidhpp::secret_agreement(const sodiumpp::locked_string &
 		std::fill_n(shared_secret_a.begin(), shared_secret_size, 0);
 		std::fill_n(shared_secret_b.begin(), shared_secret_size, 0);
 		CRYPTO_STATUS status = CRYPTO_SUCCESS;
-		// allocate curve
-		// TODO move this to class or make global variable
-		PCurveIsogenyStaticData curveIsogenyData = &CurveIsogeny_SIDHp751;
-		PCurveIsogenyStruct curveIsogeny = SIDH_curve_allocate(curveIsogenyData);
-		if (curveIsogeny == nullptr) throw std::runtime_error("SIDH_curve_allocate error");
-		status = SIDH_curve_initialize(curveIsogeny, &random_bytes_sidh, curveIsogenyData);
-		if (status != CRYPTO_SUCCESS) throw std::runtime_error("SIDH_curve_initialize error");
+		const PCurveIsogenyStruct curveIsogeny = get_curve();
 
 		status = SecretAgreement_A(
 			reinterpret_cast<unsigned char *>(&key_self_PRV_a[0]),
@@ -119,7 +111,6 @@ sodiumpp::locked_string sidhpp::secret_agreement(const sodiumpp::locked_string &
 			reinterpret_cast<unsigned char *>(&them_public_key_a[0]),
 			reinterpret_cast<unsigned char *>(&shared_secret_b[0]),
 			curveIsogeny);
-		SIDH_curve_free(curveIsogeny);
 		if (status != CRYPTO_SUCCESS) throw std::runtime_error("SecretAgreement_B error");
 		using namespace antinet_crypto;
 		using namespace string_binary_op;
@@ -127,16 +118,27 @@ sodiumpp::locked_string sidhpp::secret_agreement(const sodiumpp::locked_string &
 		return k_dh_agreed;
 }
 
+PCurveIsogenyStruct sidhpp::get_curve() {
+	static PCurveIsogenyStruct curve = nullptr; // kept until exit
+	static std::once_flag once;
+	std::call_once(once, [] { // if it throws, next call will try again
+		_note("Preparing SIDH curve (once)");
+		PCurveIsogenyStaticData curveIsogenyData = &CurveIsogeny_SIDHp751;
+		PCurveIsogenyStruct newone = SIDH_curve_allocate(curveIsogenyData);
+		if (newone == nullptr) throw std::runtime_error("SIDH_curve_allocate error");
+		if (SIDH_curve_initialize(newone, &random_bytes_sidh, curveIsogenyData) != CRYPTO_SUCCESS) {
+			SIDH_curve_free(newone);
+			throw std::runtime_error("SIDH_curve_initialize error");
+		}
+		curve = newone;
+	});
+	return curve;
+}
+
 CRYPTO_STATUS sidhpp::random_bytes_sidh(unsigned int nbytes, unsigned char *random_array) {
-	static std::ifstream rand_source("/dev/urandom");
 	if (nbytes == 0) {
 		return CRYPTO_ERROR;
 	}
-	//static int not_rand = 0;
-	for (unsigned int i = 0; i < nbytes; i++) {
-		*(random_array + i) = static_cast<unsigned char>(rand_source.get()); // nbytes of random values
-		//*(random_array + i) = (unsigned char)not_rand; // XXX
-		//++not_rand;
-	}
+	randombytes_buf(random_array, nbytes); // thread safe (the curve with this function is used from all threads)
 	return CRYPTO_SUCCESS;
 }
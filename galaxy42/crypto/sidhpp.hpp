@@ -21,6 +21,8 @@ class sidhpp {
 				  	const std::string &key_self_pub,
 					const std::string &them_public_key);
 	private:
+		/// curve with its constants (e.g. generators of the fixed bases) - is prepared once, then shared read-only by all calls
+		static PCurveIsogenyStruct get_curve();
 		static CRYPTO_STATUS random_bytes_sidh(unsigned int nbytes, unsigned char *random_array);
 };
 
@@ -7,6 +7,8 @@ bool c_protocol::command_is_valid_from_unknown_peer( c_protocol::t_proto_cmd cmd
 	if (cmd == e_proto_cmd_public_hi) return true; // establishes CA
 	if (cmd == e_proto_cmd_public_ping_request) return true; // ok to unauthed
 	if (cmd == e_proto_cmd_public_ping_reply) return true; // ok to unauthed
+	if (cmd == e_proto_cmd_dht) return true; // DHT nodes are mostly not our peers; records are signed, replies match our txid,
+		// and big replies are sent only to requests with our cookie (see dht::e_msg::cookie)
 
 	return false;
 }
@@ -14,6 +14,20 @@ class c_protocol {
 
 		constexpr static unsigned char ttl_max_value_ever = 200; // no value bigger then that can ever appear, it would be low level error to let that happen
 		constexpr static unsigned char ttl_max_accepted = 5; // how high can be the TTL requested by others that we can [normally?] accept
+		constexpr static unsigned char route_cost_max = 255; // route cost is sent in one byte (it is the sum of link costs)
+		// findhip reply: format of its cost, sent after the pubkey (older nodes ignore it). Older nodes send none: cost is in hops
+		constexpr static unsigned char findhip_cost_link_quality = 1; // sum of c_link_quality::get_cost() of the hops
+
+		constexpr static unsigned char p2p_mac_size = 8; // size of CT-P2P MAC (hop authentication) of tunneled data
+		constexpr static unsigned char tunneled_data_header_size = version_size + cmd_size + 16 + 16 + ttl_size + 24; // ...+src,dst,ttl,nonce (then blob, then CT-P2P MAC)
+		constexpr static unsigned char conn_id_size = 4; // connection ID, given by the receiving peer for (src,dst)
+		constexpr static unsigned char tunneled_data_compact_header_size = version_size + cmd_size + conn_id_size + ttl_size + 4; // ...+ttl,nonce counter (lowest bytes) (then blob, then CT-P2P MAC)
+		constexpr static unsigned char conn_id_offer_size = version_size + cmd_size + 16 + 16 + conn_id_size + 16; // ...+src,dst,ID,nonce prefix
+		constexpr static unsigned char ping_size = version_size + cmd_size + 4; // ...+seq (the same in the reply)
+		constexpr static unsigned char keepalive_size = version_size + cmd_size + 8 + 8; // ...+session ID, counter (then CT-P2P MAC)
+		constexpr static unsigned char pmtu_ack_size = version_size + cmd_size + 2 + 4; // ...+probe size, probe nonce (then CT-P2P MAC); probe starts the same
+		constexpr static unsigned char route_adv_entry_size = 16 + 1 + 4; // dst, cost, seqno
+		constexpr static unsigned char route_adv_max_entries = 50; // in one datagram (so it fits in any path MTU)
 
 /*
 Proxy format - the data to be sent on wire to peer:
@@ -34,8 +48,15 @@ typedef enum {
 	e_proto_cmd_public_hi = 3, // simple public peering
 	e_proto_cmd_public_ping_request = 4, // simple public ping to the peer
 	e_proto_cmd_public_ping_reply = 5, // simple public ping to the peer
+	e_proto_cmd_pmtu_probe = 6, // path MTU probe (padded), sent with DF
+	e_proto_cmd_pmtu_ack = 7, // we got the PMTU probe of this size (and nonce)
+	e_proto_cmd_tunneled_data_compact = 8, // tunneled data, with connection ID instead of src/dst and nonce
+	e_proto_cmd_conn_id_offer = 9, // use this connection ID when sending tunneled data (src,dst) to me
 	e_proto_cmd_findhip_query = 10, // searching HIP - query
 	e_proto_cmd_findhip_reply = 11, // searching HIP - reply
+	e_proto_cmd_route_adv = 12, // proactive routing: routes that we have (dst, cost, seqno)
+	e_proto_cmd_dht = 13, // DHT (directory of pubkeys): Kademlia message, to/from any node (see dht::message_to_bin)
+	e_proto_cmd_keepalive = 14, // instead of full HI, when the peer already has it (see hi_session)
 } t_proto_cmd ;
 
 static bool command_is_valid_from_unknown_peer( t_proto_cmd cmd ); ///< is this command one that can come from an unknown peer (without any HIP and CA)
@@ -1,7 +1,9 @@
 #ifndef C_CONNECTION_BASE_H
 #define C_CONNECTION_BASE_H
 
+#include <chrono>
 #include <string>
+#include <thread>
 
 /**
  * contains raw data and source/destination address
@@ -34,6 +36,20 @@ class c_connection_base {
 		 */
 		virtual c_network_message receive() = 0;
 
+		/**
+		 * Like receive() but waits up to timeout for a message
+		 * (default implementation polls once and sleeps, override if the node can block on its queue)
+		 * @returns empty message if error or no data received in timeout
+		 */
+		virtual c_network_message receive_wait(std::chrono::microseconds timeout) {
+			c_network_message message = receive();
+			if (message.data.empty()) {
+				std::this_thread::sleep_for(timeout);
+				message = receive();
+			}
+			return message;
+		}
+
 		virtual ~c_connection_base() = default;
 };
 
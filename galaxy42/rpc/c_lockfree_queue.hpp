@@ -0,0 +1,236 @@
+#ifndef NETWORKLIB_LOCKFREEQUEUE
+#define NETWORKLIB_LOCKFREEQUEUE
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+// Bounded lock-free queues (ring buffers) used instead of c_locked_queue on hot paths.
+// c_mpsc_ring - many producers (e.g. all asio threads), one consumer
+// c_spsc_ring - exactly one producer and one consumer thread
+// Both can be used non-blocking (try_push/try_pop) or the consumer can block in wait_pop().
+
+namespace lockfree_detail {
+
+constexpr std::size_t cache_line_size = 64;
+
+inline std::size_t check_capacity(std::size_t capacity) {
+	if (capacity < 2 || (capacity & (capacity - 1)) != 0)
+		throw std::invalid_argument("ring capacity must be a power of 2 (and at least 2)");
+	return capacity;
+}
+
+/**
+ * @brief Lets the single consumer sleep when the ring is empty.
+ * Producers only touch the mutex when the consumer announced that it sleeps, so the fast path
+ * (consumer busy) is lock-free. Both sides use a seq_cst fence between "publish" and "check",
+ * so either the producer sees m_sleeping, or the consumer sees the new element.
+ */
+class c_consumer_waiter {
+	public:
+		c_consumer_waiter() : m_sleeping(false) { }
+
+		void notify() { ///< call by producer after publishing an element
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (m_sleeping.load(std::memory_order_relaxed)) {
+				std::lock_guard<std::mutex> lg(m_mutex);
+				m_cv.notify_one();
+			}
+		}
+
+		/// sleep until has_data() is true or timeout passes. @return has_data() at exit
+		template <typename TPred>
+		bool wait(TPred has_data, std::chrono::microseconds timeout) {
+			for (int i=0; i<64; ++i) { // short spin, most waits are very short under load
+				if (has_data()) return true;
+				std::this_thread::yield();
+			}
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_sleeping.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			bool ret = m_cv.wait_for(lock, timeout, has_data);
+			m_sleeping.store(false, std::memory_order_relaxed);
+			return ret;
+		}
+
+	private:
+		std::atomic<bool> m_sleeping;
+		std::mutex m_mutex;
+		std::condition_variable m_cv;
+};
+
+} // namespace lockfree_detail
+
+/**
+ * @brief Bounded multi-producer single-consumer ring.
+ * Each cell has a sequence number (D. Vyukov's bounded queue), so producers only compete with one CAS on m_tail,
+ * and the consumer never writes to shared counters other than the cell it frees.
+ * Capacity must be a power of 2.
+ */
+template <typename _T>
+class c_mpsc_ring {
+	public:
+		explicit c_mpsc_ring(std::size_t capacity)
+		:
+			m_mask(lockfree_detail::check_capacity(capacity) - 1),
+			m_cells(new t_cell[capacity]),
+			m_tail(0),
+			m_head(0)
+		{
+			for (std::size_t i=0; i<capacity; ++i) m_cells[i].m_seq.store(i, std::memory_order_relaxed);
+		}
+		c_mpsc_ring(const c_mpsc_ring &) = delete;
+		c_mpsc_ring & operator=(const c_mpsc_ring &) = delete;
+
+		/// thread safe (for producers). Moves from value only on success. @return false if queue is full
+		bool try_push(_T &value) {
+			t_cell *cell;
+			std::size_t pos = m_tail.load(std::memory_order_relaxed);
+			for (;;) {
+				cell = &m_cells[pos & m_mask];
+				std::size_t seq = cell->m_seq.load(std::memory_order_acquire);
+				std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+				if (diff == 0) {
+					if (m_tail.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) break;
+				}
+				else if (diff < 0) return false; // full
+				else pos = m_tail.load(std::memory_order_relaxed);
+			}
+			cell->m_value = std::move(value);
+			cell->m_seq.store(pos+1, std::memory_order_release);
+			m_waiter.notify();
+			return true;
+		}
+
+		bool try_push(_T &&value) { return try_push(value); }
+
+		/// only one consumer thread. @return false if queue is empty (value is not touched then)
+		bool try_pop(_T &value) {
+			t_cell &cell = m_cells[m_head & m_mask];
+			std::size_t seq = cell.m_seq.load(std::memory_order_acquire);
+			if (seq != m_head+1) return false; // empty (or the producer did not finish writing yet)
+			value = std::move(cell.m_value);
+			cell.m_value = _T(); // do not keep moved-from data (e.g. big strings) alive in the ring
+			cell.m_seq.store(m_head + m_mask + 1, std::memory_order_release);
+			++m_head;
+			return true;
+		}
+
+		/// only one consumer thread. Blocks up to timeout for an element. @return false on timeout
+		bool wait_pop(_T &value, std::chrono::microseconds timeout) {
+			if (try_pop(value)) return true;
+			if (!m_waiter.wait([this]{ return !empty(); }, timeout)) return false;
+			return try_pop(value);
+		}
+
+		/// only reliable from the consumer thread (as hint for producers)
+		bool empty() const {
+			return m_cells[m_head & m_mask].m_seq.load(std::memory_order_acquire) != m_head+1;
+		}
+
+		/// from any thread, a hint: try_push would fail now (the consumer did not free the next cell yet)
+		bool full() const {
+			const std::size_t pos = m_tail.load(std::memory_order_acquire);
+			const std::size_t seq = m_cells[pos & m_mask].m_seq.load(std::memory_order_acquire);
+			return static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos) < 0;
+		}
+
+		std::size_t capacity() const { return m_mask + 1; }
+
+	private:
+		struct t_cell {
+			std::atomic<std::size_t> m_seq;
+			_T m_value;
+		};
+
+		// padding instead of alignas: rings are members of heap objects, and C++14 new ignores extended alignment
+		const std::size_t m_mask;
+		std::unique_ptr<t_cell[]> m_cells;
+		char m_pad0[lockfree_detail::cache_line_size];
+		std::atomic<std::size_t> m_tail; ///< producers
+		char m_pad1[lockfree_detail::cache_line_size];
+		std::size_t m_head; ///< consumer only
+		char m_pad2[lockfree_detail::cache_line_size];
+		lockfree_detail::c_consumer_waiter m_waiter;
+};
+
+/**
+ * @brief Bounded single-producer single-consumer ring.
+ * Producer and consumer keep a cached copy of the other side's index, so in steady state
+ * they do not touch each others cache line.
+ * Capacity must be a power of 2.
+ */
+template <typename _T>
+class c_spsc_ring {
+	public:
+		explicit c_spsc_ring(std::size_t capacity)
+		:
+			m_mask(lockfree_detail::check_capacity(capacity) - 1),
+			m_data(new _T[capacity]),
+			m_tail(0),
+			m_head_cached(0),
+			m_head(0),
+			m_tail_cached(0)
+		{ }
+		c_spsc_ring(const c_spsc_ring &) = delete;
+		c_spsc_ring & operator=(const c_spsc_ring &) = delete;
+
+		/// only one producer thread. Moves from value only on success. @return false if queue is full
+		bool try_push(_T &value) {
+			const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+			if (tail - m_head_cached > m_mask) {
+				m_head_cached = m_head.load(std::memory_order_acquire);
+				if (tail - m_head_cached > m_mask) return false; // full
+			}
+			m_data[tail & m_mask] = std::move(value);
+			m_tail.store(tail+1, std::memory_order_release);
+			m_waiter.notify();
+			return true;
+		}
+
+		bool try_push(_T &&value) { return try_push(value); }
+
+		/// only one consumer thread. @return false if queue is empty
+		bool try_pop(_T &value) {
+			const std::size_t head = m_head.load(std::memory_order_relaxed);
+			if (head == m_tail_cached) {
+				m_tail_cached = m_tail.load(std::memory_order_acquire);
+				if (head == m_tail_cached) return false; // empty
+			}
+			value = std::move(m_data[head & m_mask]);
+			m_data[head & m_mask] = _T();
+			m_head.store(head+1, std::memory_order_release);
+			return true;
+		}
+
+		/// only one consumer thread. Blocks up to timeout for an element. @return false on timeout
+		bool wait_pop(_T &value, std::chrono::microseconds timeout) {
+			if (try_pop(value)) return true;
+			if (!m_waiter.wait([this]{ return !empty(); }, timeout)) return false;
+			return try_pop(value);
+		}
+
+		bool empty() const {
+			return m_head.load(std::memory_order_relaxed) == m_tail.load(std::memory_order_acquire);
+		}
+
+		std::size_t capacity() const { return m_mask + 1; }
+
+	private:
+		const std::size_t m_mask;
+		std::unique_ptr<_T[]> m_data;
+		char m_pad0[lockfree_detail::cache_line_size];
+		std::atomic<std::size_t> m_tail; ///< written by producer
+		std::size_t m_head_cached; ///< producer's copy of m_head
+		char m_pad1[lockfree_detail::cache_line_size];
+		std::atomic<std::size_t> m_head; ///< written by consumer
+		std::size_t m_tail_cached; ///< consumer's copy of m_tail
+		char m_pad2[lockfree_detail::cache_line_size];
+		lockfree_detail::c_consumer_waiter m_waiter;
+};
+
+#endif
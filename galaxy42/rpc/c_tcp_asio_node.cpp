@@ -1,17 +1,25 @@
 #include "c_tcp_asio_node.hpp"
 
+#include <algorithm>
 #include <functional>
 
 using namespace boost::asio;
 using namespace asio_node;
 
-c_tcp_asio_node::c_tcp_asio_node(unsigned int port)
+constexpr size_t c_tcp_asio_node::s_recv_queue_size;
+constexpr size_t c_tcp_asio_node::s_connection_shards;
+constexpr size_t c_connection::s_max_send_queue_bytes;
+constexpr size_t c_connection::s_max_gather_messages;
+constexpr std::chrono::seconds c_connection::s_send_queue_timeout;
+
+c_tcp_asio_node::c_tcp_asio_node(unsigned int port, const ip::address & listen_address)
 :
 	m_asio_threads(),
 	m_stop_flag(false),
 	m_ioservice(),
-	m_recv_queue(),
-	m_acceptor(m_ioservice, ip::tcp::endpoint(ip::tcp::v4(), port)),
+	m_recv_queue(s_recv_queue_size),
+	m_any_paused(false),
+	m_acceptor(m_ioservice, ip::tcp::endpoint(listen_address, port)),
 	m_socket_accept(m_ioservice)
 {
 	_dbg_mtx("c_tcp_asio_node constructor");
@@ -51,26 +59,86 @@ void c_tcp_asio_node::send(c_network_message && message) {
 	ip::address_v4 ip_addr = ip::address_v4::from_string(msg.address_ip); // throw "Invalid argument"
 	ip::tcp::endpoint endpoint(ip_addr, msg.port); // generate endpoint from message
 
-	std::lock_guard<std::mutex> lg(m_connection_map_mtx);
-	auto it = m_connection_map.find(endpoint); // find destination connection
-	if (it == m_connection_map.end()) { // not found connection, create new
-		m_connection_map[endpoint] = std::unique_ptr<c_connection>(new c_connection(*this, endpoint));
+	t_connection_shard &shard = get_shard(endpoint);
+	std::shared_ptr<c_connection> connection;
+	{
+		std::lock_guard<std::mutex> lg(shard.m_mtx);
+		auto it = shard.m_map.find(endpoint); // find destination connection
+		if (it != shard.m_map.end()) connection = it->second;
+	}
+	if (!connection) { // not found connection, create new (connect blocks, so not under the lock)
+		auto new_connection = std::make_shared<c_connection>(*this, endpoint);
+		bool added = false;
+		{
+			std::lock_guard<std::mutex> lg(shard.m_mtx);
+			auto result = shard.m_map.emplace(endpoint, new_connection); // other thread could connect meanwhile, use his
+			connection = result.first->second;
+			added = result.second;
+		}
+		if (added) new_connection->start();
+		else new_connection->close(); // nothing runs on it yet
+	}
+	connection->send(std::move(msg.data)); // queue raw data, only blocks if this connection is over its limit
+}
+
+unsigned short c_tcp_asio_node::get_port() const {
+	return m_acceptor.local_endpoint().port();
+}
+
+c_tcp_asio_node::t_connection_shard & c_tcp_asio_node::get_shard(const ip::tcp::endpoint &endpoint) {
+	size_t hash = endpoint.port();
+	const ip::address &address = endpoint.address();
+	if (address.is_v4()) {
+		hash ^= static_cast<size_t>(address.to_v4().to_ulong()) * 31;
+	} else {
+		for (unsigned char byte : address.to_v6().to_bytes()) hash = hash * 31 + byte;
 	}
-	assert(!m_connection_map.empty());
-	m_connection_map.at(endpoint)->send(std::move(msg.data)); // send raw data
+	hash ^= hash >> 7;
+	return m_connection_shards.at(hash % s_connection_shards);
 }
 
 c_network_message c_tcp_asio_node::receive() {
 	c_network_message message;
-	std::lock_guard<std::recursive_mutex> lg(m_recv_queue.get_mutex());
-	// if incomming queue is empty returns empty message
-	if (m_recv_queue.empty()) {
-		return message;
-	}
-	message = m_recv_queue.pop();
+	if (m_recv_queue.try_pop(message) && m_any_paused) resume_reading(); // if incomming queue is empty returns empty message
+	return message;
+}
+
+c_network_message c_tcp_asio_node::receive_wait(std::chrono::microseconds timeout) {
+	c_network_message message;
+	if (m_recv_queue.wait_pop(message, timeout) && m_any_paused) resume_reading();
 	return message;
 }
 
+void c_tcp_asio_node::pause_reading(const ip::tcp::endpoint &endpoint) {
+	std::lock_guard<std::mutex> lg(m_paused_mtx);
+	m_paused.push_back(endpoint);
+	m_any_paused = true;
+}
+
+bool c_tcp_asio_node::unpause(const ip::tcp::endpoint &endpoint) {
+	std::lock_guard<std::mutex> lg(m_paused_mtx);
+	auto it = std::find(m_paused.begin(), m_paused.end(), endpoint);
+	if (it == m_paused.end()) return false;
+	m_paused.erase(it);
+	m_any_paused = !m_paused.empty();
+	return true;
+}
+
+void c_tcp_asio_node::resume_reading() {
+	std::vector<ip::tcp::endpoint> paused;
+	{
+		std::lock_guard<std::mutex> lg(m_paused_mtx);
+		paused.swap(m_paused);
+		m_any_paused = false;
+	}
+	for (const auto &endpoint : paused) {
+		t_connection_shard &shard = get_shard(endpoint);
+		std::lock_guard<std::mutex> lg(shard.m_mtx); // so the connection is not deleted meanwhile
+		auto it = shard.m_map.find(endpoint);
+		if (it != shard.m_map.end()) it->second->push_or_pause(); // it can pause again, if others took the place
+	}
+}
+
 
 void c_tcp_asio_node::accept_handler(const boost::system::error_code &error) {
 	_dbg_mtx("accept handler");
@@ -78,11 +146,21 @@ void c_tcp_asio_node::accept_handler(const boost::system::error_code &error) {
 		_dbg_mtx("error: " << error.message());
 		return;
 	}
-	// create new connection in m_connection_map
-	auto endpoint = m_socket_accept.remote_endpoint();
-	std::unique_lock<std::mutex> lg(m_connection_map_mtx);
-	m_connection_map[endpoint] = std::unique_ptr<c_connection>(new c_connection(*this, std::move(m_socket_accept)));
-	lg.unlock();
+	boost::system::error_code endpoint_error;
+	auto endpoint = m_socket_accept.remote_endpoint(endpoint_error);
+	if (endpoint_error) { // he is gone already
+		_dbg_mtx("error: " << endpoint_error.message());
+		m_socket_accept.close(endpoint_error);
+	} else { // create new connection in m_connection_map
+		auto connection = std::make_shared<c_connection>(*this, std::move(m_socket_accept), endpoint);
+		t_connection_shard &shard = get_shard(endpoint);
+		std::unique_lock<std::mutex> lg(shard.m_mtx);
+		std::shared_ptr<c_connection> old_connection = shard.m_map[endpoint]; // (the same endpoint again: the old one is dead)
+		shard.m_map[endpoint] = connection;
+		lg.unlock();
+		connection->start();
+		if (old_connection) m_ioservice.post([old_connection]() { old_connection->close(); }); // its read fails, then it is freed
+	}
 	m_acceptor.async_accept(m_socket_accept, std::bind(&c_tcp_asio_node::accept_handler, this, std::placeholders::_1)); // continue accepting
 	_dbg_mtx("accept handler end");
 }
@@ -95,8 +173,9 @@ c_connection::c_connection(c_tcp_asio_node &node, const boost::asio::ip::tcp::en
 :
 	m_tcp_node(node),
 	m_socket(node.m_ioservice),
-	m_streambuff(),
-	m_ostream(&m_streambuff),
+	m_endpoint(endpoint),
+	m_send_queue_bytes(0),
+	m_write_in_progress(false),
 	m_read_size(),
 	m_streambuff_in()
 {
@@ -105,48 +184,79 @@ c_connection::c_connection(c_tcp_asio_node &node, const boost::asio::ip::tcp::en
 	_dbg_mtx("connected");
 	boost::asio::ip::tcp::no_delay option;
 	m_socket.set_option(option);
-	m_socket.async_read_some(buffer(&m_read_size, sizeof(m_read_size)),
-							std::bind(&c_connection::read_size_handler, this, std::placeholders::_1, std::placeholders::_2));
 }
 
 // accept constructor
-c_connection::c_connection(c_tcp_asio_node &node, ip::tcp::socket && socket)
+c_connection::c_connection(c_tcp_asio_node &node, ip::tcp::socket && socket, const ip::tcp::endpoint &endpoint)
 :
 	m_tcp_node(node),
 	m_socket(std::move(socket)),
-	m_streambuff(),
-	m_ostream(&m_streambuff),
+	m_endpoint(endpoint),
+	m_send_queue_bytes(0),
+	m_write_in_progress(false),
 	m_read_size(),
 	m_streambuff_in()
 {
 	boost::asio::ip::tcp::no_delay option;
-	m_socket.set_option(option);
-	// start read size
-	m_socket.async_read_some(buffer(&m_read_size, sizeof(m_read_size)),
-							std::bind(&c_connection::read_size_handler, this, std::placeholders::_1, std::placeholders::_2));
+	boost::system::error_code ec; // if he is gone already, the first read fails
+	m_socket.set_option(option, ec);
 }
 
 c_connection::~c_connection() {
 	_dbg_mtx("");
-	if (m_socket.is_open()) {
-		_dbg_mtx("close connection socket");
-		m_socket.shutdown(ip::tcp::socket::socket_base::shutdown_both);
-		m_socket.close();
-	}
+	close();
+}
+
+void c_connection::start() {
+	start_read();
+}
+
+void c_connection::close() {
+	if (!m_socket.is_open()) return;
+	_dbg_mtx("close connection socket");
+	boost::system::error_code ec; // the peer could be gone already
+	m_socket.shutdown(ip::tcp::socket::socket_base::shutdown_both, ec);
+	m_socket.close(ec);
 }
 
 void c_connection::send(std::string && message) {
 	const uint32_t size_of_message = message.size();
-	std::string msg(std::move(message)); //< consume message
-	_dbg_mtx("msg.size() = " << msg.size());
-	_dbg_mtx("size_of_message = " << size_of_message);
-	assert(msg.size() == size_of_message);
-	std::unique_lock<std::mutex> lg(m_streambuff_mtx);
-	m_ostream.write(reinterpret_cast<const char *>(&size_of_message), sizeof(size_of_message)); ///< write size of message (4 bytes)
-	m_ostream.write(msg.data(), msg.size()); ///< write message
-	lg.unlock();
-	m_socket.async_write_some(buffer(m_streambuff.data(), m_streambuff.size()),
-							std::bind(&c_connection::write_handler, this, std::placeholders::_1, std::placeholders::_2));
+	t_out_message msg{size_of_message, std::move(message)}; //< consume message
+	_dbg_mtx("msg.size() = " << msg.m_data.size());
+	assert(msg.m_data.size() == size_of_message);
+	const size_t bytes = sizeof(msg.m_size) + msg.m_data.size();
+
+	std::unique_lock<std::mutex> lg(m_send_mtx);
+	// backpressure: do not let a slow peer eat all memory. One big message is always allowed into an empty queue.
+	bool has_place = m_send_cv.wait_for(lg, s_send_queue_timeout, [this, bytes]() {
+		return m_send_queue_bytes == 0 || m_send_queue_bytes + bytes <= s_max_send_queue_bytes;
+	});
+	if (!has_place) throw std::runtime_error("tcp send queue is full (peer is not reading)");
+	m_send_queue.emplace_back(std::move(msg));
+	m_send_queue_bytes += bytes;
+	if (!m_write_in_progress) start_write(); // else write_handler will pick it up
+}
+
+void c_connection::start_write() {
+	assert(!m_write_in_progress);
+	assert(m_send_in_flight.empty());
+	if (m_send_queue.empty()) return;
+	// take many queued messages at once, and send them as one gather-write (one syscall for many small messages)
+	const size_t count = std::min(m_send_queue.size(), s_max_gather_messages);
+	m_send_in_flight.reserve(count);
+	for (size_t i = 0; i < count; ++i) {
+		m_send_in_flight.emplace_back(std::move(m_send_queue.front()));
+		m_send_queue.pop_front();
+	}
+	std::vector<const_buffer> buffers; // build after m_send_in_flight is complete, so pointers into it stay valid
+	buffers.reserve(count * 2);
+	for (const auto &msg : m_send_in_flight) {
+		buffers.emplace_back(buffer(&msg.m_size, sizeof(msg.m_size))); ///< size of message (4 bytes)
+		buffers.emplace_back(buffer(msg.m_data)); ///< message
+	}
+	m_write_in_progress = true;
+	async_write(m_socket, buffers,
+		std::bind(&c_connection::write_handler, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
 }
 
 void c_connection::write_handler(const boost::system::error_code &error, std::size_t length) {
@@ -156,15 +266,21 @@ void c_connection::write_handler(const boost::system::error_code &error, std::si
 		delete_me();
 		return;
 	}
-	std::lock_guard<std::mutex> lg(m_streambuff_mtx);
-	m_streambuff.consume(length); // remove sended data from stream
-	if (m_streambuff.size() > 0) { ///< if sen buffer is not empty continue sending
-		m_socket.async_write_some(buffer(m_streambuff.data(), m_streambuff.size()),
-							std::bind(&c_connection::write_handler, this, std::placeholders::_1, std::placeholders::_2));
-	}
+	std::lock_guard<std::mutex> lg(m_send_mtx);
+	assert(m_send_queue_bytes >= length);
+	m_send_queue_bytes -= length; // async_write finishes only when all in-flight data was sent
+	m_send_in_flight.clear();
+	m_write_in_progress = false;
+	m_send_cv.notify_all();
+	start_write(); // if send queue is not empty continue sending
 	_dbg_mtx("end");
 }
 
+void c_connection::start_read() {
+	async_read(m_socket, buffer(&m_read_size, sizeof(m_read_size)), // exactly 4 bytes, partial read would break framing
+							std::bind(&c_connection::read_size_handler, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
+}
+
 // read always 4 bytes (size)
 void c_connection::read_size_handler(const boost::system::error_code &error, size_t length) {
 	UNUSED(length);
@@ -179,7 +295,7 @@ void c_connection::read_size_handler(const boost::system::error_code &error, siz
 	_dbg_mtx("wait for " << m_read_size << " bytes");
 	async_read(m_socket, m_streambuff_in,
 							transfer_exactly(m_read_size),
-							std::bind(&c_connection::read_data_handler, this, std::placeholders::_1, std::placeholders::_2));
+							std::bind(&c_connection::read_data_handler, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
 }
 
 void c_connection::read_data_handler(const boost::system::error_code &error, size_t length) {
@@ -193,29 +309,40 @@ void c_connection::read_data_handler(const boost::system::error_code &error, siz
 	_dbg_mtx("m_read_size " << m_read_size);
 	_dbg_mtx("length " << length);
 	// generate c_network_message
-	c_network_message network_message;
-	network_message.data.reserve(length);
+	m_received = c_network_message();
+	m_received.data.reserve(length);
 	_dbg_mtx("streambuff size " << m_streambuff_in.size());
 	// get data from input stream
 	streambuf::const_buffers_type buf = m_streambuff_in.data();
-	std::copy(buffers_begin(buf), buffers_begin(buf) + length, std::back_inserter(network_message.data));
+	std::copy(buffers_begin(buf), buffers_begin(buf) + length, std::back_inserter(m_received.data));
 	m_streambuff_in.consume(length);
-	_dbg_mtx("network_message.data.size() " << network_message.data.size());
+	_dbg_mtx("m_received.data.size() " << m_received.data.size());
 	// fill source message data
-	auto endpoint = m_socket.remote_endpoint();
-	network_message.address_ip = endpoint.address().to_string();
-	network_message.port = endpoint.port();
-	m_tcp_node.get().m_recv_queue.push(std::move(network_message));
-	// continue read
-	m_socket.async_read_some(buffer(&m_read_size, sizeof(m_read_size)),
-							std::bind(&c_connection::read_size_handler, this, std::placeholders::_1, std::placeholders::_2));
+	m_received.address_ip = m_endpoint.address().to_string();
+	m_received.port = m_endpoint.port();
+	push_or_pause(); // and continue read
+}
+
+void c_connection::push_or_pause() {
+	c_tcp_asio_node &node = m_tcp_node.get();
+	while (!node.m_recv_queue.try_push(m_received)) {
+		// queue is full: the reader is slower then network, so stop reading this connection until there is place
+		// (TCP flow control will then slow down the sender). receive() resumes us, when it pops from the queue
+		if (node.m_stop_flag) return;
+		node.pause_reading(m_endpoint);
+		if (node.m_recv_queue.full()) return;
+		// the queue was emptied before we paused (so maybe no one will resume us): take it back, unless receive() already did
+		if (!node.unpause(m_endpoint)) return;
+	}
+	start_read();
 }
 
 
 void c_connection::delete_me() {
 	_dbg_mtx("");
-	auto endpoint = m_socket.remote_endpoint();
-	std::unique_lock<std::mutex> lg(m_tcp_node.get().m_connection_map_mtx);
-	m_tcp_node.get().m_connection_map.erase(endpoint); // remove this object from connection map
-	lg.unlock();
+	auto &shard = m_tcp_node.get().get_shard(m_endpoint);
+	std::unique_lock<std::mutex> lg(shard.m_mtx);
+	auto it = shard.m_map.find(m_endpoint);
+	if ((it != shard.m_map.end()) && (it->second.get() == this)) shard.m_map.erase(it); // remove this object from connection map
+	lg.unlock(); // we are freed when the handler that called us returns (it holds the last shared_ptr)
 }
@@ -2,10 +2,13 @@
 #define C_TCP_ASIO_NODE_H
 
 #include "c_connection_base.hpp"
-#include "c_locked_queue.hpp"
+#include "c_lockfree_queue.hpp"
 #include "../libs0.hpp"
 
+#include <array>
 #include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <boost/asio.hpp>
 #include <map>
 #include <memory>
@@ -29,18 +32,44 @@ class c_tcp_asio_node final : public c_connection_base
 {
 	friend class c_connection;
 	public:
-		c_tcp_asio_node(unsigned int port);
+		///! port 0: any free one, see get_port(). Accepts connections only on this address (by default loopback: anyone who can
+		///! connect can send us messages)
+		c_tcp_asio_node(unsigned int port, const boost::asio::ip::address & listen_address = boost::asio::ip::address_v4::loopback());
 		~c_tcp_asio_node();
+		unsigned short get_port() const; ///< where we accept connections
 		void send(c_network_message && message) override;
 		c_network_message receive() override;
+		c_network_message receive_wait(std::chrono::microseconds timeout) override;
 	private:
 		std::vector<std::unique_ptr<std::thread>> m_asio_threads;
 		std::atomic<bool> m_stop_flag; // TODO atomic_flag?
 		boost::asio::io_service m_ioservice;
-		c_locked_queue<c_network_message> m_recv_queue; ///< queue for incomming message
+		static constexpr size_t s_recv_queue_size = 4096; ///< max messages waiting for receive(), must be power of 2
+		c_mpsc_ring<c_network_message> m_recv_queue; ///< queue for incomming message, pushed by all asio threads, popped by receive()
 
-		std::mutex m_connection_map_mtx;
-		std::map<boost::asio::ip::tcp::endpoint, std::unique_ptr<c_connection>> m_connection_map; ///< always use m_connection_map_mtx !!!
+		/**
+		 * Backpressure: when m_recv_queue is full, a connection keeps its message and stops reading (so TCP flow control
+		 * slows down the sender), instead of waiting on the asio thread. receive() resumes them after it makes place.
+		 */
+		std::mutex m_paused_mtx;
+		std::vector<boost::asio::ip::tcp::endpoint> m_paused; ///< connections that do not read now. always use m_paused_mtx
+		std::atomic<bool> m_any_paused; ///< m_paused is not empty (checked by receive() without the lock)
+		void pause_reading(const boost::asio::ip::tcp::endpoint &endpoint);
+		bool unpause(const boost::asio::ip::tcp::endpoint &endpoint); ///< @return was it paused (then the caller resumes it)
+		void resume_reading(); ///< m_recv_queue has place now, all paused connections read again
+
+		/**
+		 * Connections are split into shards by endpoint hash, so sending to different peers
+		 * does not serialize on one global mutex. The mutex is held only to find the connection: send() and connect
+		 * (that can block) are done after it is released, on a copy of shared_ptr.
+		 */
+		struct t_connection_shard {
+			std::mutex m_mtx;
+			std::map<boost::asio::ip::tcp::endpoint, std::shared_ptr<c_connection>> m_map; ///< always use m_mtx !!!
+		};
+		static constexpr size_t s_connection_shards = 16;
+		std::array<t_connection_shard, s_connection_shards> m_connection_shards;
+		t_connection_shard & get_shard(const boost::asio::ip::tcp::endpoint &endpoint);
 
 		boost::asio::ip::tcp::acceptor m_acceptor;
 		boost::asio::ip::tcp::socket m_socket_accept;
@@ -48,35 +77,62 @@ class c_tcp_asio_node final : public c_connection_base
 		void accept_handler(const boost::system::error_code& error);
 };
 
-class c_connection final {
+/**
+ * Always in a shared_ptr: each pending async operation keeps it alive (its handler holds shared_from_this()), so it can be
+ * removed from the map of node (or never put there) while they run.
+ */
+class c_connection final : public std::enable_shared_from_this<c_connection> {
 	public:
 		c_connection(const c_connection &) = delete;
 		c_connection& operator = (const c_connection &) = delete;
-		c_connection(c_connection &&) = default;
-		c_connection& operator = (c_connection &&) = default;
 
 		c_connection(c_tcp_asio_node &node, const boost::asio::ip::tcp::endpoint &endpoint); ///< connect constructor
-		c_connection(c_tcp_asio_node &node, boost::asio::ip::tcp::socket &&socket); ///< accept constructor
+		/// accept constructor; endpoint is of the peer (from accept)
+		c_connection(c_tcp_asio_node &node, boost::asio::ip::tcp::socket &&socket, const boost::asio::ip::tcp::endpoint &endpoint);
 		~c_connection();
 
+		void start(); ///< start reading; call it once, when it is in the map of node (not from constructor: no shared_ptr yet)
+		void close(); ///< shutdown and close the socket; only while no async operation runs on it (or from its handler)
+
 		/**
-		 * sends 4 size bytes(as uint32_t) and message data
+		 * queue 4 size bytes(as uint32_t) and message data for sending
 		 * consume message
+		 * If there is already s_max_send_queue_bytes waiting, blocks up to s_send_queue_timeout for place, then throws
 		 */
 		void send(std::string && message);
 
+		/// push the received message to the queue of node, then read the next one - or pause reading, if the queue is full
+		void push_or_pause();
+
+		static constexpr size_t s_max_send_queue_bytes = 16 * 1024 * 1024; ///< backpressure limit per connection
+		static constexpr size_t s_max_gather_messages = 256; ///< max messages in one async_write (2 buffers each)
+		static constexpr std::chrono::seconds s_send_queue_timeout{5};
+
 	private:
 		std::reference_wrapper<c_tcp_asio_node> m_tcp_node;
 		boost::asio::ip::tcp::socket m_socket;
+		boost::asio::ip::tcp::endpoint m_endpoint; ///< of the peer, saved when connected (remote_endpoint() throws when he is gone)
 
-		std::mutex m_streambuff_mtx;
-		boost::asio::streambuf m_streambuff; ///< always lock m_streambuff_mtx before use
-		std::ostream m_ostream; ///< always lock m_streambuff_mtx before use
+		struct t_out_message {
+			uint32_t m_size; ///< size prefix, as sent on the wire
+			std::string m_data;
+		};
 
+		std::mutex m_send_mtx;
+		std::condition_variable m_send_cv; ///< signalled when m_send_queue_bytes drops
+		std::deque<t_out_message> m_send_queue; ///< waiting for next write. always lock m_send_mtx
+		size_t m_send_queue_bytes; ///< bytes in m_send_queue and m_send_in_flight. always lock m_send_mtx
+		bool m_write_in_progress; ///< always lock m_send_mtx
+		std::vector<t_out_message> m_send_in_flight; ///< owned by the running async_write, touch only from its handler
+
+		void start_write(); ///< m_send_mtx must be locked, and no write in progress
 		void write_handler(const boost::system::error_code &error, size_t length);
 
 		uint32_t m_read_size;
 		boost::asio::streambuf m_streambuff_in;
+		c_network_message m_received; ///< read, and waiting for place in the queue of node (see push_or_pause)
+
+		void start_read(); ///< read the next message (its size first)
 
 		void read_size_handler(const boost::system::error_code &error, size_t length);
 		void read_data_handler(const boost::system::error_code &error, size_t length);
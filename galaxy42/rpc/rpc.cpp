@@ -36,7 +36,7 @@ try {
 void c_rpc_server::main_loop() {
 	assert(m_stop_flag == false);
 	while (!m_stop_flag) {
-		auto message = m_connection_node->receive();
+		auto message = m_connection_node->receive_wait(std::chrono::milliseconds(1));
 		if (!message.data.empty()) { // get RPC request
 			auto it = std::find(message.data.begin(), message.data.end(), ';');
 			if (it == message.data.end()) continue; // bad packet format (not found ';')
@@ -53,13 +53,12 @@ void c_rpc_server::main_loop() {
 				_dbg1("not found function " << command);
 			}
 		}
-		std::this_thread::sleep_for(std::chrono::milliseconds(1));
 	}
 }
 
-c_rpc_server::c_rpc_server(const unsigned int port)
+c_rpc_server::c_rpc_server(const unsigned int port, const std::string & listen_address)
 :
-	m_connection_node(std::make_unique<c_tcp_asio_node>(port)),
+	m_connection_node(std::make_unique<c_tcp_asio_node>(port, boost::asio::ip::address::from_string(listen_address))),
 	m_stop_flag(false),
 	m_work_thread(std::make_unique<std::thread>(&c_rpc_server::main_loop, this))
 {
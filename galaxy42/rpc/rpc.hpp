@@ -23,7 +23,8 @@ class c_rpc_server final {
 		std::map<std::string, std::function<bool(const std::string &)>> m_command_map;
 		std::mutex m_command_map_mtx;
 	public:
-		c_rpc_server(const unsigned int port);
+		///! commands are not authenticated: listen_address should be loopback (the default), unless the network is trusted
+		c_rpc_server(const unsigned int port, const std::string & listen_address = "127.0.0.1");
 		void register_function(const std::string &command_name, std::function<bool(const std::string &)> function);
 		~c_rpc_server();
 
@@ -0,0 +1,77 @@
+#include "gtest/gtest.h"
+#include "../c_compress.hpp"
+
+#include <random>
+#include <string>
+
+namespace {
+
+std::string make_text(size_t size) { ///< something like logs or JSON
+	std::string ret;
+	for (int i=0; ret.size() < size; ++i) ret += "{\"id\":" + std::to_string(i) + ",\"level\":\"info\",\"msg\":\"request done\"}\n";
+	return ret.substr(0, size);
+}
+
+std::string make_random(size_t size) {
+	std::mt19937 gen(42);
+	std::string ret(size, 0);
+	for (auto & c : ret) c = static_cast<char>(gen());
+	return ret;
+}
+
+} // namespace
+
+TEST(compress, lz4_round_trip) {
+	for (const std::string & data : { std::string(), std::string("abc"), std::string(1000, 'a'), make_text(1400),
+		make_random(1400), make_text(70000) })
+	{
+		const std::string compressed = tunnel_compress::lz4_compress(data.data(), data.size());
+		EXPECT_EQ(tunnel_compress::lz4_decompress(compressed.data(), compressed.size(), data.size()), data);
+	}
+	const std::string text = make_text(1400);
+	const std::string compressed = tunnel_compress::lz4_compress(text.data(), text.size());
+	EXPECT_LT(compressed.size(), text.size() / 2);
+	EXPECT_THROW(tunnel_compress::lz4_decompress(compressed.data(), compressed.size(), 100), std::invalid_argument); // too big
+	EXPECT_THROW(tunnel_compress::lz4_decompress(compressed.data(), compressed.size() / 2, 2000), std::invalid_argument);
+	const std::string bad_offset("\x04" "abcd" "\xff\x00", 7);
+	EXPECT_THROW(tunnel_compress::lz4_decompress(bad_offset.data(), bad_offset.size(), 2000), std::invalid_argument);
+}
+
+TEST(compress, entropy_estimate) {
+	const std::string text = make_text(1400), random = make_random(1400), zeros(1400, 0);
+	EXPECT_LT(tunnel_compress::entropy_estimate(text.data(), text.size()), tunnel_compress::max_entropy);
+	EXPECT_GT(tunnel_compress::entropy_estimate(random.data(), random.size()), tunnel_compress::max_entropy);
+	EXPECT_GT(tunnel_compress::entropy_estimate(random.data(), 200), tunnel_compress::max_entropy); // also small sample
+	EXPECT_EQ(tunnel_compress::entropy_estimate(zeros.data(), zeros.size()), 0);
+}
+
+TEST(compress, negotiated_per_tunnel) {
+	tunnel_compress::c_compressor alice, bob, old_node;
+	alice.set_enabled(true);
+	bob.set_enabled(true);
+	const std::string text = std::string(4, 0) + make_text(1400), random = std::string(4, 0) + make_random(1400);
+
+	// first packet: alice does not know yet if bob accepts
+	std::string wire = alice.encode(text.data(), text.size());
+	EXPECT_EQ(wire.size(), text.size());
+	EXPECT_EQ(bob.decode(wire), text);
+	EXPECT_TRUE(bob.is_peer_accepting());
+	wire = bob.encode(text.data(), text.size()); // bob compresses already
+	EXPECT_LT(wire.size(), text.size() / 2);
+	EXPECT_EQ(alice.decode(wire), text);
+	EXPECT_TRUE(alice.is_peer_accepting());
+	wire = alice.encode(random.data(), random.size()); // skipped by entropy
+	EXPECT_EQ(wire.size(), random.size());
+	EXPECT_EQ(bob.decode(wire), random);
+	EXPECT_EQ(alice.get_stats().m_bypass_entropy, 1u);
+	EXPECT_EQ(bob.get_stats().m_compressed, 1u);
+
+	// node without compression never accepts, so never gets compressed data
+	wire = old_node.encode(text.data(), text.size());
+	EXPECT_EQ(wire, text);
+	EXPECT_EQ(alice.decode(wire), text);
+	EXPECT_FALSE(alice.is_peer_accepting());
+	wire = alice.encode(text.data(), text.size());
+	EXPECT_EQ(old_node.decode(wire), text);
+	EXPECT_THROW(old_node.decode(bob.encode(text.data(), text.size())), std::invalid_argument);
+}
@@ -0,0 +1,46 @@
+#include "gtest/gtest.h"
+#include "../c_conn_ids.hpp"
+
+#include <string>
+
+TEST(conn_ids, expand_sequence) {
+	EXPECT_EQ(conn_ids::expand_sequence(100, 102), 102u);
+	EXPECT_EQ(conn_ids::expand_sequence(100, 90), 90u); // reordered, a bit older
+	EXPECT_EQ(conn_ids::expand_sequence(0xFFFFFFF0u, 0x10), 0x100000010u); // counter wrapped its lowest 32 bits
+	EXPECT_EQ(conn_ids::expand_sequence(0x100000010u, 0xFFFFFFF0u), 0xFFFFFFF0u); // and an older one from before that
+	EXPECT_EQ(conn_ids::expand_sequence(0x512345678u, 0x12345680u), 0x512345680u);
+
+	const std::string prefix(conn_ids::nonce_prefix_size, 'p');
+	const std::string nonce = conn_ids::make_nonce(prefix, 0x0102030405060708u);
+	EXPECT_EQ(nonce.size(), conn_ids::nonce_size);
+	EXPECT_EQ(conn_ids::nonce_prefix(nonce), prefix);
+	EXPECT_EQ(conn_ids::nonce_sequence(nonce), 0x0102030405060708u);
+	EXPECT_THROW(conn_ids::nonce_sequence("short"), std::invalid_argument);
+	EXPECT_EQ(conn_ids::bin_to_u32( conn_ids::u32_to_bin(0xFFFFFFFEu).data() ), 0xFFFFFFFEu);
+}
+
+TEST(conn_ids, offer_then_compact_frames) {
+	typedef conn_ids::c_conn_ids<std::string> t_ids;
+	t_ids receiver, sender;
+	auto now = t_ids::t_clock::now();
+	const std::string prefix(conn_ids::nonce_prefix_size, 'n');
+
+	EXPECT_EQ(sender.get_remote("A", "B", conn_ids::make_nonce(prefix, 2)), 0u); // no ID yet: full format
+	uint32_t id = receiver.seen_full("A", "B", conn_ids::make_nonce(prefix, 2), now);
+	ASSERT_NE(id, 0u);
+	EXPECT_EQ(receiver.seen_full("A", "B", conn_ids::make_nonce(prefix, 4), now), 0u); // offered just now
+	EXPECT_EQ(receiver.seen_full("A", "B", conn_ids::make_nonce(prefix, 6), now + std::chrono::seconds(2)), id); // again
+	EXPECT_NE(receiver.seen_full("A", "C", conn_ids::make_nonce(prefix, 2), now), id);
+
+	sender.set_remote("A", "B", prefix, id);
+	EXPECT_EQ(sender.get_remote("A", "B", conn_ids::make_nonce(prefix, 8)), id);
+	EXPECT_EQ(sender.get_remote("A", "B", conn_ids::make_nonce(std::string(conn_ids::nonce_prefix_size, 'x'), 8)), 0u);
+	EXPECT_EQ(sender.get_remote("B", "A", conn_ids::make_nonce(prefix, 8)), 0u);
+
+	std::string src, dst, nonce;
+	ASSERT_TRUE(receiver.seen_compact(id, 8, src, dst, nonce));
+	EXPECT_EQ(src, "A");  EXPECT_EQ(dst, "B");
+	EXPECT_EQ(nonce, conn_ids::make_nonce(prefix, 8));
+	EXPECT_FALSE(receiver.seen_compact(id + 100, 8, src, dst, nonce));
+	EXPECT_THROW(sender.set_remote("A", "B", prefix, 0), std::invalid_argument);
+}
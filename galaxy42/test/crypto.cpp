@@ -3,6 +3,8 @@
 #include "../crypto/ntrupp.hpp"
 #include "../crypto/sidhpp.hpp"
 #include "../crypto/crypto_basic.hpp"
+#include "../crypto/crypto_p2p.hpp"
+#include <thread>
 // ntru sign
 extern "C" {
 #include <constants.h>
@@ -164,11 +166,7 @@ TEST(crypto, ntru_sign) {
 	int64 secretkey[PASS_N];
 	int64 pubkey[PASS_N] = {0};
 	int64 z[PASS_N];
-	if(ntt_setup() == -1) {
-		fprintf(stderr,
-		"ERROR: Could not initialize FFTW. Bad wisdom?\n");
-		exit(EXIT_FAILURE);
-	}
+	ntrupp::ntt_setup_once(); // tables are kept for ntrupp functions (do not ntt_cleanup() them)
 	gen_key(secretkey);
 	unsigned char hash[HASH_BYTES];
 	crypto_hash_sha512(hash, reinterpret_cast<unsigned char*>(secretkey), sizeof(int64)*PASS_N); // necessary?
@@ -177,7 +175,6 @@ TEST(crypto, ntru_sign) {
 	ASSERT_EQ(verify(hash, z, pubkey, reinterpret_cast<const unsigned char *>(msg.data()), msg.size()), VALID);
 	z[0] = ~ z[0];
 	ASSERT_NE(verify(hash, z, pubkey, reinterpret_cast<const unsigned char *>(msg.data()), msg.size()), VALID);
-	ntt_cleanup();
 
 }
 
@@ -231,6 +228,23 @@ TEST(crypto, ntrupp_encrypt) {
 	}
 }
 
+TEST(crypto, ntrupp_drbg_per_thread) {
+	const DRBG_HANDLE main_drbg = ntrupp::get_DRBG(128);
+	EXPECT_EQ(ntrupp::get_DRBG(128), main_drbg); // long-lived, not created for each use
+	for (uint32_t i = 0; i <= ntrupp::c_thread_DRBG::reseed_after_uses; ++i) ntrupp::get_DRBG(128); // reseeds on the way
+
+	const auto keypair = ntrupp::generate_encrypt_keypair();
+	DRBG_HANDLE thread_drbg = main_drbg;
+	std::string decrypted;
+	std::thread thread([&] {
+		thread_drbg = ntrupp::get_DRBG(128);
+		decrypted = ntrupp::decrypt<std::string>( ntrupp::encrypt(std::string("msg"), keypair.second) , keypair.first );
+	});
+	thread.join();
+	EXPECT_NE(thread_drbg, main_drbg);
+	EXPECT_EQ(decrypted.substr(0, 3), "msg");
+}
+
 TEST(crypto, ntrupp_sign) {
 
 	FILE * f_ptr;
@@ -333,3 +347,56 @@ TEST(crypto, sidhpp) {
 	using namespace antinet_crypto;
 	ASSERT_EQ(alice_secret, bob_secret);
 }
+
+TEST(crypto, ct_p2p_hop_mac) {
+	antinet_crypto::c_multikeys_PAIR Alice, Bob, Eve;
+	Alice.generate(antinet_crypto::e_crypto_system_type_X25519,1);
+	Bob.generate(antinet_crypto::e_crypto_system_type_X25519,1);
+	Eve.generate(antinet_crypto::e_crypto_system_type_X25519,1);
+
+	antinet_crypto::c_crypto_p2p alice_p2p(Alice, Bob.m_pub);
+	antinet_crypto::c_crypto_p2p bob_p2p(Bob, Alice.m_pub);
+	antinet_crypto::c_crypto_p2p eve_p2p(Eve, Bob.m_pub); // Eve pretends to be Alice
+	EXPECT_TRUE(alice_p2p.is_for_them(Bob.m_pub));
+	EXPECT_FALSE(alice_p2p.is_for_them(Eve.m_pub));
+
+	const std::string header("frame-header-with-src-dst-ttl-and-nonce");
+	char mac[antinet_crypto::c_crypto_p2p::mac_size];
+	alice_p2p.write_mac(header.data(), header.size(), mac);
+	EXPECT_TRUE(bob_p2p.check_mac(header.data(), header.size(), mac));
+
+	std::string forged(header); forged.at(5) ^= 1;
+	EXPECT_FALSE(bob_p2p.check_mac(forged.data(), forged.size(), mac));
+
+	eve_p2p.write_mac(header.data(), header.size(), mac);
+	EXPECT_FALSE(bob_p2p.check_mac(header.data(), header.size(), mac));
+
+	EXPECT_EQ(bob_p2p.get_count_ok(), 1u);
+	EXPECT_EQ(bob_p2p.get_count_bad(), 2u);
+}
+
+TEST(crypto, ct_p2p_hop_mac_of_whole_frame) {
+	antinet_crypto::c_multikeys_PAIR Alice, Bob;
+	Alice.generate(antinet_crypto::e_crypto_system_type_X25519,1);
+	Bob.generate(antinet_crypto::e_crypto_system_type_X25519,1);
+	antinet_crypto::c_crypto_p2p alice_p2p(Alice, Bob.m_pub);
+	antinet_crypto::c_crypto_p2p bob_p2p(Bob, Alice.m_pub);
+
+	std::string frame("frame-header-with-src-dst-ttl-and-nonce"); // as in c_peering_udp::prepare_data_udp
+	frame += std::string(1000, 'd'); // the blob (CT-E2E data)
+	char mac[antinet_crypto::c_crypto_p2p::mac_size];
+	alice_p2p.write_mac(frame.data(), frame.size(), mac);
+	frame += std::string(mac, sizeof(mac));
+	EXPECT_TRUE(bob_p2p.check_frame(frame.data(), frame.size()));
+
+	std::string tampered(frame); tampered.at(500) ^= 1; // a hop changed the payload, but not the header
+	EXPECT_FALSE(bob_p2p.check_frame(tampered.data(), tampered.size()));
+	tampered = frame; tampered.at(frame.size() - sizeof(mac) - 1) ^= 1; // last byte of payload
+	EXPECT_FALSE(bob_p2p.check_frame(tampered.data(), tampered.size()));
+	tampered = frame; tampered.erase(100, 1); // payload cut
+	EXPECT_FALSE(bob_p2p.check_frame(tampered.data(), tampered.size()));
+	EXPECT_FALSE(bob_p2p.check_frame(frame.data(), sizeof(mac) - 1)); // too short for a MAC
+
+	EXPECT_EQ(bob_p2p.get_count_ok(), 1u);
+	EXPECT_EQ(bob_p2p.get_count_bad(), 4u);
+}
@@ -0,0 +1,232 @@
+#include "gtest/gtest.h"
+#include "../c_dht.hpp"
+
+#include <array>
+#include <deque>
+#include <random>
+
+namespace {
+
+typedef std::array<unsigned char, 16> t_id;
+typedef dht::c_dht<t_id, std::string> t_dht; // locator is the node number, as text
+
+/// many nodes, each knows only a few others at start; messages are delivered in order, at once
+struct c_sim_net {
+	std::vector<std::unique_ptr<t_dht>> m_nodes;
+	std::vector<t_id> m_ids;
+	std::deque<std::tuple<size_t, size_t, t_dht::t_message_type>> m_queue; ///< from, to, message
+	std::vector<bool> m_down;
+	t_dht::t_clock::time_point m_now = t_dht::t_clock::now();
+
+	/// with_cookies: nodes require return routability (see dht::e_msg::cookie)
+	c_sim_net(size_t count, unsigned int seed, bool with_cookies=false) : m_down(count, false) {
+		std::mt19937 gen(seed);
+		std::uniform_int_distribution<int> byte(0, 255);
+		for (size_t i=0; i<count; ++i) {
+			t_id id;
+			for (auto & b : id) b = static_cast<unsigned char>(byte(gen));
+			m_ids.push_back(id);
+			auto send = [this, i](const std::string & to, const t_dht::t_message_type & msg) {
+				// through the wire format, as it would be sent
+				m_queue.emplace_back(i, std::stoul(to), dht::message_from_bin<t_id, std::string>( dht::message_to_bin(msg) ));
+			};
+			auto check = [](const t_id & key, const std::string & value) { return value == "record of " + std::to_string(key[0]); };
+			auto cookie = [i](const std::string & from) { return static_cast<uint32_t>( 1 + (std::stoul(from) * 7919 + i) % 1000 ); };
+			m_nodes.emplace_back( new t_dht(id, send, check, with_cookies ? t_dht::t_cookie_func(cookie) : nullptr) );
+		}
+		std::uniform_int_distribution<size_t> any(0, count-1);
+		for (size_t i=0; i<count; ++i) {
+			for (int j=0; j<3; ++j) {
+				const size_t other = any(gen);
+				m_nodes[i]->add_contact( t_dht::t_contact_type{ m_ids[other] , std::to_string(other) } );
+			}
+		}
+	}
+
+	void run() {
+		while (! m_queue.empty()) {
+			auto item = std::move(m_queue.front());
+			m_queue.pop_front();
+			if (m_down[std::get<1>(item)]) continue;
+			m_nodes[std::get<1>(item)]->receive(std::to_string(std::get<0>(item)), std::get<2>(item), m_now);
+		}
+		m_now += dht::c_dht<t_id, std::string>::query_timeout + std::chrono::milliseconds(1);
+		for (size_t i=0; i<m_nodes.size(); ++i) if (! m_down[i]) m_nodes[i]->tick(m_now); // timeouts of nodes that are down
+		if (! m_queue.empty()) run();
+	}
+
+	uint64_t count_sent() const {
+		uint64_t ret = 0;
+		for (const auto & node : m_nodes) ret += node->get_count_sent();
+		return ret;
+	}
+};
+
+} // namespace
+
+TEST(dht, message_codec) {
+	t_dht::t_message_type msg{ dht::e_msg::nodes , 0xFFFFFFFE , t_id() , t_id() , "" , { } , 0 };
+	msg.m_key[3] = 7;
+	msg.m_contacts.push_back( t_dht::t_contact_type{ t_id() , "192.168.1.2" } );
+	const auto decoded = dht::message_from_bin<t_id, std::string>( dht::message_to_bin(msg) );
+	EXPECT_EQ(decoded.m_txid, msg.m_txid);
+	EXPECT_EQ(decoded.m_key, msg.m_key);
+	ASSERT_EQ(decoded.m_contacts.size(), 1u);
+	EXPECT_EQ(decoded.m_contacts.at(0).m_locator, "192.168.1.2");
+
+	std::string bad = dht::message_to_bin(msg);
+	EXPECT_ANY_THROW( (dht::message_from_bin<t_id, std::string>( bad + "x" )) );
+	bad[0] = 99;
+	EXPECT_ANY_THROW( (dht::message_from_bin<t_id, std::string>( bad )) );
+
+	t_id a{}, b{}, target{};
+	a[0] = 0x01;  b[0] = 0x80;
+	EXPECT_TRUE( dht::is_closer(a, b, target) );
+	EXPECT_EQ( dht::common_prefix_bits(a, target), 7 );
+	EXPECT_EQ( dht::common_prefix_bits(target, target), 128 );
+}
+
+TEST(dht, cookie_before_big_reply) {
+	t_id id_a{}, id_b{};
+	id_a[0] = 1;  id_b[0] = 2;
+	std::vector<t_dht::t_message_type> sent; // by node B
+	auto check = [](const t_id &, const std::string &) { return true; };
+	t_dht node_b(id_b, [&](const std::string &, const t_dht::t_message_type & msg) { sent.push_back(msg); }, check,
+		[](const std::string & from) { return from == "A" ? 1234u : 99u; });
+	for (unsigned char i=10; i<40; ++i) { t_id other{};  other[0] = i;  node_b.add_contact( t_dht::t_contact_type{ other , "x" } ); }
+
+	t_dht::t_message_type request{ dht::e_msg::find_node , 5 , id_a , t_id() , "" , { } , 0 };
+	node_b.receive("A", request, t_dht::t_clock::now()); // maybe it is not from A at all
+	ASSERT_EQ(sent.size(), 1u);
+	EXPECT_EQ(sent.at(0).m_type, dht::e_msg::cookie);
+	EXPECT_EQ(sent.at(0).m_cookie, 1234u);
+	EXPECT_EQ(dht::message_to_bin(sent.at(0)).size(), dht::message_to_bin(request).size()); // no amplification
+	EXPECT_EQ(node_b.get_routing_table().size(), 30u); // not added yet
+
+	request.m_cookie = 1234; // A got it, so he gets data at this address
+	node_b.receive("A", request, t_dht::t_clock::now());
+	ASSERT_EQ(sent.size(), 2u);
+	EXPECT_EQ(sent.at(1).m_type, dht::e_msg::nodes);
+	EXPECT_EQ(sent.at(1).m_contacts.size(), dht::k_bucket_size);
+	EXPECT_EQ(node_b.get_routing_table().size(), 31u);
+}
+
+TEST(dht, too_many_lookups) {
+	t_dht node(t_id(), [](const std::string &, const t_dht::t_message_type &) { },
+		[](const t_id &, const std::string &) { return true; });
+	t_id other{};  other[0] = 1;
+	node.add_contact( t_dht::t_contact_type{ other , "1" } ); // never replies, so lookups are running till timeout
+	const auto now = t_dht::t_clock::now();
+	size_t found = 0;
+	const auto on_found = [&found](const t_id &, const std::string &, const std::vector<t_dht::t_contact_type> &) { ++found; };
+	for (size_t i=0; i<t_dht::max_lookups; ++i) {
+		t_id key{};  key[0] = static_cast<unsigned char>(i);  key[1] = static_cast<unsigned char>(i >> 8);  key[2] = 1;
+		EXPECT_TRUE(node.find_value(key, on_found, now));
+	}
+	t_id key{};  key[3] = 1;
+	EXPECT_FALSE(node.find_value(key, on_found, now));
+	t_id running{};  running[2] = 1; // the same key as a running lookup: waits for it, but not too many
+	for (size_t i=1; i<t_dht::max_found_per_lookup; ++i) EXPECT_TRUE(node.find_value(running, on_found, now));
+	EXPECT_FALSE(node.find_value(running, on_found, now));
+
+	node.tick(now + t_dht::query_timeout + std::chrono::milliseconds(1)); // all fail
+	EXPECT_EQ(found, t_dht::max_lookups + t_dht::max_found_per_lookup - 1);
+	EXPECT_TRUE(node.find_value(key, on_found, now));
+}
+
+TEST(dht, next_tick_time) {
+	t_dht node(t_id(), [](const std::string &, const t_dht::t_message_type &) { },
+		[](const t_id &, const std::string &) { return true; });
+	const auto start = t_dht::t_clock::now();
+	EXPECT_LE(node.next_tick_time(), start); // the first publish is due at once
+	node.tick(start);
+	EXPECT_EQ(node.next_tick_time(), start + t_dht::republish_interval); // nothing else to do
+
+	t_id other{};  other[0] = 1;
+	node.add_contact( t_dht::t_contact_type{ other , "1" } ); // never replies
+	const auto asked = start + std::chrono::seconds(1);
+	t_id key{};  key[0] = 2;
+	EXPECT_TRUE(node.find_value(key, [](const t_id &, const std::string &, const std::vector<t_dht::t_contact_type> &) { }, asked));
+	EXPECT_EQ(node.next_tick_time(), asked + t_dht::query_timeout); // the query times out then
+	node.tick(asked + t_dht::query_timeout);
+	EXPECT_EQ(node.next_tick_time(), start + t_dht::republish_interval);
+
+	const auto stored = start + std::chrono::seconds(2); // a record from other node
+	node.receive("1", t_dht::t_message_type{ dht::e_msg::store , 1 , other , key , "value" , { } , 0 }, stored);
+	ASSERT_EQ(node.get_local(key), "value");
+	EXPECT_EQ(node.next_tick_time(), start + t_dht::republish_interval);
+	for (int i=1; i<=2; ++i) { // record_ttl is 2 republish_interval: the record is kept till then
+		node.tick(start + t_dht::republish_interval * i);
+		EXPECT_NO_THROW(node.get_local(key));
+	}
+	EXPECT_EQ(node.next_tick_time(), stored + t_dht::record_ttl); // it is dropped then
+	node.tick(stored + t_dht::record_ttl + std::chrono::milliseconds(1));
+	EXPECT_THROW(node.get_local(key), expected_not_found);
+	EXPECT_EQ(node.next_tick_time(), start + t_dht::republish_interval * 3);
+}
+
+TEST(dht, lookup_with_cookies) {
+	const size_t count = 200;
+	c_sim_net net(count, 7, true);
+	for (size_t i=0; i<count; ++i) { net.m_nodes[i]->bootstrap(net.m_now);  net.run(); }
+	const t_id key = net.m_ids[50];
+	const std::string record = "record of " + std::to_string(key[0]);
+	net.m_nodes[50]->publish(key, record, net.m_now);
+	net.run();
+	for (size_t asking : { 3u, 77u, 150u }) {
+		std::string found = "none";
+		net.m_nodes[asking]->find_value(key, [&](const t_id &, const std::string & value, const std::vector<t_dht::t_contact_type> &) {
+			found = value;  }, net.m_now);
+		net.run();
+		EXPECT_EQ(found, record);
+	}
+}
+
+TEST(dht, lookup_in_big_network) {
+	const size_t count = 500;
+	c_sim_net net(count, 42);
+	for (size_t i=0; i<count; ++i) { net.m_nodes[i]->bootstrap(net.m_now);  net.run(); }
+
+	const t_id key = net.m_ids[123];
+	const std::string record = "record of " + std::to_string(key[0]);
+	net.m_nodes[123]->publish(key, record, net.m_now);
+	net.run();
+	size_t stored = 0;
+	for (const auto & node : net.m_nodes) {
+		try { node->get_local(key);  ++stored; } catch(const expected_not_found &) { }
+	}
+	EXPECT_GE(stored, dht::k_bucket_size);
+
+	std::mt19937 gen(1);
+	std::uniform_int_distribution<size_t> any(0, count-1);
+	for (int i=0; i<20; ++i) {
+		const size_t asking = any(gen);
+		const auto sent_before = net.count_sent();
+		std::string found = "none";
+		std::vector<t_dht::t_contact_type> nearest;
+		net.m_nodes[asking]->find_value(key, [&](const t_id &, const std::string & value, const std::vector<t_dht::t_contact_type> & n) {
+			found = value;  nearest = n;  }, net.m_now);
+		net.run();
+		EXPECT_EQ(found, record);
+		EXPECT_LT(net.count_sent() - sent_before, 60u); // O(log N), not O(N)
+	}
+
+	// a node that is not there is not found, but we learn the nearest ones, and the lookup ends even if some nodes are down
+	for (size_t i=0; i<count; i+=5) net.m_down[i] = true;
+	t_id missing = key;
+	missing[15] ^= 1;
+	std::string found = "none";
+	std::vector<t_dht::t_contact_type> nearest;
+	net.m_nodes[1]->find_value(missing, [&](const t_id &, const std::string & value, const std::vector<t_dht::t_contact_type> & n) {
+		found = value;  nearest = n;  }, net.m_now);
+	net.run();
+	EXPECT_EQ(found, "");
+	ASSERT_FALSE(nearest.empty());
+	EXPECT_EQ(nearest.at(0).m_id, key); // the node 123 itself
+	EXPECT_EQ(nearest.at(0).m_locator, "123");
+
+	// bad record is not stored
+	net.m_nodes[7]->publish(missing, "fake", net.m_now);
+	net.run();
+	EXPECT_THROW(net.m_nodes[1]->get_local(missing), expected_not_found);
+}
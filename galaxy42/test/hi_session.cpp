@@ -0,0 +1,78 @@
+#include "gtest/gtest.h"
+#include "../c_hi_session.hpp"
+
+namespace {
+
+typedef hi_session::t_clock t_clock;
+
+} // namespace
+
+TEST(hi_session, full_hi_until_confirmed) {
+	hi_session::c_hi_session session;
+	auto now = t_clock::now();
+	EXPECT_TRUE(session.need_full_hi(now));
+	EXPECT_FALSE(session.keepalive_received(1234, 1, now)); // no HI from him yet
+
+	EXPECT_TRUE(session.hi_received(1234)); // his first HI
+	EXPECT_FALSE(session.hi_received(1234)); // the same session again
+	EXPECT_TRUE(session.need_full_hi(now)); // he did not confirm ours yet
+
+	EXPECT_TRUE(session.keepalive_received(1234, 1, now));
+	EXPECT_FALSE(session.need_full_hi(now)); // only keepalives from now
+	EXPECT_FALSE(session.need_full_hi(now + hi_session::c_hi_session::established_timeout));
+	now += std::chrono::seconds(3);
+	EXPECT_TRUE(session.keepalive_received(1234, 2, now));
+	EXPECT_FALSE(session.need_full_hi(now + std::chrono::seconds(20)));
+
+	// nothing from him for too long: maybe he lost our HI
+	EXPECT_TRUE(session.need_full_hi(now + hi_session::c_hi_session::established_timeout + std::chrono::seconds(1)));
+}
+
+TEST(hi_session, replay_and_restart) {
+	hi_session::c_hi_session session;
+	const auto now = t_clock::now();
+	session.hi_received(1234);
+	EXPECT_TRUE(session.keepalive_received(1234, 5, now));
+	EXPECT_FALSE(session.keepalive_received(1234, 5, now)); // replayed
+	EXPECT_FALSE(session.keepalive_received(1234, 4, now)); // older
+	EXPECT_FALSE(session.keepalive_received(999, 6, now)); // other session
+
+	EXPECT_TRUE(session.hi_received(5678)); // he restarted
+	EXPECT_TRUE(session.need_full_hi(now)); // he lost our HI
+	EXPECT_FALSE(session.keepalive_received(1234, 6, now)); // from the old session
+	EXPECT_TRUE(session.keepalive_received(5678, 1, now)); // counter starts again
+	EXPECT_FALSE(session.need_full_hi(now));
+
+	hi_session::c_hi_session old_peer; // sends no session ID (0), and no keepalives: gets full HI always
+	old_peer.hi_received(0);
+	EXPECT_FALSE(old_peer.keepalive_received(0, 1, now));
+	EXPECT_TRUE(old_peer.need_full_hi(now));
+}
+
+TEST(hi_session, restart_confirmed_by_keepalive) {
+	hi_session::c_hi_session session;
+	const auto now = t_clock::now();
+	session.hi_received(1234);
+	EXPECT_TRUE(session.keepalive_received(1234, 1, now));
+	EXPECT_FALSE(session.pop_restart_confirmed()); // first session, nothing to restart
+
+	EXPECT_TRUE(session.hi_received(5678)); // he restarted (or someone resent his HI with other ID)
+	EXPECT_FALSE(session.pop_restart_confirmed()); // not yet authenticated
+	EXPECT_FALSE(session.keepalive_received(1234, 2, now));
+	EXPECT_FALSE(session.pop_restart_confirmed());
+	EXPECT_TRUE(session.keepalive_received(5678, 1, now));
+	EXPECT_TRUE(session.pop_restart_confirmed());
+	EXPECT_FALSE(session.pop_restart_confirmed()); // only once
+	EXPECT_TRUE(session.keepalive_received(5678, 2, now));
+	EXPECT_FALSE(session.pop_restart_confirmed());
+}
+
+TEST(hi_session, counters) {
+	hi_session::c_hi_session session;
+	EXPECT_EQ(session.next_keepalive_counter(), 1u);
+	EXPECT_EQ(session.next_keepalive_counter(), 2u);
+	session.full_hi_sent();
+	EXPECT_EQ(session.get_count_full_hi(), 1u);
+	EXPECT_NE(hi_session::generate_session_id(), 0u);
+	EXPECT_NE(hi_session::generate_session_id(), hi_session::generate_session_id());
+}
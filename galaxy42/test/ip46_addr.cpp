@@ -0,0 +1,55 @@
+#include "gtest/gtest.h"
+#include "../c_ip46_addr.hpp"
+
+#include <cstring>
+
+TEST(ip46_addr, sockaddr_round_trip) {
+	for (const auto & addr : { c_ip46_addr::create_ipv4("192.168.1.62", 9042) , c_ip46_addr::create_ipv6("2001:db8::42", 9043) }) {
+		sockaddr_storage raw;
+		socklen_t raw_len = addr.get_sockaddr(raw);
+		EXPECT_EQ(raw_len, (addr.get_ip_type() == c_ip46_addr::tag_ipv4) ? sizeof(sockaddr_in) : sizeof(sockaddr_in6));
+		c_ip46_addr back;
+		back.set_sockaddr(reinterpret_cast<sockaddr*>(&raw), raw_len);
+		EXPECT_EQ(back, addr);
+		EXPECT_EQ(back.get_assign_port(), addr.get_assign_port());
+	}
+	c_ip46_addr none;
+	sockaddr_storage raw;
+	EXPECT_THROW(none.get_sockaddr(raw), std::invalid_argument);
+}
+
+TEST(ip46_addr, v4_mapped_is_ipv4) {
+	sockaddr_in6 in6;
+	std::memset(&in6, 0, sizeof(in6));
+	in6.sin6_family = AF_INET6;
+	in6.sin6_port = htons(9042);
+	inet_pton(AF_INET6, "::ffff:192.168.1.62", &in6.sin6_addr); // as seen on dual-stack socket
+	c_ip46_addr addr;
+	addr.set_sockaddr(reinterpret_cast<sockaddr*>(&in6), sizeof(in6));
+	EXPECT_EQ(addr.get_ip_type(), c_ip46_addr::tag_ipv4);
+	EXPECT_EQ(addr, c_ip46_addr::create_ipv4("192.168.1.62", 9042));
+	EXPECT_EQ(addr.get_assign_port(), 9042);
+
+	sockaddr unknown;
+	std::memset(&unknown, 0, sizeof(unknown));
+	unknown.sa_family = AF_UNIX;
+	EXPECT_THROW(addr.set_sockaddr(&unknown, sizeof(unknown)), std::invalid_argument);
+}
+
+TEST(ip46_addr, serialize) {
+	for (const auto & addr : { c_ip46_addr::create_ipv4("10.1.2.3", 65535) , c_ip46_addr::create_ipv6("fd42::1", 9042) }) {
+		trivialserialize::generator gen(30);
+		gen.push_object(addr);
+		const std::string bin = gen.str();
+		trivialserialize::parser parser( trivialserialize::parser::tag_caller_must_keep_this_string_valid() , bin );
+		const c_ip46_addr back = parser.pop_object<c_ip46_addr>();
+		EXPECT_EQ(back, addr);
+		EXPECT_EQ(back.get_assign_port(), addr.get_assign_port());
+		EXPECT_TRUE(parser.is_end());
+	}
+	trivialserialize::generator gen(30);
+	EXPECT_THROW(gen.push_object(c_ip46_addr()), std::invalid_argument);
+	const std::string bad("\x05\x01", 2);
+	trivialserialize::parser parser( trivialserialize::parser::tag_caller_must_keep_this_string_valid() , bad );
+	EXPECT_THROW(parser.pop_object<c_ip46_addr>(), std::invalid_argument);
+}
@@ -0,0 +1,121 @@
+#include "gtest/gtest.h"
+#include "../c_keystore.hpp"
+
+#include <unistd.h>
+
+namespace {
+
+keystore::t_hip make_hip(int nr) {
+	keystore::t_hip hip;
+	hip.fill(0);
+	hip.at(0) = 0xFD;  hip.at(1) = 0x42;
+	for (int i=0; i<4; ++i) hip.at(15-i) = static_cast<unsigned char>(nr >> (8*i));
+	return hip;
+}
+
+std::string make_pubkey(int nr) { return "pubkey-" + std::to_string(nr) + std::string(nr % 100, 'k'); }
+
+/// path of keystore in temporary dir, removed at the end
+class c_temp_keystore_path {
+	public:
+		c_temp_keystore_path() : m_dir( fs::temp_directory_path() / fs::unique_path("keystore-test-%%%%-%%%%") ) { }
+		~c_temp_keystore_path() { fs::remove_all(m_dir); }
+		fs::path get() const { return m_dir / "keystore"; }
+	private:
+		const fs::path m_dir;
+};
+
+} // namespace
+
+TEST(keystore, put_get_reopen) {
+	c_temp_keystore_path path;
+	const int count = 3000; // index grows a few times
+	{
+		keystore::c_keystore store( path.get() , keystore::c_keystore::e_sync::by_caller ); // no fdatasync for each put
+		EXPECT_EQ(store.size(), 0u);
+		EXPECT_FALSE(store.has(e_filestore_galaxy_pub, make_hip(1)));
+		EXPECT_THROW(store.get(e_filestore_galaxy_pub, make_hip(1)), expected_not_found);
+		for (int i=0; i<count; ++i) store.put(e_filestore_galaxy_pub, make_hip(i), make_pubkey(i));
+		store.put(e_filestore_galaxy_pub, make_hip(7), "newer"); // replaces
+		store.put_mlocked(e_filestore_galaxy_wallet_PRV, make_hip(7), sodiumpp::locked_string(std::string("secret")));
+		EXPECT_EQ(store.size(), size_t(count) + 1);
+		EXPECT_EQ(store.get(e_filestore_galaxy_pub, make_hip(7)).to_string(), "newer");
+		EXPECT_EQ(store.get(e_filestore_galaxy_pub, make_hip(100)).to_string(), make_pubkey(100));
+		store.sync();
+	}
+	keystore::c_keystore store( path.get() );
+	EXPECT_EQ(store.size(), size_t(count) + 1);
+	for (int i=0; i<count; ++i) {
+		if (i == 7) continue;
+		ASSERT_EQ(store.get(e_filestore_galaxy_pub, make_hip(i)).to_string(), make_pubkey(i));
+	}
+	EXPECT_EQ(store.get(e_filestore_galaxy_pub, make_hip(7)).to_string(), "newer");
+	const auto secret = store.get_mlocked(e_filestore_galaxy_wallet_PRV, make_hip(7));
+	EXPECT_EQ(std::string(secret.c_str(), secret.size()), "secret");
+	EXPECT_FALSE(store.has(e_filestore_galaxy_wallet_PRV, make_hip(8)));
+}
+
+TEST(keystore, recovery) {
+	c_temp_keystore_path path;
+	uintmax_t good_size;
+	{
+		keystore::c_keystore store( path.get() );
+		for (int i=0; i<10; ++i) store.put(e_filestore_galaxy_pub, make_hip(i), make_pubkey(i));
+		good_size = fs::file_size( path.get() );
+		store.put(e_filestore_galaxy_pub, make_hip(10), make_pubkey(10));
+	}
+	fs::resize_file( path.get() , fs::file_size( path.get() ) - 3 ); // last record was not fully written
+	fs::remove( path.get().native() + ".idx" ); // and index is lost
+	{
+		keystore::c_keystore store( path.get() ); // index is rebuilt, damaged end cut off
+		EXPECT_EQ(store.size(), 10u);
+		EXPECT_EQ(fs::file_size( path.get() ), good_size);
+		EXPECT_EQ(store.get(e_filestore_galaxy_pub, make_hip(9)).to_string(), make_pubkey(9));
+		EXPECT_FALSE(store.has(e_filestore_galaxy_pub, make_hip(10)));
+		store.put(e_filestore_galaxy_pub, make_hip(10), make_pubkey(10));
+	}
+	keystore::c_keystore store( path.get() );
+	EXPECT_EQ(store.get(e_filestore_galaxy_pub, make_hip(10)).to_string(), make_pubkey(10));
+
+	std::ofstream( path.get().native() + ".bad" ) << "not a keystore";
+	EXPECT_THROW(keystore::c_keystore( path.get().native() + ".bad" ), std::runtime_error);
+}
+
+TEST(keystore, compaction) {
+	c_temp_keystore_path path;
+	const std::string big(1000, 'x');
+	{
+		keystore::c_keystore store( path.get() , keystore::c_keystore::e_sync::by_caller );
+		for (int i=0; i<10; ++i) store.put(e_filestore_galaxy_pub, make_hip(i), make_pubkey(i));
+		for (int i=0; i<3000; ++i) store.put(e_filestore_galaxy_pub, make_hip(100), big + std::to_string(i)); // old ones are garbage
+		EXPECT_LT(store.get_data_size(), 2*keystore::c_keystore::compact_min_size);
+		EXPECT_EQ(store.size(), 11u);
+		EXPECT_EQ(store.get(e_filestore_galaxy_pub, make_hip(100)).to_string(), big + "2999");
+		store.compact();
+		EXPECT_LT(store.get_data_size(), 2*big.size());
+	}
+	keystore::c_keystore store( path.get() );
+	EXPECT_EQ(store.size(), 11u);
+	for (int i=0; i<10; ++i) EXPECT_EQ(store.get(e_filestore_galaxy_pub, make_hip(i)).to_string(), make_pubkey(i));
+	EXPECT_EQ(store.get(e_filestore_galaxy_pub, make_hip(100)).to_string(), big + "2999");
+	EXPECT_FALSE(fs::exists( path.get().native() + ".new" ));
+}
+
+TEST(keystore, max_keys) {
+	c_temp_keystore_path path;
+	const size_t max_keys = 100;
+	{
+		keystore::c_keystore store( path.get() , keystore::c_keystore::e_sync::by_caller );
+		store.set_max_keys(max_keys);
+		for (int i=0; i<1000; ++i) {
+			store.put(e_filestore_galaxy_pub, make_hip(i), make_pubkey(i));
+			ASSERT_LE(store.size(), max_keys + max_keys/8);
+		}
+		EXPECT_FALSE(store.has(e_filestore_galaxy_pub, make_hip(0))); // the oldest are dropped
+		EXPECT_EQ(store.get(e_filestore_galaxy_pub, make_hip(999)).to_string(), make_pubkey(999));
+	}
+	keystore::c_keystore store( path.get() );
+	EXPECT_LE(store.size(), max_keys + max_keys/8);
+	EXPECT_GE(store.size(), max_keys);
+	for (int i=1000-max_keys; i<1000; ++i) EXPECT_EQ(store.get(e_filestore_galaxy_pub, make_hip(i)).to_string(), make_pubkey(i));
+}
@@ -0,0 +1,58 @@
+#include "gtest/gtest.h"
+#include "../c_latency.hpp"
+
+#include <sstream>
+
+TEST(latency, histogram_buckets) {
+	typedef latency::c_histogram t_hist;
+	for (uint64_t value=0; value<t_hist::sub_bucket_count; ++value) EXPECT_EQ(t_hist::highest_of( t_hist::index_of(value) ), value);
+	uint64_t prev_highest = t_hist::highest_of( t_hist::index_of(0) );
+	for (size_t index=1; index<t_hist::bucket_count; ++index) { // buckets follow each other, with no gaps
+		EXPECT_EQ(t_hist::index_of( prev_highest + 1 ), index);
+		EXPECT_EQ(t_hist::index_of( t_hist::highest_of(index) ), index);
+		prev_highest = t_hist::highest_of(index);
+	}
+	EXPECT_EQ(prev_highest, std::numeric_limits<uint64_t>::max());
+	for (uint64_t value : { 17ull , 1000ull , 123456789ull , 1ull << 50 }) { // relative error
+		EXPECT_LE(t_hist::highest_of( t_hist::index_of(value) ) - value, value / t_hist::sub_bucket_count);
+	}
+}
+
+TEST(latency, histogram_percentiles) {
+	latency::c_histogram hist;
+	EXPECT_EQ(hist.get_percentile(50), 0u);
+	for (uint64_t value=1; value<=1000; ++value) hist.record(value * 1000);
+	EXPECT_EQ(hist.get_count(), 1000u);
+	EXPECT_EQ(hist.get_max(), 1000u * 1000);
+	EXPECT_NEAR(hist.get_mean(), 500500, 1);
+	EXPECT_NEAR(hist.get_percentile(50), 500000, 500000 / 16);
+	EXPECT_NEAR(hist.get_percentile(99), 990000, 990000 / 16);
+	EXPECT_EQ(hist.get_percentile(100), 1000u * 1000);
+	hist.reset();
+	EXPECT_EQ(hist.get_count(), 0u);
+	EXPECT_EQ(hist.get_percentile(99), 0u);
+}
+
+TEST(latency, sampled_trace) {
+	latency::c_stages stages(4);
+	latency::c_trace trace(stages);
+	for (int i=0; i<100; ++i) {
+		trace.start( latency::c_stages::t_clock::now() );
+		trace.mark( latency::e_stage::tun_read );
+		trace.mark_idle();
+		trace.mark( latency::e_stage::tun_box );
+		trace.stop();
+		trace.mark( latency::e_stage::route ); // after stop: nothing
+	}
+	EXPECT_EQ(stages.get( latency::e_stage::tun_read ).get_count(), 25u);
+	EXPECT_EQ(stages.get( latency::e_stage::tun_box ).get_count(), 25u);
+	EXPECT_EQ(stages.get( latency::e_stage::route ).get_count(), 0u);
+	std::ostringstream oss;
+	stages.print(oss);
+	EXPECT_NE(oss.str().find("tun_box"), std::string::npos);
+
+	stages.set_sample_every(0);
+	trace.start( latency::c_stages::t_clock::now() );
+	trace.mark( latency::e_stage::tun_read );
+	EXPECT_EQ(stages.get( latency::e_stage::tun_read ).get_count(), 25u);
+}
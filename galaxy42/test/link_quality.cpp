@@ -0,0 +1,85 @@
+#include "gtest/gtest.h"
+#include "../c_link_quality.hpp"
+
+namespace {
+
+typedef link_quality::c_link_quality::t_clock t_clock;
+
+/// pings each second, answered after rtt (if answer is true); returns count of replies that were accepted
+int run_pings(link_quality::c_link_quality & link, t_clock::time_point & now, int count, std::chrono::milliseconds rtt,
+	bool answer=true)
+{
+	int accepted = 0;
+	for (int i=0; i<count; ++i) {
+		const uint32_t seq = link.ping_to_send(now);
+		EXPECT_NE(seq, 0u);
+		if (answer && link.pong_received(seq, now + rtt)) ++accepted;
+		now += link_quality::c_link_quality::ping_interval;
+	}
+	return accepted;
+}
+
+} // namespace
+
+TEST(link_quality, rtt_and_cost) {
+	link_quality::c_link_quality fast, slow;
+	auto now = t_clock::now();
+	EXPECT_FALSE(fast.is_measured());
+	EXPECT_EQ(fast.get_cost(), slow.get_cost()); // nothing known yet
+	EXPECT_EQ(run_pings(fast, now, 50, std::chrono::milliseconds(5)), 50);
+	EXPECT_EQ(run_pings(slow, now, 50, std::chrono::milliseconds(200)), 50);
+
+	EXPECT_TRUE(fast.is_measured());
+	EXPECT_NEAR(fast.get_rtt().count(), 5000, 100);
+	EXPECT_NEAR(slow.get_rtt().count(), 200000, 1000);
+	EXPECT_LT(fast.get_jitter().count(), 100); // stable link
+	EXPECT_NEAR(fast.get_loss(), 0, 0.001);
+	EXPECT_EQ(fast.get_cost(), link_quality::c_link_quality::hop_cost + 1);
+	EXPECT_GT(slow.get_cost(), 4 * link_quality::c_link_quality::hop_cost);
+	EXPECT_GT(fast.get_weight(), 3 * slow.get_weight());
+
+	EXPECT_NE(fast.ping_to_send(now), 0u);
+	EXPECT_EQ(fast.ping_to_send(now + std::chrono::milliseconds(10)), 0u); // interval is kept
+	EXPECT_FALSE(fast.pong_received(12345, now)); // not our ping
+}
+
+TEST(link_quality, loss_makes_peer_worse) {
+	link_quality::c_link_quality link;
+	auto now = t_clock::now();
+	run_pings(link, now, 20, std::chrono::milliseconds(20));
+	const int good_cost = link.get_cost();
+	const double good_weight = link.get_weight();
+
+	const uint32_t seq = link.ping_to_send(now);
+	now += link_quality::c_link_quality::ping_interval;
+	run_pings(link, now, 20, std::chrono::milliseconds(20), false); // peer is gone
+	EXPECT_FALSE(link.pong_received(seq, now)); // too late, already counted as lost
+	EXPECT_GT(link.get_loss(), 0.5);
+	EXPECT_GT(link.get_cost(), good_cost + link_quality::c_link_quality::hop_cost);
+	EXPECT_LE(link.get_cost(), link_quality::c_link_quality::max_cost);
+	EXPECT_LT(link.get_weight(), good_weight / 2);
+
+	run_pings(link, now, 100, std::chrono::milliseconds(20)); // and back again
+	EXPECT_LT(link.get_loss(), 0.01);
+	EXPECT_NEAR(link.get_cost(), good_cost, 1);
+}
+
+TEST(link_quality, dead_link) {
+	link_quality::c_link_quality link;
+	auto now = t_clock::now();
+	EXPECT_FALSE(link.is_dead()); // nothing known yet
+	run_pings(link, now, link_quality::c_link_quality::dead_lost_in_row, std::chrono::milliseconds(20), false); // sent...
+	run_pings(link, now, 3, std::chrono::milliseconds(20), false); // ...and after ping_timeout counted as lost: never answered
+	EXPECT_TRUE(link.is_dead());
+	EXPECT_LE(link.get_cost(), link_quality::c_link_quality::max_cost); // the cost alone does not show it
+	EXPECT_EQ(run_pings(link, now, 1, std::chrono::milliseconds(20)), 1);
+	EXPECT_FALSE(link.is_dead()); // answers again
+
+	link_quality::c_link_quality lossy;
+	run_pings(lossy, now, 20, std::chrono::milliseconds(20));
+	for (int i=0; i<200; ++i) { // 1 of 20 pings is answered
+		run_pings(lossy, now, 1, std::chrono::milliseconds(20), (i % 20) == 0);
+	}
+	EXPECT_GE(lossy.get_loss(), link_quality::c_link_quality::dead_loss);
+	EXPECT_TRUE(lossy.is_dead());
+}
@@ -0,0 +1,110 @@
+#include "gtest/gtest.h"
+#include "../rpc/c_lockfree_queue.hpp"
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(lockfree_queue, capacity_must_be_power_of_2) {
+	EXPECT_THROW(c_mpsc_ring<int> ring(0), std::invalid_argument);
+	EXPECT_THROW(c_mpsc_ring<int> ring(3), std::invalid_argument);
+	EXPECT_THROW(c_spsc_ring<int> ring(100), std::invalid_argument);
+	EXPECT_NO_THROW(c_mpsc_ring<int> ring(64));
+	EXPECT_NO_THROW(c_spsc_ring<int> ring(2));
+}
+
+TEST(lockfree_queue, mpsc_fifo_and_full) {
+	c_mpsc_ring<std::string> ring(4);
+	std::string out;
+	EXPECT_TRUE(ring.empty());
+	EXPECT_FALSE(ring.try_pop(out));
+	for (int i=0; i<4; ++i) EXPECT_TRUE(ring.try_push(std::to_string(i)));
+	std::string extra("extra");
+	EXPECT_FALSE(ring.try_push(extra)); // full
+	EXPECT_EQ(extra, "extra"); // not moved from on failure
+	for (int i=0; i<4; ++i) {
+		ASSERT_TRUE(ring.try_pop(out));
+		EXPECT_EQ(out, std::to_string(i));
+	}
+	EXPECT_TRUE(ring.empty());
+	EXPECT_TRUE(ring.try_push(extra)); // wrap around
+	ASSERT_TRUE(ring.try_pop(out));
+	EXPECT_EQ(out, "extra");
+}
+
+TEST(lockfree_queue, spsc_fifo_and_full) {
+	c_spsc_ring<std::string> ring(2);
+	std::string out;
+	EXPECT_FALSE(ring.try_pop(out));
+	EXPECT_TRUE(ring.try_push(std::string("a")));
+	EXPECT_TRUE(ring.try_push(std::string("b")));
+	EXPECT_FALSE(ring.try_push(std::string("c")));
+	ASSERT_TRUE(ring.try_pop(out)); EXPECT_EQ(out, "a");
+	EXPECT_TRUE(ring.try_push(std::string("c")));
+	ASSERT_TRUE(ring.try_pop(out)); EXPECT_EQ(out, "b");
+	ASSERT_TRUE(ring.try_pop(out)); EXPECT_EQ(out, "c");
+	EXPECT_TRUE(ring.empty());
+}
+
+TEST(lockfree_queue, wait_pop_timeout_and_wakeup) {
+	c_mpsc_ring<int> ring(8);
+	int out = 0;
+	EXPECT_FALSE(ring.wait_pop(out, std::chrono::milliseconds(5)));
+	std::thread producer([&ring]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		ring.try_push(42);
+	});
+	EXPECT_TRUE(ring.wait_pop(out, std::chrono::seconds(10)));
+	EXPECT_EQ(out, 42);
+	producer.join();
+}
+
+namespace {
+
+// every producer pushes values producer_id*per_producer + i, consumer checks per-producer order and that it got all
+void run_contention(size_t producers, size_t per_producer, c_mpsc_ring<size_t> & ring) {
+	std::vector<std::thread> threads;
+	for (size_t p=0; p<producers; ++p) {
+		threads.emplace_back([=, &ring]() {
+			for (size_t i=0; i<per_producer; ++i) {
+				size_t value = p * per_producer + i;
+				while (!ring.try_push(value)) std::this_thread::yield();
+			}
+		});
+	}
+	std::vector<size_t> last_seen(producers, 0);
+	std::vector<bool> seen_any(producers, false);
+	size_t total = producers * per_producer;
+	for (size_t received=0; received<total; ) {
+		size_t value;
+		if (!ring.wait_pop(value, std::chrono::milliseconds(10))) continue;
+		size_t p = value / per_producer;
+		EXPECT_TRUE(!seen_any[p] || value > last_seen[p]); // FIFO per producer
+		seen_any[p] = true;
+		last_seen[p] = value;
+		++received;
+	}
+	for (auto & thread : threads) thread.join();
+	EXPECT_TRUE(ring.empty());
+}
+
+} // namespace
+
+TEST(lockfree_queue, mpsc_contention) { // the speed of it (and of c_locked_queue) is in bench.elf
+	size_t producers = std::thread::hardware_concurrency();
+	if (producers < 2) producers = 2;
+	c_mpsc_ring<size_t> ring(64); // small, so producers often find it full
+	run_contention(producers, 20000, ring);
+}
+
+TEST(lockfree_queue, mpsc_full_hint) {
+	c_mpsc_ring<int> ring(2);
+	EXPECT_FALSE(ring.full());
+	EXPECT_TRUE(ring.try_push(1));
+	EXPECT_TRUE(ring.try_push(2));
+	EXPECT_TRUE(ring.full());
+	int out = 0;
+	EXPECT_TRUE(ring.try_pop(out));
+	EXPECT_FALSE(ring.full());
+}
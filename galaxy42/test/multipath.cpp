@@ -0,0 +1,53 @@
+#include "gtest/gtest.h"
+#include "../c_multipath.hpp"
+
+#include <map>
+#include <string>
+
+namespace {
+
+std::string make_packet(unsigned char proto, uint16_t src_port, uint16_t dst_port, char payload) {
+	std::string packet(100, payload);
+	packet[0] = 0x60;  packet[6] = static_cast<char>(proto);
+	for (int i=8; i<40; ++i) packet[i] = static_cast<char>(i);
+	packet[40] = static_cast<char>(src_port >> 8);  packet[41] = static_cast<char>(src_port & 0xFF);
+	packet[42] = static_cast<char>(dst_port >> 8);  packet[43] = static_cast<char>(dst_port & 0xFF);
+	return packet;
+}
+
+uint64_t hash_of(const std::string & packet, uint64_t seed=1) { return multipath::flow_hash(packet.data(), packet.size(), seed); }
+
+} // namespace
+
+TEST(multipath, flow_hash_uses_5_tuple) {
+	EXPECT_EQ(hash_of(make_packet(6, 1000, 80, 'a')), hash_of(make_packet(6, 1000, 80, 'b'))); // payload does not matter
+	EXPECT_NE(hash_of(make_packet(6, 1000, 80, 'a')), hash_of(make_packet(6, 1001, 80, 'a')));
+	EXPECT_NE(hash_of(make_packet(6, 1000, 80, 'a')), hash_of(make_packet(17, 1000, 80, 'a')));
+	EXPECT_NE(hash_of(make_packet(6, 1000, 80, 'a'), 1), hash_of(make_packet(6, 1000, 80, 'a'), 2));
+	EXPECT_EQ(hash_of(make_packet(58, 1, 2, 'a')), hash_of(make_packet(58, 3, 4, 'a'))); // ICMPv6: no ports
+	EXPECT_THROW(multipath::flow_hash("abc", 3, 1), std::invalid_argument);
+}
+
+TEST(multipath, flows_are_spread_by_weight_and_stick) {
+	std::vector<std::pair<std::string, double>> paths{ {"A", 1.0}, {"B", 1.0}, {"C", 2.0}, {"D", 0.0} };
+	std::map<std::string, int> count;
+	std::map<uint64_t, std::string> chosen;
+	const int flows = 20000;
+	for (int i=0; i<flows; ++i) {
+		uint64_t flow = multipath::hash_bytes(&i, sizeof(i), 42);
+		const std::string & path = multipath::pick_path(flow, paths);
+		++count[path];
+		chosen[flow] = path;
+		EXPECT_EQ(multipath::pick_path(flow, paths), path); // the same flow, the same path
+	}
+	EXPECT_EQ(count["D"], 0);
+	EXPECT_NEAR(count["A"], flows/4, flows/40);
+	EXPECT_NEAR(count["B"], flows/4, flows/40);
+	EXPECT_NEAR(count["C"], flows/2, flows/40);
+
+	paths.erase(paths.begin() + 1); // B is gone: only its flows move
+	for (const auto & c : chosen) {
+		if (c.second != "B") { EXPECT_EQ(multipath::pick_path(c.first, paths), c.second); }
+	}
+	EXPECT_THROW(multipath::pick_path(1, std::vector<std::pair<std::string, double>>{ {"D", 0.0} }), std::invalid_argument);
+}
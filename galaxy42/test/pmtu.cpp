@@ -0,0 +1,122 @@
+#include "gtest/gtest.h"
+#include "../c_pmtu.hpp"
+#include "../c_tun_offload.hpp"
+
+#include <string>
+
+namespace {
+
+/// simulated path: each probe up to path_mtu arrives and is acked, bigger ones are lost; returns the time that it took
+std::chrono::milliseconds run_search(pmtu::c_path_mtu & path, size_t path_mtu, pmtu::c_path_mtu::t_clock::time_point & now) {
+	const auto start = now;
+	for (int i=0; i<1000 && path.is_searching(); ++i) {
+		size_t probe = path.probe_to_send(now);
+		if ((probe != 0) && (probe <= path_mtu)) EXPECT_TRUE(path.probe_acked(probe, path.get_probe_nonce()));
+		now += std::chrono::milliseconds(100);
+	}
+	return std::chrono::duration_cast<std::chrono::milliseconds>(now - start);
+}
+
+} // namespace
+
+TEST(pmtu, search_finds_path_mtu) {
+	for (size_t path_mtu : { 1200u, 1280u, 1400u, 1420u, 1452u }) {
+		pmtu::c_path_mtu path(1200, 1452);
+		auto now = pmtu::c_path_mtu::t_clock::now();
+		EXPECT_EQ(path.get_mtu(), 1200u);
+		run_search(path, path_mtu, now);
+		EXPECT_FALSE(path.is_searching());
+		EXPECT_LE(path.get_mtu(), path_mtu);
+		EXPECT_GT(path.get_mtu() + pmtu::c_path_mtu::search_granularity, path_mtu);
+		EXPECT_EQ(path.probe_to_send(now), 0u); // done, until the raise timer
+	}
+}
+
+TEST(pmtu, lost_probe_is_retried_then_raised_later) {
+	pmtu::c_path_mtu path(1200, 1452);
+	auto now = pmtu::c_path_mtu::t_clock::now();
+	size_t probe = path.probe_to_send(now);
+	ASSERT_GT(probe, 1200u);
+	EXPECT_EQ(path.probe_to_send(now + std::chrono::milliseconds(10)), 0u); // still waiting for ack
+	EXPECT_EQ(path.probe_to_send(now + std::chrono::seconds(2)), probe); // lost once, the same size again
+	path.probe_acked(probe, path.get_probe_nonce());
+	EXPECT_EQ(path.get_mtu(), probe);
+
+	run_search(path, 1300, now); // path got smaller: confirmed size stays, but is never increased above path
+	run_search(path, 1452, now);
+	EXPECT_EQ(path.get_mtu(), probe);
+	now += pmtu::c_path_mtu::raise_interval;
+	EXPECT_GT(path.probe_to_send(now), probe); // search for bigger again
+
+	path.packet_too_big(1000); // never below the base
+	EXPECT_EQ(path.get_mtu(), 1200u);
+	EXPECT_EQ(pmtu::tun_mtu_for_payload(1452, 90), 1362u);
+	EXPECT_EQ(pmtu::tun_mtu_for_payload(1200, 90), pmtu::ipv6_min_mtu);
+}
+
+TEST(pmtu, only_ack_of_our_probe) {
+	pmtu::c_path_mtu path(1200, 1452);
+	auto now = pmtu::c_path_mtu::t_clock::now();
+	EXPECT_FALSE(path.probe_acked(1300, path.get_probe_nonce())); // no probe sent yet
+	const size_t probe = path.probe_to_send(now);
+	const uint32_t nonce = path.get_probe_nonce();
+	EXPECT_FALSE(path.probe_acked(1452, nonce)); // size that we did not probe
+	EXPECT_FALSE(path.probe_acked(probe - 1, nonce));
+	EXPECT_FALSE(path.probe_acked(probe, nonce + 1)); // forged (or of an older probe)
+	EXPECT_EQ(path.get_mtu(), 1200u);
+	EXPECT_TRUE(path.probe_acked(probe, nonce));
+	EXPECT_EQ(path.get_mtu(), probe);
+	EXPECT_FALSE(path.probe_acked(probe, nonce)); // the same ack again
+
+	const size_t probe2 = path.probe_to_send(now);
+	EXPECT_NE(path.get_probe_nonce(), nonce);
+	EXPECT_FALSE(path.probe_acked(probe2, nonce)); // replayed nonce of the previous probe
+}
+
+TEST(pmtu, next_probe_time) {
+	pmtu::c_path_mtu path(1200, 1452);
+	const auto start = pmtu::c_path_mtu::t_clock::now();
+	auto now = start;
+	EXPECT_EQ(path.next_probe_time(now), now); // search at once
+	size_t probes = 0;
+	while (path.is_searching()) { // called only when it is due, and then each call has a probe
+		ASSERT_LT(probes, 100u);
+		now = std::max( now , path.next_probe_time(now) );
+		const size_t probe = path.probe_to_send(now);
+		ASSERT_NE(probe, 0u);
+		++probes;
+		EXPECT_EQ(path.next_probe_time(now), now + pmtu::c_path_mtu::probe_timeout); // wait for ack
+		if (probe <= 1400) EXPECT_TRUE(path.probe_acked(probe, path.get_probe_nonce())); // bigger are lost
+	}
+	EXPECT_GT(path.get_mtu() + pmtu::c_path_mtu::search_granularity, 1400u);
+
+	EXPECT_EQ(path.next_probe_time(now), now); // search ended: probe_to_send notes it
+	EXPECT_EQ(path.probe_to_send(now), 0u);
+	EXPECT_EQ(path.next_probe_time(now), now + pmtu::c_path_mtu::raise_interval);
+	now += pmtu::c_path_mtu::raise_interval;
+	EXPECT_GT(path.probe_to_send(now), path.get_mtu()); // search for bigger again
+}
+
+TEST(pmtu, packet_too_big) {
+	std::string packet(1500, 'x');
+	packet[0] = 0x60;  packet[6] = 17; // UDP
+	for (int i=0; i<16; ++i) { packet[8+i] = static_cast<char>(0xfd);  packet[24+i] = 0x42; }
+	std::string ptb = pmtu::make_packet_too_big(packet.data(), packet.size(), 1362);
+	ASSERT_EQ(ptb.size(), pmtu::ipv6_min_mtu);
+	const unsigned char * ip = reinterpret_cast<const unsigned char*>(ptb.data());
+	EXPECT_EQ(ip[6], 58);
+	EXPECT_EQ(ptb.substr(8, 16), packet.substr(24, 16)); // from its destination
+	EXPECT_EQ(ptb.substr(24, 16), packet.substr(8, 16)); // to its source
+	EXPECT_EQ(ip[40], pmtu::icmpv6_type_packet_too_big);
+	EXPECT_EQ((uint32_t(ip[44])<<24) | (uint32_t(ip[45])<<16) | (uint32_t(ip[46])<<8) | ip[47], 1362u);
+	EXPECT_EQ(ptb.substr(48), packet.substr(0, ptb.size() - 48));
+	std::string check(ptb);
+	check[42] = 0;  check[43] = 0;
+	uint16_t checksum = tun_offload::l4_checksum_ipv6(reinterpret_cast<const unsigned char*>(check.data()), ptb.size() - 40, 58);
+	EXPECT_EQ(checksum, (uint16_t(ip[42]) << 8) | ip[43]);
+
+	EXPECT_EQ(pmtu::make_packet_too_big(ptb.data(), ptb.size(), 1280), ""); // no error about an error
+	packet[24] = static_cast<char>(0xff);
+	EXPECT_EQ(pmtu::make_packet_too_big(packet.data(), packet.size(), 1280), ""); // multicast
+	EXPECT_THROW(pmtu::make_packet_too_big("abc", 3, 1280), std::invalid_argument);
+}
@@ -0,0 +1,58 @@
+#include "gtest/gtest.h"
+#include "../crypto/replay_window.hpp"
+
+using antinet_crypto::c_replay_window;
+
+TEST(replay_window, in_order_and_duplicates) {
+	c_replay_window window;
+	for (uint64_t seq=1; seq<10000; seq+=2) { // nonces of one side step by 2
+		ASSERT_TRUE(window.check(seq));
+		window.mark(seq);
+	}
+	EXPECT_FALSE(window.check(9999));
+	EXPECT_FALSE(window.check(9001));
+	EXPECT_EQ(window.get_count_replay(), 2u);
+	EXPECT_EQ(window.get_count_stale(), 0u);
+	EXPECT_TRUE(window.check(10001));
+}
+
+TEST(replay_window, out_of_order_and_stale) {
+	c_replay_window window;
+	window.mark(5000);
+	EXPECT_TRUE(window.check(4000)); // reordered, inside window
+	window.mark(4000);
+	EXPECT_FALSE(window.check(4000));
+	EXPECT_TRUE(window.check(5000 - c_replay_window::window_size + 1)); // oldest that still fits
+	EXPECT_FALSE(window.check(5000 - c_replay_window::window_size));
+	EXPECT_EQ(window.get_count_stale(), 1u);
+
+	window.mark(5100); // small move forward keeps the old bits
+	EXPECT_FALSE(window.check(4000));
+	EXPECT_FALSE(window.check(5000));
+	EXPECT_TRUE(window.check(5050));
+
+	window.mark(1000000); // big jump clears everything
+	EXPECT_FALSE(window.check(5100)); // now it is stale
+	EXPECT_TRUE(window.check(1000000 - 1));
+	EXPECT_FALSE(window.check(1000000));
+}
+
+TEST(replay_window, not_marked_is_not_remembered) {
+	c_replay_window window;
+	EXPECT_TRUE(window.check(42)); // e.g. authentication failed, so mark() was not called
+	EXPECT_TRUE(window.check(42));
+	window.mark(42);
+	EXPECT_FALSE(window.check(42));
+}
+
+TEST(replay_window, reset) {
+	c_replay_window window;
+	for (uint64_t seq=1; seq<100; seq+=2) window.mark(seq);
+	EXPECT_FALSE(window.check(51));
+	window.reset(); // e.g. sender restarted, his nonces start again
+	EXPECT_TRUE(window.check(1));
+	EXPECT_TRUE(window.check(51));
+	window.mark(1);
+	EXPECT_FALSE(window.check(1));
+	EXPECT_EQ(window.get_count_replay(), 2u); // counters are kept
+}
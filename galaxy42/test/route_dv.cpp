@@ -0,0 +1,142 @@
+#include "gtest/gtest.h"
+#include "../c_route_dv.hpp"
+
+#include <string>
+
+namespace {
+
+typedef route_dv::c_dv_table<std::string> t_table;
+
+/// a few nodes, links given as "AB" with cost; adverts are exchanged in rounds
+struct c_small_net {
+	std::map<std::string, t_table> m_tables;
+	std::map<std::pair<std::string, std::string>, int> m_links; ///< both directions
+	t_table::t_clock::time_point m_now = t_table::t_clock::now();
+
+	void add_link(const std::string & a, const std::string & b, int cost) {
+		for (const auto & n : { a, b }) m_tables.emplace(n, t_table(n));
+		m_links[{a, b}] = cost;  m_links[{b, a}] = cost;
+		m_tables.at(a).set_link(b, cost, m_now);  m_tables.at(b).set_link(a, cost, m_now);
+	}
+
+	void fail_link(const std::string & a, const std::string & b) {
+		m_links.erase({a, b});  m_links.erase({b, a});
+		m_tables.at(a).link_down(b, m_now);  m_tables.at(b).link_down(a, m_now);
+	}
+
+	void run(int rounds) {
+		for (int round = 0; round < rounds; ++round) {
+			m_now += t_table::triggered_update_interval;
+			std::vector<std::tuple<std::string, std::string, route_dv::t_adv<std::string>>> sent;
+			for (auto & node : m_tables) {
+				const auto kind = node.second.start_update(m_now);
+				if (kind == t_table::e_update::none) continue;
+				for (const auto & link : m_links) {
+					if (link.first.first != node.first) continue;
+					for (const auto & adv : node.second.make_adv(link.first.second, kind == t_table::e_update::changed)) {
+						sent.emplace_back(node.first, link.first.second, adv);
+					}
+				}
+				node.second.update_sent();
+			}
+			for (const auto & s : sent) m_tables.at(std::get<1>(s)).got_adv(std::get<0>(s), std::get<2>(s), m_now);
+		}
+	}
+
+	int cost(const std::string & src, const std::string & dst) const { return m_tables.at(src).get_route(dst).m_cost; }
+	std::string path(std::string src, const std::string & dst) const {
+		std::string ret = src;
+		while ((src != dst) && (ret.size() <= m_tables.size())) { src = m_tables.at(src).get_nexthop(dst);  ret += src; }
+		return ret;
+	}
+};
+
+} // namespace
+
+TEST(route_dv, converges_to_cheapest_paths) {
+	c_small_net net; //  A-B-C-D is cheap, A-D is expensive, E hangs on C
+	net.add_link("A", "B", 10);  net.add_link("B", "C", 10);  net.add_link("C", "D", 10);
+	net.add_link("A", "D", 50);  net.add_link("C", "E", 20);
+	net.run(10);
+	EXPECT_EQ(net.path("A", "D"), "ABCD");
+	EXPECT_EQ(net.cost("A", "D"), 30);
+	EXPECT_EQ(net.path("D", "A"), "DCBA");
+	EXPECT_EQ(net.path("E", "A"), "ECBA");
+	EXPECT_EQ(net.cost("E", "A"), 40);
+	EXPECT_THROW(net.m_tables.at("A").get_nexthop("X"), expected_not_found);
+
+	// split horizon: B does not tell C about routes that go via C
+	for (const auto & adv : net.m_tables.at("B").make_adv("C", false)) {
+		EXPECT_NE(adv.m_dst, "C");  EXPECT_NE(adv.m_dst, "D");  EXPECT_NE(adv.m_dst, "E");
+	}
+}
+
+TEST(route_dv, link_failure_and_timeout) {
+	c_small_net net;
+	net.add_link("A", "B", 10);  net.add_link("B", "C", 10);  net.add_link("C", "D", 10);  net.add_link("A", "D", 50);
+	net.run(10);
+	ASSERT_EQ(net.path("A", "C"), "ABC");
+
+	net.fail_link("B", "C");
+	EXPECT_THROW(net.m_tables.at("B").get_nexthop("C"), expected_not_found); // at once, not after a timeout
+	EXPECT_EQ(net.m_tables.at("B").get_route("C").m_seqno % 2, 1u); // broken on the way
+	net.run(static_cast<int>(t_table::full_update_interval / t_table::triggered_update_interval) + 5);
+	EXPECT_EQ(net.path("A", "C"), "ADC"); // after C gave a newer seqno
+	EXPECT_EQ(net.path("B", "C"), "BADC");
+	EXPECT_EQ(net.cost("B", "C"), 70);
+
+	// old advert (older seqno, as from a loop) does not bring the broken route back
+	const auto & route = net.m_tables.at("B").get_route("C");
+	EXPECT_FALSE( net.m_tables.at("B").got_adv("A", route_dv::t_adv<std::string>{ "C", 0, route.m_seqno - 2 }, net.m_now) );
+	EXPECT_EQ(net.cost("B", "C"), 70);
+
+	// C is gone (no adverts from it at all): routes to it time out
+	net.fail_link("C", "D");
+	net.m_links.clear(); // nobody talks
+	net.m_now += t_table::route_timeout + std::chrono::seconds(1);
+	net.m_tables.at("A").start_update(net.m_now);
+	EXPECT_THROW(net.m_tables.at("A").get_nexthop("C"), expected_not_found);
+	net.m_now += t_table::gc_timeout + std::chrono::seconds(1);
+	net.m_tables.at("A").start_update(net.m_now);
+	EXPECT_THROW(net.m_tables.at("A").get_route("C"), expected_not_found); // forgotten
+}
+
+TEST(route_dv, next_update_time) {
+	const auto start = t_table::t_clock::now();
+	t_table table("A");
+	EXPECT_LE(table.next_update_time(), start); // the first full update is due at once
+	ASSERT_EQ(table.start_update(start), t_table::e_update::full);
+	table.update_sent();
+	EXPECT_EQ(table.next_update_time(), start + t_table::full_update_interval);
+
+	table.set_link("B", 10, start);
+	const auto got = start + std::chrono::seconds(3);
+	EXPECT_TRUE(table.got_adv("B", route_dv::t_adv<std::string>{ "C", 10, 2 }, got)); // changed: triggered update soon
+	EXPECT_EQ(table.next_update_time(), start + t_table::triggered_update_interval);
+	EXPECT_EQ(table.start_update(got), t_table::e_update::changed);
+	table.update_sent();
+	EXPECT_EQ(table.next_update_time(), start + t_table::full_update_interval);
+
+	// B is silent: only full updates, till C (not refreshed) times out
+	for (auto now = table.next_update_time(); now < got + t_table::route_timeout; now = table.next_update_time()) {
+		EXPECT_EQ(table.start_update(now), t_table::e_update::full);
+		table.update_sent();
+	}
+	EXPECT_EQ(table.next_update_time(), got + t_table::route_timeout);
+	const auto now = table.next_update_time() + std::chrono::milliseconds(1);
+	EXPECT_EQ(table.start_update(now), t_table::e_update::changed); // retracted at once
+	EXPECT_THROW(table.get_nexthop("C"), expected_not_found);
+}
+
+TEST(route_dv, seqno_from_wall_clock) {
+	const auto seconds = [] { return std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch() ).count(); };
+	const auto start = seconds();
+	t_table table("A");
+	table.start_update( t_table::t_clock::now() );
+	const uint32_t seqno = table.make_adv("B", false).at(0).m_seqno;
+	EXPECT_EQ(seqno % 2, 0u);
+	// restarted node starts with 2 per second since its last start, and it advertised only 2 per full_update_interval
+	EXPECT_GE(seqno, static_cast<uint32_t>(start) * 2);
+	EXPECT_LE(seqno, static_cast<uint32_t>(seconds()) * 2 + 2);
+}
@@ -0,0 +1,89 @@
+#include "gtest/gtest.h"
+#include "../c_state_snapshot.hpp"
+#include "../trivialserialize.hpp"
+
+namespace {
+
+state_snapshot::t_hip make_hip(int nr) {
+	state_snapshot::t_hip hip;
+	hip.fill(0);
+	hip.at(0) = 0xFD;  hip.at(1) = 0x42;
+	hip.at(15) = static_cast<unsigned char>(nr);
+	return hip;
+}
+
+state_snapshot::c_snapshot make_snapshot() {
+	state_snapshot::c_snapshot snapshot;
+	snapshot.m_pubkeys[ make_hip(1) ] = "pubkey-1";
+	snapshot.m_pubkeys[ make_hip(2) ] = std::string(1000, 'k');
+	snapshot.m_peers.push_back( state_snapshot::t_peer{ make_hip(1) , c_ip46_addr::create_ipv4("192.168.1.1", 9042) , std::chrono::seconds(0) } );
+	snapshot.m_peers.push_back( state_snapshot::t_peer{ make_hip(3) , c_ip46_addr::create_ipv6("fd00::3", 65535) , std::chrono::hours(23) } );
+	snapshot.m_routes.push_back( state_snapshot::t_route{ make_hip(2) , make_hip(1) , 20 , std::chrono::seconds(10) } );
+	snapshot.m_routes.push_back( state_snapshot::t_route{ make_hip(2) , make_hip(3) , 35 , std::chrono::minutes(25) } );
+	snapshot.m_tunnels.push_back( make_hip(2) );
+	return snapshot;
+}
+
+} // namespace
+
+TEST(state_snapshot, serialize_with_age) {
+	const auto written = std::chrono::system_clock::now();
+	const std::string data = make_snapshot().serialize(written);
+
+	const auto loaded = state_snapshot::c_snapshot::deserialize(data, written + std::chrono::seconds(5));
+	EXPECT_EQ(loaded.m_pubkeys, make_snapshot().m_pubkeys);
+	ASSERT_EQ(loaded.m_peers.size(), 2u);
+	EXPECT_EQ(loaded.m_peers.at(0).m_hip, make_hip(1));
+	EXPECT_EQ(loaded.m_peers.at(0).m_pip, c_ip46_addr::create_ipv4("192.168.1.1", 9042));
+	EXPECT_EQ(loaded.m_peers.at(0).m_age, std::chrono::seconds(5)); // older by the time since it was written
+	EXPECT_EQ(loaded.m_peers.at(1).m_pip, c_ip46_addr::create_ipv6("fd00::3", 65535));
+	ASSERT_EQ(loaded.m_routes.size(), 2u);
+	EXPECT_EQ(loaded.m_routes.at(0).m_dst, make_hip(2));
+	EXPECT_EQ(loaded.m_routes.at(0).m_nexthop, make_hip(1));
+	EXPECT_EQ(loaded.m_routes.at(0).m_cost, 20);
+	EXPECT_EQ(loaded.m_routes.at(0).m_age, std::chrono::seconds(15));
+	ASSERT_EQ(loaded.m_tunnels.size(), 1u);
+	EXPECT_EQ(loaded.m_tunnels.at(0), make_hip(2));
+
+	const auto later = state_snapshot::c_snapshot::deserialize(data, written + std::chrono::minutes(90));
+	EXPECT_EQ(later.m_routes.size(), 0u); // too old
+	EXPECT_EQ(later.m_peers.size(), 1u); // the one seen 23 hours ago is forgotten
+	EXPECT_EQ(later.m_pubkeys.size(), 2u);
+
+	const auto clock_back = state_snapshot::c_snapshot::deserialize(data, written - std::chrono::hours(1));
+	EXPECT_EQ(clock_back.m_routes.at(0).m_age, std::chrono::seconds(10));
+}
+
+TEST(state_snapshot, format_errors) {
+	const auto now = std::chrono::system_clock::now();
+	std::string data = make_snapshot().serialize(now);
+	std::string other_version = data;
+	other_version.at(8) = static_cast<char>( state_snapshot::c_snapshot::version + 1 );
+	EXPECT_THROW(state_snapshot::c_snapshot::deserialize(other_version, now), trivialserialize::format_error_read_invalid_version);
+	EXPECT_THROW(state_snapshot::c_snapshot::deserialize("G42OTHER", now), trivialserialize::format_error);
+	EXPECT_THROW(state_snapshot::c_snapshot::deserialize(data.substr(0, data.size() - 3), now), trivialserialize::format_error);
+
+	trivialserialize::generator gen(100); // a section from newer program is skipped
+	gen.push_bytes_n(17, data.substr(0, 17)); // magic, version, time
+	gen.push_integer_uvarint(2);
+	gen.push_byte_u(200);  gen.push_varstring("unknown");
+	gen.push_byte_u(4);  gen.push_varstring( std::string(1, 1) + std::string(16, 'h') ); // tunnels
+	const auto loaded = state_snapshot::c_snapshot::deserialize(gen.get_buffer(), now);
+	ASSERT_EQ(loaded.m_tunnels.size(), 1u);
+	EXPECT_EQ(loaded.m_tunnels.at(0).at(0), 'h');
+}
+
+TEST(state_snapshot, save_load) {
+	const fs::path dir = fs::temp_directory_path() / fs::unique_path("snapshot-test-%%%%-%%%%");
+	const fs::path path = dir / "state";
+	EXPECT_THROW(state_snapshot::c_snapshot::load(path), expected_not_found);
+	make_snapshot().save(path);
+	state_snapshot::c_snapshot changed = make_snapshot();
+	changed.m_tunnels.push_back( make_hip(3) );
+	changed.save(path); // replaces it
+	EXPECT_FALSE(fs::exists( path.native() + ".tmp" ));
+	const auto loaded = state_snapshot::c_snapshot::load(path);
+	EXPECT_EQ(loaded.m_tunnels.size(), 2u);
+	EXPECT_EQ(loaded.m_routes.size(), 2u);
+	fs::remove_all(dir);
+}
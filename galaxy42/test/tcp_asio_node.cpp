@@ -0,0 +1,77 @@
+#include "gtest/gtest.h"
+#include "../rpc/c_tcp_asio_node.hpp"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+TEST(tcp_asio_node, many_small_messages_in_order) {
+	using namespace asio_node;
+	c_tcp_asio_node receiver(0); // any free ports
+	c_tcp_asio_node sender(0);
+
+	const size_t count = 20000; // more then the receive queue, so reading is paused and resumed
+	for (size_t i=0; i<count; ++i) {
+		c_network_message message;
+		message.address_ip = "127.0.0.1";
+		message.port = receiver.get_port();
+		message.data = std::to_string(i);
+		sender.send(std::move(message)); // queued and coalesced into gather-writes
+	}
+
+	size_t received = 0;
+	while (received < count) {
+		auto message = receiver.receive_wait(std::chrono::seconds(5));
+		ASSERT_FALSE(message.data.empty()) << "timeout after " << received << " messages";
+		EXPECT_EQ(message.data, std::to_string(received)); // one connection keeps the order
+		++received;
+	}
+}
+
+TEST(tcp_asio_node, senders_race_to_connect) {
+	using namespace asio_node;
+	c_tcp_asio_node receiver(0);
+	const size_t threads_count = 8, count = 100;
+	for (int round=0; round<5; ++round) { // new sender each round: all threads connect at once, only one connection is kept
+		c_tcp_asio_node sender(0);
+		std::vector<std::thread> threads;
+		for (size_t t=0; t<threads_count; ++t) {
+			threads.emplace_back([&sender, &receiver]() {
+				for (size_t i=0; i<count; ++i) {
+					c_network_message message;
+					message.address_ip = "127.0.0.1";
+					message.port = receiver.get_port();
+					message.data = "x";
+					sender.send(std::move(message));
+				}
+			});
+		}
+		for (auto & thread : threads) thread.join();
+		for (size_t received=0; received < threads_count * count; ++received) {
+			ASSERT_FALSE(receiver.receive_wait(std::chrono::seconds(5)).data.empty()) << "timeout after " << received << " messages";
+		}
+	}
+}
+
+TEST(tcp_asio_node, peer_gone) {
+	using namespace asio_node;
+	c_tcp_asio_node sender(0);
+	unsigned short port = 0;
+	auto make_message = [&port]() {
+		c_network_message message;
+		message.address_ip = "127.0.0.1";
+		message.port = port;
+		message.data = std::string(1000, 'x');
+		return message;
+	};
+	{
+		c_tcp_asio_node receiver(0);
+		port = receiver.get_port();
+		sender.send(make_message());
+		ASSERT_FALSE(receiver.receive_wait(std::chrono::seconds(5)).data.empty());
+	} // receiver is gone, the connection to him is still in sender
+	for (int i=0; i<100; ++i) { // writes fail, the connection is removed (no exception in asio threads), then connect fails
+		try { sender.send(make_message()); } catch (const std::exception &) { }
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+}
@@ -0,0 +1,94 @@
+#include "gtest/gtest.h"
+#include "../c_timer_wheel.hpp"
+
+#include <random>
+
+namespace {
+
+typedef timer_wheel::c_timer_wheel<int> t_wheel;
+typedef t_wheel::t_clock t_clock;
+
+} // namespace
+
+TEST(timer_wheel, fire_once_not_early) {
+	const auto start = t_clock::now();
+	t_wheel wheel(start);
+	wheel.schedule(1, start + std::chrono::milliseconds(50));
+	wheel.schedule(2, start + std::chrono::seconds(1));
+	wheel.schedule(3, start + std::chrono::seconds(100)); // in higher level, cascaded down
+	EXPECT_EQ(wheel.size(), 3u);
+
+	EXPECT_TRUE(wheel.expire(start + std::chrono::milliseconds(49)).empty());
+	EXPECT_EQ(wheel.expire(start + std::chrono::milliseconds(50)), std::vector<int>{ 1 });
+	EXPECT_TRUE(wheel.expire(start + std::chrono::milliseconds(60)).empty()); // only once
+	EXPECT_FALSE(wheel.is_scheduled(1));
+
+	EXPECT_TRUE(wheel.expire(start + std::chrono::milliseconds(999)).empty());
+	EXPECT_EQ(wheel.expire(start + std::chrono::seconds(1)), std::vector<int>{ 2 });
+	EXPECT_TRUE(wheel.expire(start + std::chrono::milliseconds(99999)).empty());
+	EXPECT_EQ(wheel.expire(start + std::chrono::seconds(100)), std::vector<int>{ 3 });
+	EXPECT_EQ(wheel.size(), 0u);
+}
+
+TEST(timer_wheel, move_and_cancel) {
+	const auto start = t_clock::now();
+	t_wheel wheel(start);
+	wheel.schedule(1, start + std::chrono::seconds(1));
+	wheel.schedule(1, start + std::chrono::seconds(2)); // moved, the old one does not fire
+	wheel.schedule(2, start + std::chrono::seconds(1));
+	EXPECT_TRUE(wheel.cancel(2));
+	EXPECT_FALSE(wheel.cancel(2));
+	EXPECT_TRUE(wheel.expire(start + std::chrono::milliseconds(1500)).empty());
+	EXPECT_EQ(wheel.expire(start + std::chrono::seconds(2)), std::vector<int>{ 1 });
+
+	wheel.schedule(3, start + std::chrono::seconds(1)); // already in the past: fires at once
+	EXPECT_EQ(wheel.expire(start + std::chrono::milliseconds(2010)), std::vector<int>{ 3 });
+}
+
+TEST(timer_wheel, many_random) {
+	const auto start = t_clock::now();
+	t_wheel wheel(start);
+	std::minstd_rand random(42);
+	std::uniform_int_distribution<int> deadline_ms(0, 3*24*3600*1000); // also after the range of the last level
+	std::map<int, t_clock::time_point> deadlines;
+	for (int key=0; key<10000; ++key) {
+		deadlines[key] = start + std::chrono::milliseconds( deadline_ms(random) );
+		wheel.schedule(key, deadlines[key]);
+	}
+	for (int key=0; key<10000; key+=2) { // move half of them, with jitter
+		deadlines[key] = start + std::chrono::milliseconds( deadline_ms(random) );
+		wheel.schedule(key, deadlines[key], std::chrono::milliseconds(0));
+	}
+
+	std::uniform_int_distribution<int> step_ms(1, 60*1000);
+	auto now = start;
+	size_t fired = 0;
+	while (wheel.size() > 0) {
+		const auto wait = wheel.time_to_next(now, std::chrono::minutes(1));
+		EXPECT_GE(wait, t_clock::duration::zero());
+		const auto next = now + std::chrono::milliseconds( step_ms(random) );
+		const auto expired = wheel.expire(next);
+		if (next < now + wait) { EXPECT_TRUE(expired.empty()); } // time_to_next is never too long
+		for (int key : expired) {
+			ASSERT_TRUE(deadlines.count(key));
+			EXPECT_LE(deadlines.at(key), next); // not early
+			EXPECT_GT(deadlines.at(key) + t_wheel::tick, now); // and not late (it would have fired in the previous expire)
+			deadlines.erase(key);
+			++fired;
+		}
+		now = next;
+	}
+	EXPECT_EQ(fired, 10000u);
+	EXPECT_TRUE(deadlines.empty());
+}
+
+TEST(timer_wheel, jitter) {
+	const auto start = t_clock::now();
+	t_wheel wheel(start);
+	for (int key=0; key<100; ++key) wheel.schedule(key, start + std::chrono::seconds(1), std::chrono::seconds(1));
+	const size_t first_half = wheel.expire(start + std::chrono::milliseconds(1500)).size();
+	EXPECT_GT(first_half, 10u); // spread, not all at once
+	EXPECT_LT(first_half, 90u);
+	EXPECT_EQ(wheel.expire(start + std::chrono::seconds(2)).size() + first_half, 100u);
+}
+
@@ -0,0 +1,85 @@
+#include "gtest/gtest.h"
+#include "../c_traffic_shaper.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+TEST(traffic_shaper, token_bucket_rate_and_burst) {
+	auto now = c_token_bucket::t_clock::now();
+	c_token_bucket bucket(1000, 1500); // 1000 B/s, burst 1500 B
+	EXPECT_TRUE(bucket.try_consume(1000, now));
+	EXPECT_TRUE(bucket.try_consume(500, now));
+	EXPECT_FALSE(bucket.try_consume(100, now)); // burst used
+	EXPECT_GT(bucket.time_until(100, now), std::chrono::milliseconds(99));
+	now += std::chrono::milliseconds(100); // +100 B
+	EXPECT_TRUE(bucket.try_consume(100, now));
+	EXPECT_FALSE(bucket.try_consume(100, now));
+	now += std::chrono::seconds(10); // refill is capped at burst
+	EXPECT_TRUE(bucket.try_consume(1500, now));
+	EXPECT_FALSE(bucket.try_consume(1, now));
+
+	c_token_bucket unlimited;
+	EXPECT_TRUE(unlimited.is_unlimited());
+	EXPECT_TRUE(unlimited.try_consume(1000000, now));
+
+	c_token_bucket small(100, 100);
+	EXPECT_TRUE(small.try_consume(1400, now)); // bigger then burst is allowed when full (goes into debt)
+	EXPECT_FALSE(small.try_consume(1, now));
+}
+
+TEST(traffic_shaper, drr_fair_between_flows) {
+	typedef c_drr_scheduler<int, int> t_sched;
+	t_sched sched(1000, 1000000);
+	auto now = t_sched::t_clock::now();
+	for (int i=0; i<100; ++i) sched.enqueue(1, 1, std::string(1000,'h'), now); // heavy flow
+	for (int i=0; i<10; ++i) sched.enqueue(2, 2, std::string(1000,'l'), now); // light flow
+
+	c_token_bucket uplink(20000, 20000); // only 20 frames can go now
+	std::vector<int> order;
+	size_t sent = sched.run(now, uplink, [&order](const int & dst, const std::string &) { order.push_back(dst); });
+	EXPECT_EQ(sent, 20u);
+	EXPECT_EQ(std::count(order.begin(), order.end(), 2), 10); // light flow got its share, not starved
+	EXPECT_FALSE(sched.empty());
+	EXPECT_GT(sched.next_wakeup(now, uplink), std::chrono::milliseconds(1));
+	EXPECT_EQ(sched.get_stats(2).m_sent_frames, 10u);
+}
+
+TEST(traffic_shaper, drr_frame_bigger_then_quantum) {
+	typedef c_drr_scheduler<int, int> t_sched;
+	t_sched sched(1500, 1000000);
+	auto now = t_sched::t_clock::now();
+	sched.enqueue(1, 1, std::string(64*1024,'s'), now); // e.g. TUN super-packet
+	sched.enqueue(2, 2, std::string(1000,'l'), now);
+	c_token_bucket uplink; // unlimited
+	std::vector<int> order;
+	EXPECT_EQ(sched.run(now, uplink, [&order](const int & dst, const std::string &) { order.push_back(dst); }), 2u); // in one run
+	EXPECT_EQ(order, (std::vector<int>{ 1 , 2 }));
+	EXPECT_TRUE(sched.empty());
+}
+
+TEST(traffic_shaper, drr_per_flow_rate_and_queue_limit) {
+	typedef c_drr_scheduler<int, int> t_sched;
+	t_sched sched(1500, 3000);
+	sched.set_default_flow_limits(1000, 1000); // each flow max 1000 B/s
+	sched.set_flow_limits(0, 0, 0); // flow 0 (e.g. our own) is not limited
+	auto now = t_sched::t_clock::now();
+	EXPECT_TRUE(sched.enqueue(1, 1, std::string(1000,'a'), now));
+	EXPECT_TRUE(sched.enqueue(1, 1, std::string(1000,'a'), now));
+	EXPECT_TRUE(sched.enqueue(1, 1, std::string(1000,'a'), now));
+	EXPECT_FALSE(sched.enqueue(1, 1, std::string(1000,'a'), now)); // queue of flow 1 is full
+	EXPECT_TRUE(sched.enqueue(0, 0, std::string(1000,'o'), now));
+	EXPECT_TRUE(sched.enqueue(0, 0, std::string(1000,'o'), now));
+
+	c_token_bucket uplink; // unlimited
+	size_t sent = sched.run(now, uplink, [](const int &, const std::string &) { });
+	EXPECT_EQ(sent, 3u); // 1 frame of flow 1 (its rate), 2 of flow 0
+	EXPECT_EQ(sched.get_stats(1).m_dropped_frames, 1u);
+	EXPECT_EQ(sched.get_stats(0).m_sent_frames, 2u);
+
+	now += std::chrono::seconds(1);
+	sent = sched.run(now, uplink, [](const int &, const std::string &) { });
+	EXPECT_EQ(sent, 1u);
+	EXPECT_GE(sched.get_stats(1).m_delay_max_us, 1000000u); // waited 1 second in queue
+}
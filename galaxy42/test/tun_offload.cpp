@@ -0,0 +1,114 @@
+#include "gtest/gtest.h"
+#include "../c_tun_offload.hpp"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+uint32_t test_sum16(const unsigned char * data, size_t size, uint32_t sum) {
+	for (size_t i=0; i<size; i+=2) sum += (uint32_t(data[i]) << 8) | ((i+1<size) ? data[i+1] : 0);
+	return sum;
+}
+
+/// is the TCP/UDP checksum of this ipv6 packet (at ip) correct
+bool l4_checksum_ok(const unsigned char * ip) {
+	const size_t l4_size = (size_t(ip[4]) << 8) | ip[5];
+	uint32_t sum = test_sum16(ip+8, 32, 0) + l4_size + ip[6];
+	sum = test_sum16(ip+40, l4_size, sum);
+	while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+	return sum == 0xFFFF;
+}
+
+/// PI + vnet header + ipv6 + L4 header + payload of given size (payload bytes are 0,1,2...)
+std::string make_tun_data(unsigned char proto, size_t payload_size, uint8_t gso_type, uint16_t gso_size) {
+	const size_t l4_header = (proto == 6) ? 20 : 8;
+	std::string data(tun_offload::header_position_of_ipv6 + 40 + l4_header + payload_size, 0);
+	tun_offload::t_vnet_hdr hdr;
+	std::memset(&hdr, 0, sizeof(hdr));
+	hdr.gso_type = gso_type;  hdr.gso_size = gso_size;
+	std::memcpy(&data[tun_offload::pi_size], &hdr, sizeof(hdr));
+	unsigned char * ip = reinterpret_cast<unsigned char*>(&data[tun_offload::header_position_of_ipv6]);
+	ip[0] = 0x60;  ip[6] = proto;  ip[7] = 64;
+	ip[4] = (l4_header + payload_size) >> 8;  ip[5] = (l4_header + payload_size) & 0xFF;
+	ip[8] = 0xfd;  ip[9] = 0x42;  ip[23] = 1; // src
+	ip[24] = 0xfd;  ip[25] = 0x42;  ip[39] = 2; // dst
+	unsigned char * l4 = ip + 40;
+	if (proto == 6) {
+		l4[4] = 0x10;  l4[5] = 0x20;  l4[6] = 0x30;  l4[7] = 0x40; // seq
+		l4[12] = 5 << 4;  l4[13] = 0x80 | 0x10 | 0x08 | 0x01; // CWR ACK PSH FIN
+	}
+	for (size_t i=0; i<payload_size; ++i) l4[l4_header + i] = static_cast<unsigned char>(i);
+	return data;
+}
+
+} // namespace
+
+TEST(tun_offload, tcp_super_packet_is_segmented) {
+	const size_t mss = 1000, payload_size = 4500;
+	std::string data = make_tun_data(6, payload_size, tun_offload::vnet_gso_tcpv6, mss);
+	std::vector<std::string> packets;
+	std::string scratch;
+	auto count = tun_offload::segment(data.data(), data.size(),
+		[&](const char * p, size_t s) { packets.emplace_back(p, s); }, scratch);
+	ASSERT_EQ(count, 5u);
+	ASSERT_EQ(packets.size(), 5u);
+	size_t offset = 0;
+	for (size_t i=0; i<packets.size(); ++i) {
+		const unsigned char * ip = reinterpret_cast<const unsigned char*>(packets[i].data() + tun_offload::pi_size);
+		const size_t chunk = (i < 4) ? mss : 500;
+		EXPECT_EQ(packets[i].size(), tun_offload::pi_size + 40 + 20 + chunk);
+		EXPECT_EQ((size_t(ip[4]) << 8) | ip[5], 20 + chunk);
+		const unsigned char * tcp = ip + 40;
+		uint32_t seq = (uint32_t(tcp[4])<<24) | (uint32_t(tcp[5])<<16) | (uint32_t(tcp[6])<<8) | tcp[7];
+		EXPECT_EQ(seq, 0x10203040u + offset);
+		EXPECT_EQ(bool(tcp[13] & 0x80), i == 0); // CWR
+		EXPECT_EQ(bool(tcp[13] & 0x01), i == 4); // FIN
+		EXPECT_TRUE(tcp[13] & 0x10); // ACK in all
+		EXPECT_EQ(tcp[20], static_cast<unsigned char>(offset)); // payload continues
+		EXPECT_TRUE(l4_checksum_ok(ip));
+		offset += chunk;
+	}
+}
+
+TEST(tun_offload, udp_super_packet_and_plain_packet) {
+	std::string data = make_tun_data(17, 3000, tun_offload::vnet_gso_udp_l4, 1200);
+	std::string scratch;
+	size_t sizes = 0;
+	auto count = tun_offload::segment(data.data(), data.size(), [&](const char * p, size_t s) {
+		const unsigned char * ip = reinterpret_cast<const unsigned char*>(p + tun_offload::pi_size);
+		EXPECT_TRUE(l4_checksum_ok(ip));
+		EXPECT_EQ((size_t(ip[44]) << 8) | ip[45], s - tun_offload::pi_size - 40); // UDP length
+		sizes += s - tun_offload::pi_size - 48;
+	}, scratch);
+	EXPECT_EQ(count, 3u);
+	EXPECT_EQ(sizes, 3000u);
+
+	// normal packet, with checksum left for us: the field has sum of the pseudo-header
+	std::string plain = make_tun_data(17, 100, tun_offload::vnet_gso_none, 0);
+	tun_offload::t_vnet_hdr hdr;
+	std::memcpy(&hdr, &plain[tun_offload::pi_size], sizeof(hdr));
+	hdr.flags = tun_offload::vnet_flag_needs_csum;  hdr.csum_start = 40;  hdr.csum_offset = 6;
+	std::memcpy(&plain[tun_offload::pi_size], &hdr, sizeof(hdr));
+	unsigned char * ip = reinterpret_cast<unsigned char*>(&plain[tun_offload::header_position_of_ipv6]);
+	ip[44] = 0;  ip[45] = 108; // UDP length
+	uint32_t pseudo = test_sum16(ip+8, 32, 0) + 108 + 17;
+	while (pseudo >> 16) pseudo = (pseudo & 0xFFFF) + (pseudo >> 16);
+	ip[46] = pseudo >> 8;  ip[47] = pseudo & 0xFF;
+	count = tun_offload::segment(plain.data(), plain.size(), [&](const char * p, size_t s) {
+		EXPECT_EQ(s, plain.size() - tun_offload::vnet_hdr_size);
+		EXPECT_TRUE(l4_checksum_ok(reinterpret_cast<const unsigned char*>(p + tun_offload::pi_size)));
+	}, scratch);
+	EXPECT_EQ(count, 1u);
+}
+
+TEST(tun_offload, bad_data_throws) {
+	std::string scratch;
+	auto ignore = [](const char *, size_t) { };
+	EXPECT_THROW(tun_offload::segment("abc", 3, ignore, scratch), std::invalid_argument);
+	std::string data = make_tun_data(6, 3000, tun_offload::vnet_gso_tcpv4, 1000);
+	EXPECT_THROW(tun_offload::segment(data.data(), data.size(), ignore, scratch), std::invalid_argument);
+	data = make_tun_data(6, 3000, tun_offload::vnet_gso_tcpv6, 0);
+	EXPECT_THROW(tun_offload::segment(data.data(), data.size(), ignore, scratch), std::invalid_argument);
+}
@@ -0,0 +1,65 @@
+#include "gtest/gtest.h"
+#include "../c_udp_gso.hpp"
+
+#include <arpa/inet.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+int make_loopback_socket(sockaddr_in & addr) {
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);  addr.sin_port = 0;
+	socklen_t len = sizeof(addr);
+	bind(sock, reinterpret_cast<sockaddr*>(&addr), len);
+	getsockname(sock, reinterpret_cast<sockaddr*>(&addr), &len);
+	timeval timeout{ 1, 0 };
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	return sock;
+}
+
+/// send given datagrams (in this order) and check that all come in the same form
+void check_send_receive(bool gso, const std::vector<std::string> & datagrams) {
+	sockaddr_in addr_send, addr_recv;
+	int sock_send = make_loopback_socket(addr_send), sock_recv = make_loopback_socket(addr_recv);
+	udp_gso::c_batch_sender sender(sock_send);
+	sender.set_gso_enabled(gso);
+	udp_gso::c_gro_receiver receiver(sock_recv, gso);
+
+	for (const auto & datagram : datagrams) {
+		sender.add(reinterpret_cast<sockaddr*>(&addr_recv), sizeof(addr_recv), datagram.data(), datagram.size());
+	}
+	sender.flush();
+	EXPECT_EQ(sender.get_count_datagrams(), datagrams.size());
+	if (!gso) { EXPECT_EQ(sender.get_count_syscalls(), datagrams.size()); }
+
+	std::string buf(65535, 0);
+	for (const auto & datagram : datagrams) {
+		sockaddr_storage from;  socklen_t from_len = sizeof(from);
+		auto size = receiver.receive(&buf[0], buf.size(), reinterpret_cast<sockaddr*>(&from), &from_len);
+		ASSERT_EQ(size, static_cast<ssize_t>(datagram.size()));
+		EXPECT_EQ(buf.substr(0, size), datagram);
+		ASSERT_EQ(from_len, sizeof(sockaddr_in));
+		EXPECT_EQ(reinterpret_cast<sockaddr_in*>(&from)->sin_port, addr_send.sin_port);
+	}
+	EXPECT_FALSE(receiver.has_pending());
+	close(sock_send);  close(sock_recv);
+}
+
+} // namespace
+
+TEST(udp_gso, batches_arrive_as_separate_datagrams) {
+	std::vector<std::string> datagrams;
+	for (int i=0; i<10; ++i) datagrams.emplace_back(1000, static_cast<char>('a' + i));
+	datagrams.emplace_back(300, 'z'); // smaller one ends the batch
+	datagrams.emplace_back(1000, 'A'); // so this starts a new one
+	datagrams.emplace_back(1200, 'B'); // bigger then segment size: new batch too
+	for (int i=0; i<100; ++i) datagrams.emplace_back(500, static_cast<char>(i)); // more then max_segments
+	check_send_receive(true, datagrams);
+	check_send_receive(false, datagrams);
+}
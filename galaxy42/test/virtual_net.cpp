@@ -0,0 +1,96 @@
+#include "gtest/gtest.h"
+#include "../c_virtual_net.hpp"
+
+#include <sys/select.h>
+
+namespace {
+
+bool is_readable(int fd) {
+	fd_set fds;
+	FD_ZERO(&fds);
+	FD_SET(fd, &fds);
+	timeval timeout{ 0 , 0 };
+	return select(fd+1, &fds, nullptr, nullptr, &timeout) > 0;
+}
+
+std::string receive(virtual_net::c_udp & udp, c_ip46_addr & from) {
+	char buf[100];
+	sockaddr_storage addr;
+	socklen_t addr_len = sizeof(addr);
+	const ssize_t size = udp.receive(buf, sizeof(buf), reinterpret_cast<sockaddr*>(&addr), &addr_len);
+	if (size < 0) return "";
+	from.set_sockaddr(reinterpret_cast<sockaddr*>(&addr), addr_len);
+	return std::string(buf, size);
+}
+
+void send(virtual_net::c_udp & udp, const c_ip46_addr & to, const std::string & data) {
+	sockaddr_storage addr;
+	const socklen_t addr_len = to.get_sockaddr(addr);
+	udp.send(reinterpret_cast<sockaddr*>(&addr), addr_len, data.data(), data.size());
+}
+
+} // namespace
+
+TEST(virtual_net, udp_latency_and_loss) {
+	virtual_net::c_network network(42);
+	const auto ip_a = c_ip46_addr::create_ipv4("10.42.0.1", 9042), ip_b = c_ip46_addr::create_ipv4("10.42.0.2", 9042);
+	auto udp_a = network.bind(ip_a);
+	auto udp_b = network.bind(ip_b);
+	EXPECT_THROW(network.bind(ip_a), std::invalid_argument);
+	EXPECT_FALSE(is_readable(udp_b->get_fd()));
+
+	send(*udp_a, ip_b, "hello"); // no latency: at once
+	EXPECT_TRUE(is_readable(udp_b->get_fd()));
+	EXPECT_TRUE(udp_b->has_pending());
+	c_ip46_addr from;
+	EXPECT_EQ(receive(*udp_b, from), "hello");
+	EXPECT_EQ(from, ip_a);
+	EXPECT_FALSE(is_readable(udp_b->get_fd()));
+	EXPECT_EQ(receive(*udp_b, from), ""); // would block
+
+	network.set_link(ip_a, ip_b, virtual_net::t_link_params{ std::chrono::milliseconds(50) , 0 });
+	const auto start = std::chrono::steady_clock::now();
+	send(*udp_b, ip_a, "first");  send(*udp_b, ip_a, "second");
+	EXPECT_FALSE(udp_a->has_pending());
+	fd_set fds;
+	FD_ZERO(&fds);
+	FD_SET(udp_a->get_fd(), &fds);
+	timeval timeout{ 1 , 0 };
+	ASSERT_EQ(select(udp_a->get_fd()+1, &fds, nullptr, nullptr, &timeout), 1);
+	EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(50));
+	EXPECT_EQ(receive(*udp_a, from), "first");
+	while (! udp_a->has_pending()) std::this_thread::yield();
+	EXPECT_EQ(receive(*udp_a, from), "second");
+
+	network.set_link(ip_a, ip_b, virtual_net::t_link_params{ std::chrono::microseconds(0) , 0.3 });
+	int received = 0;
+	for (int i=0; i<1000; ++i) { send(*udp_a, ip_b, "x");  if (receive(*udp_b, from) == "x") ++received; }
+	EXPECT_NEAR(received, 700, 60);
+	EXPECT_EQ(network.get_count_lost(), 1000u - received);
+	send(*udp_a, c_ip46_addr::create_ipv4("10.42.0.3", 9042), "nobody");
+	EXPECT_EQ(network.get_count_lost(), 1001u - received);
+}
+
+TEST(virtual_net, tun) {
+	std::vector<std::string> output;
+	virtual_net::c_tun tun( [&output](const char * packet, size_t size) { output.emplace_back(packet, size); } );
+	EXPECT_FALSE(is_readable(tun.get_fd()));
+	EXPECT_TRUE(tun.inject("packet"));
+	EXPECT_TRUE(is_readable(tun.get_fd()));
+	char buf[10];
+	EXPECT_EQ(tun.read(buf, sizeof(buf)), 6);
+	EXPECT_EQ(std::string(buf, 6), "packet");
+	EXPECT_FALSE(is_readable(tun.get_fd()));
+	EXPECT_EQ(tun.read(buf, sizeof(buf)), -1);
+
+	char part1[] = "ab", part2[] = "cd";
+	iovec iov[2] = { { part1 , 2 } , { part2 , 2 } };
+	EXPECT_EQ(tun.writev(iov, 2), 4);
+	ASSERT_EQ(output.size(), 1u);
+	EXPECT_EQ(output.at(0), "abcd");
+
+	for (size_t i=0; i<virtual_net::c_tun::max_queue; ++i) EXPECT_TRUE(tun.inject("p"));
+	EXPECT_FALSE(tun.inject("p")); // full
+	tun.set_mtu(1280);
+	EXPECT_EQ(tun.get_mtu(), 1280u);
+}